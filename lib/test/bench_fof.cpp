@@ -0,0 +1,75 @@
+//
+// Thread scaling of the kdtree construction and the FoF halo finder on a
+// 2LPT snapshot at a=1 (use nc=512 for a 512^3 particle benchmark)
+//
+// Usage: OMP_NUM_THREADS=n bench_fof [nc] [boxsize]
+//   FoF is run with 1, 2, 4, ... up to n threads on the prebuilt tree
+//   (update_tree), which is refitted but not rebuilt; the FoF time
+//   includes the refit, which is also timed alone
+//
+#include <cstdlib>
+#include <mpi.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "fs.h"
+#include "bench_util.h"
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+  comm_mpi_init(&argc, &argv);
+
+  const int nc= argc > 1 ? atoi(argv[1]) : 128;
+  const Float boxsize= argc > 2 ? atof(argv[2]) : 2.0*nc;
+  const double omega_m= 0.308;
+  const double a= 1.0;
+  const Float ll= 0.2*boxsize/nc;
+
+  PowerSpectrum* ps= bench_init(omega_m);
+  Particles* particles= new Particles(bench_np_alloc(nc), boxsize);
+
+  lpt_init(nc, boxsize, 0);
+  bench_set_particles(particles, ps, a, "2lpt");
+
+#ifdef _OPENMP
+  const int nthread_max= omp_get_max_threads();
+#else
+  const int nthread_max= 1;
+#endif
+
+  msg_set_loglevel(msg_info);
+  msg_printf(msg_info, "nc= %d, boxsize= %.1f, ll= %.3f\n", nc, boxsize, ll);
+
+  double time1= 0.0;
+  for(int nthread=1; nthread<=nthread_max; nthread*=2) {
+#ifdef _OPENMP
+    omp_set_num_threads(nthread);
+#endif
+    msg_set_loglevel(msg_warn);
+    const double t0= MPI_Wtime();
+    kdtree_init(particles, 0, 32, false);
+    const double t1= MPI_Wtime();
+    kdtree_update(particles);
+    const double t2= MPI_Wtime();
+    fof_find_groups(particles, ll, 0, 32, false, FofMethod::kdtree, true);
+    const double t= MPI_Wtime() - t2;
+    msg_set_loglevel(msg_info);
+
+    if(nthread == 1)
+      time1= t;
+
+    msg_printf(msg_info, "%3d threads: kdtree %.3f sec, refit %.3f sec, "
+	       "FoF %.3f sec, speedup %.2f, %lu groups\n",
+	       nthread, t1 - t0, t2 - t1, t, time1/t,
+	       (unsigned long) bench_count_groups());
+  }
+
+  lpt_free();
+  delete particles;
+  delete ps;
+  comm_mpi_finalise();
+
+  return 0;
+}
@@ -0,0 +1,68 @@
+//
+// Time of the kdtree and the grid FoF backends on 2LPT snapshots at
+// a = 0.1, 0.5, and 1, from nearly uniform to clustered particles
+//
+// Usage: bench_fof_backend [nc] [boxsize]
+//
+#include <cstdlib>
+#include <mpi.h>
+#include "fs.h"
+#include "bench_util.h"
+
+using namespace std;
+
+static double run(Particles* const particles, const Float ll,
+		  const FofMethod method, size_t* const ngrp)
+{
+  // Returns the time of FoF including the kdtree construction or the
+  // cell sort
+  msg_set_loglevel(msg_warn);
+  const double t0= MPI_Wtime();
+  fof_find_groups(particles, ll, 0, 32, false, method);
+  const double t= MPI_Wtime() - t0;
+  msg_set_loglevel(msg_info);
+
+  *ngrp= bench_count_groups();
+
+  return t;
+}
+
+int main(int argc, char* argv[])
+{
+  comm_mpi_init(&argc, &argv);
+
+  const int nc= argc > 1 ? atoi(argv[1]) : 128;
+  const Float boxsize= argc > 2 ? atof(argv[2]) : 2.0*nc;
+  const double omega_m= 0.308;
+  const Float ll= 0.2*boxsize/nc;
+  const double a[]= {0.1, 0.5, 1.0};
+
+  PowerSpectrum* ps= bench_init(omega_m);
+  Particles* particles= new Particles(bench_np_alloc(nc), boxsize);
+
+  lpt_init(nc, boxsize, 0);
+
+  msg_set_loglevel(msg_info);
+  msg_printf(msg_info, "nc= %d, boxsize= %.1f, ll= %.3f\n", nc, boxsize, ll);
+
+  for(int ia=0; ia<3; ++ia) {
+    msg_set_loglevel(msg_warn);
+    bench_set_particles(particles, ps, a[ia], "2lpt");
+
+    size_t ngrp_kdtree, ngrp_grid;
+    const double t_kdtree= run(particles, ll, FofMethod::kdtree, &ngrp_kdtree);
+    const double t_grid= run(particles, ll, FofMethod::grid, &ngrp_grid);
+
+    msg_printf(msg_info, "a= %.1f: kdtree %.3f sec, grid %.3f sec, "
+	       "%lu groups%s\n", a[ia], t_kdtree, t_grid,
+	       (unsigned long) ngrp_kdtree,
+	       ngrp_grid == ngrp_kdtree ? "" : " (differ)");
+  }
+
+  lpt_free();
+  delete particles;
+  delete ps;
+  comm_mpi_finalise();
+
+  return 0;
+}
@@ -0,0 +1,70 @@
+//
+// Pruning efficiency of kdtree traversals: node visits for the leaf
+// neighbour search within the FoF linking length, with the 3-D bounding
+// box test and with the 1-D test of the previous tree, which kept the
+// node extent along one axis only
+//
+// Usage: bench_kdtree [nc] [boxsize]
+//
+#include <cstdlib>
+#include <vector>
+#include <mpi.h>
+#include "fs.h"
+#include "bench_util.h"
+
+using namespace std;
+
+static void search(const Float r, const Float boxsize, const bool prune_3d)
+{
+  const Index nleaf= kdtree_get_leaves().size();
+  vector<Index> v;
+
+  kdtree_reset_counter();
+  const double t0= MPI_Wtime();
+  for(Index l=0; l<nleaf; ++l)
+    kdtree_leaf_neighbours(l, r, boxsize, v, prune_3d);
+  const double t= MPI_Wtime() - t0;
+
+  KdTreeCounter const c= kdtree_get_counter();
+  msg_printf(msg_info,
+	     "%s: %.3f sec, %.1f nodes visited, %.1f pruned, "
+	     "%.1f neighbour leaves per leaf\n",
+	     prune_3d ? "3-D box" : "1-D axis", t,
+	     (double) c.visited/nleaf, (double) c.pruned/nleaf,
+	     (double) c.leaves/nleaf);
+}
+
+int main(int argc, char* argv[])
+{
+  comm_mpi_init(&argc, &argv);
+
+  const int nc= argc > 1 ? atoi(argv[1]) : 64;
+  const Float boxsize= argc > 2 ? atof(argv[2]) : 2.0*nc;
+  const double omega_m= 0.308;
+  const Float ll= 0.2*boxsize/nc;
+  const double a[]= {0.1, 1.0};
+
+  PowerSpectrum* ps= bench_init(omega_m);
+  Particles* particles= new Particles(bench_np_alloc(nc), boxsize);
+
+  lpt_init(nc, boxsize, 0);
+
+  for(int i=0; i<2; ++i) {
+    bench_set_particles(particles, ps, a[i], "2lpt");
+    kdtree_init(particles, 0);
+
+    msg_set_loglevel(msg_info);
+    msg_printf(msg_info, "a= %.1f, nc= %d, %d leaves, r= %.3f\n",
+	       a[i], nc, (int) kdtree_get_leaves().size(), ll);
+    search(ll, boxsize, false);
+    search(ll, boxsize, true);
+    msg_set_loglevel(msg_warn);
+  }
+
+  lpt_free();
+  delete particles;
+  delete ps;
+  comm_mpi_finalise();
+
+  return 0;
+}
@@ -0,0 +1,134 @@
+//
+// kdtree construction from scratch versus kdtree_update (refit with
+// partial rebuilds) after each step of a COLA simulation; the quality of
+// the tree is measured by the node visits of the FoF leaf neighbour search
+//
+// Usage: bench_kdtree_update [nc] [nstep] [overlap_max]
+//
+#include <cstdlib>
+#include <vector>
+#include <mpi.h>
+#include "fs.h"
+#include "bench_util.h"
+
+using namespace std;
+
+struct StepResult {
+  double a, t_tree, t_search, visited, rebuilt;
+};
+
+static void search(const Float r, const Float boxsize, StepResult* const s)
+{
+  // Leaf neighbour search of FoF; time and node visits per leaf
+  const Index nleaf= kdtree_get_leaves().size();
+  vector<Index> v;
+
+  kdtree_reset_counter();
+  const double t0= MPI_Wtime();
+  for(Index l=0; l<nleaf; ++l)
+    kdtree_leaf_neighbours(l, r, boxsize, v);
+  s->t_search= MPI_Wtime() - t0;
+  s->visited= static_cast<double>(kdtree_get_counter().visited)/nleaf;
+}
+
+static vector<StepResult> run(Particles* const particles,
+			      PowerSpectrum* const ps, const int nstep,
+			      const double a_init, const double a_final,
+			      const Float ll, const bool update,
+			      const Float overlap_max)
+{
+  // COLA steps from a_init to a_final; the kdtree is constructed or
+  // updated after each step
+  const unsigned long seed= 1;
+  const double da= (a_final - a_init)/nstep;
+  const size_t np= particles->np_local;
+  vector<StepResult> results;
+
+  lpt_set_displacements(seed, ps, a_init, "cola", particles);
+  kdtree_init(particles, 0, 32, false);
+
+  for(int istep=0; istep<nstep; ++istep) {
+    const double a_x= a_init + istep*da;
+    const double a_vel= a_x + 0.5*da;
+
+    pm_domain_send_positions(particles);
+    pm_compute_density(particles);
+    pm_compute_force(particles);
+    pm_domain_get_forces(particles);
+    cola_kick(particles, a_vel);
+    cola_drift(particles, a_x + da);
+    util_periodic_wrapup(particles);
+
+    StepResult s;
+    s.a= a_x + da;
+    const double t0= MPI_Wtime();
+    if(update)
+      s.rebuilt= static_cast<double>(kdtree_update(particles, overlap_max))/np;
+    else {
+      kdtree_init(particles, 0, 32, false);
+      s.rebuilt= 1.0;
+    }
+    s.t_tree= MPI_Wtime() - t0;
+
+    search(ll, particles->boxsize, &s);
+    results.push_back(s);
+  }
+
+  return results;
+}
+
+int main(int argc, char* argv[])
+{
+  comm_mpi_init(&argc, &argv);
+
+  const int nc= argc > 1 ? atoi(argv[1]) : 64;
+  const int nstep= argc > 2 ? atoi(argv[2]) : 10;
+  const Float overlap_max= argc > 3 ? atof(argv[3]) : 0.2;
+  const double omega_m= 0.308;
+  const Float boxsize= 2.0*nc;
+  const double a_init= 0.1;
+  const double a_final= 1.0;
+  const double pm_factor= 2.0;
+  const Float ll= 0.2*boxsize/nc;
+
+  PowerSpectrum* ps= bench_init(omega_m);
+
+  // Particles are not exchanged between nodes; the comparison is per node
+  Particles* particles= new Particles(bench_np_alloc(nc), boxsize);
+
+  lpt_init(nc, boxsize, 0);
+  bench_pm_init(nc, pm_factor, boxsize);
+
+  vector<StepResult> const r_init=
+    run(particles, ps, nstep, a_init, a_final, ll, false, overlap_max);
+  vector<StepResult> const r_update=
+    run(particles, ps, nstep, a_init, a_final, ll, true, overlap_max);
+
+  msg_set_loglevel(msg_info);
+  msg_printf(msg_info, "nc= %d, %d steps, overlap_max= %.2f\n",
+	     nc, nstep, overlap_max);
+  msg_printf(msg_info, "   a   kdtree_init          kdtree_update\n");
+  msg_printf(msg_info, "       tree  search visit  tree  search visit "
+	     "rebuilt\n");
+
+  double t_init= 0.0, t_update= 0.0;
+  for(int i=0; i<nstep; ++i) {
+    StepResult const& s= r_init[i];
+    StepResult const& u= r_update[i];
+    msg_printf(msg_info, "%.3f %.3f %.3f %5.1f  %.3f %.3f %5.1f %.3f\n",
+	       s.a, s.t_tree, s.t_search, s.visited,
+	       u.t_tree, u.t_search, u.visited, u.rebuilt);
+    t_init += s.t_tree + s.t_search;
+    t_update += u.t_tree + u.t_search;
+  }
+
+  msg_printf(msg_info, "total: kdtree_init %.3f sec, kdtree_update %.3f sec\n",
+	     t_init, t_update);
+
+  lpt_free();
+  delete particles;
+  delete ps;
+  comm_mpi_finalise();
+
+  return 0;
+}
@@ -0,0 +1,148 @@
+//
+// Time per COLA step for the array-of-structures (Particles) and the
+// structure-of-arrays (ParticlesSoA) particle layouts, the latter also with
+// 16-bit LPT displacements (compress_lpt) and uint32 positions
+// (fixed_position)
+//
+// Usage: bench_particle_layout [nc] [nstep]
+//
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <mpi.h>
+#include "fs.h"
+#include "bench_util.h"
+
+using namespace std;
+
+struct StepTime {
+  double pm, kick, drift;
+};
+
+template<class Container>
+static StepTime run(Container* const particles, const int nstep,
+		    const double a_init, const double a_final)
+{
+  // Leapfrog with kick-drift; returns time per step in seconds
+  StepTime t= {0.0, 0.0, 0.0};
+  const double da= (a_final - a_init)/nstep;
+
+  for(int istep=0; istep<nstep; ++istep) {
+    const double a_x= a_init + istep*da;
+    const double a_vel= a_x + 0.5*da;
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    double t0= MPI_Wtime();
+    pm_domain_send_positions(particles);
+    pm_compute_density(particles);
+    pm_compute_force(particles);
+    pm_domain_get_forces(particles);
+    double t1= MPI_Wtime();
+
+    cola_kick(particles, a_vel);
+    double t2= MPI_Wtime();
+
+    cola_drift(particles, a_x + da);
+    double t3= MPI_Wtime();
+
+    t.pm += t1 - t0;
+    t.kick += t2 - t1;
+    t.drift += t3 - t2;
+  }
+
+  t.pm /= nstep;
+  t.kick /= nstep;
+  t.drift /= nstep;
+
+  return t;
+}
+
+static Float max_position_diff(ParticlesSoA const * const p,
+				ParticlesSoA const * const q)
+{
+  // Maximum periodic distance between the same particles in p and q
+  const Float boxsize= p->boxsize;
+  Float diff_max= 0;
+  for(size_t i=0; i<p->np_local; ++i) {
+    Float x[3], y[3];
+    if(p->position_fixed())
+      position_float(p->xi[i], boxsize, x);
+    else
+      position_float(p->x[i], boxsize, x);
+    if(q->position_fixed())
+      position_float(q->xi[i], boxsize, y);
+    else
+      position_float(q->x[i], boxsize, y);
+
+    for(int k=0; k<3; ++k) {
+      Float d= fabs(x[k] - y[k]);
+      diff_max= max(diff_max, min(d, boxsize - d));
+    }
+  }
+
+  return comm_max<Float>(diff_max);
+}
+
+static void print_time(const char name[], const StepTime& t)
+{
+  msg_printf(msg_info, "%s: %.4f sec/step (pm %.4f, kick %.4f, drift %.4f)\n",
+	     name, t.pm + t.kick + t.drift, t.pm, t.kick, t.drift);
+}
+
+int main(int argc, char* argv[])
+{
+  comm_mpi_init(&argc, &argv);
+
+  const int nc= argc > 1 ? atoi(argv[1]) : 64;
+  const int nstep= argc > 2 ? atoi(argv[2]) : 10;
+  const double omega_m= 0.308;
+  const Float boxsize= 64.0;
+  const unsigned long seed= 1;
+  const double a_init= 0.1;
+  const double a_final= 1.0;
+  const double pm_factor= 2.0;
+
+  PowerSpectrum* ps= bench_init(omega_m);
+
+  const size_t np_alloc= bench_np_alloc(nc);
+  Particles* particles= new Particles(np_alloc, boxsize);
+  ParticlesSoA* particles_soa= new ParticlesSoA(np_alloc, boxsize);
+  ParticlesSoA* particles_soa16= new ParticlesSoA(np_alloc, boxsize, true);
+  ParticlesSoA* particles_fixed=
+    new ParticlesSoA(np_alloc, boxsize, true, true);
+
+  lpt_init(nc, boxsize, 0);
+  lpt_set_displacements(seed, ps, a_init, "cola", particles);
+  particles_copy(particles, particles_soa);
+  lpt_set_displacements(seed, ps, a_init, "cola", particles_soa16);
+  lpt_set_displacements(seed, ps, a_init, "cola", particles_fixed);
+
+  bench_pm_init(nc, pm_factor, boxsize);
+
+  const StepTime t_aos= run(particles, nstep, a_init, a_final);
+  const StepTime t_soa= run(particles_soa, nstep, a_init, a_final);
+  const StepTime t_soa16= run(particles_soa16, nstep, a_init, a_final);
+  const StepTime t_fixed= run(particles_fixed, nstep, a_init, a_final);
+
+  msg_set_loglevel(msg_info);
+  msg_printf(msg_info, "nc= %d, %d steps, %d nodes\n",
+	     nc, nstep, comm_n_nodes());
+  print_time("AoS", t_aos);
+  print_time("SoA", t_soa);
+  print_time("SoA 16-bit LPT", t_soa16);
+  print_time("SoA 16-bit LPT, uint32 x", t_fixed);
+  msg_printf(msg_info, "max position difference with 16-bit LPT: %e\n",
+	     max_position_diff(particles_soa, particles_soa16));
+  msg_printf(msg_info, "max position difference with uint32 x: %e\n",
+	     max_position_diff(particles_soa16, particles_fixed));
+
+  lpt_free();
+  delete particles_fixed;
+  delete particles_soa16;
+  delete particles_soa;
+  delete particles;
+  delete ps;
+  comm_mpi_finalise();
+
+  return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H 1
+
+//
+// Setup shared by the benchmarks: cosmology, power spectrum, LPT
+// particles, PM, and the number of FoF groups
+//
+#include <vector>
+#include "fs.h"
+
+static inline PowerSpectrum* bench_init(const double omega_m= 0.308)
+{
+  // Initialise the cosmology; returns the power spectrum
+  msg_set_loglevel(msg_warn);
+  cosmology_init(omega_m);
+
+  return new PowerSpectrum("../../data/planck_matterpower.dat");
+}
+
+static inline size_t bench_np_alloc(const int nc)
+{
+  // Particles allocated per node for nc^3 particles
+  return 1.25*nc*nc*(nc/comm_n_nodes() + 1);
+}
+
+static inline void bench_set_particles(Particles* const particles,
+				       PowerSpectrum* const ps,
+				       const double a, char const kind[],
+				       const unsigned long seed= 1)
+{
+  // LPT particles at a in [0, boxsize); lpt_init must be called before
+  lpt_set_displacements(seed, ps, a, kind, particles);
+  util_periodic_wrapup(particles);
+}
+
+static inline void bench_pm_init(const int nc, const double pm_factor,
+				 const Float boxsize)
+{
+  const int nc_pm= static_cast<int>(pm_factor*nc);
+  const size_t mem_size= fft_mem_size(nc_pm, 1);
+  Mem* const mem1= new Mem("ParticleMesh", mem_size);
+  Mem* const mem2= new Mem("delta_k", mem_size);
+  pm_init(nc_pm, pm_factor, mem1, mem2, boxsize);
+}
+
+static inline size_t bench_count_groups()
+{
+  // Number of groups of the last fof_find_groups
+  std::vector<Index> const& grp= fof_grp();
+  size_t ngrp= 0;
+  for(size_t i=0; i<grp.size(); ++i) {
+    if(grp[i] == static_cast<Index>(i))
+      ngrp++;
+  }
+
+  return ngrp;
+}
+
+#endif
@@ -0,0 +1,62 @@
+//
+// cola_velocity() against cola_interpolate() at a_out = a_x
+//
+// Both add the 2LPT velocity at a_x to the COLA velocity; with the
+// velocities at a_v = a_x after the LPT initial condition, the kick and
+// drift of cola_interpolate() are zero and the velocities must agree
+//
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include "fs.h"
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+  comm_mpi_init(&argc, &argv);
+
+  const double omega_m= 0.308;
+  const int nc= 32;
+  const Float boxsize= 64.0;
+  const unsigned long seed= 1;
+  const double a= 0.5;
+
+  msg_set_loglevel(msg_info);
+  cosmology_init(omega_m);
+
+  PowerSpectrum* ps= new PowerSpectrum("../../data/planck_matterpower.dat");
+  Particles* particles= new Particles(nc*nc*nc, boxsize);
+
+  lpt_init(nc, boxsize, 0);
+  lpt_set_displacements(seed, ps, a, "cola", particles);
+  assert(particles->a_v == particles->a_x);
+
+  const size_t np= particles->np_local;
+  vector<Float> v= cola_velocity(particles);
+  vector<Particle> out(np);
+  cola_interpolate(particles, a, a, 0, np, out.data());
+
+  double v_max= 0.0, diff_max= 0.0;
+  for(size_t i=0; i<np; ++i) {
+    for(int k=0; k<3; ++k) {
+      v_max= max(v_max, fabs(static_cast<double>(out[i].v[k])));
+      diff_max= max(diff_max,
+		    fabs(static_cast<double>(v[3*i + k] - out[i].v[k])));
+    }
+  }
+
+  if(!(v_max > 0.0) || diff_max > 1.0e-5*v_max)
+    msg_abort("Error: test_cola_velocity failed; |dv| %e, |v| %e\n",
+	      diff_max, v_max);
+
+  msg_printf(msg_info, "test_cola_velocity successful for %lu particles.\n",
+	     (unsigned long) np);
+
+  lpt_free();
+  delete ps;
+  delete particles;
+  comm_mpi_finalise();
+
+  return 0;
+}
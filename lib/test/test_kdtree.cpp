@@ -19,10 +19,10 @@ int main(int argc, char* argv[])
   cosmology_init(omega_m);
 
   PowerSpectrum* ps= new PowerSpectrum("../../data/planck_matterpower.dat");
-  Particles* particles= new Particles(nc, boxsize);
+  Particles* particles= new Particles(nc*nc*nc, boxsize);
 
   lpt_init(nc, boxsize, 0);
-  lpt_set_displacements(seed, ps, a_final, particles);
+  lpt_set_displacements(seed, ps, a_final, "2lpt", particles);
 
   // ToDo: This boxsize3 is for 1 node
   Float boxsize3[]= {boxsize, boxsize, boxsize};
@@ -40,27 +40,29 @@ int main(int argc, char* argv[])
 
 
 
-KdTree const * search_nearest_leaf(const Float x[], KdTree const * const kdtree, const size_t inode)
+static bool box_contains(KdTree const * const tree, const Float x[])
 {
-  // Find a leaf that contains a particle position x
+  return tree->lo[0] <= x[0] && x[0] <= tree->hi[0] &&
+         tree->lo[1] <= x[1] && x[1] <= tree->hi[1] &&
+         tree->lo[2] <= x[2] && x[2] <= tree->hi[2];
+}
+
+KdTree const * search_nearest_leaf(const Float x[], KdTree const * const kdtree, const size_t inode, const Index i)
+{
+  // Find the leaf that contains particle i at position x
   KdTree const * const tree= kdtree + inode;
-  if(tree->iend - tree->ibegin <= KdTree::quota)
+  if(!box_contains(tree, x) || i < tree->ibegin || i >= tree->iend)
+    return 0;
+
+  if(is_leaf(tree))
     return tree;
   
-  const size_t ileft= left_child(inode);
-  KdTree const * const l= kdtree + ileft;
+  KdTree const * const l=
+    search_nearest_leaf(x, kdtree, left_child(inode), i);
+  if(l)
+    return l;
 
-  if(l->left <= x[l->k] && x[l->k] <= l->right)
-    return search_nearest_leaf(x, kdtree, ileft);
-
-  const size_t iright= right_child(inode);
-  KdTree const * const r= kdtree + iright;  
-
-  if(r->left <= x[r->k] && x[r->k] <= r->right)
-    return search_nearest_leaf(x, kdtree, iright);
-
-  assert(false);
-  return 0;
+  return search_nearest_leaf(x, kdtree, right_child(inode), i);
 }
 
 
@@ -72,8 +74,8 @@ void test_kdtree(Particles* const particles, KdTree const * const kdtree)
   size_t n= 0;
   
   for(size_t i=0; i<particles->np_local; ++i) {
-    KdTree const * const tree= search_nearest_leaf(p[i].x, kdtree, 0);
-    if(!(tree->ibegin <= i && i < tree->iend)) {
+    KdTree const * const tree= search_nearest_leaf(p[i].x, kdtree, 0, i);
+    if(tree == 0) {
       msg_abort("Error: test_kdtree failed for particle %ul\n", i);
     }
     n++;
@@ -0,0 +1,119 @@
+//
+// Simulation::run with the ParticlesSoA layouts against Particles
+//
+// The same COLA steps are run for Particles, ParticlesSoA with Float
+// positions, and ParticlesSoA with 16-bit LPT displacements (compress_lpt)
+// and uint32 positions (fixed_position); the positions must agree within
+// a small fraction of the particle spacing
+//
+#include <cmath>
+#include <algorithm>
+#include "fs.h"
+
+using namespace std;
+
+static void position(Particles const * const particles, const size_t i,
+		     Float x[])
+{
+  for(int k=0; k<3; ++k)
+    x[k]= particles->p[i].x[k];
+}
+
+static void position(ParticlesSoA const * const particles, const size_t i,
+		     Float x[])
+{
+  if(particles->position_fixed())
+    position_float(particles->xi[i], particles->boxsize, x);
+  else
+    position_float(particles->x[i], particles->boxsize, x);
+}
+
+template<class Container>
+static Float max_position_diff(Particles const * const p,
+			       Container const * const q)
+{
+  // Maximum periodic distance between the same particles in p and q
+  if(p->np_local != q->np_local)
+    msg_abort("Error: number of particles differ %lu %lu\n",
+	      (unsigned long) p->np_local, (unsigned long) q->np_local);
+
+  const Float boxsize= p->boxsize;
+  Float diff_max= 0;
+  for(size_t i=0; i<p->np_local; ++i) {
+    Float x[3], y[3];
+    position(p, i, x);
+    position(q, i, y);
+
+    for(int k=0; k<3; ++k) {
+      Float d= fabs(x[k] - y[k]);
+      diff_max= max(diff_max, min(d, boxsize - d));
+    }
+  }
+
+  return comm_max<Float>(diff_max);
+}
+
+int main(int argc, char* argv[])
+{
+  comm_mpi_init(&argc, &argv);
+
+  const double omega_m= 0.308;
+  const int nc= 32;
+  const Float boxsize= 64.0;
+  const unsigned long seed= 1;
+  const double a_init= 0.1;
+  const double a_final= 0.5;
+  const int nstep= 5;
+  const double pm_factor= 2.0;
+  const Float tol= 0.01*boxsize/nc;
+
+  msg_set_loglevel(msg_info);
+  cosmology_init(omega_m);
+
+  PowerSpectrum* ps= new PowerSpectrum("../../data/planck_matterpower.dat");
+
+  const size_t np_alloc= 1.25*nc*nc*(nc/comm_n_nodes() + 1);
+  Particles* particles= new Particles(np_alloc, boxsize);
+  ParticlesSoA* particles_soa= new ParticlesSoA(np_alloc, boxsize);
+  ParticlesSoA* particles_fixed=
+    new ParticlesSoA(np_alloc, boxsize, true, true);
+
+  lpt_init(nc, boxsize, 0);
+  lpt_set_displacements(seed, ps, a_init, "cola", particles);
+  lpt_set_displacements(seed, ps, a_init, "cola", particles_soa);
+  lpt_set_displacements(seed, ps, a_init, "cola", particles_fixed);
+
+  const Float diff_init= max_position_diff(particles, particles_fixed);
+
+  const int nc_pm= static_cast<int>(pm_factor*nc);
+  const size_t mem_size= fft_mem_size(nc_pm, 1);
+  Mem* const mem1= new Mem("ParticleMesh", mem_size);
+  Mem* const mem2= new Mem("delta_k", mem_size);
+  pm_init(nc_pm, pm_factor, mem1, mem2, boxsize);
+
+  Simulation simulation(a_init, a_final, nstep, StepSpacing::linear);
+  simulation.add_output(a_final);
+  simulation.run(particles);
+  simulation.run(particles_soa);
+  simulation.run(particles_fixed);
+
+  const Float diff_soa= max_position_diff(particles, particles_soa);
+  const Float diff_fixed= max_position_diff(particles, particles_fixed);
+
+  if(!(diff_init < tol) || !(diff_soa < tol) || !(diff_fixed < tol))
+    msg_abort("Error: test_particle_layout failed; "
+	      "|dx| initial %e, SoA %e, fixed %e > %e\n",
+	      diff_init, diff_soa, diff_fixed, tol);
+
+  msg_printf(msg_info, "test_particle_layout successful; "
+	     "|dx| SoA %e, fixed %e\n", diff_soa, diff_fixed);
+
+  lpt_free();
+  delete particles_fixed;
+  delete particles_soa;
+  delete particles;
+  delete ps;
+  comm_mpi_finalise();
+
+  return 0;
+}
@@ -4,13 +4,9 @@
 #include <cassert>
 #include <mpi.h>
 
-#include <gsl/gsl_integration.h>
-#include <gsl/gsl_roots.h>
-#include <gsl/gsl_sf_hyperg.h> 
-#include <gsl/gsl_errno.h>
-
 #include "particle.h"
 #include "msg.h"
+#include "util.h"
 #include "cola.h"
 #include "cosmology.h"
 
@@ -20,6 +16,31 @@ namespace {
   constexpr double nLPT= -2.5f;
 
   double Sq(double ai, double af, double aRef);
+  void get_kick_factors(const double ai, const double a, const double af,
+			StepSchedule const * const schedule,
+			Float* const kick_factor, Float* const q1,
+			Float* const q2);
+  void get_drift_factors(const double ai, const double af, const double av,
+			 StepSchedule const * const schedule,
+			 Float* const dt, Float* const da1, Float* const da2);
+
+  template<class Access>
+  void kick(typename Access::Container* const particles, const double avel1,
+	    StepSchedule const * const schedule);
+  template<class Access>
+  void drift(typename Access::Container* const particles, const double apos1,
+	     StepSchedule const * const schedule, Lightcone* const lightcone);
+  template<class Access>
+  void step(typename Access::Container* const particles,
+	    const double avel1, const double apos1,
+	    StepSchedule const * const schedule, Lightcone* const lightcone);
+  template<class Access>
+  vector<Float> velocity(typename Access::Container const * const particles);
+  template<class Access>
+  void interpolate(typename Access::Container const * const particles,
+		   const double avel1, const double a_out,
+		   const size_t ibegin, const size_t iend,
+		   Particle* const out);
 }
 
 void cola_set_initial(Particles* const particles, const double a)
@@ -45,28 +66,204 @@ void cola_set_initial(Particles* const particles, const double a)
   msg_printf(msg_debug, "Dv= %e, Dv2= %e\n", Dv, D2v);
 }
 
-void cola_kick(Particles* const particles, const double avel1)
+void cola_kick_factors(const double ai, const double a, const double af,
+		       Float* const kick_factor, Float* const q1, Float* const q2)
 {
-  const double ai=  particles->a_v;  // t - 0.5*dt
-  const double a=   particles->a_x;  // t
-  const double af=  avel1;           // t + 0.5*dt
-
+  // Kick factor for velocity ai -> af, and 2LPT acceleration factors at a
   const double om= cosmology_omega_m();
-  msg_printf(msg_info, "Kick %lg -> %lg\n", ai, avel1);
-
-  const Float kick_factor= (pow(af, nLPT) - pow(ai, nLPT))/
-                             (nLPT*pow(a, nLPT)*sqrt(om/a + (1.0 - om)*a*a));
+  *kick_factor= (pow(af, nLPT) - pow(ai, nLPT))/
+                  (nLPT*pow(a, nLPT)*sqrt(om/a + (1.0 - om)*a*a));
   
   const double growth1= cosmology_D_growth(a);
   const double growth2= cosmology_D2_growth(a, growth1);
 	
   msg_printf(msg_debug, "growth factor %lg\n", growth1);
 
-  const Float q1= growth1;
-  const Float q2= cosmology_D2a_growth(growth1, growth2);
+  *q1= growth1;
+  *q2= cosmology_D2a_growth(growth1, growth2);
+}
+
+void cola_drift_factors(const double ai, const double af, const double av,
+			Float* const dt, Float* const da1, Float* const da2)
+{
+  // Drift factor for position ai -> af with velocity at av,
+  // and changes in 1LPT and 2LPT growth factors
+  *dt= Sq(ai, af, av);
+
+  const double growth_i= cosmology_D_growth(ai);
+  const double growth_f= cosmology_D_growth(af);
+  *da1= growth_f - growth_i;
+
+  *da2= cosmology_D2_growth(af, growth_f) -
+          cosmology_D2_growth(ai, growth_i);
+}
+
+void cola_kick(Particles* const particles, const double avel1,
+	       StepSchedule const * const schedule)
+{
+  kick<ParticleAccessAoS>(particles, avel1, schedule);
+}
+
+void cola_kick(ParticlesSoA* const particles, const double avel1,
+	       StepSchedule const * const schedule)
+{
+  // Positions are not used in kick; fixed_position needs no variant
+  if(particles->lpt_compressed())
+    kick<ParticleAccessSoA16>(particles, avel1, schedule);
+  else
+    kick<ParticleAccessSoA>(particles, avel1, schedule);
+}
+
+void cola_drift(Particles* const particles, const double apos1,
+		StepSchedule const * const schedule,
+		Lightcone* const lightcone)
+{
+  drift<ParticleAccessAoS>(particles, apos1, schedule, lightcone);
+}
+
+void cola_drift(ParticlesSoA* const particles, const double apos1,
+		StepSchedule const * const schedule,
+		Lightcone* const lightcone)
+{
+  if(particles->position_fixed()) {
+    if(particles->lpt_compressed())
+      drift<ParticleAccessSoA16Fixed>(particles, apos1, schedule, lightcone);
+    else
+      drift<ParticleAccessSoAFixed>(particles, apos1, schedule, lightcone);
+  }
+  else if(particles->lpt_compressed())
+    drift<ParticleAccessSoA16>(particles, apos1, schedule, lightcone);
+  else
+    drift<ParticleAccessSoA>(particles, apos1, schedule, lightcone);
+}
+
+void cola_step(Particles* const particles,
+	       const double avel1, const double apos1,
+	       StepSchedule const * const schedule,
+	       Lightcone* const lightcone)
+{
+  // Kick to avel1, drift to apos1, and periodic wrapup in one pass over
+  // the particles; same as cola_kick, cola_drift, util_periodic_wrapup
+  step<ParticleAccessAoS>(particles, avel1, apos1, schedule, lightcone);
+}
+
+void cola_step(ParticlesSoA* const particles,
+	       const double avel1, const double apos1,
+	       StepSchedule const * const schedule,
+	       Lightcone* const lightcone)
+{
+  if(particles->position_fixed()) {
+    if(particles->lpt_compressed())
+      step<ParticleAccessSoA16Fixed>(particles, avel1, apos1, schedule,
+					 lightcone);
+    else
+      step<ParticleAccessSoAFixed>(particles, avel1, apos1, schedule,
+				   lightcone);
+  }
+  else if(particles->lpt_compressed())
+    step<ParticleAccessSoA16>(particles, avel1, apos1, schedule, lightcone);
+  else
+    step<ParticleAccessSoA>(particles, avel1, apos1, schedule, lightcone);
+}
+
+vector<Float> cola_velocity(Particles const * const particles)
+{
+  // Convert COLA 2LPT subtracted velocity to usual velocity
+  return velocity<ParticleAccessAoS>(particles);
+}
+
+vector<Float> cola_velocity(ParticlesSoA const * const particles)
+{
+  if(particles->lpt_compressed())
+    return velocity<ParticleAccessSoA16>(particles);
+
+  return velocity<ParticleAccessSoA>(particles);
+}
+
+void cola_interpolate(Particles const * const particles,
+		      const double avel1, const double a_out,
+		      const size_t ibegin, const size_t iend,
+		      Particle* const out)
+{
+  interpolate<ParticleAccessAoS>(particles, avel1, a_out, ibegin, iend, out);
+}
+
+void cola_interpolate(ParticlesSoA const * const particles,
+		      const double avel1, const double a_out,
+		      const size_t ibegin, const size_t iend,
+		      Particle* const out)
+{
+  if(particles->position_fixed()) {
+    if(particles->lpt_compressed())
+      interpolate<ParticleAccessSoA16Fixed>(particles, avel1, a_out,
+					    ibegin, iend, out);
+    else
+      interpolate<ParticleAccessSoAFixed>(particles, avel1, a_out,
+					  ibegin, iend, out);
+  }
+  else if(particles->lpt_compressed())
+    interpolate<ParticleAccessSoA16>(particles, avel1, a_out,
+				     ibegin, iend, out);
+  else
+    interpolate<ParticleAccessSoA>(particles, avel1, a_out,
+				   ibegin, iend, out);
+}
+
+namespace {
+
+void get_kick_factors(const double ai, const double a, const double af,
+		      StepSchedule const * const schedule,
+		      Float* const kick_factor, Float* const q1, Float* const q2)
+{
+  // Kick factors from the schedule if available, otherwise computed
+  KickFactors const * const k= schedule ? schedule->find_kick(ai, a, af) : 0;
+  if(schedule && k == 0)
+    msg_printf(msg_warn, "Warning: kick %lg -> %lg not in StepSchedule\n",
+	       ai, af);
+
+  if(k) {
+    *kick_factor= k->cola_kick;
+    *q1= k->q1;
+    *q2= k->q2;
+  }
+  else
+    cola_kick_factors(ai, a, af, kick_factor, q1, q2);
+}
+
+void get_drift_factors(const double ai, const double af, const double av,
+		       StepSchedule const * const schedule,
+		       Float* const dt, Float* const da1, Float* const da2)
+{
+  // Drift factors from the schedule if available, otherwise computed
+  DriftFactors const * const d= schedule ? schedule->find_drift(ai, af, av) : 0;
+  if(schedule && d == 0)
+    msg_printf(msg_warn, "Warning: drift %lg -> %lg not in StepSchedule\n",
+	       ai, af);
+
+  if(d) {
+    *dt= d->cola_dt;
+    *da1= d->da1;
+    *da2= d->da2;
+  }
+  else
+    cola_drift_factors(ai, af, av, dt, da1, da2);
+}
+
+template<class Access>
+void kick(typename Access::Container* const particles, const double avel1,
+	  StepSchedule const * const schedule)
+{
+  const double ai=  particles->a_v;  // t - 0.5*dt
+  const double a=   particles->a_x;  // t
+  const double af=  avel1;           // t + 0.5*dt
 
+  const double om= cosmology_omega_m();
+  msg_printf(msg_info, "Kick %lg -> %lg\n", ai, avel1);
+
+  Float kick_factor, q1, q2;
+  get_kick_factors(ai, a, af, schedule, &kick_factor, &q1, &q2);
   
-  Particle* const p= particles->p;
+  const Access p(particles);
   const size_t np= particles->np_local;
   Float3* const f= particles->force;
 
@@ -77,81 +274,205 @@ void cola_kick(Particles* const particles, const double avel1)
   #pragma omp parallel for default(shared)
 #endif
   for(size_t i=0; i<np; i++) {
-    Float ax= -1.5*om*(f[i][0] + p[i].dx1[0]*q1 + p[i].dx2[0]*q2);
-    Float ay= -1.5*om*(f[i][1] + p[i].dx1[1]*q1 + p[i].dx2[1]*q2);
-    Float az= -1.5*om*(f[i][2] + p[i].dx1[2]*q1 + p[i].dx2[2]*q2);
-
-    p[i].v[0] += ax*kick_factor;
-    p[i].v[1] += ay*kick_factor;
-    p[i].v[2] += az*kick_factor;
+    Float* const v= p.v(i);
+    const auto dx1= p.dx1(i);
+    const auto dx2= p.dx2(i);
+    
+    Float ax= -1.5*om*(f[i][0] + dx1[0]*q1 + dx2[0]*q2);
+    Float ay= -1.5*om*(f[i][1] + dx1[1]*q1 + dx2[1]*q2);
+    Float az= -1.5*om*(f[i][2] + dx1[2]*q1 + dx2[2]*q2);
 
+    v[0] += ax*kick_factor;
+    v[1] += ay*kick_factor;
+    v[2] += az*kick_factor;
   }
 
   // velocity is now at a= avel1
   particles->a_v= avel1;
 }
 
-void cola_drift(Particles* const particles, const double apos1)
+template<class Access>
+void drift(typename Access::Container* const particles, const double apos1,
+	   StepSchedule const * const schedule, Lightcone* const lightcone)
 {
   const double ai= particles->a_x;
   const double af= apos1;
   
-  Particle* const p= particles->p;
+  const Access p(particles);
   const size_t np= particles->np_local;
+  const Float boxsize= particles->boxsize;
 
-  const double dt=Sq(ai, af, particles->a_v);
-
-  const double growth_i= cosmology_D_growth(ai);
-  const double growth_f= cosmology_D_growth(af);
-  const Float da1= growth_f - growth_i;
-
-  const Float da2= cosmology_D2_growth(af, growth_f) -
-                     cosmology_D2_growth(ai, growth_i);
+  Float dt, da1, da2;
+  get_drift_factors(ai, af, particles->a_v, schedule, &dt, &da1, &da2);
 
   msg_printf(msg_info, "Drift %lg -> %lg\n", ai, af);
+
+  if(lightcone)
+    lightcone->begin_drift(ai, af, true);
+  const bool record_lightcone= lightcone && lightcone->active();
     
   // Drift
 #ifdef _OPENMP
   #pragma omp parallel for default(shared)
 #endif
   for(size_t i=0; i<np; i++) {
-    p[i].x[0] += p[i].v[0]*dt + 
-                 (p[i].dx1[0]*da1 + p[i].dx2[0]*da2);
-    p[i].x[1] += p[i].v[1]*dt +
-                 (p[i].dx1[1]*da1 + p[i].dx2[1]*da2);
-    p[i].x[2] += p[i].v[2]*dt + 
-                 (p[i].dx1[2]*da1 + p[i].dx2[2]*da2);
+    Float const * const v= p.v(i);
+    const auto dx1= p.dx1(i);
+    const auto dx2= p.dx2(i);
+    
+    Float d[3];
+    d[0]= v[0]*dt + (dx1[0]*da1 + dx2[0]*da2);
+    d[1]= v[1]*dt + (dx1[1]*da1 + dx2[1]*da2);
+    d[2]= v[2]*dt + (dx1[2]*da1 + dx2[2]*da2);
+
+    if(record_lightcone) {
+      Float x[3];
+      position_float(p.positions()[i], boxsize, x);
+      lightcone->check(p.id(i), x, d, v, dx1, dx2);
+    }
+    p.move(i, d);
   }
 
+  if(lightcone)
+    lightcone->end_drift();
+
   particles->a_x= af;
 }
 
-vector<Float> cola_velocity(Particles const * const particles)
+template<class Access>
+void step(typename Access::Container* const particles,
+	  const double avel1, const double apos1,
+	  StepSchedule const * const schedule, Lightcone* const lightcone)
+{
+  const double a_v= particles->a_v;
+  const double a_x= particles->a_x;
+
+  const double om= cosmology_omega_m();
+  msg_printf(msg_info, "Kick %lg -> %lg, drift %lg -> %lg\n",
+	     a_v, avel1, a_x, apos1);
+
+  Float kick_factor, q1, q2;
+  get_kick_factors(a_v, a_x, avel1, schedule, &kick_factor, &q1, &q2);
+
+  Float dt, da1, da2;
+  get_drift_factors(a_x, apos1, avel1, schedule, &dt, &da1, &da2);
+
+  const Access p(particles);
+  const size_t np= particles->np_local;
+  Float3 const * const f= particles->force;
+  const Float boxsize= particles->boxsize;
+
+  if(lightcone)
+    lightcone->begin_drift(a_x, apos1, true);
+  const bool record_lightcone= lightcone && lightcone->active();
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared)
+#endif
+  for(size_t i=0; i<np; i++) {
+    Float* const v= p.v(i);
+    const auto dx1= p.dx1(i);
+    const auto dx2= p.dx2(i);
+    
+    Float d[3];
+    for(int k=0; k<3; k++) {
+      Float acc= -1.5*om*(f[i][k] + dx1[k]*q1 + dx2[k]*q2);
+      v[k] += acc*kick_factor;
+      d[k]= v[k]*dt + (dx1[k]*da1 + dx2[k]*da2);
+    }
+
+    if(record_lightcone) {
+      Float x[3];
+      position_float(p.positions()[i], boxsize, x);
+      lightcone->check(p.id(i), x, d, v, dx1, dx2);
+    }
+    p.move(i, d);
+    p.wrap(i, boxsize);
+  }
+
+  if(lightcone)
+    lightcone->end_drift();
+
+  particles->a_v= avel1;
+  particles->a_x= apos1;
+}
+
+template<class Access>
+vector<Float> velocity(typename Access::Container const * const particles)
 {
-  // Convert COLA 2LPT subtracted velocity to usual velocity
   const size_t np= particles->np_local;
   vector<Float> v(3*np);
 
   const double a= particles->a_x;
   const double D1= cosmology_D_growth(a);
   const Float  Dv= cosmology_Dv_growth(a, D1);
-  const Float  D2v= cosmology_D2v_growth(a, D1);
+  const Float  D2v= cosmology_D2v_growth(a, cosmology_D2_growth(a, D1));
 
-  Particle const * const p= particles->p;  
+  // particle data are only read
+  const Access p(const_cast<typename Access::Container*>(particles));
   for(size_t i=0; i<np; ++i) {
+    Float const * const vi= p.v(i);
+    const auto dx1= p.dx1(i);
+    const auto dx2= p.dx2(i);
     for(size_t k=0; k<3; ++k) {
-      v[3*i + k]= p[i].v[k] + Dv*p[i].dx1[k] + D2v*p[i].dx2[k];
+      v[3*i + k]= vi[k] + Dv*dx1[k] + D2v*dx2[k];
     }
   }
 
   return v;
 }
 
-namespace {
-  
-double fun (double a, void * params) {
-  double om= *(double*)params;
-  return pow(a, nLPT)/(sqrt(om/(a*a*a) + 1.0 - om)*a*a*a);
+template<class Access>
+void interpolate(typename Access::Container const * const particles,
+		 const double avel1, const double a_out,
+		 const size_t ibegin, const size_t iend,
+		 Particle* const out)
+{
+  // Positions and velocities at a_out, if the next step kicked to avel1
+  // and drifted to a_out; the force at a_x is used for the kick to a_out
+  const double a_v= particles->a_v;
+  const double a_x= particles->a_x;
+  const double om= cosmology_omega_m();
+
+  Float kick_vel, kick_out, q1, q2;
+  cola_kick_factors(a_v, a_x, avel1, &kick_vel, &q1, &q2);
+  cola_kick_factors(a_v, a_x, a_out, &kick_out, &q1, &q2);
+
+  Float dt, da1, da2;
+  cola_drift_factors(a_x, a_out, avel1, &dt, &da1, &da2);
+
+  // LPT velocity at a_out added to the COLA velocity
+  const double D1= cosmology_D_growth(a_out);
+  const Float Dv= cosmology_Dv_growth(a_out, D1);
+  const Float D2v= cosmology_D2v_growth(a_out, cosmology_D2_growth(a_out, D1));
+
+  // particle data are only read
+  const Access p(const_cast<typename Access::Container*>(particles));
+  Float3 const * const f= particles->force;
+  const Float boxsize= particles->boxsize;
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared)
+#endif
+  for(size_t i=ibegin; i<iend; i++) {
+    Float const * const v= p.v(i);
+    const auto dx1= p.dx1(i);
+    const auto dx2= p.dx2(i);
+    Particle& o= out[i - ibegin];
+
+    Float x[3];
+    position_float(p.positions()[i], boxsize, x);
+
+    for(int k=0; k<3; k++) {
+      Float acc= -1.5*om*(f[i][k] + dx1[k]*q1 + dx2[k]*q2);
+      o.x[k]= periodic_wrapup_x(x[k] + (v[k] + acc*kick_vel)*dt
+				+ (dx1[k]*da1 + dx2[k]*da2), boxsize);
+      o.v[k]= v[k] + acc*kick_out + Dv*dx1[k] + D2v*dx2[k];
+      o.dx1[k]= dx1[k];
+      o.dx2[k]= dx2[k];
+    }
+    o.id= p.id(i);
+  }
 }
 
 double Sq(double ai, double af, double av) {
@@ -160,22 +481,7 @@ double Sq(double ai, double af, double av) {
   // = \int_ai^af (a/a(av))^nLPT da/(a^3 H(a))
   //
   assert(ai > 0.0);
-  const int n_workspace= 5000;
-  gsl_integration_workspace* w= gsl_integration_workspace_alloc(n_workspace);
-  
-  double result, error;
-  double omega_m= cosmology_omega_m();
-  
-  gsl_function F;
-  F.function= &fun;
-  F.params= &omega_m;
-  
-  gsl_integration_qag(&F, ai, af, 0, 1e-5, n_workspace, 6,
-		      w, &result, &error); 
-  
-  gsl_integration_workspace_free(w);
-     
-  return result/pow(av, nLPT);
+  return cosmology_time_integral(ai, af, nLPT)/pow(av, nLPT);
 }
   
 } // unnamed namespace
@@ -3,9 +3,47 @@
 
 #include <vector>
 #include "particle.h"
+#include "step_schedule.h"
+#include "lightcone.h"
 
-void cola_kick(Particles* const particles, const double a_vel1);
-void cola_drift(Particles* const particles, const double a_pos1);
+void cola_kick(Particles* const particles, const double a_vel1,
+	       StepSchedule const * const schedule=0);
+void cola_drift(Particles* const particles, const double a_pos1,
+		StepSchedule const * const schedule=0,
+		Lightcone* const lightcone=0);
+void cola_step(Particles* const particles,
+	       const double a_vel1, const double a_pos1,
+	       StepSchedule const * const schedule=0,
+	       Lightcone* const lightcone=0);
+
+// Same for the structure-of-arrays layout
+void cola_kick(ParticlesSoA* const particles, const double a_vel1,
+	       StepSchedule const * const schedule=0);
+void cola_drift(ParticlesSoA* const particles, const double a_pos1,
+		StepSchedule const * const schedule=0,
+		Lightcone* const lightcone=0);
+void cola_step(ParticlesSoA* const particles,
+	       const double a_vel1, const double a_pos1,
+	       StepSchedule const * const schedule=0,
+	       Lightcone* const lightcone=0);
+
+// Particles i in [ibegin, iend) at a_out within the next step, kick to
+// a_vel1 followed by drift to a_out, written to out[i - ibegin] without
+// changing particles; v is the usual velocity (not LPT subtracted)
+void cola_interpolate(Particles const * const particles,
+		      const double a_vel1, const double a_out,
+		      const size_t ibegin, const size_t iend,
+		      Particle* const out);
+void cola_interpolate(ParticlesSoA const * const particles,
+		      const double a_vel1, const double a_out,
+		      const size_t ibegin, const size_t iend,
+		      Particle* const out);
+
+void cola_kick_factors(const double ai, const double a, const double af,
+		       Float* const kick_factor, Float* const q1, Float* const q2);
+void cola_drift_factors(const double ai, const double af, const double av,
+			Float* const dt, Float* const da1, Float* const da2);
 std::vector<Float> cola_velocity(Particles const * const particles);
+std::vector<Float> cola_velocity(ParticlesSoA const * const particles);
 
 #endif
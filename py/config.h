@@ -30,6 +30,24 @@ typedef float Float;
 
 #endif
 
+// MPI and HDF5 types for precision T, for classes templated on the
+// precision; FLOAT_TYPE etc. above are those for Float
+template<class T> struct PrecisionTraits;
+
+template<> struct PrecisionTraits<float> {
+  static MPI_Datatype mpi_type() { return MPI_FLOAT; }
+  static hid_t mem_type() { return H5T_NATIVE_FLOAT; }
+  static hid_t save_type() { return H5T_IEEE_F32LE; }
+  static const char* name() { return "single"; }
+};
+
+template<> struct PrecisionTraits<double> {
+  static MPI_Datatype mpi_type() { return MPI_DOUBLE; }
+  static hid_t mem_type() { return H5T_NATIVE_DOUBLE; }
+  static hid_t save_type() { return H5T_IEEE_F64LE; }
+  static const char* name() { return "double"; }
+};
+
 typedef Float Float3[3];
 typedef int   Index;
 // number of particles in one MPI node must not overflow Index
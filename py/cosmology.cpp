@@ -2,11 +2,16 @@
 // Analytical functions in cosmology, e.g. linear growth rate
 // Flat Lambda CDM assumed
 //
+// D(a), f(a), and the time integrals are tabulated in log a at
+// cosmology_init and evaluated with cubic splines; outside the table,
+// a < a_min or a > a_max, they are integrated directly.
+//
 
 #include <math.h>
 #include <assert.h>
 #include <gsl/gsl_math.h>
 #include <gsl/gsl_integration.h>
+#include <gsl/gsl_spline.h>
 #include "msg.h"
 #include "const.h"
 #include "cosmology.h"
@@ -16,9 +21,33 @@ namespace {
   double omega_m0;
   double growth_normalisation;
 
+  // Tables in log a, used for a_min <= a <= a_max. The tables extend
+  // beyond that range, where the natural spline boundary loses precision
+  const double a_min= 1.0e-4;
+  const double a_max= 1.5;
+  const double a_table_min= 0.5e-4;
+  const double a_table_max= 2.0;
+  const int n_table= 1001;
+
+  // Time integrals \int a^n/(a^3 H) da are tabulated for these n
+  const int n_time= 3;
+  const double time_n[]= {0.0, 1.0, -2.5};
+
+  gsl_spline* spline_log_D= 0;
+  gsl_spline* spline_f= 0;
+  gsl_spline* spline_time[n_time]= {0, 0, 0};
+  // gsl_interp_accel is not used, so that the splines are thread safe
+
   void check_initialisation();
   double growth_integrand(double a, void* param);
   double growth_unnormalised(const double a);
+  double growth_rate_direct(const double a, const double d_un);
+  double time_integrand(double a, void* param);
+  double time_integral_direct(const double ai, const double af,
+			      const double n);
+  void init_tables();
+  void free_tables();
+  bool in_table(const double a);
 }
 
 void cosmology_init(const double omega_m0_)
@@ -28,6 +57,8 @@ void cosmology_init(const double omega_m0_)
   msg_printf(msg_info, "Cosmology initialised with omega_m = %.7f\n", omega_m0);
 
   growth_normalisation= 1.0/growth_unnormalised(1.0); // D_growth=1 at a=1
+
+  init_tables();
 }
 
 double cosmology_D_growth(const double a)
@@ -35,6 +66,9 @@ double cosmology_D_growth(const double a)
   check_initialisation();
   // Linear growth factor D
   if(a == 0.0) return 0.0;
+
+  if(in_table(a))
+    return exp(gsl_spline_eval(spline_log_D, log(a), 0));
   
   return growth_normalisation*growth_unnormalised(a);
 }
@@ -70,17 +104,51 @@ double cosmology_D2a_growth(const double D1, const double D2)
   return D2 - D1*D1;
 }
 
+double cosmology_D3a_growth(const double a, const double D)
+{
+  // 3rd-order growth factor for Psi(3a), div Psi(3a) = det Psi_i,j
+  // Omega dependence from Bouchet et al. (1995)
+  if(a == 0.0) return 0.0;
+
+  return -1.0/3.0*D*D*D*pow(cosmology_omega(a), -4.0/275.0);
+}
+
+double cosmology_D3b_growth(const double a, const double D)
+{
+  // 3rd-order growth factor for Psi(3b), the Psi - Psi(2) coupling
+  if(a == 0.0) return 0.0;
+
+  return 10.0/21.0*D*D*D*pow(cosmology_omega(a), -269.0/17875.0);
+}
+
+double cosmology_D3c_growth(const double a, const double D)
+{
+  // 3rd-order growth factor for the transverse part Psi(3c)
+  if(a == 0.0) return 0.0;
+
+  return -1.0/7.0*D*D*D*pow(cosmology_omega(a), -2.0/143.0);
+}
+
+double cosmology_D3v_growth(const double a, const double D3)
+{
+  // dD3/dlna ~ 3 f D3
+  double H= cosmology_hubble_function(a);
+  double f= cosmology_f_growth_rate(a);
+
+  return 3.0*a*a*D3*H*f;
+}
+
 double cosmology_f_growth_rate(const double a)
 {
   check_initialisation();
 
   if(a == 0.0) return 1.0;
-  
-  // Linear growth rate f=dlnD/dlna
-  const double d_un= growth_unnormalised(a);
-  const double hf= cosmology_hubble_function(a);
 
-  return 1.0/(d_un*a*a*hf*hf) - 1.5*omega_m0/(hf*hf*a*a*a);   
+  // Linear growth rate f=dlnD/dlna
+  if(in_table(a))
+    return gsl_spline_eval(spline_f, log(a), 0);
+  
+  return growth_rate_direct(a, growth_unnormalised(a));
 }  
 
 
@@ -96,11 +164,38 @@ void cosmology_growth(const double a,
     return;
   }
   
+  if(in_table(a)) {
+    *D_result= exp(gsl_spline_eval(spline_log_D, log(a), 0));
+    *f_result= gsl_spline_eval(spline_f, log(a), 0);
+    return;
+  }
+  
   const double d_un= growth_unnormalised(a);
-  const double hf= cosmology_hubble_function(a);
 
   *D_result= growth_normalisation*d_un;
-  *f_result= 1.0/(d_un*a*a*hf*hf) - 1.5*omega_m0/(hf*hf*a*a*a);   
+  *f_result= growth_rate_direct(a, d_un);
+}
+
+double cosmology_time_integral(const double ai, const double af,
+			       const double n)
+{
+  // \int_ai^af a^n/(a^3 H(a)/H0) da
+  //   n = 0: drift, \int dt/a^2
+  //   n = 1: kick,  \int dt/a
+  //   n = -2.5: COLA drift
+  check_initialisation();
+
+  if(in_table(ai) && in_table(af)) {
+    for(int i=0; i<n_time; i++) {
+      if(n == time_n[i]) {
+	// The table is \int_a^a_table_max
+	return gsl_spline_eval(spline_time[i], log(ai), 0) -
+	       gsl_spline_eval(spline_time[i], log(af), 0);
+      }
+    }
+  }
+
+  return time_integral_direct(ai, af, n);
 }
 
 double cosmology_hubble_function(const double a)
@@ -109,6 +204,12 @@ double cosmology_hubble_function(const double a)
   return sqrt(omega_m0/(a*a*a) + (1 - omega_m0));
 }
 
+double cosmology_comoving_distance(const double a)
+{
+  // Comoving distance to a [1/h Mpc], c/H0 \int_a^1 da/(a^2 H(a)/H0)
+  return c::cH0inv*cosmology_time_integral(a, 1.0, 1.0);
+}
+
 double cosmology_omega(const double a)
 {
   // Omega_m(a)
@@ -131,6 +232,62 @@ double cosmology_rho_m()
 
 namespace {
 
+bool in_table(const double a)
+{
+  return spline_log_D && a_min <= a && a <= a_max;
+}
+
+void init_tables()
+{
+  // Tabulate log D, f, and the time integrals in log a
+  free_tables();
+  
+  double log_a[n_table], y[n_table];
+  const double dlog_a= (log(a_table_max) - log(a_table_min))/(n_table - 1);
+  for(int i=0; i<n_table; i++)
+    log_a[i]= log(a_table_min) + i*dlog_a;
+  log_a[n_table - 1]= log(a_table_max);
+
+  double f[n_table];
+  for(int i=0; i<n_table; i++) {
+    const double a= exp(log_a[i]);
+    const double d_un= growth_unnormalised(a);
+    y[i]= log(growth_normalisation*d_un);
+    f[i]= growth_rate_direct(a, d_un);
+  }
+
+  spline_log_D= gsl_spline_alloc(gsl_interp_cspline, n_table);
+  gsl_spline_init(spline_log_D, log_a, y, n_table);
+
+  spline_f= gsl_spline_alloc(gsl_interp_cspline, n_table);
+  gsl_spline_init(spline_f, log_a, f, n_table);
+
+  // \int_a^a_table_max, accumulated from the end, so that the difference
+  // for a short interval does not lose precision at large a
+  for(int j=0; j<n_time; j++) {
+    y[n_table - 1]= 0.0;
+    for(int i=n_table-2; i>=0; i--)
+      y[i]= y[i + 1] + time_integral_direct(exp(log_a[i]),
+					    exp(log_a[i + 1]), time_n[j]);
+
+    spline_time[j]= gsl_spline_alloc(gsl_interp_cspline, n_table);
+    gsl_spline_init(spline_time[j], log_a, y, n_table);
+  }
+
+  msg_printf(msg_verbose, "Cosmology tables computed for %e <= a <= %e\n",
+	     a_min, a_max);
+}
+
+void free_tables()
+{
+  gsl_spline_free(spline_log_D); spline_log_D= 0;
+  gsl_spline_free(spline_f);     spline_f= 0;
+  for(int j=0; j<n_time; j++) {
+    gsl_spline_free(spline_time[j]);
+    spline_time[j]= 0;
+  }
+}
+
 void check_initialisation()
 {
   // Check if this module is initilised
@@ -170,4 +327,41 @@ double growth_unnormalised(const double a)
   return cosmology_hubble_function(a) * result;
 }
 
+double growth_rate_direct(const double a, const double d_un)
+{
+  // f = dlnD/dlna from unnormalised D(a)
+  const double hf= cosmology_hubble_function(a);
+
+  return 1.0/(d_un*a*a*hf*hf) - 1.5*omega_m0/(hf*hf*a*a*a);   
+}
+
+double time_integrand(double a, void* param)
+{
+  // a^n/(a^3 H(a)/H0)
+  const double n= *(double*) param;
+  return pow(a, n)/(sqrt(omega_m0/(a*a*a) + 1.0 - omega_m0)*a*a*a);
+}
+
+double time_integral_direct(const double ai, const double af, const double n)
+{
+  assert(ai > 0.0);
+  const size_t worksize= 1000;
+
+  gsl_integration_workspace* workspace=
+    gsl_integration_workspace_alloc(worksize);
+
+  double nn= n;
+  gsl_function F;
+  F.function= &time_integrand;
+  F.params= &nn;
+
+  double result, abserr;
+  gsl_integration_qag(&F, ai, af, 0, 1.0e-8, worksize, GSL_INTEG_GAUSS41,
+		      workspace, &result, &abserr);
+
+  gsl_integration_workspace_free(workspace);
+
+  return result;
+}
+
 }
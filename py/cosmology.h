@@ -8,12 +8,19 @@ double cosmology_D2_growth(const double a, const double D);
 double cosmology_Dv_growth(const double a, const double D);
 double cosmology_D2v_growth(const double a, const double D2);
 double cosmology_D2a_growth(const double D1, const double D2);
+double cosmology_D3a_growth(const double a, const double D);
+double cosmology_D3b_growth(const double a, const double D);
+double cosmology_D3c_growth(const double a, const double D);
+double cosmology_D3v_growth(const double a, const double D3);
 
 void   cosmology_growth(const double a, double* const D, double* const f);
 
 double cosmology_f_growth_rate(const double a);
+double cosmology_time_integral(const double ai, const double af,
+			       const double n);
 
 double cosmology_hubble_function(const double a);
+double cosmology_comoving_distance(const double a);
 double cosmology_omega(const double a);
 
 double cosmology_omega_m();
@@ -15,27 +15,122 @@
 
 using namespace std;
 
+namespace {
+//
+// FFTW functions for precision T
+//
+template<class T> struct FFTWLib;
+
+template<> struct FFTWLib<float> {
+  typedef FFTWTypes<float>::complex complex;
+  typedef FFTWTypes<float>::plan    plan;
+
+  static ptrdiff_t local_size_many(const ptrdiff_t n[], const ptrdiff_t howmany,
+				   ptrdiff_t* local_nx, ptrdiff_t* local_ix0) {
+    return fftwf_mpi_local_size_many(3, n, howmany, FFTW_MPI_DEFAULT_BLOCK,
+				     MPI_COMM_WORLD, local_nx, local_ix0);
+  }
+  static ptrdiff_t local_size_many_transposed(const ptrdiff_t n[],
+	     const ptrdiff_t howmany, ptrdiff_t* local_nx, ptrdiff_t* local_ix0,
+	     ptrdiff_t* local_nky, ptrdiff_t* local_iky0) {
+    return fftwf_mpi_local_size_many_transposed(3, n, howmany,
+	     FFTW_MPI_DEFAULT_BLOCK, FFTW_MPI_DEFAULT_BLOCK, MPI_COMM_WORLD,
+	     local_nx, local_ix0, local_nky, local_iky0);
+  }
+  static plan plan_r2c(const ptrdiff_t nr[], const ptrdiff_t howmany,
+		       float* fx, complex* fk, const unsigned flags) {
+    return fftwf_mpi_plan_many_dft_r2c(3, nr, howmany,
+	     FFTW_MPI_DEFAULT_BLOCK, FFTW_MPI_DEFAULT_BLOCK,
+	     fx, fk, MPI_COMM_WORLD, flags);
+  }
+  static plan plan_c2r(const ptrdiff_t nr[], const ptrdiff_t howmany,
+		       complex* fk, float* fx, const unsigned flags) {
+    return fftwf_mpi_plan_many_dft_c2r(3, nr, howmany,
+	     FFTW_MPI_DEFAULT_BLOCK, FFTW_MPI_DEFAULT_BLOCK,
+	     fk, fx, MPI_COMM_WORLD, flags);
+  }
+  static void execute_r2c(plan p, float* fx, complex* fk) {
+    fftwf_mpi_execute_dft_r2c(p, fx, fk);
+  }
+  static void execute_c2r(plan p, complex* fk, float* fx) {
+    fftwf_mpi_execute_dft_c2r(p, fk, fx);
+  }
+  static void destroy_plan(plan p) {
+    fftwf_destroy_plan(p);
+  }
+};
 
-FFT::FFT(const char name[], const int nc_, Mem* mem, const bool transposed) :
-  nc(nc_), mode(fft_mode_unknown), own_mem(nullptr)
+template<> struct FFTWLib<double> {
+  typedef FFTWTypes<double>::complex complex;
+  typedef FFTWTypes<double>::plan    plan;
+
+  static ptrdiff_t local_size_many(const ptrdiff_t n[], const ptrdiff_t howmany,
+				   ptrdiff_t* local_nx, ptrdiff_t* local_ix0) {
+    return fftw_mpi_local_size_many(3, n, howmany, FFTW_MPI_DEFAULT_BLOCK,
+				    MPI_COMM_WORLD, local_nx, local_ix0);
+  }
+  static ptrdiff_t local_size_many_transposed(const ptrdiff_t n[],
+	     const ptrdiff_t howmany, ptrdiff_t* local_nx, ptrdiff_t* local_ix0,
+	     ptrdiff_t* local_nky, ptrdiff_t* local_iky0) {
+    return fftw_mpi_local_size_many_transposed(3, n, howmany,
+	     FFTW_MPI_DEFAULT_BLOCK, FFTW_MPI_DEFAULT_BLOCK, MPI_COMM_WORLD,
+	     local_nx, local_ix0, local_nky, local_iky0);
+  }
+  static plan plan_r2c(const ptrdiff_t nr[], const ptrdiff_t howmany,
+		       double* fx, complex* fk, const unsigned flags) {
+    return fftw_mpi_plan_many_dft_r2c(3, nr, howmany,
+	     FFTW_MPI_DEFAULT_BLOCK, FFTW_MPI_DEFAULT_BLOCK,
+	     fx, fk, MPI_COMM_WORLD, flags);
+  }
+  static plan plan_c2r(const ptrdiff_t nr[], const ptrdiff_t howmany,
+		       complex* fk, double* fx, const unsigned flags) {
+    return fftw_mpi_plan_many_dft_c2r(3, nr, howmany,
+	     FFTW_MPI_DEFAULT_BLOCK, FFTW_MPI_DEFAULT_BLOCK,
+	     fk, fx, MPI_COMM_WORLD, flags);
+  }
+  static void execute_r2c(plan p, double* fx, complex* fk) {
+    fftw_mpi_execute_dft_r2c(p, fx, fk);
+  }
+  static void execute_c2r(plan p, complex* fk, double* fx) {
+    fftw_mpi_execute_dft_c2r(p, fk, fx);
+  }
+  static void destroy_plan(plan p) {
+    fftw_destroy_plan(p);
+  }
+};
+}
+
+
+template<class T>
+FFTT<T>::FFTT(const char name[], const int nc_, Mem* mem,
+	      const bool transposed, const int howmany_) :
+  nc(nc_), howmany(howmany_), mode(fft_mode_unknown), own_mem(nullptr)
 {
   // Allocates memory for FFT real and Fourier space and initilise fftw_plans
+  //
+  // howmany > 1 transforms that many fields with one plan, so that all of
+  // them share one MPI communication. The fields are interleaved:
+  // component i of grid point index is at fx[index*howmany + i]
+  // (fk likewise).
   assert(nc > 0);
+  assert(howmany > 0);
 
   msg_printf(msg_verbose, "Setting up FFT %s with FFTW_MEASURE\n", name);
+
+  const ptrdiff_t n[]= {(ptrdiff_t) nc, (ptrdiff_t) nc, (ptrdiff_t) nc/2+1};
   
   if(transposed) {
-    ncomplex= FFTW(mpi_local_size_3d_transposed)(nc, nc, nc/2+1, MPI_COMM_WORLD,
+    ncomplex= FFTWLib<T>::local_size_many_transposed(n, howmany,
 	                 &local_nx, &local_ix0,
 			 &local_nky, &local_iky0);
   }
   else {
-    ncomplex= FFTW(mpi_local_size_3d)(nc, nc, nc/2+1, MPI_COMM_WORLD,
-			    &local_nx, &local_ix0);
+    ncomplex= FFTWLib<T>::local_size_many(n, howmany,
+					  &local_nx, &local_ix0);
     local_nky= local_iky0= 0;
   }
 
-  size_t size= sizeof(complex_t)*ncomplex;
+  size_t size= sizeof(Complex)*ncomplex;
   assert(local_nx >= 0); assert(local_ix0 >= 0);
   
     
@@ -47,12 +142,14 @@ FFT::FFT(const char name[], const int nc_, Mem* mem, const bool transposed) :
   void* buf= mem->use_remaining(size);
   // Call mem_use_from_zero(mem, 0) before this to use mem from the beginning.
 
-  fx= (Float*) buf; fk= (complex_t*) buf;
+  fx= (T*) buf; fk= (Complex*) buf;
+
+  const ptrdiff_t nr[]= {(ptrdiff_t) nc, (ptrdiff_t) nc, (ptrdiff_t) nc};
 
   unsigned flag= 0;
   if(transposed) flag= FFTW_MPI_TRANSPOSED_OUT;
-  forward_plan= FFTW(mpi_plan_dft_r2c_3d)(nc, nc, nc, fx, fk,
-					  MPI_COMM_WORLD, FFTW_MEASURE | flag);
+  forward_plan= FFTWLib<T>::plan_r2c(nr, howmany, fx, fk,
+				     FFTW_MEASURE | flag);
 
   unsigned flag_inv= 0;
   if(transposed) {
@@ -60,16 +157,17 @@ FFT::FFT(const char name[], const int nc_, Mem* mem, const bool transposed) :
     msg_printf(msg_debug, "FFTW transposed in/out\n");
   }
   
-  inverse_plan= FFTW(mpi_plan_dft_c2r_3d)(nc, nc, nc, fk, fx,
-                                     MPI_COMM_WORLD, FFTW_MEASURE | flag_inv);
+  inverse_plan= FFTWLib<T>::plan_c2r(nr, howmany, fk, fx,
+				     FFTW_MEASURE | flag_inv);
 }
 
 
-FFT::~FFT()
+template<class T>
+FFTT<T>::~FFTT()
 {
   if(comm_status() == comm_parallel) {
-    FFTW(destroy_plan)(forward_plan);
-    FFTW(destroy_plan)(inverse_plan);
+    FFTWLib<T>::destroy_plan(forward_plan);
+    FFTWLib<T>::destroy_plan(inverse_plan);
   }
 
   if(own_mem)
@@ -77,7 +175,8 @@ FFT::~FFT()
 }
 
 
-void FFT::execute_forward()
+template<class T>
+void FFTT<T>::execute_forward()
 {
   if(mode != fft_mode_x) {
     msg_printf(msg_warn,
@@ -85,10 +184,11 @@ void FFT::execute_forward()
 	       name, mode, fft_mode_x);
     throw FFTError();
   }
-  FFTW(mpi_execute_dft_r2c)(forward_plan, fx, fk);
+  FFTWLib<T>::execute_r2c(forward_plan, fx, fk);
 }
 
-void FFT::execute_inverse()
+template<class T>
+void FFTT<T>::execute_inverse()
 {
   if(mode != fft_mode_k) {
     msg_printf(msg_warn,
@@ -96,26 +196,32 @@ void FFT::execute_inverse()
 	       name, mode, fft_mode_x);
     throw FFTError();
   }
-  FFTW(mpi_execute_dft_c2r)(inverse_plan, fk, fx);
+  FFTWLib<T>::execute_c2r(inverse_plan, fk, fx);
 }
 
 
-size_t fft_mem_size(const int nc, const int transposed)
+template<class T>
+size_t fft_mem_size(const int nc, const int transposed, const int howmany)
 {
-  // return the memory size necessary for the 3D FFT
+  // return the memory size necessary for the 3D FFT of howmany fields
   ptrdiff_t local_nx, local_ix0, local_nky, local_iky0;
+  const ptrdiff_t n[]= {nc, nc, nc/2+1};
 
-  ptrdiff_t n= 0;
+  ptrdiff_t size= 0;
   if(transposed)
-    n= FFTW(mpi_local_size_3d_transposed)(nc, nc, nc/2+1, MPI_COMM_WORLD,
+    size= FFTWLib<T>::local_size_many_transposed(n, howmany,
 	           &local_nx, &local_ix0, &local_nky, &local_iky0);
   else
-    n= FFTW(mpi_local_size_3d)(nc, nc, nc/2+1, MPI_COMM_WORLD,
-				      &local_nx, &local_ix0);
+    size= FFTWLib<T>::local_size_many(n, howmany, &local_nx, &local_ix0);
 
-  return size_align(sizeof(complex_t)*n);
+  return size_align(sizeof(typename FFTWTypes<T>::complex)*size);
 }
 
+template class FFTT<float>;
+template class FFTT<double>;
+template size_t fft_mem_size<float>(const int, const int, const int);
+template size_t fft_mem_size<double>(const int, const int, const int);
+
 
 size_t fft_local_nx(const int nc)
 {
@@ -128,8 +234,10 @@ size_t fft_local_nx(const int nc)
 
 void fft_finalise()
 {
-  if(comm_status() == comm_parallel)
-    FFTW(mpi_cleanup)();
+  if(comm_status() == comm_parallel) {
+    fftwf_mpi_cleanup();
+    fftw_mpi_cleanup();
+  }
 }
 
 void* fft_malloc(size_t size)
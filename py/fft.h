@@ -12,33 +12,60 @@
 #define FFTW(f) fftwf_ ## f
 #endif
 
+// FFTW types for precision T (float or double)
+template<class T> struct FFTWTypes;
+
+template<> struct FFTWTypes<float> {
+  typedef fftwf_complex complex;
+  typedef fftwf_plan    plan;
+};
+
+template<> struct FFTWTypes<double> {
+  typedef fftw_complex complex;
+  typedef fftw_plan    plan;
+};
 
 enum FFTMode {fft_mode_unknown, fft_mode_x, fft_mode_k};
 
-class FFT {
+//
+// 3D MPI FFT with real-space grid of type T; both FFTT<float> and
+// FFTT<double> are compiled, FFT is the one with the default Float
+//
+template<class T>
+class FFTT {
  public:
-  FFT(const char name[], const int nc, Mem* mem, const bool transposed);
-  ~FFT();
+  typedef T Real;
+  typedef typename FFTWTypes<T>::complex Complex;
+  
+  FFTT(const char name[], const int nc, Mem* mem, const bool transposed,
+       const int howmany=1);
+  ~FFTT();
   void execute_forward();
   void execute_inverse();
   
   char*       name;
   //int         nc;
   size_t    nc;
-  Float*    fx;
-  complex_t*  fk;
+  int       howmany; // number of interleaved fields transformed together
+  T*        fx;
+  Complex*  fk;
   ptrdiff_t   local_nx, local_ix0;
   ptrdiff_t   local_nky, local_iky0;
   FFTMode     mode;
  private:
-  FFTW(plan)  forward_plan, inverse_plan;
+  typename FFTWTypes<T>::plan forward_plan, inverse_plan;
   ptrdiff_t   ncomplex;
   Mem*        own_mem; // Allocated memory soley for this FFT
 };
 
+typedef FFTT<Float> FFT;
+
 class FFTError{};
 
-size_t fft_mem_size(const int nc, const int transposed);
+// Memory for FFTT<T>
+template<class T=Float>
+size_t fft_mem_size(const int nc, const int transposed,
+		    const int howmany=1);
 size_t fft_local_nx(const int nc);
   
 void fft_finalize();
@@ -1,10 +1,20 @@
 #include <iostream>
+#include <cmath>
 #include <vector>
-#include <queue>
+#include <algorithm>
+#include <unordered_map>
 #include <cassert>
+#include <mpi.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "msg.h"
+#include "comm.h"
+#include "error.h"
+#include "util.h"
 #include "kdtree.h"
+#include "fof.h"
 
 using namespace std;
 
@@ -13,10 +23,34 @@ static Float boxsize= 0, half_boxsize;
 static Float ll, ll2;
 static vector<Index> grp;
 static vector<Index> nfof;
-static queue<Index> q;
-static Particle const * p;
+static KdPoint const * p;   // positions in the kdtree order
 static size_t n_reserve= 0;
 
+// leaf_linked[l]: all particles in kdtree leaf l are in one group
+static vector<char> leaf_linked;
+
+// Group members in the CSR format
+static vector<Index> member_offsets, members, group_roots;
+
+// Grid FoF; points of cell c are cell_points[cell_begin[c]:cell_begin[c+1]]
+static int nc_cell;
+static vector<KdPoint> cell_points;
+static vector<Index> cell_begin;
+
+// Distributed FoF
+struct FofParticle {
+  Float x[3];
+  uint64_t id;
+};
+
+struct HaloCount {
+  uint64_t id, nfof;
+  bool operator<(const HaloCount& h) const { return id < h.id; }
+};
+
+static vector<uint64_t> group_id;
+static vector<uint64_t> halo_id, halo_nfof;
+
 static inline Float periodic_dx(Float dx)
 {
   dx= dx < -half_boxsize ? dx + boxsize : dx;
@@ -35,25 +69,86 @@ static inline Float dist2(const Float x[], const Float y[])
   return dx*dx + dy*dy + dz*dz;
 }
 
-static void link_particles_recursive(const size_t inode, const Index i);
+static inline Index find_root(Index i)
+{
+  // Root of the group of particle i with path halving
+  // Other threads may rewrite grp[i] concurrently, but only with one of
+  // its ancestors, so the path is always valid
+  while(grp[i] != i) {
+    const Index parent= grp[i];
+    grp[i]= grp[parent];
+    i= parent;
+  }
+
+  return i;
+}
+
+static inline void link(Index i, Index j)
+{
+  // Merge the groups of particles i and j; the larger root is attached
+  // to the smaller, so that the root is the smallest index in the group
+  while(true) {
+    i= find_root(i);
+    j= find_root(j);
+    if(i == j)
+      return;
+    if(i > j)
+      swap(i, j);
+#ifdef _OPENMP
+    if(__sync_bool_compare_and_swap(&grp[j], j, i))
+      return;
+#else
+    grp[j]= i;
+    return;
+#endif
+  }
+}
+
+static inline void atomic_min(Index& x, const Index y)
+{
+  // x= min(x, y); x may be updated by other threads concurrently
+#ifdef _OPENMP
+  Index x0= x;
+  while(y < x0 && !__sync_bool_compare_and_swap(&x, x0, y))
+    x0= x;
+#else
+  if(y < x)
+    x= y;
+#endif
+}
+
+static void link_leaf(const Index l);
+static void link_leaf_pair(const Index l, const Index m);
+static Index find_groups_local(const Index n);
+static void grid_sort(Particle const * const particles_p, const Index n);
+static Index find_groups_grid(const Index n);
+static Index count_roots(const Index n);
+template<class T>
+static void exchange(vector<T> const& sendbuf, vector<int> const& nsend,
+		     vector<T>& recvbuf, vector<int>& nrecv);
 
 
 
 void fof_find_groups(Particles* const particles,
 		     const Float linking_length,
 		     Float const * const boxsize3,
-		     const int quota)
+		     const int quota, const bool permute,
+		     const FofMethod method, const bool update_tree)
 {
   // Apply Friends-of-Friends (FoF) halo finder on particles
   // A pair of particles x and y will be in the same member if
   // |x - y| < linking_length
-  // particles will be suffled by kdtree_init()
+  // particles will be suffled by kdtree_init() if permute is true and
+  // method is kdtree; the group number of a particle is the smallest
+  // particle index in its group in any case
+  // update_tree: update the kdtree of the previous call with
+  //              kdtree_update() instead of kdtree_init(), for particles
+  //              moved but not reordered since; particles are not shuffled
 
   boxsize= particles->boxsize;
   half_boxsize= particles->boxsize / 2;
   ll= linking_length;
   ll2= linking_length*linking_length;
-  assert(q.empty());
 
   msg_printf(msg_info, "Linking length %f\n", ll);
 
@@ -67,33 +162,414 @@ void fof_find_groups(Particles* const particles,
   for(Index i=0; i<n; ++i)
     grp.push_back(i);
 
-  kdtree= kdtree_init(particles, boxsize3, quota);
-  
-  p= particles->p;
-
-  Index ngrp= 0;
+  if(method == FofMethod::grid) {
+    grid_sort(particles->p, n);
+    p= n > 0 ? &cell_points.front() : 0;
 
-  for(Index i=0; i<n; ++i) {
-    if(grp[i] != i)
-      continue; // already belongs to other group
-
-    // Start finding a new FoF group
-    ngrp++;
-    assert(q.empty());
-    q.push(i);
-
-    while(!q.empty()) {
-      // Find friends of particle q.front
-      link_particles_recursive(0, q.front());
-      q.pop();
+    const Index ngrp= find_groups_grid(n);
+    msg_printf(msg_verbose, "FoF grid %d groups found\n", ngrp);
+  }
+  else {
+    if(update_tree) {
+      kdtree_update(particles);
+      kdtree= kdtree_get_root();
     }
+    else
+      kdtree= kdtree_init(particles, boxsize3, quota, permute);
+    p= n > 0 ? &kdtree_get_points().front() : 0;
+
+    const Index ngrp= find_groups_local(n);
+    msg_printf(msg_verbose, "FoF %d groups found\n", ngrp);
+  }
 
-    //nfof.push_back(nfriends);
+  if(method == FofMethod::grid || !permute || update_tree) {
+    // Group numbers in the point order to the smallest particle index in
+    // the group; the root point is not the smallest particle in general
+    vector<Index> grp_tree(grp);
+    vector<Index> grp_min(n);
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared)
+#endif
+    for(Index j=0; j<n; ++j)
+      grp_min[j]= p[j].i;
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared)
+#endif
+    for(Index j=0; j<n; ++j)
+      atomic_min(grp_min[grp_tree[j]], p[j].i);
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared)
+#endif
+    for(Index j=0; j<n; ++j)
+      grp[p[j].i]= grp_min[grp_tree[j]];
   }
 
   //msg_printf(msg_info, "fof %lu groups found.\n", (unsigned long) nfof.size());
 }
 
+//
+// Distributed FoF
+//
+// Node i links the particles in the x slab [i*width, (i + 1)*width),
+// width = boxsize/n_nodes, together with ghost copies of the particles
+// within ll of the slab faces. Two linked particles on different nodes
+// are then ghosts of each other, and the group id -- the smallest
+// particle id in the group -- is exchanged between the ghosts and their
+// originals and propagated through the local groups until no id changes.
+//
+
+static inline int slab_node(const Float x, const Float width, const int n)
+{
+  const int i= static_cast<int>(x/width);
+  return i < 0 ? 0 : (i >= n ? n - 1 : i);
+}
+
+static inline int ghost_nodes(const Float x, const int node,
+			      const Float width, const int n, int ghost[])
+{
+  // Neighbouring nodes that need a ghost copy of particle x in the slab
+  // of node; returns the number of such nodes, 0, 1, or 2
+  if(n == 1)
+    return 0;
+
+  int ng= 0;
+  const int left= (node - 1 + n) % n;
+  const int right= (node + 1) % n;
+  if(x - width*node < ll)
+    ghost[ng++]= left;
+  if(width*(node + 1) - x < ll && !(ng == 1 && ghost[0] == right))
+    ghost[ng++]= right;
+
+  return ng;
+}
+
+void fof_find_groups_mpi(Particles* const particles,
+			 const Float linking_length, const int quota)
+{
+  // Apply FoF on particles distributed over MPI nodes
+  // Groups are identified by the smallest member particle id, which does
+  // not depend on the number of nodes.
+  //
+  // Results:
+  //   fof_group_id()[i]: group id of particles->p[i]
+  //   fof_halo_id(), fof_halo_nfof(): id and the number of members of
+  //     the groups with id % n_nodes == this node, sorted by id
+  //
+  // particles are not reordered
+  const int n_nodes= comm_n_nodes();
+
+  boxsize= particles->boxsize;
+  half_boxsize= particles->boxsize / 2;
+  ll= linking_length;
+  ll2= linking_length*linking_length;
+
+  const Float width= boxsize/n_nodes;
+  if(width < ll) {
+    msg_printf(msg_error,
+	       "Error: slab width %e is smaller than the linking length %e; "
+	       "too many MPI nodes for FoF\n", width, ll);
+    throw ValError();
+  }
+
+  msg_printf(msg_info, "Linking length %f, %d nodes\n", ll, n_nodes);
+
+  //
+  // Send particles to the node of the slab, and ghost copies to the
+  // neighbouring nodes
+  //
+  const Index np= particles->np_local;
+  Particle const * const p_local= particles->p;
+  vector<int> nsend(n_nodes, 0), nsend_ghost(n_nodes, 0);
+  int ghost[2];
+
+  for(Index i=0; i<np; ++i) {
+    const Float x= periodic_wrapup_x(p_local[i].x[0], boxsize);
+    const int node= slab_node(x, width, n_nodes);
+    nsend[node]++;
+
+    const int ng= ghost_nodes(x, node, width, n_nodes, ghost);
+    for(int j=0; j<ng; ++j)
+      nsend_ghost[ghost[j]]++;
+  }
+
+  vector<int> offset(n_nodes, 0), offset_ghost(n_nodes, 0);
+  for(int i=1; i<n_nodes; ++i) {
+    offset[i]= offset[i - 1] + nsend[i - 1];
+    offset_ghost[i]= offset_ghost[i - 1] + nsend_ghost[i - 1];
+  }
+
+  vector<FofParticle> sendbuf(np);
+  vector<FofParticle> sendbuf_ghost(offset_ghost[n_nodes - 1] +
+				    nsend_ghost[n_nodes - 1]);
+  vector<Index> send_index(np); // particle index in the order sent
+
+  for(Index i=0; i<np; ++i) {
+    FofParticle fp;
+    for(int k=0; k<3; ++k)
+      fp.x[k]= periodic_wrapup_x(p_local[i].x[k], boxsize);
+    fp.id= p_local[i].id;
+
+    const int node= slab_node(fp.x[0], width, n_nodes);
+    send_index[offset[node]]= i;
+    sendbuf[offset[node]++]= fp;
+
+    const int ng= ghost_nodes(fp.x[0], node, width, n_nodes, ghost);
+    for(int j=0; j<ng; ++j)
+      sendbuf_ghost[offset_ghost[ghost[j]]++]= fp;
+  }
+
+  vector<FofParticle> recvbuf, recvbuf_ghost;
+  vector<int> nrecv, nrecv_ghost;
+  exchange(sendbuf, nsend, recvbuf, nrecv);
+  exchange(sendbuf_ghost, nsend_ghost, recvbuf_ghost, nrecv_ghost);
+  vector<FofParticle>().swap(sendbuf);
+  vector<FofParticle>().swap(sendbuf_ghost);
+
+  //
+  // Link particles in this slab and ghosts
+  //
+  const Index n_owned= recvbuf.size();
+  const Index n_ghost= recvbuf_ghost.size();
+  const Index n_all= n_owned + n_ghost;
+
+  // Points for the kdtree, which reorders them;
+  // the index of the point is the index in the receive order
+  vector<KdPoint> v(n_all);
+  vector<uint64_t> id(n_all);
+  for(Index i=0; i<n_all; ++i) {
+    FofParticle const& fp=
+      i < n_owned ? recvbuf[i] : recvbuf_ghost[i - n_owned];
+    for(int k=0; k<3; ++k)
+      v[i].x[k]= fp.x[k];
+    v[i].i= i;
+    id[i]= fp.id;
+  }
+
+  grp.clear();
+  for(Index i=0; i<n_all; ++i)
+    grp.push_back(i);
+
+  if(n_all > 0) {
+    kdtree= kdtree_init(v, n_all, 0, quota);
+    p= &v.front();
+    find_groups_local(n_all);
+  }
+
+  // root[i]: local group of particle i in the receive order
+  // label[r]: group id of local group r
+  vector<Index> root(n_all);
+  vector<uint64_t> label(n_all, UINT64_MAX);
+  for(Index j=0; j<n_all; ++j) {
+    const Index i= v[j].i;
+    root[i]= grp[j];
+    label[grp[j]]= min(label[grp[j]], id[i]);
+  }
+  grp.clear();
+  vector<KdPoint>().swap(v);
+
+  // The tree is built on v; free it so that no kdtree query reads v
+  kdtree_free();
+  kdtree= 0;
+  p= 0;
+
+  //
+  // Pair the ghosts with their originals
+  //
+
+  // ghost_order: ghosts ordered by the node of the original
+  vector<int> nghost_orig(n_nodes, 0);
+  for(Index i=0; i<n_ghost; ++i)
+    nghost_orig[slab_node(recvbuf_ghost[i].x[0], width, n_nodes)]++;
+
+  offset.assign(n_nodes, 0);
+  for(int i=1; i<n_nodes; ++i)
+    offset[i]= offset[i - 1] + nghost_orig[i - 1];
+
+  vector<Index> ghost_order(n_ghost);
+  vector<uint64_t> ghost_id(n_ghost), mirror_id;
+  for(Index i=0; i<n_ghost; ++i) {
+    const int node= slab_node(recvbuf_ghost[i].x[0], width, n_nodes);
+    ghost_order[offset[node]]= n_owned + i;
+    ghost_id[offset[node]++]= recvbuf_ghost[i].id;
+  }
+
+  vector<int> nmirror;
+  exchange(ghost_id, nghost_orig, mirror_id, nmirror);
+
+  // mirror[k]: index of the original of the k-th ghost on other nodes
+  unordered_map<uint64_t, Index> face_index;
+  for(Index i=0; i<n_owned; ++i) {
+    if(ghost_nodes(recvbuf[i].x[0], slab_node(recvbuf[i].x[0], width, n_nodes),
+		   width, n_nodes, ghost) > 0)
+      face_index[recvbuf[i].id]= i;
+  }
+
+  const Index n_mirror= mirror_id.size();
+  vector<Index> mirror(n_mirror);
+  for(Index k=0; k<n_mirror; ++k) {
+    unordered_map<uint64_t, Index>::const_iterator it=
+      face_index.find(mirror_id[k]);
+    if(it == face_index.end()) {
+      msg_printf(msg_fatal,
+		 "Error: original of FoF ghost particle %llu not found\n",
+		 (unsigned long long) mirror_id[k]);
+      throw RuntimeError();
+    }
+    mirror[k]= it->second;
+  }
+
+  //
+  // Merge group ids across nodes until no id changes
+  //
+  vector<uint64_t> sendlabel, recvlabel;
+  int iter= 0;
+  long long nchange= 0;
+  do {
+    // ghost -> original
+    sendlabel.resize(n_ghost);
+    for(Index k=0; k<n_ghost; ++k)
+      sendlabel[k]= label[root[ghost_order[k]]];
+    exchange(sendlabel, nghost_orig, recvlabel, nmirror);
+
+    nchange= 0;
+    for(Index k=0; k<n_mirror; ++k) {
+      const Index r= root[mirror[k]];
+      if(recvlabel[k] < label[r]) {
+	label[r]= recvlabel[k];
+	nchange++;
+      }
+    }
+
+    // original -> ghost
+    sendlabel.resize(n_mirror);
+    for(Index k=0; k<n_mirror; ++k)
+      sendlabel[k]= label[root[mirror[k]]];
+    exchange(sendlabel, nmirror, recvlabel, nghost_orig);
+
+    for(Index k=0; k<n_ghost; ++k) {
+      const Index r= root[ghost_order[k]];
+      if(recvlabel[k] < label[r]) {
+	label[r]= recvlabel[k];
+	nchange++;
+      }
+    }
+
+    nchange= comm_sum<long long>(nchange);
+    iter++;
+  } while(nchange > 0);
+
+  msg_printf(msg_verbose, "FoF group ids merged in %d iterations\n", iter);
+
+  //
+  // Return the group ids to the nodes of the particles
+  //
+  sendlabel.resize(n_owned);
+  for(Index i=0; i<n_owned; ++i)
+    sendlabel[i]= label[root[i]];
+
+  exchange(sendlabel, nrecv, recvlabel, nsend);
+  assert(recvlabel.size() == static_cast<size_t>(np));
+
+  group_id.resize(np);
+  for(Index k=0; k<np; ++k)
+    group_id[send_index[k]]= recvlabel[k];
+
+  //
+  // Count the group members on node id % n_nodes
+  //
+  sort(sendlabel.begin(), sendlabel.end());
+
+  vector<HaloCount> counts;
+  for(Index i=0; i<n_owned; ++i) {
+    if(i == 0 || sendlabel[i] != sendlabel[i - 1]) {
+      HaloCount h= {sendlabel[i], 0};
+      counts.push_back(h);
+    }
+    counts.back().nfof++;
+  }
+
+  vector<int> nsend_count(n_nodes, 0);
+  for(vector<HaloCount>::const_iterator h= counts.begin();
+      h != counts.end(); ++h)
+    nsend_count[h->id % n_nodes]++;
+
+  offset.assign(n_nodes, 0);
+  for(int i=1; i<n_nodes; ++i)
+    offset[i]= offset[i - 1] + nsend_count[i - 1];
+
+  vector<HaloCount> sendcount(counts.size()), recvcount;
+  for(vector<HaloCount>::const_iterator h= counts.begin();
+      h != counts.end(); ++h)
+    sendcount[offset[h->id % n_nodes]++]= *h;
+
+  vector<int> nrecv_count;
+  exchange(sendcount, nsend_count, recvcount, nrecv_count);
+  sort(recvcount.begin(), recvcount.end());
+
+  halo_id.clear();
+  halo_nfof.clear();
+  for(vector<HaloCount>::const_iterator h= recvcount.begin();
+      h != recvcount.end(); ++h) {
+    if(halo_id.empty() || halo_id.back() != h->id) {
+      halo_id.push_back(h->id);
+      halo_nfof.push_back(0);
+    }
+    halo_nfof.back() += h->nfof;
+  }
+
+  msg_printf(msg_info, "FoF %lld groups found\n",
+	     comm_sum<long long>(halo_id.size()));
+}
+
+vector<uint64_t>& fof_group_id()
+{
+  return group_id;
+}
+
+vector<uint64_t>& fof_halo_id()
+{
+  return halo_id;
+}
+
+vector<uint64_t>& fof_halo_nfof()
+{
+  return halo_nfof;
+}
+
+template<class T>
+void exchange(vector<T> const& sendbuf, vector<int> const& nsend,
+	      vector<T>& recvbuf, vector<int>& nrecv)
+{
+  // Send nsend[i] elements of sendbuf, ordered by destination, to node i
+  // and receive nrecv[i] elements from node i
+  const int n= comm_n_nodes();
+  nrecv.resize(n);
+  MPI_Alltoall(nsend.data(), 1, MPI_INT, nrecv.data(), 1, MPI_INT,
+	       MPI_COMM_WORLD);
+
+  vector<int> scount(n), sdispl(n), rcount(n), rdispl(n);
+  int soffset= 0, roffset= 0;
+  for(int i=0; i<n; ++i) {
+    scount[i]= sizeof(T)*nsend[i];
+    sdispl[i]= soffset;
+    soffset += scount[i];
+    rcount[i]= sizeof(T)*nrecv[i];
+    rdispl[i]= roffset;
+    roffset += rcount[i];
+  }
+
+  recvbuf.resize(roffset/sizeof(T));
+
+  // warning: MPI_Alltoallv uses int
+  // Error beyond more than 2^31 bytes of data for 4-byte int
+  MPI_Alltoallv(sendbuf.data(), scount.data(), sdispl.data(), MPI_BYTE,
+		recvbuf.data(), rcount.data(), rdispl.data(), MPI_BYTE,
+		MPI_COMM_WORLD);
+}
+
 vector<Index>& fof_compute_nfof()
 {
   // nfof[i] is a vector of number of FoF member particles for
@@ -111,6 +587,126 @@ vector<Index>& fof_compute_nfof()
 
 
 
+size_t fof_compute_members(const Index nfof_min)
+{
+  // Sort particle indices by group with a parallel counting sort
+  // Returns the number of groups with nfof_min members or more
+  const Index n= grp.size();
+  const Index nmin= max(nfof_min, 1);
+
+  // Count; count[i] is the number of members if particle i is a root
+  vector<Index> count(n, 0);
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared)
+#endif
+  for(Index i=0; i<n; ++i) {
+#ifdef _OPENMP
+    #pragma omp atomic
+#endif
+    count[grp[i]]++;
+  }
+
+  // Exclusive scan of groups and members over blocks of roots
+#ifdef _OPENMP
+  const int nblock= omp_get_max_threads();
+#else
+  const int nblock= 1;
+#endif
+  vector<Index> block_ngrp(nblock + 1, 0), block_nmem(nblock + 1, 0);
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared)
+#endif
+  for(int b=0; b<nblock; ++b) {
+    const Index ibegin= (static_cast<size_t>(n)*b)/nblock;
+    const Index iend= (static_cast<size_t>(n)*(b + 1))/nblock;
+    for(Index i=ibegin; i<iend; ++i) {
+      if(count[i] >= nmin) {
+	block_ngrp[b + 1]++;
+	block_nmem[b + 1] += count[i];
+      }
+    }
+  }
+
+  for(int b=0; b<nblock; ++b) {
+    block_ngrp[b + 1] += block_ngrp[b];
+    block_nmem[b + 1] += block_nmem[b];
+  }
+
+  const Index ngrp= block_ngrp[nblock];
+  group_roots.resize(ngrp);
+  member_offsets.resize(ngrp + 1);
+  member_offsets[ngrp]= block_nmem[nblock];
+  members.resize(block_nmem[nblock]);
+
+  // count[i] becomes the group index of root i, or -1
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared)
+#endif
+  for(int b=0; b<nblock; ++b) {
+    const Index ibegin= (static_cast<size_t>(n)*b)/nblock;
+    const Index iend= (static_cast<size_t>(n)*(b + 1))/nblock;
+    Index g= block_ngrp[b], offset= block_nmem[b];
+    for(Index i=ibegin; i<iend; ++i) {
+      if(count[i] >= nmin) {
+	group_roots[g]= i;
+	member_offsets[g]= offset;
+	offset += count[i];
+	count[i]= g++;
+      }
+      else
+	count[i]= -1;
+    }
+  }
+
+  // Scatter
+  vector<Index> fill(member_offsets.begin(), member_offsets.end() - 1);
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared)
+#endif
+  for(Index i=0; i<n; ++i) {
+    const Index g= count[grp[i]];
+    if(g < 0)
+      continue;
+
+    Index j;
+#ifdef _OPENMP
+    #pragma omp atomic capture
+#endif
+    j= fill[g]++;
+    members[j]= i;
+  }
+
+  // The order within a group depends on the threads
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) schedule(dynamic, 64)
+#endif
+  for(Index g=0; g<ngrp; ++g)
+    sort(members.begin() + member_offsets[g],
+	 members.begin() + member_offsets[g + 1]);
+
+  msg_printf(msg_verbose, "FoF %d groups with nfof >= %d\n", ngrp, nmin);
+
+  return ngrp;
+}
+
+vector<Index>& fof_member_offsets()
+{
+  return member_offsets;
+}
+
+vector<Index>& fof_members()
+{
+  return members;
+}
+
+vector<Index>& fof_group_roots()
+{
+  return group_roots;
+}
+
 size_t fof_ngroups()
 {
   return nfof.size();
@@ -128,34 +724,272 @@ vector<Index>& fof_grp()
 
 
 
-void link_particles_recursive(const size_t inode, const Index i)
+Index find_groups_local(const Index n)
 {
-  // Find particles near particle i and add to queue if that particle
-  // is prestine
+  // Link p[0..n) using the kdtree; grp[i] is set to the first member
+  // of the group in the kdtree order. Returns the number of groups
+  //
+  // Each leaf is linked with itself and with the leaves after it whose
+  // bounding boxes come within ll, in parallel over leaves
+  if(n == 0)
+    return 0;
+
+  const Index nleaf= kdtree_get_leaves().size();
+  leaf_linked.assign(nleaf, 0);
+
+#ifdef _OPENMP
+  #pragma omp parallel default(shared)
+#endif
+  {
+    vector<Index> neighbours;
+
+#ifdef _OPENMP
+    #pragma omp for schedule(dynamic, 16)
+#endif
+    for(Index l=0; l<nleaf; ++l) {
+      link_leaf(l);
+
+      kdtree_leaf_neighbours(l, ll, boxsize, neighbours);
+      for(vector<Index>::const_iterator m= neighbours.begin();
+	  m != neighbours.end(); ++m)
+	link_leaf_pair(l, *m);
+    }
+  }
 
-  KdTree const * const tree= kdtree + inode;
-  const int k= tree->k;
-  Float x= p[i].x[k];
+  return count_roots(n);
+}
 
-  if((x < tree->left  - ll && x + boxsize > tree->right + ll) ||
-     (x > tree->right + ll && x - boxsize < tree->left  - ll)) {
+Index count_roots(const Index n)
+{
+  // Set grp[i] to the root of the group and return the number of groups
+  Index ngrp= 0;
 
-    return; // This node is far enough from particle i
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) reduction(+:ngrp)
+#endif
+  for(Index i=0; i<n; ++i) {
+    grp[i]= find_root(i);
+    if(grp[i] == i)
+      ngrp++;
   }
 
-  // Add neightbor particles if inode is a leaf
-  if(tree->iend - tree->ibegin <= KdTree::quota) {
-    for(Index j=tree->ibegin; j<tree->iend; ++j) {
-      if(grp[j] != grp[i] && dist2(p[i].x, p[j].x) < ll2) {
-	q.push(j);
-	grp[j]= grp[i];
+  return ngrp;
+}
+
+void link_leaf(const Index l)
+{
+  // Link pairs of particles within leaf l
+  KdTree const& leaf= kdtree[kdtree_get_leaves()[l]];
+  const Index ibegin= leaf.ibegin;
+
+  if(box_max_dist2(leaf, leaf, boxsize) < ll2) {
+    // All pairs are within ll
+    for(Index i=ibegin + 1; i<leaf.iend; ++i)
+      link(ibegin, i);
+    leaf_linked[l]= 1;
+    return;
+  }
+
+  for(Index i=ibegin; i<leaf.iend; ++i) {
+    for(Index j=i + 1; j<leaf.iend; ++j) {
+      if(dist2(p[i].x, p[j].x) < ll2)
+	link(i, j);
+    }
+  }
+
+  const Index r= find_root(ibegin);
+  for(Index i=ibegin + 1; i<leaf.iend; ++i) {
+    if(find_root(i) != r)
+      return;
+  }
+  leaf_linked[l]= 1;
+}
+
+void link_leaf_pair(const Index l, const Index m)
+{
+  // Link pairs of particles between leaves l and m
+  //
+  // Once a leaf is known to be one group, each particle in the other leaf
+  // needs only one link to it
+  KdTree const& a= kdtree[kdtree_get_leaves()[l]];
+  KdTree const& b= kdtree[kdtree_get_leaves()[m]];
+  const bool linked_a= leaf_linked[l];
+  const bool linked_b= leaf_linked[m];
+
+  if(linked_a && linked_b && find_root(a.ibegin) == find_root(b.ibegin))
+    return; // already in the same group
+
+  if(box_max_dist2(a, b, boxsize) < ll2) {
+    // All pairs are within ll
+    for(Index i=a.ibegin; i<a.iend; ++i)
+      link(i, b.ibegin);
+    for(Index j=b.ibegin + 1; j<b.iend; ++j)
+      link(a.ibegin, j);
+    return;
+  }
+
+  if(linked_a) {
+    for(Index j=b.ibegin; j<b.iend; ++j) {
+      for(Index i=a.ibegin; i<a.iend; ++i) {
+	if(dist2(p[i].x, p[j].x) < ll2) {
+	  link(i, j);
+	  if(linked_b)
+	    return;
+	  break;
+	}
       }
     }
     return;
   }
 
-  // Search subtrees recursively
-  link_particles_recursive(left_child(inode), i);
-  link_particles_recursive(right_child(inode), i);
+  for(Index i=a.ibegin; i<a.iend; ++i) {
+    for(Index j=b.ibegin; j<b.iend; ++j) {
+      if(dist2(p[i].x, p[j].x) < ll2) {
+	link(i, j);
+	if(linked_b)
+	  break;
+      }
+    }
+  }
+}
+
+
+//
+// Grid FoF
+//
+// Particles are sorted into nc_cell^3 cells of size >= ll with a counting
+// sort, as the particle-mesh density assignment, and each cell is linked
+// with itself and with 13 of its 26 neighbours, so that each pair of
+// neighbouring cells is linked once
+//
+
+static inline Index cell_index(const Float x)
+{
+  const Index ix= static_cast<Index>(x*nc_cell/boxsize);
+  return ix < nc_cell ? ix : nc_cell - 1;
 }
 
+void grid_sort(Particle const * const particles_p, const Index n)
+{
+  // Set cell_points, the wrapped positions and particle indices in the
+  // cell order, and cell_begin
+  const Float nc_ll= floor(boxsize/ll);
+  const Float nc_np= floor(cbrt(static_cast<double>(n)));
+  nc_cell= static_cast<int>(min(nc_ll, nc_np));
+  if(nc_cell < 3)
+    nc_cell= 1; // neighbours are not distinct for nc_cell < 3
+
+  const Index ncell= nc_cell*nc_cell*nc_cell;
+  msg_printf(msg_verbose, "FoF grid %d^3 cells\n", nc_cell);
+
+  vector<Index> cell(n);
+  cell_begin.assign(ncell + 1, 0);
+  cell_points.resize(n);
+
+  // Count
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared)
+#endif
+  for(Index i=0; i<n; ++i) {
+    Float x[3];
+    for(int k=0; k<3; ++k)
+      x[k]= periodic_wrapup_x(particles_p[i].x[k], boxsize);
+
+    const Index c= (cell_index(x[0])*nc_cell + cell_index(x[1]))*nc_cell
+                   + cell_index(x[2]);
+    cell[i]= c;
+#ifdef _OPENMP
+    #pragma omp atomic
+#endif
+    cell_begin[c + 1]++;
+  }
+
+  for(Index c=0; c<ncell; ++c)
+    cell_begin[c + 1] += cell_begin[c];
+
+  // Scatter
+  vector<Index> fill(cell_begin.begin(), cell_begin.end() - 1);
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared)
+#endif
+  for(Index i=0; i<n; ++i) {
+    Index j;
+#ifdef _OPENMP
+    #pragma omp atomic capture
+#endif
+    j= fill[cell[i]]++;
+
+    KdPoint& q= cell_points[j];
+    for(int k=0; k<3; ++k)
+      q.x[k]= periodic_wrapup_x(particles_p[i].x[k], boxsize);
+    q.i= i;
+  }
+
+  // The order within a cell depends on the threads; sort by particle
+  // index for reproducible group numbers
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) schedule(dynamic, 64)
+#endif
+  for(Index c=0; c<ncell; ++c)
+    sort(cell_points.begin() + cell_begin[c],
+	 cell_points.begin() + cell_begin[c + 1],
+	 [](KdPoint const& a, KdPoint const& b) { return a.i < b.i; });
+}
+
+static void link_cell_pair(const Index c, const Index d)
+{
+  // Link particles in cell c with those in cell d != c
+  for(Index i=cell_begin[c]; i<cell_begin[c + 1]; ++i) {
+    for(Index j=cell_begin[d]; j<cell_begin[d + 1]; ++j) {
+      if(dist2(p[i].x, p[j].x) < ll2)
+	link(i, j);
+    }
+  }
+}
+
+Index find_groups_grid(const Index n)
+{
+  // Link p[0..n) in the cell order; returns the number of groups
+  if(n == 0)
+    return 0;
+
+  const Index ncell= nc_cell*nc_cell*nc_cell;
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) schedule(dynamic, 64)
+#endif
+  for(Index c=0; c<ncell; ++c) {
+    const Index ibegin= cell_begin[c], iend= cell_begin[c + 1];
+    if(ibegin == iend)
+      continue;
+
+    for(Index i=ibegin; i<iend; ++i) {
+      for(Index j=i + 1; j<iend; ++j) {
+	if(dist2(p[i].x, p[j].x) < ll2)
+	  link(i, j);
+      }
+    }
+
+    if(nc_cell == 1)
+      continue;
+
+    const int ix= c/(nc_cell*nc_cell);
+    const int iy= (c/nc_cell) % nc_cell;
+    const int iz= c % nc_cell;
+
+    // Neighbours (dx, dy, dz) > (0, 0, 0) in the lexicographic order
+    for(int dx=0; dx<=1; ++dx) {
+      for(int dy=(dx == 0 ? 0 : -1); dy<=1; ++dy) {
+	for(int dz=(dx == 0 && dy == 0 ? 1 : -1); dz<=1; ++dz) {
+	  const int jx= (ix + dx + nc_cell) % nc_cell;
+	  const int jy= (iy + dy + nc_cell) % nc_cell;
+	  const int jz= (iz + dz + nc_cell) % nc_cell;
+	  link_cell_pair(c, (jx*nc_cell + jy)*nc_cell + jz);
+	}
+      }
+    }
+  }
+
+  return count_roots(n);
+}
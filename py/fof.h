@@ -3,11 +3,34 @@
 
 #include <vector>
 
+// kdtree: link kdtree leaves; grid: link cells of size >= linking length
+enum class FofMethod {kdtree, grid};
+
 void fof_find_groups(Particles* const particles, const Float linking_length,
-		     Float const * const boxsize3, const int quota=32);
+		     Float const * const boxsize3, const int quota=32,
+		     const bool permute=true,
+		     const FofMethod method=FofMethod::kdtree,
+		     const bool update_tree=false);
 size_t fof_ngroups();
 std::vector<Index>& fof_nfof();
+// grp[i] is the group number of particle i: the smallest particle index
+// in the group, for both methods and with or without permute
 std::vector<Index>& fof_grp();
 std::vector<Index>& fof_compute_nfof();
 
+// Members of the groups with nfof_min particles or more in the compressed
+// sparse row format: particles of group g are
+// fof_members()[fof_member_offsets()[g] .. fof_member_offsets()[g + 1]),
+// in increasing index; fof_group_roots()[g] is the group number in grp
+size_t fof_compute_members(const Index nfof_min=1);
+std::vector<Index>& fof_member_offsets();
+std::vector<Index>& fof_members();
+std::vector<Index>& fof_group_roots();
+
+void fof_find_groups_mpi(Particles* const particles,
+			 const Float linking_length, const int quota=32);
+std::vector<uint64_t>& fof_group_id();
+std::vector<uint64_t>& fof_halo_id();
+std::vector<uint64_t>& fof_halo_nfof();
+
 #endif
@@ -19,7 +19,11 @@
 #include "pm_domain.h"
 #include "leapfrog.h"
 #include "cola.h"
+#include "simulation.h"
+#include "lightcone.h"
 #include "kdtree.h"
+#include "fof.h"
+#include "halo.h"
 
 #include "gadget_file.h"
 #include "hdf5_io.h"
@@ -11,6 +11,9 @@ from .particles import Particles
 from .power import PowerSpectrum
 from .fft import FFT
 from .kdtree import KdTree
+from .step_schedule import StepSchedule
+from .simulation import Simulation
+from .lightcone import Lightcone
 
 #from fs._fs import config_precision
 
@@ -1,5 +1,7 @@
 import fs._fs as c
 from fs.particles import Particles
+from fs.step_schedule import _schedule
+from fs.lightcone import _lightcone
 
 
 """COLA (COmoving Lagrangian Acceleration) is a numerical time integration
@@ -7,23 +9,45 @@ method using Lagrantial Perturbation Theory (LPT).
 """
 
 
-def kick(particles, a_vel):
+def kick(particles, a_vel, schedule=None):
     """Update particle velocities to scale factor a_vel using COLA.
 
     Args:
         particles (Particles).
         a_vel (float): Scale factor after kick.
+        schedule (StepSchedule): precomputed factors (optional).
     """
 
-    c._cola_kick(particles._particles, a_vel)
+    c._cola_kick(particles._particles, a_vel, _schedule(schedule))
 
 
-def drift(particles, a_pos):
+def drift(particles, a_pos, schedule=None, lightcone=None):
     """Update particle positions to scale factor a_pos using COLA.
 
     Args:
         particles (Particles).
         a_pos (float): Scale factor after drift.
+        schedule (StepSchedule): precomputed factors (optional).
+        lightcone (Lightcone): record lightcone crossings (optional).
     """
 
-    c._cola_drift(particles._particles, a_pos)
+    c._cola_drift(particles._particles, a_pos, _schedule(schedule),
+                  _lightcone(lightcone))
+
+
+def step(particles, a_vel, a_pos, schedule=None, lightcone=None):
+    """Kick to a_vel, drift to a_pos, and wrap positions periodically.
+
+    Same as kick(), drift(), and particles.periodic_wrapup() but in one
+    pass over the particles.
+
+    Args:
+        particles (Particles).
+        a_vel (float): Scale factor after kick.
+        a_pos (float): Scale factor after drift.
+        schedule (StepSchedule): precomputed factors (optional).
+        lightcone (Lightcone): record lightcone crossings (optional).
+    """
+
+    c._cola_step(particles._particles, a_vel, a_pos, _schedule(schedule),
+                 _lightcone(lightcone))
@@ -34,4 +34,26 @@ def D2_growth(a):
     """
     return c._cosmology_D2_growth(a)
 
+def f_growth_rate(a):
+    """
+    Linear growth rate f = dlnD/dlna
+    Arg:
+        a (float): scale factor
+
+    Returns:
+        f(a) (float)
+    """
+    return c._cosmology_f_growth_rate(a)
 
+def time_integral(ai, af, n):
+    """
+    Integral \int_ai^af a^n/(a^3 H(a)/H0) da
+
+    Args:
+        ai, af (float): scale factors
+        n (float): power of a; n = 0, 1, -2.5 are tabulated
+
+    Returns:
+        integral (float)
+    """
+    return c._cosmology_time_integral(ai, af, n)
@@ -7,11 +7,16 @@ class FFT:
     Args:
         nc (int): Allocate a new FFT grid with nc grids per dim
         _fft (_FFT): Wrap a C++ FFT pointer
+        precision (str): 'single' or 'double' for a new grid; both are
+                         available regardless of the DOUBLEPRECISION build
     """
 
-    def __init__(self, arg):
+    def __init__(self, arg, precision='single'):
         if isinstance(arg, int):
-            self._fft = c._fft_alloc(arg)
+            if precision not in ('single', 'double'):
+                raise ValueError('precision must be single or double: %s' %
+                                 precision)
+            self._fft = c._fft_alloc(arg, precision == 'double')
         else:
             self._fft = arg
 
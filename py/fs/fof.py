@@ -1,8 +1,10 @@
+import numpy as np
 import fs._fs as c
 from fs.particles import Particles
 
 
-def find_groups(particles, ll, *, quota=32, boxsize3=None, compute_nfof=False):
+def find_groups(particles, ll, *, quota=32, boxsize3=None, compute_nfof=False,
+                permute=True, method='kdtree', update_tree=False):
     """Run FoF halo finder find_groups(particles, ll, boxsize3=None, quota=32)
 
     Args:
@@ -13,13 +15,100 @@ def find_groups(particles, ll, *, quota=32, boxsize3=None, compute_nfof=False):
         boxsize3 (Sequence of 3 floats): Length of the box enclosing particles
                   computed automatically if None (default)
         quota=32 (int): maximum number of particles in kdtree leaves
+        permute=True (bool): reorder particles to the kdtree order;
+                  particles are not changed if False
+        method='kdtree' (str): 'kdtree' or 'grid' (cells of size >= ll);
+                  particles are not reordered by 'grid'
+        update_tree=False (bool): refit the kdtree of the previous call for
+                  moved particles instead of building a new one; particles
+                  must not be reordered since, and are not reordered;
+                  the tree is rebuilt once a particle drifted boxsize/8
+                  out of the box in the unwrapped tree coordinates
 
     Returns:
         nfof: an array of group sizes (number of FoF member particles)
 
     nfof[i] is the number of FoF members of group i (0 <= i < np_local)
     0 if particle i does not represent a group (i.e., belongs to a different group != i)
+    Particles.fof_group[i] is the group of particle i, the smallest particle
+    index among the members, with any method
+
+    Raises:
+        ValueError: with more than one MPI node; use find_groups_mpi
     """
 
     return c._fof_find_groups(particles._particles, ll, boxsize3, quota,
-                              compute_nfof)
+                              compute_nfof, permute, method, update_tree)
+
+
+def find_groups_mpi(particles, ll, *, quota=32):
+    """Run FoF halo finder on particles distributed over MPI nodes
+
+    Args:
+        particles (Particles)
+        ll (float): linking length
+
+    Options:
+        quota=32 (int): maximum number of particles in kdtree leaves
+
+    Returns:
+        (group_id, halo_id, nfof) on node 0; None on other nodes
+        group_id: group id of each particle in the order of particles.id
+        halo_id: array of group ids in increasing order
+        nfof: number of FoF member particles of group halo_id
+
+    The group id is the smallest particle id among the members, which does
+    not depend on the number of MPI nodes. Particle ids must be unique.
+    """
+
+    group_id, halo_id, nfof = c._fof_find_groups_mpi(particles._particles,
+                                                     ll, quota)
+    if group_id is None:
+        return None
+
+    idx = np.argsort(halo_id)
+
+    return group_id, halo_id[idx], nfof[idx]
+
+
+def members(nfof_min=1):
+    """Members of the groups of the last find_groups
+
+    Options:
+        nfof_min=1 (int): minimum number of member particles
+
+    Returns:
+        (offsets, members, roots): particle indices of group g are
+        members[offsets[g]:offsets[g + 1]] in increasing order, and
+        roots[g] is its group number in Particles.fof_group
+    """
+
+    return c._fof_members(nfof_min)
+
+
+def write_halos(particles, filename, *, nfof_min=20, cola=True):
+    """Write the halo catalogue of the groups of the last find_groups
+
+    Args:
+        particles (Particles): particles given to find_groups
+        filename (str): output HDF5 file name
+
+    Options:
+        nfof_min=20 (int): minimum number of member particles
+        cola=True (bool): particle velocities are COLA 2LPT-subtracted
+                  velocities; the 2LPT velocities are added
+
+    Returns:
+        number of halos in this MPI node
+
+    The file has datasets id, nfof, mass, x (centre of mass), v (mean
+    velocity), sigma_v (1-D velocity dispersion), j (angular momentum per
+    unit mass), and inertia (second moments of positions per unit mass,
+    xx, yy, zz, xy, yz, zx).
+
+    Raises:
+        ValueError: with more than one MPI node, or if find_groups was not
+            run on particles
+    """
+
+    return c._fof_write_halos(particles._particles, filename, nfof_min, cola)
@@ -1,3 +1,4 @@
+import numpy as np
 import fs._fs as c
 
 class KdTree:
@@ -16,3 +17,55 @@ class KdTree:
     def right_child(i):
         return 2*i + 2
 
+
+
+def build(particles, *, quota=32):
+    """Build the kdtree of particles for knn and radius_search
+
+    Particles are not reordered; the tree is rebuilt by
+    fof.find_groups(method='kdtree') and freed by fof.find_groups_mpi, and
+    must be rebuilt after particles move. knn and radius_search raise
+    RuntimeError if no tree is built.
+    Positions must be in [0, boxsize) for periodic queries; see
+    Particles.periodic_wrapup()
+    """
+    c._kdtree_init(particles._particles, quota)
+
+
+def knn(x, k, *, boxsize=0.0):
+    """k nearest neighbours of points x in the kdtree
+
+    Args:
+        x (array of shape (n, 3)): query positions
+        k (int): number of neighbours
+
+    Options:
+        boxsize=0.0 (float): periodic box size; not periodic if 0
+
+    Returns:
+        (idx, r): arrays of shape (n, k), particle indices and distances
+        in increasing distance; idx = -1 and r = inf if fewer than k
+        particles exist
+    """
+    x = np.ascontiguousarray(x, dtype=np.float64).reshape(-1, 3)
+
+    return c._kdtree_knn(x, k, boxsize)
+
+
+def radius_search(x, r, *, boxsize=0.0):
+    """Particles within distance r of points x
+
+    Args:
+        x (array of shape (n, 3)): query positions
+        r (float): search radius, smaller than boxsize/2 if periodic
+
+    Options:
+        boxsize=0.0 (float): periodic box size; not periodic if 0
+
+    Returns:
+        (offsets, idx): indices of the particles within r of x[i] are
+        idx[offsets[i]:offsets[i + 1]]
+    """
+    x = np.ascontiguousarray(x, dtype=np.float64).reshape(-1, 3)
+
+    return c._kdtree_radius_search(x, r, boxsize)
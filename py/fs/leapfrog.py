@@ -1,5 +1,7 @@
 import fs._fs as c
 from fs.particles import Particles
+from fs.step_schedule import _schedule
+from fs.lightcone import _lightcone
 
 
 """Leapfrog integration is a numerical method for time integration --
@@ -11,23 +13,27 @@ def set_initial_velocity(particles, a_vel):
     c._leapfrog_initial_velocity(particles._particles, a_vel)
 
 
-def kick(particles, a_vel):
+def kick(particles, a_vel, schedule=None):
     """Update particle velocities to scale factor a_vel
 
     Args:
         particles (Particles)
         a_vel (float): Scale factor after kick.
+        schedule (StepSchedule): precomputed factors (optional).
     """
 
-    c._leapfrog_kick(particles._particles, a_vel)
+    c._leapfrog_kick(particles._particles, a_vel, _schedule(schedule))
 
 
-def drift(particles, a_pos):
+def drift(particles, a_pos, schedule=None, lightcone=None):
     """Update particle positions to scale factor a_pos
 
     Args:
         particles (Particles)
         a_pos (float): Scale factor after drift.
+        schedule (StepSchedule): precomputed factors (optional).
+        lightcone (Lightcone): record lightcone crossings (optional).
     """
 
-    c._leapfrog_drift(particles._particles, a_pos)
+    c._leapfrog_drift(particles._particles, a_pos, _schedule(schedule),
+                      _lightcone(lightcone))
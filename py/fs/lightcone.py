@@ -0,0 +1,37 @@
+import fs._fs as c
+
+
+class Lightcone:
+    """lightcone = Lightcone(filename, boxsize, observer=(0, 0, 0), a_min=0)
+    Past lightcone recorded during drifts.
+
+    Pass the lightcone to fs.cola.drift/step, fs.leapfrog.drift, or
+    fs.Simulation.run; particles crossing the lightcone are written to
+    the HDF5 file with datasets id, a, x, v. Periodic replicas of the box
+    are included.
+
+    Args:
+        filename (str): output HDF5 file name.
+        boxsize (float): length of the periodic box.
+        observer (tuple of float): observer position (x, y, z) at a = 1.
+        a_min (float): no particles crossing the lightcone at a < a_min
+            are recorded.
+    """
+
+    def __init__(self, filename, boxsize, observer=(0.0, 0.0, 0.0),
+                 a_min=0.0):
+        self._lightcone = c._lightcone_alloc(filename, boxsize,
+                                             tuple(observer), a_min)
+
+    def close(self):
+        """Close the file; must be called by all MPI nodes"""
+        c._lightcone_close(self._lightcone)
+
+    @property
+    def np_total(self):
+        """Number of particles written in all MPI nodes"""
+        return c._lightcone_np_total(self._lightcone)
+
+
+def _lightcone(lightcone):
+    return None if lightcone is None else lightcone._lightcone
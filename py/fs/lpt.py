@@ -2,7 +2,8 @@ import fs._fs as c
 from fs.particles import Particles
 
 
-def init(nc, boxsize, a, ps, seed, kind):
+def init(nc, boxsize, a, ps, seed, kind, *,
+         fix_amplitude=False, invert_phase=False):
     """Generate 2LPT displacements and particle positions.
 
     This function generates a random Gaussian initial condition and
@@ -16,15 +17,71 @@ def init(nc, boxsize, a, ps, seed, kind):
         a (float): scale factor at which the positions are computed.
         ps (PowerSpectrum): Linear power spectrum extrapolated to a=1.
         seed (int): random seed for the random Gaussian initial density field
-        kind (str): kind of xv, 'zeldovich', '2lpt', or 'cola'
-                    cola sets v=0
+        kind (str): kind of xv, 'zeldovich', '2lpt', 'cola', '3lpt', or
+                    'cola3lpt'
+                    cola sets v=0; cola3lpt sets v to the 3LPT velocity
+                    minus the 2LPT velocity.
+                    3lpt and cola3lpt need 6 more FFT grids of memory.
+        fix_amplitude (bool): set |delta_k|^2 = P(k) without the random
+                              Rayleigh amplitude (fixed IC).
+        invert_phase (bool): add pi to the phases, i.e., -delta_k; use with
+                             the same seed for the pair of a paired run.
 
     Returns:
         An instance of class Particles.
     """
 
     return Particles(_particles=c._lpt(nc, boxsize, a, seed, ps._ps,
-                                       kind.lower()))
+                                       kind.lower(), fix_amplitude,
+                                       invert_phase))
+
+
+def init_batch(nc, boxsize, a, ps, seeds, kind, f):
+    """Generate LPT particles for many random seeds.
+
+    FFT plans, LPT memory, and particles are reused for all seeds, and the
+    throughput in realizations per hour is reported at the end.
+
+    Args:
+        nc, boxsize, a, ps, kind: same as init().
+        seeds (sequence of int): random seeds.
+        f (callable): f(i, seed, particles) is called for each seed.
+                      particles are overwritten by the next realization
+                      unless f keeps them, e.g., in a list, in which case
+                      they are copied after f returns.
+
+    The LPT memory and FFT plans are freed at the end, as after init().
+    """
+
+    def g(i, seed, _particles):
+        f(i, seed, Particles(_particles=_particles))
+
+    c._lpt_batch(nc, boxsize, a, list(seeds), ps._ps, kind.lower(), g)
+
+
+def write(filename, nc, boxsize, a, ps, seed, kind='2lpt', *,
+          format='hdf5', var='ixv12', use_longid=False):
+    """Generate LPT particles and write them to a file.
+
+    Particles are written plane by plane without creating a Particles
+    object; memory is that of the LPT grids only.
+
+    Args:
+        filename (str): Output file name (file base for gadget).
+        nc, boxsize, a, ps, seed: same as init().
+        kind (str): 'zeldovich', '2lpt', or 'cola'.
+        format (str): 'hdf5' or 'gadget'.
+        var (str): Output variables for hdf5, a subset of 'ixv12';
+                   see Particles.save_hdf5().
+        use_longid (bool): Write 8-byte ID for gadget (default: False)
+
+    Raises:
+        ValueError: for an unsupported kind or format, or a var with
+                    unknown or repeated letters
+    """
+
+    c._lpt_write(nc, boxsize, a, seed, ps._ps, kind.lower(), filename,
+                 format.lower(), var, int(use_longid))
 
 
 def set_offset(offset):
@@ -3,15 +3,24 @@ from fs.particles import Particles
 from fs.fft import FFT
 
 
-def init(nc_pm, pm_factor, boxsize):
+def init(nc_pm, pm_factor, boxsize, precision=None):
     """Initialise pm module.
 
     Args:
         np_pm (int): Number of mesh per dimension
         pm_factor (int): nc_pm/nc -- number of mesh / particle per dimension
         boxsize (float): Length of the periodic box
+        precision (str): 'single' or 'double' for the mesh and FFT;
+            the default is the precision of the build. Particles keep
+            the precision of the build.
     """
-    c._pm_init(nc_pm, pm_factor, boxsize)
+    if precision is None:
+        precision = c.config_precision()
+    if precision not in ('single', 'double'):
+        raise ValueError('precision must be single or double: %s' %
+                         precision)
+
+    c._pm_init(nc_pm, pm_factor, boxsize, precision == 'double')
 
 
 def force(particles):
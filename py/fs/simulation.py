@@ -0,0 +1,72 @@
+import fs._fs as c
+from fs.particles import Particles
+from fs.lightcone import _lightcone
+
+
+class Simulation:
+    """simulation = Simulation(a_init, a_final, nstep, spacing='linear')
+    Time-step driver running all PM steps in one call.
+
+    Args:
+        a_init (float): initial scale factor.
+        a_final (float): final scale factor.
+        nstep (int): number of steps, excluding those added for outputs.
+        spacing (str): 'linear' (uniform in a), 'log' (uniform in log a),
+            or 'mixed' (log for a < a_mid, linear for a > a_mid).
+        a_mid (float): scale factor of the switch for 'mixed'.
+        integrator (str): 'cola' or 'leapfrog'.
+        a_out (sequence of float): scale factors of outputs.
+    """
+
+    def __init__(self, a_init, a_final, nstep, spacing='linear', *,
+                 a_mid=0.0, integrator='cola', a_out=()):
+        self._simulation = c._simulation_alloc(a_init, a_final, nstep,
+                                               spacing, a_mid, integrator)
+        for a in a_out:
+            self.add_output(a)
+
+    def add_output(self, a):
+        """Add an output at scale factor a.
+
+        a is added to the time steps if it is not already a step.
+        """
+        c._simulation_add_output(self._simulation, a)
+
+    def add_snapshot(self, a, filename):
+        """Write particles at scale factor a to an HDF5 file.
+
+        Positions and velocities are interpolated within the step
+        containing a; no step is added for a snapshot. The file has
+        datasets id, x, and v (usual velocities, also for COLA).
+        """
+        c._simulation_add_snapshot(self._simulation, a, filename)
+
+    @property
+    def a_x(self):
+        """Scale factors of positions at the step boundaries"""
+        return c._simulation_a(self._simulation)[0]
+
+    @property
+    def a_vel(self):
+        """Scale factors of velocities after the kicks"""
+        return c._simulation_a(self._simulation)[1]
+
+    def run(self, particles, output=None, lightcone=None):
+        """Evolve particles from a_init to a_final.
+
+        Prerequisite:
+            pm.init()
+
+        Args:
+            particles (Particles): particles at a_init.
+            output: function output(a, particles) called at each output
+                with velocities synchronised to positions.
+            lightcone (Lightcone): record lightcone crossings (optional).
+        """
+        f = None
+        if output is not None:
+            def f(a, _particles):
+                output(a, Particles(_particles=_particles))
+
+        c._simulation_run(self._simulation, particles._particles, f,
+                          _lightcone(lightcone))
@@ -0,0 +1,29 @@
+import fs._fs as c
+
+
+class StepSchedule:
+    """schedule = StepSchedule(a_x0, a_v0, a_vel, a_pos)
+    Kick and drift factors for a sequence of time steps, computed once.
+
+    Step i is kick(a_vel[i]) followed by drift(a_pos[i]). Pass the schedule
+    to fs.cola.kick/drift or fs.leapfrog.kick/drift; a kick or drift not
+    in the schedule is computed directly.
+
+    Args:
+        a_x0 (float): scale factor of initial positions.
+        a_v0 (float): scale factor of initial velocities.
+        a_vel (sequence of float): scale factors after kicks.
+        a_pos (sequence of float): scale factors after drifts.
+    """
+
+    def __init__(self, a_x0, a_v0, a_vel, a_pos):
+        self._schedule = c._step_schedule_alloc(a_x0, a_v0,
+                                                list(a_vel), list(a_pos))
+
+    def __len__(self):
+        """Number of steps"""
+        return c._step_schedule_n(self._schedule)
+
+
+def _schedule(schedule):
+    return None if schedule is None else schedule._schedule
@@ -6,23 +6,28 @@
 #include <cstring>
 #include <cmath>
 #include <cassert>
+#include <vector>
 #include "msg.h"
 #include "comm.h"
 #include "error.h"
 #include "cosmology.h"
 #include "gadget_file.h"
 
+using namespace std;
+
+namespace {
+  void file_name(const char filebase[], char* const filename);
+  void set_header(GadgetHeader* const header,
+		  const int np, const long long np_total,
+		  const double a, const double boxsize, const double h);
+}
+
 void gadget_file_write_particles(const char filebase[],
 				 Particles const * const particles,
 				 int use_long_id, const double h)
 {
   char filename[256];
-  if(comm_n_nodes() == 1) {
-    sprintf(filename, "%s", filebase);
-  }
-  else {
-    sprintf(filename, "%s.%d", filebase, comm_this_node());
-  }
+  file_name(filebase, filename);
 
   FILE* fp= fopen(filename, "w");
   if(fp == 0) {
@@ -33,7 +38,6 @@ void gadget_file_write_particles(const char filebase[],
   Particle* const p= particles->p;
   const int np= particles->np_local;
   const double boxsize= particles->boxsize;
-  const double omega_m= cosmology_omega_m();
 
   if(use_long_id)
     msg_printf(msg_info, "Longid is used for GADGET particles. %d-byte.\n", 
@@ -43,23 +47,8 @@ void gadget_file_write_particles(const char filebase[],
 
   long long np_total= comm_sum<long long>(np);
 
-  GadgetHeader header; assert(sizeof(GadgetHeader) == 256);
-  memset(&header, 0, sizeof(GadgetHeader));
-
-  const double m= cosmology_rho_m()*pow(boxsize, 3.0)/np_total;
-  
-  header.np[1]= np;
-  header.mass[1]= m;
-  header.time= particles->a_x;
-  header.redshift= 1.0/header.time - 1;
-  header.np_total[1]= (unsigned int) np_total;
-  header.np_total_highword[1]= (unsigned int) (np_total >> 32);
-  header.num_files= comm_n_nodes();
-  header.boxsize= boxsize;
-  header.omega0= omega_m;
-  header.omega_lambda= 1.0 - omega_m;
-  header.hubble_param= h;
-
+  GadgetHeader header;
+  set_header(&header, np, np_total, particles->a_x, boxsize, h);
 
   int blklen= sizeof(GadgetHeader);
   fwrite(&blklen, sizeof(blklen), 1, fp);
@@ -112,3 +101,184 @@ void gadget_file_write_particles(const char filebase[],
   msg_printf(msg_info, "particles %s written\n", filebase);
 }
 
+
+//
+// Streaming writer for LPT initial conditions
+//
+// The blocks in the file are allocated in begin(), and each plane of
+// particles is written at its location in the position, velocity, and
+// id blocks.
+//
+namespace {
+class GadgetLPTWriter : public LPTPlaneWriter {
+ public:
+  GadgetLPTWriter(const char filebase[], const int use_long_id,
+		  const double h);
+  virtual ~GadgetLPTWriter();
+  virtual void begin(const size_t np_local, const uint64_t np_total,
+		     const double a, const double boxsize);
+  virtual void write_plane(Particle const * const p, const size_t np);
+  virtual void end();
+ private:
+  char filename[256];
+  const int use_long_id;
+  const double h;
+  FILE* fp;
+  float vfac;
+  long pos_x, pos_v, pos_id; // file position for the next plane
+  vector<float> buf;
+  vector<unsigned long long> buf_id;
+  vector<unsigned int> buf_id32;
+
+  void write_block(long* const pos, void const * const data,
+		   const size_t size, const size_t n);
+};
+
+GadgetLPTWriter::GadgetLPTWriter(const char filebase[],
+				 const int use_long_id_, const double h_) :
+  use_long_id(use_long_id_), h(h_), fp(0)
+{
+  file_name(filebase, filename);
+}
+
+GadgetLPTWriter::~GadgetLPTWriter()
+{
+  if(fp)
+    end();
+}
+
+void GadgetLPTWriter::begin(const size_t np_local, const uint64_t np_total,
+			    const double a, const double boxsize)
+{
+  fp= fopen(filename, "w");
+  if(fp == 0) {
+    msg_printf(msg_error, "Error: Unable to write to file: %s\n", filename);
+    throw IOError();
+  }
+
+  const int np= np_local;
+  GadgetHeader header;
+  set_header(&header, np, np_total, a, boxsize, h);
+
+  vfac= 1.0/sqrt(a); // Gadget convention
+
+  const size_t id_size= use_long_id ?
+    sizeof(unsigned long long) : sizeof(unsigned int);
+
+  // [header] [x] [v] [id] blocks, each between two block lengths
+  int blklen= sizeof(GadgetHeader);
+  fwrite(&blklen, sizeof(blklen), 1, fp);
+  fwrite(&header, sizeof(GadgetHeader), 1, fp);
+  fwrite(&blklen, sizeof(blklen), 1, fp);
+
+  long pos= ftell(fp);
+  long* const begins[]= {&pos_x, &pos_v, &pos_id};
+  const size_t sizes[]= {sizeof(float)*3, sizeof(float)*3, id_size};
+
+  for(int i=0; i<3; i++) {
+    blklen= np*sizes[i];
+    fseek(fp, pos, SEEK_SET);
+    fwrite(&blklen, sizeof(blklen), 1, fp);
+    *begins[i]= pos + sizeof(blklen);
+    
+    pos= *begins[i] + np*sizes[i];
+    fseek(fp, pos, SEEK_SET);
+    fwrite(&blklen, sizeof(blklen), 1, fp);
+    pos += sizeof(blklen);
+  }
+
+  if(ferror(fp)) {
+    msg_printf(msg_error, "Error: Unable to write to file: %s\n", filename);
+    throw IOError();
+  }
+}
+
+void GadgetLPTWriter::write_plane(Particle const * const p, const size_t np)
+{
+  if(np == 0) return;
+  
+  buf.resize(3*np);
+  
+  for(size_t i=0; i<np; i++)
+    for(int k=0; k<3; k++)
+      buf[3*i + k]= p[i].x[k];
+  write_block(&pos_x, &buf.front(), sizeof(float), 3*np);
+
+  for(size_t i=0; i<np; i++)
+    for(int k=0; k<3; k++)
+      buf[3*i + k]= vfac*p[i].v[k];
+  write_block(&pos_v, &buf.front(), sizeof(float), 3*np);
+
+  if(use_long_id) {
+    buf_id.resize(np);
+    for(size_t i=0; i<np; i++)
+      buf_id[i]= p[i].id;
+    write_block(&pos_id, &buf_id.front(), sizeof(unsigned long long), np);
+  }
+  else {
+    buf_id32.resize(np);
+    for(size_t i=0; i<np; i++)
+      buf_id32[i]= p[i].id;
+    write_block(&pos_id, &buf_id32.front(), sizeof(unsigned int), np);
+  }
+}
+
+void GadgetLPTWriter::write_block(long* const pos, void const * const data,
+				  const size_t size, const size_t n)
+{
+  fseek(fp, *pos, SEEK_SET);
+  if(fwrite(data, size, n, fp) != n) {
+    msg_printf(msg_error, "Error: Unable to write to file: %s\n", filename);
+    throw IOError();
+  }
+  *pos += size*n;
+}
+
+void GadgetLPTWriter::end()
+{
+  fclose(fp);
+  fp= 0;
+
+  msg_printf(msg_info, "LPT particles written to %s\n", filename);
+}
+
+void file_name(const char filebase[], char* const filename)
+{
+  // filebase.i for node i, or filebase for a serial run
+  if(comm_n_nodes() == 1) {
+    sprintf(filename, "%s", filebase);
+  }
+  else {
+    sprintf(filename, "%s.%d", filebase, comm_this_node());
+  }
+}
+
+void set_header(GadgetHeader* const header,
+		const int np, const long long np_total,
+		const double a, const double boxsize, const double h)
+{
+  assert(sizeof(GadgetHeader) == 256);
+  memset(header, 0, sizeof(GadgetHeader));
+
+  const double omega_m= cosmology_omega_m();
+  const double m= cosmology_rho_m()*pow(boxsize, 3.0)/np_total;
+  
+  header->np[1]= np;
+  header->mass[1]= m;
+  header->time= a;
+  header->redshift= 1.0/header->time - 1;
+  header->np_total[1]= (unsigned int) np_total;
+  header->np_total_highword[1]= (unsigned int) (np_total >> 32);
+  header->num_files= comm_n_nodes();
+  header->boxsize= boxsize;
+  header->omega0= omega_m;
+  header->omega_lambda= 1.0 - omega_m;
+  header->hubble_param= h;
+}
+}
+
+LPTPlaneWriter* gadget_file_lpt_writer(const char filebase[],
+				       const int use_long_id, const double h)
+{
+  return new GadgetLPTWriter(filebase, use_long_id, h);
+}
@@ -2,6 +2,7 @@
 #define GADGET_FILE_H 1
 
 #include "particle.h"
+#include "lpt.h"
 
 typedef struct {
   int      np[6];
@@ -28,4 +29,8 @@ void gadget_file_write_particles(const char filebase[],
 				 Particles const * const particles,
 				 const int use_long_id, const double h=1.0);
 
+// Writer for lpt_write_displacements
+LPTPlaneWriter* gadget_file_lpt_writer(const char filebase[],
+				       const int use_long_id, const double h=1.0);
+
 #endif
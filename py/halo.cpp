@@ -0,0 +1,142 @@
+//
+// Halo catalogue of FoF groups
+//
+// Moments about the centre of mass are derived from sums over the members
+// of each group, with positions relative to the root particle; groups are
+// processed in parallel, each over its contiguous list of members
+//
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "msg.h"
+#include "comm.h"
+#include "error.h"
+#include "util.h"
+#include "cosmology.h"
+#include "cola.h"
+#include "fof.h"
+#include "halo.h"
+
+using namespace std;
+
+namespace {
+  vector<Halo> halos;
+
+  inline Float periodic_dx(Float dx, const Float boxsize)
+  {
+    const Float half_boxsize= 0.5*boxsize;
+    dx= dx < -half_boxsize ? dx + boxsize : dx;
+    dx= dx >= half_boxsize ? dx - boxsize : dx;
+
+    return dx;
+  }
+}
+
+vector<Halo>& halo_compute_catalogue(Particles const * const particles,
+				     const Index nfof_min, const bool cola)
+{
+  // Compute the properties of the FoF groups with nfof_min members or more
+  // The groups are those of the last fof_find_groups on the same particles
+  // cola: velocities are COLA 2LPT-subtracted velocities (cola_velocity)
+  Particle const * const p= particles->p;
+  const Index n= particles->np_local;
+  const Float boxsize= particles->boxsize;
+
+  if(comm_n_nodes() > 1) {
+    msg_printf(msg_error,
+	       "Error: halo catalogue requires one MPI node; "
+	       "groups of fof_find_groups_mpi span nodes\n");
+    throw ValError();
+  }
+
+  if(static_cast<Index>(fof_grp().size()) != n) {
+    msg_printf(msg_error,
+	       "Error: FoF groups are not computed for the particles\n");
+    throw ValError();
+  }
+
+  const Index nhalo= fof_compute_members(nfof_min);
+  vector<Index> const& offsets= fof_member_offsets();
+  vector<Index> const& members= fof_members();
+  vector<Index> const& roots= fof_group_roots();
+
+  // Velocities
+  vector<Float> v_cola;
+  if(cola)
+    v_cola= cola_velocity(particles);
+  Float const * const v= cola ? v_cola.data() : (n > 0 ? p[0].v : 0);
+  const size_t vstride= cola ? 3 : sizeof(Particle)/sizeof(Float);
+
+  const double m= cosmology_rho_m()*pow(boxsize, 3.0)/particles->np_total;
+  halos.resize(nhalo);
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) schedule(dynamic, 16)
+#endif
+  for(Index h=0; h<nhalo; ++h) {
+    Float const * const x0= p[roots[h]].x;
+
+    double sx[3]= {0, 0, 0}, sv[3]= {0, 0, 0}, sv2= 0;
+    double sxv[3]= {0, 0, 0}, sxx[6]= {0, 0, 0, 0, 0, 0};
+
+    for(Index j=offsets[h]; j<offsets[h + 1]; ++j) {
+      const Index i= members[j];
+      double dx[3], vi[3];
+      for(int k=0; k<3; ++k) {
+	dx[k]= periodic_dx(p[i].x[k] - x0[k], boxsize);
+	vi[k]= v[vstride*i + k];
+	sx[k] += dx[k];
+	sv[k] += vi[k];
+      }
+
+      sv2 += vi[0]*vi[0] + vi[1]*vi[1] + vi[2]*vi[2];
+      sxv[0] += dx[1]*vi[2] - dx[2]*vi[1];
+      sxv[1] += dx[2]*vi[0] - dx[0]*vi[2];
+      sxv[2] += dx[0]*vi[1] - dx[1]*vi[0];
+      sxx[0] += dx[0]*dx[0];
+      sxx[1] += dx[1]*dx[1];
+      sxx[2] += dx[2]*dx[2];
+      sxx[3] += dx[0]*dx[1];
+      sxx[4] += dx[1]*dx[2];
+      sxx[5] += dx[2]*dx[0];
+    }
+
+    Halo& halo= halos[h];
+    const double nm= offsets[h + 1] - offsets[h];
+    halo.id= p[roots[h]].id;
+    halo.nfof= offsets[h + 1] - offsets[h];
+    halo.mass= m*nm;
+
+    double dc[3], vm[3];
+    for(int k=0; k<3; ++k) {
+      dc[k]= sx[k]/nm;
+      vm[k]= sv[k]/nm;
+      halo.x[k]= periodic_wrapup_x(x0[k] + dc[k], boxsize);
+      halo.v[k]= vm[k];
+    }
+
+    const double v2= sv2/nm - (vm[0]*vm[0] + vm[1]*vm[1] + vm[2]*vm[2]);
+    halo.sigma_v= sqrt(max(v2, 0.0)/3.0);
+
+    halo.j[0]= sxv[0]/nm - (dc[1]*vm[2] - dc[2]*vm[1]);
+    halo.j[1]= sxv[1]/nm - (dc[2]*vm[0] - dc[0]*vm[2]);
+    halo.j[2]= sxv[2]/nm - (dc[0]*vm[1] - dc[1]*vm[0]);
+
+    halo.inertia[0]= sxx[0]/nm - dc[0]*dc[0];
+    halo.inertia[1]= sxx[1]/nm - dc[1]*dc[1];
+    halo.inertia[2]= sxx[2]/nm - dc[2]*dc[2];
+    halo.inertia[3]= sxx[3]/nm - dc[0]*dc[1];
+    halo.inertia[4]= sxx[4]/nm - dc[1]*dc[2];
+    halo.inertia[5]= sxx[5]/nm - dc[2]*dc[0];
+  }
+
+  msg_printf(msg_verbose, "%d halos with nfof >= %d\n", nhalo, nfof_min);
+
+  return halos;
+}
+
+vector<Halo>& halo_catalogue()
+{
+  return halos;
+}
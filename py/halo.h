@@ -0,0 +1,32 @@
+#ifndef HALO_H
+#define HALO_H 1
+
+#include <vector>
+#include "config.h"
+#include "particle.h"
+
+//
+// Halo catalogue of FoF groups
+//
+// Positions are relative to the centre of mass x, and velocities to the
+// mean velocity v; j and inertia are per unit mass,
+//   j = <(x_i - x) x (v_i - v)>,  inertia_ab = <(x_i - x)_a (x_i - x)_b>
+// with the order xx, yy, zz, xy, yz, zx. sigma_v is the 1-dimensional
+// velocity dispersion, sqrt(<|v_i - v|^2>/3).
+//
+struct Halo {
+  uint64_t id;        // particle id of the group root
+  uint64_t nfof;      // number of member particles
+  Float mass;         // [1/h Solar mass]
+  Float x[3], v[3];
+  Float sigma_v;
+  Float j[3];
+  Float inertia[6];
+};
+
+std::vector<Halo>& halo_compute_catalogue(Particles const * const particles,
+					  const Index nfof_min=20,
+					  const bool cola=true);
+std::vector<Halo>& halo_catalogue();
+
+#endif
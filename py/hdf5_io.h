@@ -2,10 +2,28 @@
 #define HDF5_IO_H 1
 
 #include "particle.h"
+#include "lpt.h"
+#include "lightcone.h"
+#include "halo.h"
 
 void hdf5_write_particles(const char filename[],
 			  Particles const * const particles,
 			  char const* var);
+void hdf5_write_particles(const char filename[],
+			  ParticlesSoA const * const particles,
+			  char const* var);
+
+// Writer for lpt_write_displacements; var is a subset of "ixv12"
+LPTPlaneWriter* hdf5_lpt_writer(const char filename[], char const* var);
+
+// Writer for Lightcone; id, a, x, v are appended after each drift
+LightconeWriter* hdf5_lightcone_writer(const char filename[],
+				       const double boxsize,
+				       double const observer[]);
+
+// Halo catalogue; rows of all nodes are concatenated; collective
+void hdf5_write_halos(const char filename[], std::vector<Halo> const& halos,
+		      const double boxsize, const double a);
 
 void hdf5_write_packet_data(const char filename[], const int data[], const int n);
 #endif
@@ -1,5 +1,7 @@
 #include <iostream>
 #include <vector>
+#include <string>
+#include <cstddef>
 #include <cmath>
 #include <cassert>
 #include <hdf5.h>
@@ -9,12 +11,16 @@
 #include "comm.h"
 #include "cola.h"
 #include "cosmology.h"
+#include "util.h"
 #include "hdf5_io.h"
 
 using namespace std;
 
 namespace {
-  void write_header(const hid_t loc, Particles const * const particles);
+  hid_t open_file(const char filename[], const hid_t plist);
+  void write_header(const hid_t loc, const double boxsize,
+		    const double a_x, const double a_v,
+		    const uint64_t np_total);
 
   void write_data_double(hid_t loc, const char name[], const double val);
   void write_data_int(hid_t loc, const char name[], const int val);
@@ -23,6 +29,23 @@ namespace {
 			const hsize_t stride,
 			const hid_t mem_type, const hid_t save_type,
 			void const * const data);
+
+  void write_lpt_table(hid_t loc, const char name[],
+		       const hsize_t np, const hsize_t stride,
+		       Float const * const dx);
+  void write_lpt_table(hid_t loc, const char name[],
+		       const hsize_t np, const hsize_t stride,
+		       const Disp16 dx);
+  template<class T>
+  void write_position_table(hid_t loc, const hsize_t np, T const * const p,
+			    const Float boxsize);
+  void write_position_table(hid_t loc, const hsize_t np,
+			    PosFixed const * const p, const Float boxsize);
+
+  template<class Access>
+  void write_particles(const char filename[],
+		       typename Access::Container const * const particles,
+		       char const* var);
 }
 
 void hdf5_write_particles(const char filename[],
@@ -38,13 +61,475 @@ void hdf5_write_particles(const char filename[],
   //  f: force
   //  1: 1LPT displacements (at a=1)
   //  2: 2LPT displacements (at a=1)
+  write_particles<ParticleAccessAoS>(filename, particles, var);
+}
 
-  H5Eset_auto2(H5E_DEFAULT, NULL, 0);
-    
+void hdf5_write_particles(const char filename[],
+			  ParticlesSoA const * const particles,
+			  char const* var)
+{
+  if(particles->position_fixed()) {
+    if(particles->lpt_compressed())
+      write_particles<ParticleAccessSoA16Fixed>(filename, particles, var);
+    else
+      write_particles<ParticleAccessSoAFixed>(filename, particles, var);
+  }
+  else if(particles->lpt_compressed())
+    write_particles<ParticleAccessSoA16>(filename, particles, var);
+  else
+    write_particles<ParticleAccessSoA>(filename, particles, var);
+}
+
+
+void hdf5_write_packet_data(const char filename[], const int data[], const int n)
+{
   // Parallel file access
   hid_t plist= H5Pcreate(H5P_FILE_ACCESS);
   H5Pset_fapl_mpio(plist, MPI_COMM_WORLD, MPI_INFO_NULL);
 
+  hid_t file= H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, plist);
+  if(file < 0) {
+    msg_printf(msg_error, "Error: unable to create HDF5 file, %s\n", filename);
+    throw IOError();
+  }
+
+  write_data_table(file, "packet", n, 3, 3, H5T_NATIVE_INT, H5T_STD_I32LE, data);
+
+  H5Pclose(plist);
+  H5Fclose(file);
+}
+
+void hdf5_write_halos(const char filename[], vector<Halo> const& halos,
+		      const double boxsize, const double a)
+{
+  H5Eset_auto2(H5E_DEFAULT, NULL, 0);
+
+  hid_t plist= H5Pcreate(H5P_FILE_ACCESS);
+  H5Pset_fapl_mpio(plist, MPI_COMM_WORLD, MPI_INFO_NULL);
+
+  hid_t file= H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, plist);
+  if(file < 0) {
+    msg_printf(msg_error, "Error: unable to create HDF5 file, %s\n", filename);
+    throw IOError();
+  }
+
+  const hid_t group= H5Gcreate(file, "parameters",
+			       H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+  if(group < 0) {
+    msg_printf(msg_error, "Error: unable to open group, parameters\n");
+    throw IOError();
+  }
+  write_data_double(group, "boxsize", boxsize);
+  write_data_double(group, "omega_m", cosmology_omega_m());
+  write_data_double(group, "a", a);
+  H5Gclose(group);
+
+  static_assert(sizeof(Halo) % sizeof(uint64_t) == 0,
+		"Error: sizeof(Halo) is not a multiple of sizeof(uint64_t).");
+  static_assert(sizeof(Halo) % sizeof(Float) == 0,
+		"Error: sizeof(Halo) is not a multiple of sizeof(Float).");
+
+  const Halo dummy= Halo();
+  Halo const * const h= halos.empty() ? &dummy : &halos.front();
+  const hsize_t nrow= halos.size();
+  const hsize_t istride= sizeof(Halo)/sizeof(uint64_t);
+  const hsize_t fstride= sizeof(Halo)/sizeof(Float);
+
+  write_data_table(file, "id", nrow, 1, istride,
+		   H5T_NATIVE_UINT64, H5T_STD_U64LE, &h->id);
+  write_data_table(file, "nfof", nrow, 1, istride,
+		   H5T_NATIVE_UINT64, H5T_STD_U64LE, &h->nfof);
+  write_data_table(file, "mass", nrow, 1, fstride,
+		   FLOAT_MEM_TYPE, FLOAT_SAVE_TYPE, &h->mass);
+  write_data_table(file, "x", nrow, 3, fstride,
+		   FLOAT_MEM_TYPE, FLOAT_SAVE_TYPE, h->x);
+  write_data_table(file, "v", nrow, 3, fstride,
+		   FLOAT_MEM_TYPE, FLOAT_SAVE_TYPE, h->v);
+  write_data_table(file, "sigma_v", nrow, 1, fstride,
+		   FLOAT_MEM_TYPE, FLOAT_SAVE_TYPE, &h->sigma_v);
+  write_data_table(file, "j", nrow, 3, fstride,
+		   FLOAT_MEM_TYPE, FLOAT_SAVE_TYPE, h->j);
+  write_data_table(file, "inertia", nrow, 6, fstride,
+		   FLOAT_MEM_TYPE, FLOAT_SAVE_TYPE, h->inertia);
+
+  H5Pclose(plist);
+  H5Fclose(file);
+
+  msg_printf(msg_info, "%llu halos written to %s\n",
+	     (unsigned long long) comm_sum<long long>(nrow), filename);
+}
+
+//
+// Streaming writer for LPT initial conditions
+//
+namespace {
+class HDF5LPTWriter : public LPTPlaneWriter {
+ public:
+  HDF5LPTWriter(const char filename_[], char const* var);
+  virtual ~HDF5LPTWriter();
+  virtual void begin(const size_t np_local, const uint64_t np_total,
+		     const double a, const double boxsize);
+  virtual void write_plane(Particle const * const p, const size_t np);
+  virtual void end();
+ private:
+  struct Column {
+    hid_t dataset;
+    hsize_t ncol, stride;
+    hid_t mem_type;
+    size_t offset; // byte offset in Particle
+  };
+  
+  string filename, var;
+  hid_t plist, file, xfer;
+  vector<Column> cols;
+  hsize_t row; // next row in file for this node
+};
+
+HDF5LPTWriter::HDF5LPTWriter(const char filename_[], char const* var_) :
+  filename(filename_), var(var_), plist(-1), file(-1), xfer(-1), row(0)
+{
+  // var is a subset of "ixv12" (in this order), see hdf5_write_particles;
+  // each letter is used at most once, as it creates a dataset
+  const string ixv12("ixv12");
+  size_t i= 0;
+  for(string::const_iterator c= var.begin(); c != var.end(); ++c) {
+    while(i < ixv12.size() && ixv12[i] != *c)
+      i++;
+    if(i == ixv12.size()) {
+      msg_printf(msg_error,
+		 "Error: unknown or repeated option for LPT hdf5 writer, %s\n",
+		 var_);
+      throw ValError();
+    }
+    i++;
+  }
+}
+
+HDF5LPTWriter::~HDF5LPTWriter()
+{
+  if(file >= 0)
+    end();
+}
+
+void HDF5LPTWriter::begin(const size_t np_local, const uint64_t np_total,
+			  const double a, const double boxsize)
+{
+  H5Eset_auto2(H5E_DEFAULT, NULL, 0);
+
+  plist= H5Pcreate(H5P_FILE_ACCESS);
+  H5Pset_fapl_mpio(plist, MPI_COMM_WORLD, MPI_INFO_NULL);
+
+  file= open_file(filename.c_str(), plist);
+
+  write_header(file, boxsize, a, a, np_total);
+
+  long long offset_ll= comm_partial_sum<long long>(np_local);
+  row= offset_ll - np_local;
+
+  xfer= H5Pcreate(H5P_DATASET_XFER);
+  H5Pset_dxpl_mpio(xfer, H5FD_MPIO_COLLECTIVE);
+
+  const hsize_t fstride= sizeof(Particle)/sizeof(Float);
+  
+  for(string::const_iterator c= var.begin(); c != var.end(); ++c) {
+    const char* name= 0;
+    Column col;
+    col.ncol= 3;
+    col.stride= fstride;
+    col.mem_type= FLOAT_MEM_TYPE;
+    hid_t save_type= FLOAT_SAVE_TYPE;
+
+    switch(*c) {
+    case 'i':
+      name= "id";
+      col.ncol= 1;
+      col.stride= sizeof(Particle)/sizeof(uint64_t);
+      col.mem_type= H5T_NATIVE_UINT64;
+      save_type= H5T_STD_U64LE;
+      col.offset= offsetof(Particle, id);
+      break;
+    case 'x':
+      name= "x";  col.offset= offsetof(Particle, x);   break;
+    case 'v':
+      name= "v";  col.offset= offsetof(Particle, v);   break;
+    case '1':
+      name= "dx1"; col.offset= offsetof(Particle, dx1); break;
+    case '2':
+      name= "dx2"; col.offset= offsetof(Particle, dx2); break;
+    }
+
+    const hsize_t dim= col.ncol == 1 ? 1 : 2;
+    const hsize_t data_size_file[]= {hsize_t(np_total), col.ncol};
+    hid_t filespace= H5Screate_simple(dim, data_size_file, NULL);
+    
+    col.dataset= H5Dcreate(file, name, save_type, filespace,
+			   H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    H5Sclose(filespace);
+
+    if(col.dataset < 0) {
+      msg_printf(msg_error, "Error: unable to create dataset %s in %s\n",
+		 name, filename.c_str());
+      throw IOError();
+    }
+    
+    cols.push_back(col);
+  }
+}
+
+void HDF5LPTWriter::write_plane(Particle const * const p, const size_t np)
+{
+  // Collective write of np rows; np can be 0 on some nodes
+  for(vector<Column>::const_iterator col= cols.begin();
+      col != cols.end(); ++col) {
+    const hsize_t nrow= np;
+    const hsize_t data_size_mem= np > 0 ? nrow*col->stride : 1;
+    hid_t memspace= H5Screate_simple(1, &data_size_mem, 0);
+    hid_t filespace= H5Dget_space(col->dataset);
+
+    if(np > 0) {
+      const hsize_t offset_mem= 0;
+      H5Sselect_hyperslab(memspace, H5S_SELECT_SET,
+			  &offset_mem, &col->stride, &nrow, &col->ncol);
+
+      const hsize_t offset_file[]= {row, 0};
+      const hsize_t count_file[]= {nrow, col->ncol};
+      H5Sselect_hyperslab(filespace, H5S_SELECT_SET,
+			  offset_file, NULL, count_file, NULL);
+    }
+    else {
+      H5Sselect_none(memspace);
+      H5Sselect_none(filespace);
+    }
+
+    char const * const data= reinterpret_cast<char const*>(p) + col->offset;
+    const herr_t status= H5Dwrite(col->dataset, col->mem_type,
+				  memspace, filespace, xfer, data);
+    H5Sclose(filespace);
+    H5Sclose(memspace);
+
+    if(status < 0) {
+      msg_printf(msg_error, "Error: unable to write LPT particles to %s\n",
+		 filename.c_str());
+      throw IOError();
+    }
+  }
+
+  row += np;
+}
+
+void HDF5LPTWriter::end()
+{
+  for(vector<Column>::const_iterator col= cols.begin();
+      col != cols.end(); ++col)
+    H5Dclose(col->dataset);
+  cols.clear();
+
+  H5Pclose(xfer);
+  H5Pclose(plist);
+  H5Fclose(file);
+  file= -1;
+
+  msg_printf(msg_info, "LPT particles written to %s\n", filename.c_str());
+}
+}
+
+LPTPlaneWriter* hdf5_lpt_writer(const char filename[], char const* var)
+{
+  return new HDF5LPTWriter(filename, var);
+}
+
+
+//
+// Writer for lightcone particles, appended to extendible datasets
+//
+namespace {
+class HDF5LightconeWriter : public LightconeWriter {
+ public:
+  HDF5LightconeWriter(const char filename_[], const double boxsize,
+		      double const observer[]);
+  virtual ~HDF5LightconeWriter();
+  virtual void write(LightconeParticle const * const p, const size_t np);
+ private:
+  struct Column {
+    hid_t dataset;
+    hsize_t ncol, stride;
+    hid_t mem_type;
+    size_t offset; // byte offset in LightconeParticle
+  };
+
+  void create_column(const char name[], const hsize_t ncol,
+		     const hsize_t stride, const hid_t mem_type,
+		     const hid_t save_type, const size_t offset);
+
+  string filename;
+  hid_t plist, file, xfer;
+  vector<Column> cols;
+  hsize_t nrow; // number of rows written by all nodes
+};
+
+HDF5LightconeWriter::HDF5LightconeWriter(const char filename_[],
+					 const double boxsize,
+					 double const observer[]) :
+  filename(filename_), nrow(0)
+{
+  H5Eset_auto2(H5E_DEFAULT, NULL, 0);
+
+  plist= H5Pcreate(H5P_FILE_ACCESS);
+  H5Pset_fapl_mpio(plist, MPI_COMM_WORLD, MPI_INFO_NULL);
+
+  file= H5Fcreate(filename_, H5F_ACC_TRUNC, H5P_DEFAULT, plist);
+  if(file < 0) {
+    msg_printf(msg_error, "Error: unable to create HDF5 file, %s\n",
+	       filename_);
+    throw IOError();
+  }
+
+  const hid_t group= H5Gcreate(file, "parameters",
+			       H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+  if(group < 0) {
+    msg_printf(msg_error, "Error: unable to open group, parameters\n");
+    throw IOError();
+  }
+  write_data_double(group, "boxsize", boxsize);
+  write_data_double(group, "omega_m", cosmology_omega_m());
+  write_data_table(group, "observer", comm_this_node() == 0 ? 1 : 0, 3, 3,
+		   H5T_NATIVE_DOUBLE, H5T_IEEE_F64LE, observer);
+  H5Gclose(group);
+
+  xfer= H5Pcreate(H5P_DATASET_XFER);
+  H5Pset_dxpl_mpio(xfer, H5FD_MPIO_COLLECTIVE);
+
+  static_assert(sizeof(LightconeParticle) % sizeof(uint64_t) == 0,
+		"Error: sizeof(LightconeParticle) is not a multiple of "
+		"sizeof(uint64_t).");
+  const hsize_t fstride= sizeof(LightconeParticle)/sizeof(Float);
+
+  create_column("id", 1, sizeof(LightconeParticle)/sizeof(uint64_t),
+		H5T_NATIVE_UINT64, H5T_STD_U64LE,
+		offsetof(LightconeParticle, id));
+  create_column("a", 1, fstride, FLOAT_MEM_TYPE, FLOAT_SAVE_TYPE,
+		offsetof(LightconeParticle, a));
+  create_column("x", 3, fstride, FLOAT_MEM_TYPE, FLOAT_SAVE_TYPE,
+		offsetof(LightconeParticle, x));
+  create_column("v", 3, fstride, FLOAT_MEM_TYPE, FLOAT_SAVE_TYPE,
+		offsetof(LightconeParticle, v));
+}
+
+HDF5LightconeWriter::~HDF5LightconeWriter()
+{
+  for(vector<Column>::const_iterator col= cols.begin();
+      col != cols.end(); ++col)
+    H5Dclose(col->dataset);
+
+  H5Pclose(xfer);
+  H5Pclose(plist);
+  H5Fclose(file);
+
+  msg_printf(msg_info, "%llu lightcone particles written to %s\n",
+	     (unsigned long long) nrow, filename.c_str());
+}
+
+void HDF5LightconeWriter::create_column(const char name[], const hsize_t ncol,
+					const hsize_t stride,
+					const hid_t mem_type,
+					const hid_t save_type,
+					const size_t offset)
+{
+  const int dim= ncol == 1 ? 1 : 2;
+  const hsize_t size[]= {0, ncol};
+  const hsize_t size_max[]= {H5S_UNLIMITED, ncol};
+  const hsize_t chunk[]= {65536, ncol};
+
+  hid_t filespace= H5Screate_simple(dim, size, size_max);
+  hid_t dcpl= H5Pcreate(H5P_DATASET_CREATE);
+  H5Pset_chunk(dcpl, dim, chunk);
+
+  Column col;
+  col.dataset= H5Dcreate(file, name, save_type, filespace,
+			 H5P_DEFAULT, dcpl, H5P_DEFAULT);
+  H5Pclose(dcpl);
+  H5Sclose(filespace);
+
+  if(col.dataset < 0) {
+    msg_printf(msg_error, "Error: unable to create dataset %s in %s\n",
+	       name, filename.c_str());
+    throw IOError();
+  }
+
+  col.ncol= ncol;
+  col.stride= stride;
+  col.mem_type= mem_type;
+  col.offset= offset;
+  cols.push_back(col);
+}
+
+void HDF5LightconeWriter::write(LightconeParticle const * const p,
+				const size_t np)
+{
+  // Append np rows from each node; collective
+  const long long np_total= comm_sum<long long>(np);
+  if(np_total == 0)
+    return;
+
+  const hsize_t row= nrow + comm_partial_sum<long long>(np) - np;
+  LightconeParticle dummy;
+
+  for(vector<Column>::const_iterator col= cols.begin();
+      col != cols.end(); ++col) {
+    const hsize_t size[]= {nrow + np_total, col->ncol};
+    H5Dset_extent(col->dataset, size);
+
+    const hsize_t n= np;
+    const hsize_t data_size_mem= np > 0 ? n*col->stride : 1;
+    hid_t memspace= H5Screate_simple(1, &data_size_mem, 0);
+    hid_t filespace= H5Dget_space(col->dataset);
+
+    if(np > 0) {
+      const hsize_t offset_mem= 0;
+      H5Sselect_hyperslab(memspace, H5S_SELECT_SET,
+			  &offset_mem, &col->stride, &n, &col->ncol);
+
+      const hsize_t offset_file[]= {row, 0};
+      const hsize_t count_file[]= {n, col->ncol};
+      H5Sselect_hyperslab(filespace, H5S_SELECT_SET,
+			  offset_file, NULL, count_file, NULL);
+    }
+    else {
+      H5Sselect_none(memspace);
+      H5Sselect_none(filespace);
+    }
+
+    char const * const data=
+      reinterpret_cast<char const*>(np > 0 ? p : &dummy) + col->offset;
+    const herr_t status= H5Dwrite(col->dataset, col->mem_type,
+				  memspace, filespace, xfer, data);
+    H5Sclose(filespace);
+    H5Sclose(memspace);
+
+    if(status < 0) {
+      msg_printf(msg_error,
+		 "Error: unable to write lightcone particles to %s\n",
+		 filename.c_str());
+      throw IOError();
+    }
+  }
+
+  nrow += np_total;
+}
+}
+
+LightconeWriter* hdf5_lightcone_writer(const char filename[],
+				       const double boxsize,
+				       double const observer[])
+{
+  return new HDF5LightconeWriter(filename, boxsize, observer);
+}
+
+
+namespace {
+hid_t open_file(const char filename[], const hid_t plist)
+{
+  // Open an existing file or create a new one
   hid_t file= H5Fopen(filename, H5F_ACC_RDWR, plist);
   if(file < 0) {
     file= H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, plist);
@@ -59,38 +544,101 @@ void hdf5_write_particles(const char filename[],
   else {
     msg_printf(msg_debug, "Opened HDF5 file, %s\n", filename);
   }
+
+  return file;
+}
+
+void write_lpt_table(hid_t loc, const char name[],
+		     const hsize_t np, const hsize_t stride,
+		     Float const * const dx)
+{
+  write_data_table(loc, name, np, 3, stride,
+		   FLOAT_MEM_TYPE, FLOAT_SAVE_TYPE, dx);
+}
+
+void write_lpt_table(hid_t loc, const char name[],
+		     const hsize_t np, const hsize_t stride,
+		     const Disp16 dx)
+{
+  // Decode 16-bit fixed-point displacements
+  vector<Float> v(3*np);
+  for(size_t i=0; i<np; ++i) {
+    for(int k=0; k<3; ++k)
+      v[3*i + k]= dx.scale*dx.q[i][k];
+  }
+
+  write_data_table(loc, name, np, 3, 3,
+		   FLOAT_MEM_TYPE, FLOAT_SAVE_TYPE, v.data());
+}
+
+template<class T>
+void write_position_table(hid_t loc, const hsize_t np, T const * const p,
+			  const Float)
+{
+  // T is Particle or Pos
+  static_assert(sizeof(T) % sizeof(Float) == 0,
+		"Error: Sizeof(T) is not a multiple of sizeof(Float).");
+  write_data_table(loc, "x", np, 3, sizeof(T)/sizeof(Float),
+		   FLOAT_MEM_TYPE, FLOAT_SAVE_TYPE, p->x);
+}
+
+void write_position_table(hid_t loc, const hsize_t np,
+			  PosFixed const * const p, const Float boxsize)
+{
+  // Fixed-point positions are written as Float
+  vector<Float> x(3*np);
+  for(size_t i=0; i<np; ++i)
+    position_float(p[i], boxsize, &x[3*i]);
+
+  write_data_table(loc, "x", np, 3, 3,
+		   FLOAT_MEM_TYPE, FLOAT_SAVE_TYPE, x.data());
+}
+
+template<class Access>
+void write_particles(const char filename[],
+		     typename Access::Container const * const particles,
+		     char const* var)
+{
+  H5Eset_auto2(H5E_DEFAULT, NULL, 0);
+    
+  // Parallel file access
+  hid_t plist= H5Pcreate(H5P_FILE_ACCESS);
+  H5Pset_fapl_mpio(plist, MPI_COMM_WORLD, MPI_INFO_NULL);
+
+  hid_t file= open_file(filename, plist);
   
-  Particle const * const p= particles->p;
+  // particle data are only read
+  const Access p(const_cast<typename Access::Container*>(particles));
   const size_t np= particles->np_local;
 
   msg_printf(msg_verbose, "writing header\n");
-  write_header(file, particles);
+  write_header(file, particles->boxsize, particles->a_x, particles->a_v,
+	       particles->np_total);
 
   if(*var == 'i') {
     msg_printf(msg_verbose, "writing ids\n");
-    assert(sizeof(Particle) % sizeof(uint64_t) == 0);
+    static_assert(sizeof(Particle) % sizeof(uint64_t) == 0,
+		  "Error: Sizeof(Particle) is not a multiple of sizeof(uint64_t).");
 
-    const size_t istride= sizeof(Particle)/sizeof(uint64_t);
-    write_data_table(file, "id", np, 1, istride,
-		     H5T_NATIVE_UINT64, H5T_STD_U64LE, &p->id);
+    write_data_table(file, "id", np, 1, Access::id_stride,
+		     H5T_NATIVE_UINT64, H5T_STD_U64LE, &p.id(0));
     ++var;
   }
 
   static_assert(sizeof(Particle) % sizeof(Float) == 0,
 		"Error: Sizeof(Particle) is not a multiple of sizeof(Float).");
-  const size_t stride= sizeof(Particle)/sizeof(Float);
+  const size_t stride= Access::stride;
     
   if(*var == 'x') {
     msg_printf(msg_verbose, "writing positions\n");
-    write_data_table(file, "x", np, 3, stride,
-		     FLOAT_MEM_TYPE, FLOAT_SAVE_TYPE, p->x);
+    write_position_table(file, np, p.positions(), particles->boxsize);
     ++var;
   }
 
   if(*var == 'v') {
     msg_printf(msg_verbose, "writing raw velocities\n");
     write_data_table(file, "v", np, 3, stride,
-		     FLOAT_MEM_TYPE, FLOAT_SAVE_TYPE, p->v);
+		     FLOAT_MEM_TYPE, FLOAT_SAVE_TYPE, p.v(0));
     ++var;
   }
 
@@ -115,16 +663,14 @@ void hdf5_write_particles(const char filename[],
 
   if(*var == '1') {
     msg_printf(msg_verbose, "writing 1st-order LPT displacements\n");    
-    write_data_table(file, "dx1", np, 3, stride,
-		     FLOAT_MEM_TYPE, FLOAT_SAVE_TYPE, p->dx1);
+    write_lpt_table(file, "dx1", np, stride, p.dx1(0));
     
     ++var;
   }
 
   if(*var == '2') {
     msg_printf(msg_verbose, "writing 2nd-order LPT displacements\n");    
-    write_data_table(file, "dx2", np, 3, stride,
-		     FLOAT_MEM_TYPE, FLOAT_SAVE_TYPE, p->dx2);
+    write_lpt_table(file, "dx2", np, stride, p.dx2(0));
     
     ++var;
   }
@@ -138,28 +684,9 @@ void hdf5_write_particles(const char filename[],
   H5Fclose(file);
 }
 
-
-void hdf5_write_packet_data(const char filename[], const int data[], const int n)
-{
-  // Parallel file access
-  hid_t plist= H5Pcreate(H5P_FILE_ACCESS);
-  H5Pset_fapl_mpio(plist, MPI_COMM_WORLD, MPI_INFO_NULL);
-
-  hid_t file= H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, plist);
-  if(file < 0) {
-    msg_printf(msg_error, "Error: unable to create HDF5 file, %s\n", filename);
-    throw IOError();
-  }
-
-  write_data_table(file, "packet", n, 3, 3, H5T_NATIVE_INT, H5T_STD_I32LE, data);
-
-  H5Pclose(plist);
-  H5Fclose(file);
-}
-
-
-namespace {
-void write_header(const hid_t loc, Particles const * const particles)
+void write_header(const hid_t loc, const double boxsize,
+		  const double a_x, const double a_v,
+		  const uint64_t np_total)
 {
   //hid_t plist = H5Pcreate(H5P_DATASET_XFER);
   //H5Pset_dxpl_mpio(plist, H5FD_MPIO_COLLECTIVE);
@@ -173,12 +700,12 @@ void write_header(const hid_t loc, Particles const * const particles)
       throw IOError();
   }
 
-  write_data_double(group, "boxsize", particles->boxsize);
+  write_data_double(group, "boxsize", boxsize);
   write_data_double(group, "omega_m", cosmology_omega_m());
-  write_data_double(group, "ax", particles->a_x);
-  write_data_double(group, "av", particles->a_v);
+  write_data_double(group, "ax", a_x);
+  write_data_double(group, "av", a_v);
 
-  const int nc= round(pow((double) particles->np_total, 1.0/3.0));
+  const int nc= round(pow((double) np_total, 1.0/3.0));
   write_data_int(group, "nc", nc);
 
 
@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <cmath>
 #include <cassert>
+#include <limits>
 
 #include "config.h"
 #include "msg.h"
@@ -16,25 +17,44 @@ using namespace std;
 static KdTree* kdtree= 0;
 static size_t ntree_alloc= 0;
 static size_t height;
+static vector<size_t> leaves;   // kdtree node of leaf l
+static vector<Index> node_leaf; // leaf index of a leaf node
+static KdTreeCounter counter= {0, 0, 0};
+static vector<KdPoint> points;  // points of the tree built from particles
+static KdPoint const * tree_points= 0; // points the tree is built on
+
+// Subtrees with more points than this are built in separate OpenMP tasks
+static const Index task_min= 16384;
+
+static const int max_height= kdtree_max_height;
 
 int KdTree::quota;
 
 
 //static void traverse_tree_recursive(const size_t inode);
+static void collect_leaves_recursive(const size_t inode);
+
+static inline void set_box(KdTree * const tree,
+			   const Float left[], const Float right[])
+{
+  tree->lo[0]= left[0];
+  tree->lo[1]= left[1];
+  tree->lo[2]= left[2];
+  tree->hi[0]= right[0];
+  tree->hi[1]= right[1];
+  tree->hi[2]= right[2];
+}
 
-static inline void set_left_right(KdTree * const tree, const int k,
-			     const Float left[], const Float right[])
+static inline int longest_axis(KdTree const * const tree)
 {
-  tree->left= left[k];
-  tree->right= right[k];
-  /*
-  tree->left[0]= left[0];
-  tree->left[1]= left[1];
-  tree->left[2]= left[2];
-  tree->right[0]= right[0];
-  tree->right[1]= right[1];
-  tree->right[2]= right[2];
-  */
+  // Axis of the longest edge of the bounding box
+  int k= 1;
+  if(tree->hi[2] - tree->lo[2] > tree->hi[1] - tree->lo[1])
+    k= 2;
+  if(tree->hi[0] - tree->lo[0] > tree->hi[k] - tree->lo[k])
+    k= 0;
+
+  return k;
 }
 
 
@@ -86,7 +106,7 @@ void compute_bounding_box(const vector<T>& v,
 template<typename T>
 void construct_recursive_balanced(vector<T>& v, const size_t inode, 
 			 const Index ibegin, const Index iend,
-			 Float left[], Float right[], Float boxsize3[])
+			 Float left[], Float right[], Float const boxsize3[])
 {
   assert(0 <= inode && inode < ntree_alloc);
   KdTree* const tree= kdtree + inode;
@@ -96,28 +116,35 @@ void construct_recursive_balanced(vector<T>& v, const size_t inode,
   
   if(iend - ibegin <= KdTree::quota) {
     compute_bounding_box(v, ibegin, iend, left, right);
-    set_left_right(tree, tree->k, left, right);
+    set_box(tree, left, right);
     return;
   }
   
   const int k= cut_direction(boxsize3);
 
-  boxsize3[k] /= 2;
+  Float boxsize3_child[3]= {boxsize3[0], boxsize3[1], boxsize3[2]};
+  boxsize3_child[k] /= 2;
 
   const size_t imid= ibegin + (iend - ibegin)/2;
   nth_element(v.begin() + ibegin, v.begin() + imid, v.begin() + iend,
 	      CompPoints<T>(k));
 
+  // The left subtree is built in a new task, the right subtree in this one
   const size_t ileft= left_child(inode);
-  kdtree[ileft].k= k;
-  construct_recursive_balanced(v, ileft, ibegin, imid, left, right, boxsize3);
-  set_left_right(kdtree + ileft, k, left, right);
+#ifdef _OPENMP
+  #pragma omp task default(shared) if(iend - ibegin > task_min)
+#endif
+  construct_recursive_balanced(v, ileft, ibegin, imid, left, right,
+			       boxsize3_child);
 
   Float left1[3], right1[3];
   const size_t iright= right_child(inode);
-  kdtree[iright].k= k;
-  construct_recursive_balanced(v, iright, imid, iend, left1, right1, boxsize3);
-  set_left_right(kdtree + iright, k, left1, right1);
+  construct_recursive_balanced(v, iright, imid, iend, left1, right1,
+			       boxsize3_child);
+
+#ifdef _OPENMP
+  #pragma omp taskwait
+#endif
 
   left[0]= min(left[0], left1[0]);
   left[1]= min(left[1], left1[1]);
@@ -126,6 +153,155 @@ void construct_recursive_balanced(vector<T>& v, const size_t inode,
   right[0]= max(right[0], right1[0]);
   right[1]= max(right[1], right1[1]);
   right[2]= max(right[2], right1[2]);
+
+  set_box(tree, left, right);
+}
+
+template<class T>
+static size_t update_points(T const * const p, const Float boxsize)
+{
+  // Move points to the current positions of their particles; positions
+  // are unwrapped relative to the previous ones, so that a particle crossing
+  // the periodic boundary does not stretch the node boxes over the box.
+  // Returns the number of points that drifted more than
+  // kdtree_update_margin*boxsize outside [0, boxsize)
+  const size_t np= points.size();
+  const Float half_boxsize= 0.5*boxsize;
+  const Float margin= kdtree_update_margin*boxsize;
+  size_t nout= 0;
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) reduction(+:nout)
+#endif
+  for(size_t j=0; j<np; ++j) {
+    Float x[3];
+    position_float(p[points[j].i], boxsize, x);
+    bool out= false;
+    for(int k=0; k<3; ++k) {
+      Float dx= x[k] - points[j].x[k];
+      dx= dx < -half_boxsize ? dx + boxsize : dx;
+      dx= dx >= half_boxsize ? dx - boxsize : dx;
+      points[j].x[k] += dx;
+      out= out || points[j].x[k] < -margin ||
+	          points[j].x[k] >= boxsize + margin;
+    }
+    if(out)
+      nout++;
+  }
+
+  return nout;
+}
+
+static void refit_recursive(const size_t inode)
+{
+  // Recompute the bounding boxes of the subtree bottom up
+  KdTree* const tree= kdtree + inode;
+  Float left[3], right[3];
+
+  if(is_leaf(tree)) {
+    compute_bounding_box(points, tree->ibegin, tree->iend, left, right);
+    set_box(tree, left, right);
+    return;
+  }
+
+  KdTree const * const l= kdtree + left_child(inode);
+  KdTree const * const r= kdtree + right_child(inode);
+
+#ifdef _OPENMP
+  #pragma omp task default(shared) if(tree->iend - tree->ibegin > task_min)
+#endif
+  refit_recursive(left_child(inode));
+  refit_recursive(right_child(inode));
+
+#ifdef _OPENMP
+  #pragma omp taskwait
+#endif
+
+  for(int k=0; k<3; ++k) {
+    left[k]= min(l->lo[k], r->lo[k]);
+    right[k]= max(l->hi[k], r->hi[k]);
+  }
+  set_box(tree, left, right);
+}
+
+static inline Float children_overlap(const size_t inode)
+{
+  // Overlap of the children boxes relative to the extent of the node in
+  // the axis of the least overlap; 0 after the construction, in which the
+  // children are separated along the cut axis
+  KdTree const * const tree= kdtree + inode;
+  KdTree const * const l= kdtree + left_child(inode);
+  KdTree const * const r= kdtree + right_child(inode);
+
+  Float f= 0;
+  bool first= true;
+  for(int k=0; k<3; ++k) {
+    const Float extent= tree->hi[k] - tree->lo[k];
+    if(extent <= 0)
+      continue;
+
+    const Float overlap= min(l->hi[k], r->hi[k]) - max(l->lo[k], r->lo[k]);
+    const Float fk= max(overlap, Float(0))/extent;
+    f= first ? fk : min(f, fk);
+    first= false;
+  }
+
+  return f;
+}
+
+static size_t rebuild_degraded_recursive(const size_t inode,
+					 const Float overlap_max)
+{
+  // Rebuild the subtrees whose children overlap more than overlap_max,
+  // top down; returns the number of points in the rebuilt subtrees
+  KdTree* const tree= kdtree + inode;
+  if(is_leaf(tree))
+    return 0;
+
+  const Index ibegin= tree->ibegin, iend= tree->iend;
+
+  if(children_overlap(inode) > overlap_max) {
+    // The node keeps the same points, so that the boxes of the ancestors
+    // do not change
+    Float left[3], right[3];
+    Float boxsize3[3];
+    for(int k=0; k<3; ++k)
+      boxsize3[k]= tree->hi[k] - tree->lo[k];
+
+    construct_recursive_balanced(points, inode, ibegin, iend, left, right,
+				 boxsize3);
+    return iend - ibegin;
+  }
+
+  size_t n_left= 0;
+#ifdef _OPENMP
+  #pragma omp task default(shared) if(iend - ibegin > task_min)
+#endif
+  n_left= rebuild_degraded_recursive(left_child(inode), overlap_max);
+  const size_t n_right=
+    rebuild_degraded_recursive(right_child(inode), overlap_max);
+
+#ifdef _OPENMP
+  #pragma omp taskwait
+#endif
+
+  return n_left + n_right;
+}
+
+template<class T>
+static void set_points(T const * const p, const size_t np,
+		       const Float boxsize)
+{
+  // points[i] is the position of p[i]; T is Particle, Pos, or PosFixed
+  points.resize(np);
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared)
+#endif
+  for(size_t i=0; i<np; ++i) {
+    position_float(p[i], boxsize, points[i].x);
+    points[i].i= i;
+  }
 }
 
 
@@ -136,23 +312,74 @@ void construct_recursive_balanced(vector<T>& v, const size_t inode,
 // Global functions
 //
 KdTree* kdtree_init(Particles* const particles,
-		    Float const * const boxsize3, const int quota)
+		    Float const * const boxsize3, const int quota,
+		    const bool permute)
 {
   // boxsize3: the size of the cuboid containing particles. This is only used
   //           to determine the direction of cut, does not have to be an exact
   //           bounding box
   // quota (optional): the maximum number of particles in the leaf.
   //                   Empirically, default 32 is OK.
-  
-  const size_t np= particles->np_allocated;
+  // permute (optional): reorder particles to the tree order. Otherwise,
+  //                   particles are not changed and kdtree_get_points()[j].i
+  //                   is the index of the j-th particle in the tree order
+  set_points(particles->p, particles->np_local, particles->boxsize);
+  kdtree_init(points, particles->np_allocated, boxsize3, quota);
+
+  if(permute) {
+    const size_t np= particles->np_local;
+    Particle* const p= particles->p;
+    vector<Particle> buf(np);
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared)
+#endif
+    for(size_t j=0; j<np; ++j)
+      buf[j]= p[points[j].i];
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared)
+#endif
+    for(size_t j=0; j<np; ++j) {
+      p[j]= buf[j];
+      points[j].i= j;
+    }
+  }
+
+  return kdtree;
+}
+
+KdTree* kdtree_init(ParticlesSoA const * const particles,
+		    Float const * const boxsize3, const int quota)
+{
+  // Particles in the structure-of-arrays layout are not reordered;
+  // kdtree_get_points()[j].i is the index of the j-th particle in the tree
+  if(particles->position_fixed())
+    set_points(particles->xi, particles->np_local, particles->boxsize);
+  else
+    set_points(particles->x, particles->np_local, particles->boxsize);
+
+  return kdtree_init(points, particles->np_allocated, boxsize3, quota);
+}
+
+KdTree* kdtree_init(vector<KdPoint>& v, const size_t np_alloc,
+		    Float const * const boxsize3, const int quota)
+{
+  // Construct the kdtree for points v; v is reordered
+  // np_alloc: the tree is allocated for this number of points so that
+  //           the tree is reused while v.size() <= np_alloc
+  const size_t np= v.size();
+  assert(np <= np_alloc);
+
   Index nleaf= 1;
   int height_new= 0;
-  while(static_cast<size_t>(quota*nleaf) < np) {
+  while(static_cast<size_t>(quota*nleaf) < np_alloc) {
     nleaf= nleaf << 1;
     height_new++;
   }
 
   assert(nleaf == (1 << height_new));
+  assert(height_new < max_height);
 
   KdTree::quota= quota;
   
@@ -179,6 +406,17 @@ KdTree* kdtree_init(Particles* const particles,
     }
   }
 
+  leaves.clear();
+  node_leaf.clear();
+  tree_points= np > 0 ? &v.front() : 0;
+
+  if(np == 0) {
+    kdtree->ibegin= kdtree->iend= 0;
+    for(int k=0; k<3; ++k)
+      kdtree->lo[k]= kdtree->hi[k]= 0;
+    return kdtree;
+  }
+
   Float left[3], right[3];
   Float boxsize3_copy[3];
   if(boxsize3) {
@@ -187,23 +425,85 @@ KdTree* kdtree_init(Particles* const particles,
     boxsize3_copy[2]= boxsize3[2];
   }
   else {
-    compute_bounding_box(*particles->pv, 0, particles->np_local, left, right);
+    compute_bounding_box(v, 0, np, left, right);
     boxsize3_copy[0]= right[0] - left[0];
     boxsize3_copy[1]= right[1] - left[1];
     boxsize3_copy[2]= right[2] - left[2];
   }
 
-  construct_recursive_balanced(*particles->pv, 0, 0, particles->np_local,
-			       left, right, boxsize3_copy);
+#ifdef _OPENMP
+  #pragma omp parallel default(shared)
+  #pragma omp single
+#endif
+  construct_recursive_balanced(v, 0, 0, np, left, right, boxsize3_copy);
 
-  kdtree->k= 0;
-  set_left_right(kdtree, 0, left, right);
+  collect_leaves_recursive(0);
 
   //traverse_tree_recursive(0); // !!! debug
   
   return kdtree;
 }
 
+size_t kdtree_update(Particles* const particles, const Float overlap_max)
+{
+  // Update the tree built by kdtree_init(particles, ...) for the moved
+  // particles in O(N), without reordering them; particles must not be
+  // reordered or exchanged after the construction
+  //   1. The permutation is kept and the node boxes are refitted bottom up
+  //   2. Subtrees whose children overlap more than overlap_max of the node
+  //      extent are rebuilt
+  // The tree is constructed with kdtree_init(particles, 0, quota, false) if
+  // it is not built on these particles, or if a point drifts more than
+  // kdtree_update_margin*boxsize outside the box. Returns the number of
+  // points in the rebuilt subtrees.
+  //
+  // kdtree_get_points()[j].i is the index of the j-th particle in the tree
+  // order afterwards, and positions are not wrapped periodically
+  const size_t np= particles->np_local;
+
+  if(kdtree == 0 || np == 0 || points.size() != np ||
+     tree_points != &points.front()) {
+    kdtree_init(particles, 0, kdtree ? KdTree::quota : 32, false);
+    return np;
+  }
+
+  if(update_points(particles->p, particles->boxsize) > 0) {
+    // Points too far outside the box for the periodic distances
+    msg_printf(msg_verbose, "kdtree rebuilt; points drifted out of the box\n");
+    kdtree_init(particles, 0, KdTree::quota, false);
+    return np;
+  }
+
+  size_t nrebuilt= 0;
+
+#ifdef _OPENMP
+  #pragma omp parallel default(shared)
+  #pragma omp single
+#endif
+  {
+    refit_recursive(0);
+    nrebuilt= rebuild_degraded_recursive(0, overlap_max);
+  }
+
+  msg_printf(msg_verbose, "kdtree refitted; %lu of %lu points rebuilt\n",
+	     (unsigned long) nrebuilt, (unsigned long) np);
+
+  return nrebuilt;
+}
+
+void kdtree_free()
+{
+  // Free the tree; kdtree_get_root() is 0 until the next kdtree_init
+  free(kdtree);
+  kdtree= 0;
+  ntree_alloc= 0;
+  height= 0;
+  tree_points= 0;
+  leaves.clear();
+  node_leaf.clear();
+  vector<KdPoint>().swap(points);
+}
+
 KdTree* kdtree_get_root()
 {
   return kdtree;
@@ -214,11 +514,218 @@ size_t kdtree_get_height()
   return height;
 }
 
+vector<KdPoint> const& kdtree_get_points()
+{
+  // Points of the tree built from Particles or ParticlesSoA in the tree
+  // order
+  return points;
+}
+
+KdPoint const * kdtree_get_tree_points()
+{
+  // Points the current tree is built on, Particles, ParticlesSoA, or
+  // the vector given to kdtree_init, which must be alive for the queries
+  return tree_points;
+}
+
+vector<size_t> const& kdtree_get_leaves()
+{
+  // kdtree nodes of the leaves in the order of particles
+  return leaves;
+}
+
+void kdtree_leaf_neighbours(const Index l, const Float r, const Float boxsize,
+			    vector<Index>& v, const bool prune_3d)
+{
+  // Set v to the leaves after leaf l whose bounding boxes come within
+  // distance r of that of leaf l, in periodic box of boxsize
+  //
+  // prune_3d=false prunes nodes with the distance along one axis only,
+  // the longest edge of the parent, as the tree with 1-D node extents did
+  KdTree const * const leaf= kdtree + leaves[l];
+  const Float r2= r*r;
+  KdTreeCounter count= {0, 0, 0};
+
+  // stack of (node, axis of the 1-D test)
+  size_t stack[2*max_height];
+  int axis[2*max_height];
+  int n= 0;
+  stack[n]= 0;
+  axis[n++]= longest_axis(kdtree);
+
+  v.clear();
+
+  while(n > 0) {
+    --n;
+    const size_t inode= stack[n];
+    KdTree const * const tree= kdtree + inode;
+    count.visited++;
+
+    if(tree->iend <= leaf->iend)
+      continue; // no leaf after l under this node
+
+    const bool far= prune_3d ?
+      box_dist2(*tree, *leaf, boxsize) >= r2 :
+      periodic_interval_dist(tree->lo[axis[n]], tree->hi[axis[n]],
+			     leaf->lo[axis[n]], leaf->hi[axis[n]],
+			     boxsize) >= r;
+    if(far) {
+      count.pruned++;
+      continue;
+    }
+
+    if(is_leaf(tree)) {
+      if(prune_3d || box_dist2(*tree, *leaf, boxsize) < r2) {
+	v.push_back(node_leaf[inode]);
+	count.leaves++;
+      }
+      continue;
+    }
+
+    // Right child first, so that leaves are popped in the particle order
+    const int k= longest_axis(tree);
+    assert(n + 2 <= 2*max_height);
+    stack[n]= right_child(inode);
+    axis[n++]= k;
+    stack[n]= left_child(inode);
+    axis[n++]= k;
+  }
+
+#ifdef _OPENMP
+  #pragma omp atomic
+#endif
+  counter.visited += count.visited;
+#ifdef _OPENMP
+  #pragma omp atomic
+#endif
+  counter.pruned += count.pruned;
+#ifdef _OPENMP
+  #pragma omp atomic
+#endif
+  counter.leaves += count.leaves;
+}
+
+typedef pair<Float, Index> KnnEntry; // (squared distance, point)
+
+static void knn_search(Float const y[], const size_t k, const Float boxsize,
+		       vector<KnnEntry>& heap)
+{
+  // Collect the k nearest points of y in the max heap; the nearer child
+  // is searched first and nodes farther than the k-th point are pruned
+  size_t stack[max_height + 1];
+  Float bound[max_height + 1];
+  int n= 0;
+  stack[n]= 0;
+  bound[n++]= point_box_dist2(y, *kdtree, boxsize);
+
+  while(n > 0) {
+    --n;
+    const size_t inode= stack[n];
+    if(heap.size() == k && bound[n] >= heap.front().first)
+      continue;
+
+    KdTree const * const tree= kdtree + inode;
+    if(is_leaf(tree)) {
+      for(Index j=tree->ibegin; j<tree->iend; ++j) {
+	const KnnEntry e(point_dist2(y, tree_points[j].x, boxsize), j);
+	if(heap.size() < k) {
+	  heap.push_back(e);
+	  push_heap(heap.begin(), heap.end());
+	}
+	else if(e < heap.front()) {
+	  pop_heap(heap.begin(), heap.end());
+	  heap.back()= e;
+	  push_heap(heap.begin(), heap.end());
+	}
+      }
+      continue;
+    }
+
+    const size_t ileft= left_child(inode), iright= right_child(inode);
+    const Float d_left= point_box_dist2(y, kdtree[ileft], boxsize);
+    const Float d_right= point_box_dist2(y, kdtree[iright], boxsize);
+    const bool left_first= d_left <= d_right;
+
+    stack[n]= left_first ? iright : ileft;
+    bound[n++]= left_first ? d_right : d_left;
+    stack[n]= left_first ? ileft : iright;
+    bound[n++]= left_first ? d_left : d_right;
+  }
+}
+
+void kdtree_knn(Float const x[], const size_t n, const int k,
+		const Float boxsize, Index idx[], Float dist2[])
+{
+  // k nearest neighbours of n query points x[3*i .. 3*i + 2]
+  // idx[k*i + m] is KdPoint::i of the m-th nearest point of query i and
+  // dist2[k*i + m] its squared distance, in increasing distance;
+  // idx is -1 and dist2 is the maximum Float if the tree has < k points
+  const bool empty= kdtree == 0 || kdtree->iend == kdtree->ibegin;
+
+#ifdef _OPENMP
+  #pragma omp parallel default(shared)
+#endif
+  {
+    vector<KnnEntry> heap; // per thread
+    heap.reserve(k);
+
+#ifdef _OPENMP
+    #pragma omp for schedule(dynamic, 64)
+#endif
+    for(size_t i=0; i<n; ++i) {
+      heap.clear();
+      if(!empty && k > 0) {
+	Float y[3];
+	kdtree_wrap_query(x + 3*i, boxsize, y);
+	knn_search(y, k, boxsize, heap);
+	sort_heap(heap.begin(), heap.end());
+      }
+
+      for(int m=0; m<k; ++m) {
+	if(m < static_cast<int>(heap.size())) {
+	  idx[k*i + m]= tree_points[heap[m].second].i;
+	  dist2[k*i + m]= heap[m].first;
+	}
+	else {
+	  idx[k*i + m]= -1;
+	  dist2[k*i + m]= numeric_limits<Float>::max();
+	}
+      }
+    }
+  }
+}
+
+KdTreeCounter kdtree_get_counter()
+{
+  return counter;
+}
+
+void kdtree_reset_counter()
+{
+  counter.visited= counter.pruned= counter.leaves= 0;
+}
+
+void collect_leaves_recursive(const size_t inode)
+{
+  KdTree const * const tree= kdtree + inode;
+
+  if(is_leaf(tree)) {
+    if(node_leaf.size() <= inode)
+      node_leaf.resize(inode + 1, -1);
+    node_leaf[inode]= leaves.size();
+    leaves.push_back(inode);
+    return;
+  }
+
+  collect_leaves_recursive(left_child(inode));
+  collect_leaves_recursive(right_child(inode));
+}
+
 /*
 void traverse_tree_recursive(const size_t inode)
 {
   KdTree* const tree= kdtree + inode;
-  fprintf(stderr, "%zu %d [%f %f]\n", inode, tree->k, tree->left, tree->right);
+  fprintf(stderr, "%zu [%f %f]\n", inode, tree->lo[0], tree->hi[0]);
 
   if(is_leaf(tree)) return;
 
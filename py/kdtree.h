@@ -2,18 +2,43 @@
 #define KDTREE_H 1
 
 #include <vector>
+#include <algorithm>
+#include <cmath>
 #include "config.h"
 #include "particle.h"
 //#include "cluster.h"
 
+//
+// Nodes carry the bounding box of their particles; 32 bytes in single
+// precision. The children of node i are 2i + 1 and 2i + 2.
+//
 struct KdTree {
-  int k;
-  //Float left[3], right[3];
-  Float left, right;
+  Float lo[3], hi[3];
   Index ibegin, iend;
   static int quota;
 };
 
+// Position of particle i; the tree is built on an array of points
+struct KdPoint {
+  Float x[3];
+  Index i;
+};
+
+// Maximum height of the tree, and depth of the traversal stacks
+static const int kdtree_max_height= 64;
+
+// kdtree_update rebuilds the tree if a point drifts more than this fraction
+// of boxsize outside [0, boxsize); the periodic distances below consider
+// only the nearest images, which requires excursions < boxsize/4
+static const Float kdtree_update_margin= 0.125;
+
+// Pruning-efficiency counters of tree traversals
+struct KdTreeCounter {
+  uint64_t visited;   // nodes visited
+  uint64_t pruned;    // nodes rejected by the distance test
+  uint64_t leaves;    // leaves accepted
+};
+
 static inline size_t left_child(const size_t i)
 {
   return (i << 1) + 1;
@@ -26,14 +51,158 @@ static inline size_t right_child(const size_t i)
 
 static inline bool is_leaf(KdTree const * const tree)
 {
-  return (tree->iend - tree->ibegin) < KdTree::quota;
+  return (tree->iend - tree->ibegin) <= KdTree::quota;
+}
+
+
+static inline Float periodic_interval_dist(const Float a0, const Float a1,
+					   const Float b0, const Float b1,
+					   const Float boxsize)
+{
+  // Periodic distance between intervals [a0, a1] and [b0, b1]
+  Float d= std::max(std::max(b0 - a1, a0 - b1), Float(0));
+  d= std::min(d, std::max(std::max(b0 + boxsize - a1, a0 - b1 - boxsize),
+			  Float(0)));
+  d= std::min(d, std::max(std::max(b0 - boxsize - a1, a0 - b1 + boxsize),
+			  Float(0)));
+  return d;
+}
+
+static inline Float box_dist2(KdTree const& a, KdTree const& b,
+			      const Float boxsize)
+{
+  // Minimum squared distance between points in the boxes of a and b
+  Float d2= 0;
+  for(int k=0; k<3; ++k) {
+    const Float d= periodic_interval_dist(a.lo[k], a.hi[k], b.lo[k], b.hi[k],
+					  boxsize);
+    d2 += d*d;
+  }
+  return d2;
+}
+
+static inline Float box_max_dist2(KdTree const& a, KdTree const& b,
+				  const Float boxsize)
+{
+  // Upper bound of the squared distance between points in a and b,
+  // with b shifted to the periodic image closest to a in each axis
+  Float d2= 0;
+  for(int k=0; k<3; ++k) {
+    Float shift= 0;
+    if(b.lo[k] - a.hi[k] > a.lo[k] - b.hi[k] + boxsize)
+      shift= -boxsize;
+    else if(a.lo[k] - b.hi[k] > b.lo[k] - a.hi[k] + boxsize)
+      shift= boxsize;
+
+    const Float d= std::max(a.hi[k], b.hi[k] + shift) -
+                   std::min(a.lo[k], b.lo[k] + shift);
+    d2 += d*d;
+  }
+  return d2;
+}
+
+//
+// Neighbour search
+// Queries are periodic in a box of boxsize, or not periodic if boxsize = 0;
+// in the periodic case, the points must be in [0, boxsize), up to the
+// excursions of kdtree_update_margin*boxsize left by kdtree_update, and the
+// search radius smaller than boxsize/2
+//
+static inline void kdtree_wrap_query(Float const x[], const Float boxsize,
+				     Float y[])
+{
+  for(int k=0; k<3; ++k)
+    y[k]= boxsize > 0 ? x[k] - boxsize*std::floor(x[k]/boxsize) : x[k];
 }
 
+static inline Float point_box_dist2(Float const x[], KdTree const& b,
+				    const Float boxsize)
+{
+  // Minimum squared distance between x and the points in the box of b
+  Float d2= 0;
+  for(int k=0; k<3; ++k) {
+    const Float d= periodic_interval_dist(x[k], x[k], b.lo[k], b.hi[k],
+					  boxsize);
+    d2 += d*d;
+  }
+  return d2;
+}
+
+static inline Float point_dist2(Float const x[], Float const y[],
+				const Float boxsize)
+{
+  // Squared distance between x and y in [0, boxsize)
+  Float d2= 0;
+  for(int k=0; k<3; ++k) {
+    Float d= std::fabs(x[k] - y[k]);
+    if(boxsize > 0)
+      d= std::min(d, std::fabs(boxsize - d));
+    d2 += d*d;
+  }
+  return d2;
+}
 
 //void kdtree_construct(std::vector<Cluster>& v, const Float boxsize[]);
-KdTree* kdtree_init(Particles* const particles, const Float boxsize[], const int quota_=32);
+KdTree* kdtree_init(Particles* const particles, const Float boxsize[], const int quota_=32, const bool permute=true);
+KdTree* kdtree_init(ParticlesSoA const * const particles,
+		    const Float boxsize[], const int quota_=32);
+KdTree* kdtree_init(std::vector<KdPoint>& v, const size_t np_alloc,
+		    const Float boxsize[], const int quota_=32);
+size_t kdtree_update(Particles* const particles, const Float overlap_max=0.2);
+void kdtree_free();
 
 KdTree* kdtree_get_root();
 size_t kdtree_get_height();
 
+std::vector<KdPoint> const& kdtree_get_points();
+KdPoint const * kdtree_get_tree_points();
+std::vector<size_t> const& kdtree_get_leaves();
+void kdtree_leaf_neighbours(const Index l, const Float r, const Float boxsize,
+			    std::vector<Index>& v, const bool prune_3d=true);
+
+void kdtree_knn(Float const x[], const size_t n, const int k,
+		const Float boxsize, Index idx[], Float dist2[]);
+
+template<class Callback>
+void kdtree_radius_search(Float const x[], const Float r, const Float boxsize,
+			  Callback f)
+{
+  // Call f(KdPoint const& q, Float d2) for the points q of the tree with
+  // squared distance d2 <= r^2 from x
+  KdTree const * const kdtree= kdtree_get_root();
+  KdPoint const * const p= kdtree_get_tree_points();
+  if(kdtree == 0 || kdtree->iend == kdtree->ibegin)
+    return;
+
+  Float y[3];
+  kdtree_wrap_query(x, boxsize, y);
+  const Float r2= r*r;
+
+  size_t stack[kdtree_max_height + 1];
+  int n= 0;
+  stack[n++]= 0;
+
+  while(n > 0) {
+    const size_t inode= stack[--n];
+    KdTree const * const tree= kdtree + inode;
+    if(point_box_dist2(y, *tree, boxsize) > r2)
+      continue;
+
+    if(is_leaf(tree)) {
+      for(Index j=tree->ibegin; j<tree->iend; ++j) {
+	const Float d2= point_dist2(y, p[j].x, boxsize);
+	if(d2 <= r2)
+	  f(p[j], d2);
+      }
+      continue;
+    }
+
+    stack[n++]= right_child(inode);
+    stack[n++]= left_child(inode);
+  }
+}
+
+KdTreeCounter kdtree_get_counter();
+void kdtree_reset_counter();
+
 #endif
@@ -2,19 +2,28 @@
 #include <assert.h>
 #include <mpi.h>
 
-#include <gsl/gsl_integration.h>
-#include <gsl/gsl_roots.h>
-#include <gsl/gsl_sf_hyperg.h> 
-#include <gsl/gsl_errno.h>
-
 #include "particle.h"
 #include "msg.h"
+#include "util.h"
 #include "leapfrog.h"
 #include "cosmology.h"
 
 static double SqStd(double ai, double af);
 static double SphiStd(double ai, double af);
 
+template<class Access>
+static void kick(typename Access::Container* const particles,
+		 const double avel1, StepSchedule const * const schedule);
+template<class Access>
+static void drift(typename Access::Container* const particles,
+		  const double apos1, StepSchedule const * const schedule,
+		  Lightcone* const lightcone);
+template<class Access>
+static void interpolate(typename Access::Container const * const particles,
+			const double avel1, const double a_out,
+			const size_t ibegin, const size_t iend,
+			Particle* const out);
+
 void leapfrog_set_initial_velocity(Particles* const particles, const double a)
 {
   Particle* const p= particles->p;
@@ -38,18 +47,99 @@ void leapfrog_set_initial_velocity(Particles* const particles, const double a)
   msg_printf(msg_debug, "Dv= %e, Dv2= %e\n", Dv, D2v);
 }
 
-void leapfrog_kick(Particles* const particles, const double avel1)
+double leapfrog_kick_factor(const double ai, const double af)
+{
+  return SphiStd(ai, af);
+}
+
+double leapfrog_drift_factor(const double ai, const double af)
+{
+  return SqStd(ai, af);
+}
+
+void leapfrog_kick(Particles* const particles, const double avel1,
+		   StepSchedule const * const schedule)
+{
+  kick<ParticleAccessAoS>(particles, avel1, schedule);
+}
+
+void leapfrog_kick(ParticlesSoA* const particles, const double avel1,
+		   StepSchedule const * const schedule)
+{
+  kick<ParticleAccessSoA>(particles, avel1, schedule);
+}
+
+void leapfrog_drift(Particles* const particles, const double apos1,
+		    StepSchedule const * const schedule,
+		    Lightcone* const lightcone)
+{
+  drift<ParticleAccessAoS>(particles, apos1, schedule, lightcone);
+}
+
+void leapfrog_drift(ParticlesSoA* const particles, const double apos1,
+		    StepSchedule const * const schedule,
+		    Lightcone* const lightcone)
+{
+  if(particles->position_fixed())
+    drift<ParticleAccessSoAFixed>(particles, apos1, schedule, lightcone);
+  else
+    drift<ParticleAccessSoA>(particles, apos1, schedule, lightcone);
+}
+
+void leapfrog_interpolate(Particles const * const particles,
+			  const double avel1, const double a_out,
+			  const size_t ibegin, const size_t iend,
+			  Particle* const out)
+{
+  interpolate<ParticleAccessAoS>(particles, avel1, a_out, ibegin, iend, out);
+}
+
+void leapfrog_interpolate(ParticlesSoA const * const particles,
+			  const double avel1, const double a_out,
+			  const size_t ibegin, const size_t iend,
+			  Particle* const out)
+{
+  if(particles->position_fixed())
+    interpolate<ParticleAccessSoAFixed>(particles, avel1, a_out,
+					ibegin, iend, out);
+  else
+    interpolate<ParticleAccessSoA>(particles, avel1, a_out,
+				   ibegin, iend, out);
+}
+
+static double SphiStd(double ai, double af)
+{
+  // \int_ai^af dt/a = \int da/(a^2 H(a))
+  return cosmology_time_integral(ai, af, 1.0);
+}
+
+static double SqStd(double ai, double af)
+{
+  // \int_ai^af dt/a^2 = \int da/(a^3 H(a))
+  return cosmology_time_integral(ai, af, 0.0);
+}
+
+template<class Access>
+static void kick(typename Access::Container* const particles,
+		 const double avel1, StepSchedule const * const schedule)
 {
   const double ai=  particles->a_v;  // t - 0.5*dt
   const double af=  avel1;           // t + 0.5*dt
 
   const double om= cosmology_omega_m();
-  const Float kick_factor= SphiStd(ai, af);
+
+  KickFactors const * const k=
+    schedule ? schedule->find_kick(ai, particles->a_x, af) : 0;
+  if(schedule && k == 0)
+    msg_printf(msg_warn, "Warning: kick %lg -> %lg not in StepSchedule\n",
+	       ai, af);
+
+  const Float kick_factor= k ? k->leapfrog_kick : SphiStd(ai, af);
 
   msg_printf(msg_info, "Leapfrog kick %lg -> %lg\n", ai, avel1);
   msg_printf(msg_debug, "kick_factor = %lg\n", kick_factor);
 
-  Particle* const p= particles->p;
+  const Access p(particles);
   const size_t np= particles->np_local;
   Float3* const f= particles->force;
 
@@ -59,88 +149,103 @@ void leapfrog_kick(Particles* const particles, const double avel1)
   #pragma omp parallel for default(shared)
 #endif
   for(size_t i=0; i<np; i++) {
-    p[i].v[0] += -1.5*om*f[i][0]*kick_factor;
-    p[i].v[1] += -1.5*om*f[i][1]*kick_factor;
-    p[i].v[2] += -1.5*om*f[i][2]*kick_factor;
+    Float* const v= p.v(i);
+    v[0] += -1.5*om*f[i][0]*kick_factor;
+    v[1] += -1.5*om*f[i][1]*kick_factor;
+    v[2] += -1.5*om*f[i][2]*kick_factor;
   }
   
   particles->a_v= avel1;
 }
 
-void leapfrog_drift(Particles* const particles, const double apos1)
+template<class Access>
+static void drift(typename Access::Container* const particles,
+		  const double apos1, StepSchedule const * const schedule,
+		  Lightcone* const lightcone)
 {
   const double ai= particles->a_x;
   const double af= apos1;
   
-  Particle* const p= particles->p;
+  const Access p(particles);
   const size_t np= particles->np_local;
 
-  const double dt=SqStd(ai, af);
+  DriftFactors const * const d=
+    schedule ? schedule->find_drift(ai, af, particles->a_v) : 0;
+  if(schedule && d == 0)
+    msg_printf(msg_warn, "Warning: drift %lg -> %lg not in StepSchedule\n",
+	       ai, af);
+
+  const double dt= d ? d->leapfrog_dt : SqStd(ai, af);
 
   msg_printf(msg_info, "Leapfrog drift %lg -> %lg\n", ai, af);
   msg_printf(msg_debug, "dt = %lg\n", dt);
 
+  if(lightcone)
+    lightcone->begin_drift(ai, af, false);
+  const bool record_lightcone= lightcone && lightcone->active();
+  const Float boxsize= particles->boxsize;
+
   // Drift
 #ifdef _OPENMP
   #pragma omp parallel for default(shared)
 #endif
   for(size_t i=0; i<np; i++) {
-    p[i].x[0] += p[i].v[0]*dt;
-    p[i].x[1] += p[i].v[1]*dt;
-    p[i].x[2] += p[i].v[2]*dt;
+    Float const * const v= p.v(i);
+    Float d[3];
+    d[0]= v[0]*dt;
+    d[1]= v[1]*dt;
+    d[2]= v[2]*dt;
+
+    if(record_lightcone) {
+      Float x[3];
+      position_float(p.positions()[i], boxsize, x);
+      lightcone->check(p.id(i), x, d, v);
+    }
+    p.move(i, d);
   }
+
+  if(lightcone)
+    lightcone->end_drift();
     
   particles->a_x= af;
 }
 
-static double funSphiStd (double a, void* params)
+template<class Access>
+static void interpolate(typename Access::Container const * const particles,
+			const double avel1, const double a_out,
+			const size_t ibegin, const size_t iend,
+			Particle* const out)
 {
-  const double om= *(double*) params;
-  
-  return 1.0/(sqrt(om/(a*a*a) + 1.0 - om)*a*a);
-}
+  // Positions and velocities at a_out, if the next step kicked to avel1
+  // and drifted to a_out; the force at a_x is used for the kick to a_out
+  const double a_v= particles->a_v;
+  const double om= cosmology_omega_m();
 
-static double SphiStd(double ai, double af)
-{
-  gsl_integration_workspace* const w 
-    = gsl_integration_workspace_alloc(5000);
-
-  double omega_m= cosmology_omega_m();
-     
-  gsl_function F;
-  F.function= &funSphiStd;
-  F.params= &omega_m;
-
-  double result, error;
-  gsl_integration_qag(&F, ai, af, 0, 1e-5, 5000, 6,
-		      w, &result, &error); 
-  
-  gsl_integration_workspace_free(w);
-     
-  return result;
-}
+  const Float kick_vel= SphiStd(a_v, avel1);
+  const Float kick_out= SphiStd(a_v, a_out);
+  const Float dt= SqStd(particles->a_x, a_out);
 
-static double funSqStd (double a, void* params)
-{
-  const double om= *(double*) params;
-  return 1.0/(sqrt(om/(a*a*a) + 1.0 - om)*a*a*a);
-}
-     
-static double SqStd(double ai, double af)
-{
-  gsl_integration_workspace* const w 
-    = gsl_integration_workspace_alloc(5000);
-       
-  double result, error;
-
-  double omega_m= cosmology_omega_m();
-     
-  gsl_function F;
-  F.function= &funSqStd;
-  F.params= &omega_m;
-     
-  gsl_integration_qag(&F, ai, af, 0, 1e-5, 5000, 6, w, &result, &error);      
-  gsl_integration_workspace_free(w);
-  
-  return result;
+  // particle data are only read
+  const Access p(const_cast<typename Access::Container*>(particles));
+  Float3 const * const f= particles->force;
+  const Float boxsize= particles->boxsize;
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared)
+#endif
+  for(size_t i=ibegin; i<iend; i++) {
+    Float const * const v= p.v(i);
+    Particle& o= out[i - ibegin];
+
+    Float x[3];
+    position_float(p.positions()[i], boxsize, x);
+
+    for(int k=0; k<3; k++) {
+      Float acc= -1.5*om*f[i][k];
+      o.x[k]= periodic_wrapup_x(x[k] + (v[k] + acc*kick_vel)*dt, boxsize);
+      o.v[k]= v[k] + acc*kick_out;
+      o.dx1[k]= o.dx2[k]= 0;
+    }
+    o.id= p.id(i);
+  }
 }
@@ -2,9 +2,34 @@
 #define LEAPFROG_H 1
 
 #include "particle.h"
+#include "step_schedule.h"
+#include "lightcone.h"
 
 void leapfrog_set_initial_velocity(Particles* const particles, const double a);
-void leapfrog_kick(Particles* const particles, const double avel1);
-void leapfrog_drift(Particles* const particles, const double apos1);
+void leapfrog_kick(Particles* const particles, const double avel1,
+		   StepSchedule const * const schedule=0);
+void leapfrog_drift(Particles* const particles, const double apos1,
+		    StepSchedule const * const schedule=0,
+		    Lightcone* const lightcone=0);
+void leapfrog_kick(ParticlesSoA* const particles, const double avel1,
+		   StepSchedule const * const schedule=0);
+void leapfrog_drift(ParticlesSoA* const particles, const double apos1,
+		    StepSchedule const * const schedule=0,
+		    Lightcone* const lightcone=0);
+
+// Particles i in [ibegin, iend) at a_out within the next step, kick to
+// avel1 followed by drift to a_out, written to out[i - ibegin] without
+// changing particles
+void leapfrog_interpolate(Particles const * const particles,
+			  const double avel1, const double a_out,
+			  const size_t ibegin, const size_t iend,
+			  Particle* const out);
+void leapfrog_interpolate(ParticlesSoA const * const particles,
+			  const double avel1, const double a_out,
+			  const size_t ibegin, const size_t iend,
+			  Particle* const out);
+
+double leapfrog_kick_factor(const double ai, const double af);
+double leapfrog_drift_factor(const double ai, const double af);
 
 #endif
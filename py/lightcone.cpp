@@ -0,0 +1,162 @@
+//
+// Past lightcone recorded during drifts
+//
+#include <cmath>
+#include <algorithm>
+#include "msg.h"
+#include "comm.h"
+#include "error.h"
+#include "cosmology.h"
+#include "lightcone.h"
+
+using namespace std;
+
+namespace {
+  // Particles move less than this fraction of the box in one drift;
+  // replicas are selected with this margin around the box
+  const double replica_margin= 0.1;
+}
+
+Lightcone::Lightcone(LightconeWriter* const writer_, const double boxsize_,
+		     double const observer_[], const double a_min_) :
+  writer(writer_), boxsize(boxsize_), a_min(a_min_),
+  ai(0.0), af(0.0), chi_i(0), chi_f(0), t_min(0),
+  dv1_i(0), dv1_f(0), dv2_i(0), dv2_f(0), n_written(0)
+{
+  for(int k=0; k<3; ++k)
+    observer[k]= observer_[k];
+
+  buf.resize(1);
+
+  msg_printf(msg_verbose,
+	     "Lightcone with observer at (%.1f, %.1f, %.1f), a >= %.3f\n",
+	     observer[0], observer[1], observer[2], a_min);
+}
+
+Lightcone::~Lightcone()
+{
+  close();
+}
+
+void Lightcone::close()
+{
+  // Close the writer; collective
+  delete writer;
+  writer= 0;
+  replicas.clear();
+}
+
+void Lightcone::begin_drift(const double ai_, const double af_,
+			    const bool cola)
+{
+  // Prepare for drift ai -> af; no particle is checked if the shell
+  // chi(af) < r < chi(ai) is outside the lightcone range
+  ai= ai_;
+  af= af_;
+  replicas.clear();
+
+#ifdef _OPENMP
+  // One buffer per thread of the drift loop, which may change between drifts
+  buf.resize(max(omp_get_max_threads(), 1));
+#endif
+
+  if(writer == 0 || af < a_min || ai >= 1.0)
+    return;
+
+  chi_i= cosmology_comoving_distance(ai);
+  chi_f= max(cosmology_comoving_distance(af), 0.0);
+
+  // Crossings are limited to a_min <= a in a drift straddling a_min;
+  // chi_f >= 0 limits them to a <= 1
+  t_min= 0;
+  if(ai < a_min && chi_i > chi_f)
+    t_min= (chi_i - cosmology_comoving_distance(a_min))/(chi_i - chi_f);
+
+  if(cola) {
+    const double D1_i= cosmology_D_growth(ai);
+    const double D1_f= cosmology_D_growth(af);
+    dv1_i= cosmology_Dv_growth(ai, D1_i);
+    dv1_f= cosmology_Dv_growth(af, D1_f);
+    dv2_i= cosmology_D2v_growth(ai, cosmology_D2_growth(ai, D1_i));
+    dv2_f= cosmology_D2v_growth(af, cosmology_D2_growth(af, D1_f));
+  }
+  else {
+    dv1_i= dv1_f= dv2_i= dv2_f= 0;
+  }
+
+  // a(t) for t = j/n_a_table by bisection in chi, which decreases with a
+  for(int j=0; j<=n_a_table; ++j) {
+    const double chi= chi_i + (chi_f - chi_i)*j/n_a_table;
+    double a0= ai, a1= af;
+    for(int iter=0; iter<40; ++iter) {
+      const double a= 0.5*(a0 + a1);
+      if(cosmology_comoving_distance(a) > chi)
+	a0= a;
+      else
+	a1= a;
+    }
+    a_table[j]= 0.5*(a0 + a1);
+  }
+
+  // Box replicas intersecting the shell
+  const double margin= replica_margin*boxsize;
+  int n_min[3], n_max[3];
+  for(int k=0; k<3; ++k) {
+    n_min[k]= (int) floor((observer[k] - chi_i - margin)/boxsize);
+    n_max[k]= (int) floor((observer[k] + chi_i + margin)/boxsize);
+  }
+
+  int n[3];
+  for(n[0]=n_min[0]; n[0]<=n_max[0]; ++n[0]) {
+    for(n[1]=n_min[1]; n[1]<=n_max[1]; ++n[1]) {
+      for(n[2]=n_min[2]; n[2]<=n_max[2]; ++n[2]) {
+	double dmin2= 0.0, dmax2= 0.0;
+	for(int k=0; k<3; ++k) {
+	  const double lo= n[k]*boxsize - margin - observer[k];
+	  const double hi= (n[k] + 1)*boxsize + margin - observer[k];
+	  const double dmin= lo > 0.0 ? lo : (hi < 0.0 ? -hi : 0.0);
+	  const double dmax= max(fabs(lo), fabs(hi));
+	  dmin2 += dmin*dmin;
+	  dmax2 += dmax*dmax;
+	}
+
+	if(dmin2 <= chi_i*chi_i && dmax2 >= chi_f*chi_f) {
+	  for(int k=0; k<3; ++k)
+	    replicas.push_back(n[k]*boxsize);
+	}
+      }
+    }
+  }
+
+  msg_printf(msg_verbose,
+	     "Lightcone drift %lg -> %lg, chi %.1f -> %.1f, %d replicas\n",
+	     ai, af, chi_i, chi_f, (int) replicas.size()/3);
+}
+
+void Lightcone::end_drift()
+{
+  // Write the particles that crossed the lightcone; collective
+  if(!active())
+    return;
+
+  size_t np= 0;
+  for(vector<vector<LightconeParticle> >::const_iterator b= buf.begin();
+      b != buf.end(); ++b)
+    np += b->size();
+
+  vector<LightconeParticle>& p= buf.front();
+  p.reserve(np);
+  for(size_t j=1; j<buf.size(); ++j) {
+    p.insert(p.end(), buf[j].begin(), buf[j].end());
+    buf[j].clear();
+  }
+
+  writer->write(p.empty() ? 0 : &p.front(), p.size());
+
+  const long long np_drift= comm_sum<long long>(p.size());
+  n_written += np_drift;
+  p.clear();
+
+  msg_printf(msg_info, "Lightcone %lg -> %lg: %lld particles\n",
+	     ai, af, np_drift);
+}
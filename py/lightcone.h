@@ -0,0 +1,142 @@
+#ifndef LIGHTCONE_H
+#define LIGHTCONE_H 1
+
+#include <vector>
+#include <cmath>
+#include <cassert>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "config.h"
+
+//
+// Past lightcone recorded during drifts
+//
+// A particle image (a periodic replica of the box) crosses the lightcone
+// when its distance from the observer, r, becomes equal to the comoving
+// distance chi(a). In each drift ai -> af, the position and chi are
+// interpolated linearly in a drift parameter t in [0, 1]; particles with
+// a sign change in r - chi are stored with the position and velocity at
+// the crossing, and written at the end of the drift. The scale factor at
+// the crossing is a(t) with chi(a(t)) = chi_i + t*(chi_f - chi_i); only
+// crossings with a_min <= a(t) <= 1 are recorded.
+//
+
+struct LightconeParticle {
+  uint64_t id;
+  Float a;
+  Float x[3], v[3];
+};
+
+// Destination of lightcone particles; write is collective and np can be 0
+class LightconeWriter {
+ public:
+  virtual ~LightconeWriter() {}
+  virtual void write(LightconeParticle const * const p, const size_t np)= 0;
+};
+
+class Lightcone {
+ public:
+  // Lightcone takes the ownership of writer
+  Lightcone(LightconeWriter* const writer, const double boxsize,
+	    double const observer[], const double a_min=0.0);
+  ~Lightcone();
+
+  void begin_drift(const double ai, const double af, const bool cola);
+  void end_drift();
+  void close();
+
+  // Check particle at x moving by d in the drift; v is the velocity
+  // of the drift, with COLA LPT velocity from dx1 and dx2 added
+  template<class Disp>
+  void check(const uint64_t id, Float const x[], Float const d[],
+	     Float const v[], Disp const& dx1, Disp const& dx2) {
+    const size_t n= replicas.size();
+    for(size_t j=0; j<n; j+=3) {
+      Float t;
+      if(crossing(x, d, &replicas[j], &t)) {
+	LightconeParticle& p= add(id, x, d, &replicas[j], t);
+	const Float dv1= dv1_i + t*(dv1_f - dv1_i);
+	const Float dv2= dv2_i + t*(dv2_f - dv2_i);
+	for(int k=0; k<3; ++k)
+	  p.v[k]= v[k] + dv1*dx1[k] + dv2*dx2[k];
+      }
+    }
+  }
+
+  // Same for leapfrog, without the LPT velocity
+  void check(const uint64_t id, Float const x[], Float const d[],
+	     Float const v[]) {
+    const size_t n= replicas.size();
+    for(size_t j=0; j<n; j+=3) {
+      Float t;
+      if(crossing(x, d, &replicas[j], &t)) {
+	LightconeParticle& p= add(id, x, d, &replicas[j], t);
+	for(int k=0; k<3; ++k)
+	  p.v[k]= v[k];
+      }
+    }
+  }
+
+  bool active() const { return !replicas.empty(); }
+  uint64_t np_total() const { return n_written; }
+
+ private:
+  bool crossing(Float const x[], Float const d[], Float const offset[],
+		Float* const t) const {
+    // Fraction t of the drift at which x + offset + t*d crosses
+    Float ri= 0, rf= 0;
+    for(int k=0; k<3; ++k) {
+      const Float y= x[k] + offset[k] - observer[k];
+      ri += y*y;
+      rf += (y + d[k])*(y + d[k]);
+    }
+    const Float fi= std::sqrt(ri) - chi_i;
+    const Float ff= std::sqrt(rf) - chi_f;
+    if(fi < 0 && ff >= 0) {
+      *t= fi/(fi - ff);
+      return *t >= t_min;
+    }
+    return false;
+  }
+
+  Float scale_factor(const Float t) const {
+    // a(t) interpolated from the table for this drift
+    const Float x= t*n_a_table;
+    const int j= x < n_a_table - 1 ? static_cast<int>(x) : n_a_table - 1;
+    return a_table[j] + (x - j)*(a_table[j + 1] - a_table[j]);
+  }
+
+  LightconeParticle& add(const uint64_t id, Float const x[], Float const d[],
+			 Float const offset[], const Float t) {
+#ifdef _OPENMP
+    assert(omp_get_thread_num() < static_cast<int>(buf.size()));
+    std::vector<LightconeParticle>& b= buf[omp_get_thread_num()];
+#else
+    std::vector<LightconeParticle>& b= buf[0];
+#endif
+    b.push_back(LightconeParticle());
+    LightconeParticle& p= b.back();
+    p.id= id;
+    p.a= scale_factor(t);
+    for(int k=0; k<3; ++k)
+      p.x[k]= x[k] + offset[k] + t*d[k];
+    return p;
+  }
+
+  LightconeWriter* writer;
+  const Float boxsize;
+  Float observer[3];
+  const double a_min;
+  double ai, af;
+  Float chi_i, chi_f;
+  Float t_min;                       // t at a_min, or 0
+  static const int n_a_table= 32;
+  Float a_table[n_a_table + 1];      // a at t = j/n_a_table
+  Float dv1_i, dv1_f, dv2_i, dv2_f;  // COLA LPT velocity factors
+  std::vector<Float> replicas;       // offsets of box replicas, 3 per replica
+  std::vector<std::vector<LightconeParticle> > buf; // per thread
+  uint64_t n_written;
+};
+
+#endif
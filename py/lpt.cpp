@@ -7,8 +7,13 @@
 #include <iostream>
 #include <cmath>
 #include <cassert>
+#include <vector>
+#include <string>
+#include <algorithm>
 #include <gsl/gsl_rng.h>
 #include "msg.h"
+#include "error.h"
+#include "comm.h"
 #include "mem.h"
 #include "config.h"
 #include "cosmology.h"
@@ -28,67 +33,135 @@ namespace {
   size_t local_ix0;
   Float offset= 0.5;
 
-  FFT* fft_psi[3];    // Zeldovichi displacement Psi_i
-  FFT* fft_psi_ij[6]; // derivative Psi_i,j= dPsi_i/dq_j
-  FFT* fft_psi2[3];   // 2nd order displacement Psi(2)
+  // Fields are interleaved, e.g., Psi_i at grid index is fx[3*index + i],
+  // so that all components are transformed with one FFTW plan
+  FFT* fft_psi;       // Zeldovichi displacement Psi_i (3 fields)
+  FFT* fft_psi_ij;    // derivative Psi_i,j= dPsi_i/dq_j (6 fields)
+  FFT* fft_psi2;      // 2nd order displacement Psi(2) (3 fields)
   FFT* fft_div_psi2;  // divergence of Psi(2)
+  // fft_div_psi2 and fft_psi2 share memory with fft_psi_ij
+
+  // 3LPT, allocated only if lpt_init is called with third_order
+  FFT* fft_psi2_ij= 0; // derivative Psi(2)_i,j (6 fields)
+  FFT* fft_src3= 0;    // div Psi(3) and curl Psi(3) (4 fields)
+  FFT* fft_psi3= 0;    // 3rd order displacement Psi(3) at a (3 fields)
+  // fft_src3 shares memory with fft_psi_ij, fft_psi3 with fft_psi2_ij
+  
+  Mem* own_mem= 0;    // Allocated if lpt_init is called with mem = 0
+  Mem* lpt_mem= 0;    // Memory used for the FFT grids
 
   void set_seedtable(const int nc, gsl_rng* random_generator,
 		     unsigned int* const stable);
-  void lpt_generate_psi_k(const unsigned long seed, PowerSpectrum* const);
+  void lpt_generate_psi_k(const unsigned long seed, PowerSpectrum* const,
+			  const bool fix_amplitude, const bool invert_phase);
   void lpt_compute_psi2_k(void);
+  void lpt_compute_psi3_k(const double a, Particles* const particles);
+  void compute_psi_ij_k(FFT const * const fft_psi, FFT* const fft_psi_ij);
+  bool is_lpt_kind(const string& kind);
+  void max_displacements(Float* const dx1_max, Float* const dx2_max);
+  void growth_factors(const double a, const string& kind,
+		      Float* D1, Float* D2, Float* Dv, Float* D2v, Float* D3v);
 }
 
-void lpt_init(const int nc_, const double boxsize_, Mem* mem)
+void lpt_init(const int nc_, const double boxsize_, Mem* mem,
+	      const bool third_order)
 {
   // nc_: number of particles per dimension
   // boxsize_: box length on a side
   // Mem: Memory object for LPT, can be 0.
   //      If mem = 0, memory is allocated exclusively for LPT
+  // third_order: allocate 6 more grids for 3LPT (kind "3lpt", "cola3lpt")
+  //
+  // lpt_init may be called multiple times; FFT plans and memory are reused
+  // if the parameters are the same
+  //
+  if(nc > 0) {
+    if(nc_ == static_cast<int>(nc) && boxsize_ == boxsize &&
+       (fft_psi3 != 0 || !third_order) &&
+       (mem == 0 ? own_mem != 0 : mem == lpt_mem))
+      return;
+    
+    lpt_free();
+  }
+    
   boxsize= boxsize_;
   nc= nc_;
 
   msg_printf(msg_debug, "lpt_init(nc= %d, boxsize= %.1lf)\n", nc, boxsize);
 
-  if(mem)
-    mem->use_from_zero(0);
-  
-  for(int i=0; i<3; i++)
-    fft_psi[i]= new FFT("Psi_i", nc, mem, 0);
+  if(mem == 0) {
+    own_mem= new Mem("LPT", lpt_mem_size(nc, third_order));
+    mem= own_mem;
+  }
+  lpt_mem= mem;
 
-  for(int i=0; i<6; i++)
-    fft_psi_ij[i]= new FFT("Psi_ij", nc, mem, 0);
+  const size_t size_psi_ij= fft_mem_size(nc, 0, 6);
+  const size_t size_psi= fft_mem_size(nc, 0, 3);
 
-  for(int i=0; i<3; i++)
-    fft_psi2[i]= fft_psi_ij[i];
+  mem->use_from_zero(0);
+  fft_psi_ij= new FFT("Psi_ij", nc, mem, 0, 6);
+  fft_psi= new FFT("Psi_i", nc, mem, 0, 3);
+  if(third_order)
+    fft_psi2_ij= new FFT("Psi2_ij", nc, mem, 0, 6);
 
-  fft_div_psi2= fft_psi_ij[3];
+  // div Psi(2) and Psi(2) reuse the memory for Psi_ij
+  mem->use_from_zero(0);
+  fft_div_psi2= new FFT("div_Psi2", nc, mem, 0, 1);
+  fft_psi2= new FFT("Psi2", nc, mem, 0, 3);
+  assert(fft_mem_size(nc, 0, 1) + fft_mem_size(nc, 0, 3) <= size_psi_ij);
+
+  if(third_order) {
+    // 3LPT source reuses Psi_ij, and Psi(3) reuses Psi(2)_ij
+    mem->use_from_zero(0);
+    fft_src3= new FFT("Psi3_source", nc, mem, 0, 4);
+
+    mem->use_from_zero(size_psi_ij + size_psi);
+    fft_psi3= new FFT("Psi3", nc, mem, 0, 3);
+  }
+  
+  mem->use_from_zero(lpt_mem_size(nc, third_order));
   
   seedtable = (unsigned int *) malloc(nc*nc*sizeof(unsigned int)); assert(seedtable);
 
   // checks
-  local_nx= fft_psi[0]->local_nx;
-  local_ix0= fft_psi[0]->local_ix0;
-  
-  for(int i=0; i<3; i++) {
-    assert(fft_psi[i]->nc == nc);
-    assert(fft_psi[i]->local_nx == static_cast<ptrdiff_t>(local_nx));
-    assert(fft_psi[i]->local_ix0 == static_cast<ptrdiff_t>(local_ix0));
-  }
-  for(int i=0; i<6; i++) {
-    assert(fft_psi_ij[i]->nc == nc);
-    assert(fft_psi_ij[i]->local_nx == static_cast<ptrdiff_t>(local_nx));
-    assert(fft_psi_ij[i]->local_ix0 == static_cast<ptrdiff_t>(local_ix0));
+  local_nx= fft_psi->local_nx;
+  local_ix0= fft_psi->local_ix0;
+
+  FFT const * const ffts[]= {fft_psi, fft_psi_ij, fft_div_psi2, fft_psi2,
+			     fft_psi2_ij, fft_src3, fft_psi3};
+  for(int i=0; i<7; i++) {
+    if(ffts[i] == 0) continue;
+    assert(ffts[i]->nc == nc);
+    assert(ffts[i]->local_nx == static_cast<ptrdiff_t>(local_nx));
+    assert(ffts[i]->local_ix0 == static_cast<ptrdiff_t>(local_ix0));
   }
 }
 
+size_t lpt_mem_size(const int nc, const bool third_order)
+{
+  // Memory required for lpt_init(nc, boxsize, mem, third_order)
+  size_t size= fft_mem_size(nc, 0, 6) + fft_mem_size(nc, 0, 3);
+  if(third_order)
+    size += fft_mem_size(nc, 0, 6);
+
+  return size;
+}
+
 void lpt_free()
 {
-  for(int i=0; i<3; i++)
-    delete fft_psi[i];
+  // Free the LPT memory and FFT plans; lpt_init is needed again
+  delete fft_psi2;     fft_psi2= 0;
+  delete fft_div_psi2; fft_div_psi2= 0;
+  delete fft_psi;      fft_psi= 0;
+  delete fft_psi_ij;   fft_psi_ij= 0;
+
+  delete fft_psi3;     fft_psi3= 0;
+  delete fft_src3;     fft_src3= 0;
+  delete fft_psi2_ij;  fft_psi2_ij= 0;
 
-  for(int i=0; i<6; i++)
-    delete fft_psi_ij[i];
+  delete own_mem;
+  own_mem= 0;
+  lpt_mem= 0;
 
   free(seedtable);
   seedtable= 0;
@@ -99,21 +172,45 @@ void lpt_free()
 
 void lpt_set_displacements(const unsigned long seed, PowerSpectrum* const ps,
 			   const double a, const char ckind[],
-			   Particles* particles)
+			   Particles* particles,
+			   const bool fix_amplitude, const bool invert_phase)
 {
   //
   // kind
   //  "zeldovich" x (1LPT) v (1LPT)
   //  "2lpt"      x (2LPT) v (2LPT)
   //  "cola":     x (2LPT) v (0)
+  //  "3lpt"      x (3LPT) v (3LPT)
+  //  "cola3lpt"  x (3LPT) v (3LPT - 2LPT)
+  //
+  // For 3LPT, the third-order term is added to x and v directly;
+  // only dx1 and dx2 are stored in particles.
+  //
+  // fix_amplitude: |delta_k| = sqrt(P(k)) instead of Rayleigh distribution
+  // invert_phase:  phase + pi, i.e., -delta_k, for a pair of simulations
   //
   if(nc == 0 || seedtable == 0) {
     msg_printf(msg_error,
 	       "Error: lpt_init() not called before lpt_set_displacements");
     return;
   }
+
+  msg_printf(msg_verbose, "LPT initial condition: %s\n", ckind);
+  const string kind(ckind);
+  const bool third_order= kind == "3lpt" || kind == "cola3lpt";
+
+  if(!is_lpt_kind(kind)) {
+    msg_printf(msg_error, "Error: unknown LPT kind %s\n", ckind);
+    return;
+  }
+
+  if(third_order && fft_psi3 == 0) {
+    msg_printf(msg_error,
+	       "Error: lpt_init() not called with third_order for %s\n", ckind);
+    return;
+  }
   
-  msg_printf(msg_verbose, "Computing 2LPT\n");
+  msg_printf(msg_verbose, "Computing %s\n", third_order ? "3LPT" : "2LPT");
   assert(particles);
   size_t np_local= local_nx*nc*nc;
   if(particles->np_allocated < np_local)
@@ -121,66 +218,55 @@ void lpt_set_displacements(const unsigned long seed, PowerSpectrum* const ps,
 	      "np_allocated= %lu < required %lu\n",
 	      particles->np_allocated, np_local);
  
-  lpt_generate_psi_k(seed, ps);
+  lpt_generate_psi_k(seed, ps, fix_amplitude, invert_phase);
 
   lpt_compute_psi2_k();
 
-  // precondition: psi_k in fft_psi[]->fk and psi2_k in fft_psi2[]->fk
+  // precondition: psi_k in fft_psi->fk and psi2_k in fft_psi2->fk
 
-  // Convert Psi_k Psi2_k to realspace
-  msg_printf(msg_verbose, "Fourier transforming 2LPT displacements\n");
-  for(int i=0; i<3; i++) {
-    fft_psi[i]->execute_inverse();
-    fft_psi2[i]->execute_inverse();
+  if(third_order) {
+    // Psi(2) is stored in particles->dx2 and psi3_k is in fft_psi3->fk
+    lpt_compute_psi3_k(a, particles);
   }
 
-  Float* psi[]=  {fft_psi[0]->fx, fft_psi[1]->fx, fft_psi[2]->fx};
-  Float* psi2[]= {fft_psi2[0]->fx, fft_psi2[1]->fx, fft_psi2[2]->fx};
+  // Convert Psi_k Psi2_k (Psi3_k) to realspace
+  msg_printf(msg_verbose, "Fourier transforming LPT displacements\n");
+  fft_psi->execute_inverse();
+  if(third_order)
+    fft_psi3->execute_inverse();
+  else
+    fft_psi2->execute_inverse();
+
+  Float const * const psi= fft_psi->fx;
+  Float const * const psi2= fft_psi2->fx;
+  Float const * const psi3= third_order ? fft_psi3->fx : 0;
   
 
   msg_printf(msg_verbose, "Setting particle grid and displacements\n");
 
   const size_t nczr= 2*(nc/2 + 1);
   const Float dx= boxsize/nc;
-  Particle* p= particles->p;
 
   double nmesh3_inv= 1.0/pow((double)nc, 3.0);
-  uint64_t id= (uint64_t) local_ix0*nc*nc + 1;
 
   //
   // kind of particle initial condition
   //
-  msg_printf(msg_verbose, "LPT initial condition: %s\n", ckind);
-  const string kind(ckind);
-  
-  const Float D1= cosmology_D_growth(a);
-  const Float D2= kind == "zeldovich" ? 0.0 : cosmology_D2_growth(a, D1);
-
-  msg_printf(msg_verbose, "LPT growth factor for a=%e: D1= %e, D2= %e\n",
-	     a, D1, D2);
-
-  Float Dv, D2v;
-  if(kind == "cola") {
-    Dv= D2v= 0.0;
-  }
-  else if(kind == "zeldovich") {
-    Dv= cosmology_Dv_growth(a, D1);
-    D2v= 0.0;
-  }
-  else if(kind == "2lpt") {
-    Dv= cosmology_Dv_growth(a, D1);
-    D2v= cosmology_D2v_growth(a, D1);
-  }
-  else
-    assert(false);
-  
+  Float D1, D2, Dv, D2v, D3v;
+  growth_factors(a, kind, &D1, &D2, &Dv, &D2v, &D3v);
 
 
   double sum2= 0.0;
 
-  Float x[3];
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) reduction(+:sum2)
+#endif
   for(size_t ix=0; ix<local_nx; ix++) {
+   Float x[3];
    x[0]= (local_ix0 + ix + offset)*dx;
+   Particle* p= particles->p + ix*nc*nc;
+   uint64_t id= (uint64_t) (local_ix0 + ix)*nc*nc + 1;
+   
    for(size_t iy=0; iy<nc; iy++) {
     x[1]= (iy + offset)*dx;
     for(size_t iz=0; iz<nc; iz++) {
@@ -188,12 +274,18 @@ void lpt_set_displacements(const unsigned long seed, PowerSpectrum* const ps,
 
      size_t index= (ix*nc + iy)*nczr + iz;
      for(int k=0; k<3; k++) {
-       Float dis=  psi[k][index];
-       Float dis2= nmesh3_inv*psi2[k][index];
+       Float dis=  psi[3*index + k];
+       Float dis2, dis3= 0;
+       if(third_order) {
+	 dis2= p->dx2[k];
+	 dis3= nmesh3_inv*psi3[3*index + k];
+       }
+       else
+	 dis2= nmesh3_inv*psi2[3*index + k];
        // psi2 had two inverse Fourier transofroms, giving additional nmesh3
        
-       p->x[k]= x[k] + D1*dis + D2*dis2;
-       p->v[k]= Dv*dis + D2v*dis2;
+       p->x[k]= x[k] + D1*dis + D2*dis2 + dis3;
+       p->v[k]= Dv*dis + D2v*dis2 + D3v*dis3;
        
        p->dx1[k]= dis;              // 1LPT extrapolated to a=1
        p->dx2[k]= dis2;             // 2LPT displacement
@@ -201,7 +293,7 @@ void lpt_set_displacements(const unsigned long seed, PowerSpectrum* const ps,
        //p->v[k]= 0;                  // velocity in comoving 2LPT
 
 
-       sum2 += (D1*dis + D2*dis2)*(D1*dis + D2*dis2);
+       sum2 += (D1*dis + D2*dis2 + dis3)*(D1*dis + D2*dis2 + dis3);
      }
      p->id= id++;
      
@@ -211,9 +303,9 @@ void lpt_set_displacements(const unsigned long seed, PowerSpectrum* const ps,
   }
 
   msg_printf(msg_debug, "disp rms %e\n", sqrt(sum2/(local_nx*nc*nc)));
-  p= particles->p;
   
-  msg_printf(msg_verbose, "2LPT displacements calculated.\n");
+  msg_printf(msg_verbose, "%s displacements calculated.\n",
+	     third_order ? "3LPT" : "2LPT");
 
   uint64_t nc64= nc;
   
@@ -224,6 +316,232 @@ void lpt_set_displacements(const unsigned long seed, PowerSpectrum* const ps,
 
 }
 
+void lpt_set_displacements_batch(const int n, unsigned long const seeds[],
+				 PowerSpectrum* const ps,
+				 const double a, const char kind[],
+				 Particles* particles,
+				 LPTBatchFunc f, void* data,
+				 const bool fix_amplitude, const bool invert_phase)
+{
+  //
+  // Generate n realizations with seeds[i], reusing the FFT plans, memory,
+  // and particles; f(i, seeds[i], particles, data) is called for each
+  // realization, which stops the batch by returning false.
+  //
+  const double t0= MPI_Wtime();
+  double t_lpt= 0.0;
+  int i;
+  
+  for(i=0; i<n; i++) {
+    const double t= MPI_Wtime();
+    lpt_set_displacements(seeds[i], ps, a, kind, particles,
+			  fix_amplitude, invert_phase);
+    t_lpt += MPI_Wtime() - t;
+    
+    if(f && !f(i, seeds[i], particles, data)) {
+      i++;
+      break;
+    }
+  }
+
+  const double t_total= MPI_Wtime() - t0;
+
+  if(t_total > 0.0)
+    msg_printf(msg_info,
+	       "LPT batch: %d realizations in %.2f sec (LPT %.2f sec); "
+	       "%.1f realizations per hour\n",
+	       i, t_total, t_lpt, 3600.0*i/t_total);
+}
+
+void lpt_write_displacements(const unsigned long seed, PowerSpectrum* const ps,
+			     const double a, const char ckind[],
+			     LPTPlaneWriter* const writer,
+			     const bool fix_amplitude, const bool invert_phase)
+{
+  //
+  // Computes 2LPT particles as lpt_set_displacements, but passes them to
+  // writer plane by plane without a Particles object.
+  // kind: "zeldovich", "2lpt", or "cola"; 3LPT is not supported because
+  // lpt_compute_psi3_k keeps Psi(2) in particles.
+  //
+  if(nc == 0 || seedtable == 0) {
+    msg_printf(msg_error,
+	       "Error: lpt_init() not called before lpt_write_displacements");
+    return;
+  }
+
+  const string kind(ckind);
+  if(!is_lpt_kind(kind) || kind == "3lpt" || kind == "cola3lpt") {
+    msg_printf(msg_error,
+	       "Error: LPT kind %s not supported for lpt_write_displacements\n",
+	       ckind);
+    throw ValError();
+  }
+
+  msg_printf(msg_verbose, "LPT initial condition to writer: %s\n", ckind);
+  assert(writer);
+
+  lpt_generate_psi_k(seed, ps, fix_amplitude, invert_phase);
+  lpt_compute_psi2_k();
+
+  msg_printf(msg_verbose, "Fourier transforming LPT displacements\n");
+  fft_psi->execute_inverse();
+  fft_psi2->execute_inverse();
+
+  Float const * const psi= fft_psi->fx;
+  Float const * const psi2= fft_psi2->fx;
+
+  const size_t nczr= 2*(nc/2 + 1);
+  const Float dx= boxsize/nc;
+  const double nmesh3_inv= 1.0/pow((double)nc, 3.0);
+
+  Float D1, D2, Dv, D2v, D3v;
+  growth_factors(a, kind, &D1, &D2, &Dv, &D2v, &D3v);
+
+  const uint64_t nc64= nc;
+  writer->begin(local_nx*nc*nc, nc64*nc64*nc64, a, boxsize);
+
+  // Only one plane of particles is held in memory
+  vector<Particle> plane(nc*nc);
+  
+  const size_t nx_max= comm_max<long long>(local_nx);
+  for(size_t ix=0; ix<nx_max; ix++) {
+    if(ix >= local_nx) {
+      writer->write_plane(&plane.front(), 0);
+      continue;
+    }
+
+    const Float x0= (local_ix0 + ix + offset)*dx;
+    const uint64_t id0= (uint64_t) (local_ix0 + ix)*nc*nc + 1;
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared)
+#endif
+    for(size_t iy=0; iy<nc; iy++) {
+      Float x[3];
+      x[0]= x0;
+      x[1]= (iy + offset)*dx;
+      Particle* p= &plane[iy*nc];
+      for(size_t iz=0; iz<nc; iz++) {
+	x[2]= (iz + offset)*dx;
+
+	size_t index= (ix*nc + iy)*nczr + iz;
+	for(int k=0; k<3; k++) {
+	  Float dis=  psi[3*index + k];
+	  Float dis2= nmesh3_inv*psi2[3*index + k];
+	  
+	  p->x[k]= x[k] + D1*dis + D2*dis2;
+	  p->v[k]= Dv*dis + D2v*dis2;
+	  p->dx1[k]= dis;
+	  p->dx2[k]= dis2;
+	}
+	p->id= id0 + iy*nc + iz;
+	p++;
+      }
+    }
+
+    writer->write_plane(&plane.front(), plane.size());
+  }
+
+  writer->end();
+
+  msg_printf(msg_verbose, "2LPT displacements written.\n");
+}
+
+namespace {
+//
+// Plane writer that fills ParticlesSoA
+//
+class SoAWriter : public LPTPlaneWriter {
+ public:
+  explicit SoAWriter(ParticlesSoA* const particles_) :
+    particles(particles_), a(0.0) {}
+  virtual void begin(const size_t np_local, const uint64_t np_total,
+		     const double a, const double boxsize);
+  virtual void write_plane(Particle const * const p, const size_t np);
+  virtual void end();
+ private:
+  ParticlesSoA* const particles;
+  double a;
+};
+
+void SoAWriter::begin(const size_t np_local, const uint64_t np_total,
+		      const double a_, const double boxsize_)
+{
+  if(np_local > particles->np_allocated) {
+    msg_printf(msg_fatal,
+	       "Error: %lu particles allocated for %lu LPT particles\n",
+	       particles->np_allocated, np_local);
+    throw MemoryError();
+  }
+
+  particles->np_local= 0;
+  particles->np_total= np_total;
+  particles->boxsize= boxsize_;
+  a= a_;
+
+  if(particles->lpt_compressed()) {
+    // The Psi fields are in real space; the scales are set from their
+    // maxima before any particle is encoded
+    Float dx1_max, dx2_max;
+    max_displacements(&dx1_max, &dx2_max);
+    particles->dx1_scale= fixed16_scale(dx1_max);
+    particles->dx2_scale= fixed16_scale(dx2_max);
+    msg_printf(msg_verbose, "16-bit LPT displacements; scale %e %e\n",
+	       particles->dx1_scale, particles->dx2_scale);
+  }
+}
+
+void SoAWriter::write_plane(Particle const * const p, const size_t np)
+{
+  const size_t n0= particles->np_local;
+  const bool compressed= particles->lpt_compressed();
+  const bool fixed= particles->position_fixed();
+  const double to_fixed= fixed32_to_fixed(particles->boxsize);
+
+  for(size_t i=0; i<np; ++i) {
+    const size_t j= n0 + i;
+    for(int k=0; k<3; ++k) {
+      if(fixed)
+	particles->xi[j].x[k]= fixed32_encode(p[i].x[k], to_fixed);
+      else
+	particles->x[j].x[k]= p[i].x[k];
+      particles->v[j][k]= p[i].v[k];
+      if(compressed) {
+	particles->dx1_16[j][k]= fixed16_encode(p[i].dx1[k],
+						particles->dx1_scale);
+	particles->dx2_16[j][k]= fixed16_encode(p[i].dx2[k],
+						particles->dx2_scale);
+      }
+      else {
+	particles->dx1[j][k]= p[i].dx1[k];
+	particles->dx2[j][k]= p[i].dx2[k];
+      }
+    }
+    particles->id[j]= p[i].id;
+  }
+
+  particles->np_local= n0 + np;
+}
+
+void SoAWriter::end()
+{
+  particles->a_x= a;
+  particles->a_v= a;
+  particles->a_f= 0.0;
+}
+}
+
+void lpt_set_displacements(const unsigned long seed, PowerSpectrum* const ps,
+			   const double a, const char kind[],
+			   ParticlesSoA* particles,
+			   const bool fix_amplitude, const bool invert_phase)
+{
+  SoAWriter writer(particles);
+  lpt_write_displacements(seed, ps, a, kind, &writer,
+			  fix_amplitude, invert_phase);
+}
+
 void lpt_set_offset(Float offset_)
 {
   offset= offset_;
@@ -273,16 +591,25 @@ void set_seedtable(const int nc, gsl_rng* random_generator,
 }
 
 
-void lpt_generate_psi_k(const unsigned long seed, PowerSpectrum* const ps)
+void lpt_generate_psi_k(const unsigned long seed, PowerSpectrum* const ps,
+			const bool fix_amplitude, const bool invert_phase)
 {
   // Generates 1LPT (Zeldovich) displacements, Psi_k
   // from N-GenIC by Volker Springel
+  //
+  // fix_amplitude: |delta_k|^2 = P(k), the mean of the exponential
+  //                distribution -log(ampl) P(k)
+  // invert_phase:  phase + pi
+  // The random numbers are drawn in the same way for all options, so that
+  // the phases are the same for a given seed.
   msg_printf(msg_verbose, "Generating delta_k...\n");
-  msg_printf(msg_info, "Random Seed = %lu\n", seed);
+  msg_printf(msg_info, "Random Seed = %lu%s%s\n", seed,
+	     fix_amplitude ? ", fixed amplitude" : "",
+	     invert_phase ? ", inverted phase" : "");
 
-  for(int i=0; i<3; i++) assert(fft_psi[i]);
+  assert(fft_psi && fft_psi->howmany == 3);
   
-  complex_t* psi_k[]= {fft_psi[0]->fk, fft_psi[1]->fk, fft_psi[2]->fk};
+  complex_t* const psi_k= fft_psi->fk;
 
   const size_t nckz= nc/2 + 1;
   const double dk= 2.0*M_PI/boxsize;
@@ -296,13 +623,16 @@ void lpt_generate_psi_k(const unsigned long seed, PowerSpectrum* const ps)
 
   
   // clean the delta_k grid
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared)
+#endif
   for(size_t ix=0; ix<local_nx; ix++)
    for(size_t iy=0; iy<nc; iy++)
     for(size_t iz=0; iz<nckz; iz++)
       for(int i=0; i<3; i++) {
 	size_t index= (ix*nc + iy)*nckz + iz;
-	psi_k[i][index][0] = 0;
-	psi_k[i][index][1] = 0;
+	psi_k[3*index + i][0] = 0;
+	psi_k[3*index + i][1] = 0;
       }
 
   double kvec[3];
@@ -325,6 +655,9 @@ void lpt_generate_psi_k(const unsigned long seed, PowerSpectrum* const ps)
 	  ampl = gsl_rng_uniform(random_generator);
 	while(ampl == 0.0);
 
+	if(invert_phase)
+	  phase += M_PI;
+
 	if(ix == nc/2 || iy == nc/2 || iz == nc/2)
 	  continue;
 	if(ix == 0 && iy == 0 && iz == 0)
@@ -361,7 +694,9 @@ void lpt_generate_psi_k(const unsigned long seed, PowerSpectrum* const ps)
 	  continue;
 #endif
 	
-	double delta2= -log(ampl)*fac_2pi3*ps->P(kmag);
+	double delta2= fac_2pi3*ps->P(kmag);
+	if(!fix_amplitude)
+	  delta2 *= -log(ampl);
 	
 	double delta_k_mag= fac*sqrt(delta2);
 	// delta_k_mag -- |delta_k| extrapolated to a=1
@@ -371,8 +706,8 @@ void lpt_generate_psi_k(const unsigned long seed, PowerSpectrum* const ps)
 	  if(local_ix0 <= ix && ix < (local_ix0 + local_nx)) {
 	    size_t index= ((ix - local_ix0)*nc + iy)*nckz + iz;
 	    for(int i=0; i<3; i++) {
-	      psi_k[i][index][0]= -kvec[i]/kmag2*delta_k_mag*sin(phase);
-	      psi_k[i][index][1]=  kvec[i]/kmag2*delta_k_mag*cos(phase);
+	      psi_k[3*index + i][0]= -kvec[i]/kmag2*delta_k_mag*sin(phase);
+	      psi_k[3*index + i][1]=  kvec[i]/kmag2*delta_k_mag*cos(phase);
 	    }
 	  }
 	}
@@ -386,11 +721,11 @@ void lpt_generate_psi_k(const unsigned long seed, PowerSpectrum* const ps)
 		size_t index= ((ix - local_ix0)*nc + iy)*nckz + iz;				size_t iindex= ((ix - local_ix0)*nc + iiy)*nckz + iz;
 		
 		for(int i=0; i<3; i++) {
-		  psi_k[i][index][0]=  -kvec[i]/kmag2*delta_k_mag*sin(phase);
-		  psi_k[i][index][1]=   kvec[i]/kmag2*delta_k_mag*cos(phase);
+		  psi_k[3*index + i][0]=  -kvec[i]/kmag2*delta_k_mag*sin(phase);
+		  psi_k[3*index + i][1]=   kvec[i]/kmag2*delta_k_mag*cos(phase);
 		  
-		  psi_k[i][iindex][0]= -kvec[i]/kmag2*delta_k_mag*sin(phase);
-		  psi_k[i][iindex][1]= -kvec[i]/kmag2*delta_k_mag*cos(phase);
+		  psi_k[3*iindex + i][0]= -kvec[i]/kmag2*delta_k_mag*sin(phase);
+		  psi_k[3*iindex + i][1]= -kvec[i]/kmag2*delta_k_mag*cos(phase);
 		}
 	      }
 	    }
@@ -409,16 +744,16 @@ void lpt_generate_psi_k(const unsigned long seed, PowerSpectrum* const ps)
 	      if(local_ix0 <= ix && ix < (local_ix0 + local_nx)) {
 		size_t index= ((ix - local_ix0)*nc + iy)*nckz + iz;
 		for(int i=0; i<3; i++) {
-		  psi_k[i][index][0]= -kvec[i]/kmag2*delta_k_mag*sin(phase);
-		  psi_k[i][index][1]=  kvec[i]/kmag2*delta_k_mag*cos(phase);
+		  psi_k[3*index + i][0]= -kvec[i]/kmag2*delta_k_mag*sin(phase);
+		  psi_k[3*index + i][1]=  kvec[i]/kmag2*delta_k_mag*cos(phase);
 		}
 	      }
 	      
 	      if(local_ix0 <= iix && iix < (local_ix0 + local_nx)) {
 		size_t index= ((iix - local_ix0)*nc + iiy)*nckz + iz;
 		for(int i=0; i<3; i++) {
-		  psi_k[i][index][0]= -kvec[i]/kmag2*delta_k_mag*sin(phase);
-		  psi_k[i][index][1]= -kvec[i]/kmag2*delta_k_mag*cos(phase);
+		  psi_k[3*index + i][0]= -kvec[i]/kmag2*delta_k_mag*sin(phase);
+		  psi_k[3*index + i][1]= -kvec[i]/kmag2*delta_k_mag*cos(phase);
 		}
 	      }
 	    }
@@ -428,110 +763,131 @@ void lpt_generate_psi_k(const unsigned long seed, PowerSpectrum* const ps)
     }
   }
 
-  for(int i=0; i<3; ++i) {
-    fft_psi[i]->mode= fft_mode_k;
-  }
+  fft_psi->mode= fft_mode_k;
   
   gsl_rng_free(random_generator);  
 }
 
 
-void lpt_compute_psi2_k(void)
+void compute_psi_ij_k(FFT const * const fft_psi, FFT* const fft_psi_ij)
 {
-  // Compute 2nd order Psi(2) from 1st order Psi
-  //   Precondition Psi_k  in fft_psi[]->fk
-  //   Result       Psi2_k in fft_psi2[]->fk (Fourier space)
-  
-  msg_printf(msg_verbose, "Computing 2LPT displacement fields...\n");
+  // Derivative of a displacement field in Fourier space
+  //   Input  Psi_i_k   in fft_psi->fk    (3 fields)
+  //   Output Psi_i,j_k in fft_psi_ij->fk (6 fields: 11, 12, 13, 22, 23, 33)
+  assert(fft_psi->howmany == 3 && fft_psi_ij->howmany == 6);
 
   const size_t nckz= nc/2 + 1;
   const double dk= 2.0*M_PI/boxsize;
-
-  complex_t* psi_k[]= {fft_psi[0]->fk, fft_psi[1]->fk, fft_psi[2]->fk};
-
-  //const double fac = pow(2*M_PI/boxsize, 1.5);
-  double kvec[3];
-
-  //
-  // 2nd order LPT
-  //
-  complex_t* psi_ij_k[6];
-  for(int i=0; i<6; i++) {
-    assert(fft_psi_ij[i]);
-    psi_ij_k[i]= fft_psi_ij[i]->fk;
-  }
+  complex_t const * const psi_k= fft_psi->fk;
+  complex_t* const psi_ij_k= fft_psi_ij->fk;
 
   // Take derivative dPsi_i/dq_j in Fourier space
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared)
+#endif
   for(size_t ix=0; ix<local_nx; ix++) {
+    double kvec[3];
+    if((ix + local_ix0) < nc/2)
+      kvec[0]= dk*(ix + local_ix0);
+    else
+      kvec[0]= -dk*(nc - (ix + local_ix0));
+
     for(size_t iy=0; iy<nc; iy++) {
+      if(iy < nc/2)
+	kvec[1]= dk*iy;
+      else
+	kvec[1]= -dk*(nc - iy);
+
       for(size_t iz=0; iz<nckz; iz++) {
 	size_t index= (ix*nc + iy)*nckz + iz;
-	if((ix + local_ix0) < nc/2)
-	  kvec[0]= dk*(ix + local_ix0);
-	else
-	  kvec[0]= -dk*(nc - (ix + local_ix0));
-	      
-	if(iy < nc/2)
-	  kvec[1]= dk*iy;
-	else
-	  kvec[1]= -dk*(nc - iy);
 	      
 	if(iz < nc/2)
 	  kvec[2]= dk*iz;
 	else
 	  kvec[2]= -dk*(nc - iz);
+
+	complex_t const * const psi= psi_k + 3*index;
+	complex_t* const psi_ij= psi_ij_k + 6*index;
 	      
 	// Derivatives of ZA displacements
 	// dPsi_i/dq_j -> sqrt(-1) k_j Psi_i(k)
-	psi_ij_k[0][index][0]= -psi_k[0][index][1]*kvec[0]; // Psi_1,1
-	psi_ij_k[0][index][1]=  psi_k[0][index][0]*kvec[0];
+	psi_ij[0][0]= -psi[0][1]*kvec[0]; // Psi_1,1
+	psi_ij[0][1]=  psi[0][0]*kvec[0];
 
-	psi_ij_k[1][index][0]= -psi_k[0][index][1]*kvec[1]; // Psi_1,2
-	psi_ij_k[1][index][1]=  psi_k[0][index][0]*kvec[1];
+	psi_ij[1][0]= -psi[0][1]*kvec[1]; // Psi_1,2
+	psi_ij[1][1]=  psi[0][0]*kvec[1];
 
-	psi_ij_k[2][index][0]= -psi_k[0][index][1]*kvec[2]; // Psi_1,3
-	psi_ij_k[2][index][1]=  psi_k[0][index][0]*kvec[2];
+	psi_ij[2][0]= -psi[0][1]*kvec[2]; // Psi_1,3
+	psi_ij[2][1]=  psi[0][0]*kvec[2];
 	      
-	psi_ij_k[3][index][0]= -psi_k[1][index][1]*kvec[1]; // Psi_2,2
-	psi_ij_k[3][index][1]=  psi_k[1][index][0]*kvec[1];
+	psi_ij[3][0]= -psi[1][1]*kvec[1]; // Psi_2,2
+	psi_ij[3][1]=  psi[1][0]*kvec[1];
 
-	psi_ij_k[4][index][0]= -psi_k[1][index][1]*kvec[2]; // Psi_2,3
-	psi_ij_k[4][index][1]=  psi_k[1][index][0]*kvec[2];
+	psi_ij[4][0]= -psi[1][1]*kvec[2]; // Psi_2,3
+	psi_ij[4][1]=  psi[1][0]*kvec[2];
 
-	psi_ij_k[5][index][0]= -psi_k[2][index][1]*kvec[2]; // Psi_3,3
-	psi_ij_k[5][index][1]=  psi_k[2][index][0]*kvec[2];
+	psi_ij[5][0]= -psi[2][1]*kvec[2]; // Psi_3,3
+	psi_ij[5][1]=  psi[2][0]*kvec[2];
       }
     }
   }
 
-  for(int i=0; i<6; i++) 
-    fft_psi_ij[i]->mode= fft_mode_k;
+  fft_psi_ij->mode= fft_mode_k;
+}
+
+void lpt_compute_psi2_k(void)
+{
+  // Compute 2nd order Psi(2) from 1st order Psi
+  //   Precondition Psi_k  in fft_psi->fk
+  //   Result       Psi2_k in fft_psi2->fk (Fourier space)
+  
+  msg_printf(msg_verbose, "Computing 2LPT displacement fields...\n");
+
+  const size_t nckz= nc/2 + 1;
+  const double dk= 2.0*M_PI/boxsize;
+
+  //
+  // 2nd order LPT
+  //
+
+  compute_psi_ij_k(fft_psi, fft_psi_ij);
 
   // Second-order displacement Psi(2)
   // div.Psi(2) = Sum_{i<j} [ Psi_i,j Psi_i,j - Psi_i,i Psi_j,j ]
   // in realspace
 
   msg_printf(msg_verbose, "Fourier transforming displacement gradient...\n");
-  for(int i=0; i<6; i++) 
-    fft_psi_ij[i]->execute_inverse();
+  fft_psi_ij->execute_inverse(); // all 6 components at once
 
-  Float* psi_ij[6]; for(int i=0; i<6; i++) psi_ij[i]= fft_psi_ij[i]->fx;
-  Float* const div_psi2= fft_div_psi2->fx; // == fft_psi_ij[3];
+  Float const * const psi_ij= fft_psi_ij->fx;
+  Float* const div_psi2= fft_div_psi2->fx;
 
-  size_t nczr= 2*(nc/2 + 1);
+  // div_psi2 shares memory with the beginning of psi_ij. The source is
+  // computed plane by plane to a buffer and copied to div_psi2; plane ix
+  // of div_psi2 overwrites psi_ij in planes <= ix only, which are done.
+  const size_t nczr= 2*(nc/2 + 1);
+  const size_t nplane= nc*nczr;
+  vector<Float> plane(nplane, 0);
+  
   for(size_t ix=0; ix<local_nx; ix++) {
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared)
+#endif
     for(size_t iy=0; iy<nc; iy++) {
       for(size_t iz=0; iz<nc; iz++) {
 	size_t index= (ix*nc + iy)*nczr + iz;
-
-	div_psi2[index]=
-	    psi_ij[0][index]*(psi_ij[3][index] + psi_ij[5][index])
-	  + psi_ij[3][index]*psi_ij[5][index]
-          - psi_ij[1][index]*psi_ij[1][index]
-          - psi_ij[2][index]*psi_ij[2][index]
-	  - psi_ij[4][index]*psi_ij[4][index];
+	Float const * const d= psi_ij + 6*index;
+
+	plane[iy*nczr + iz]=
+	    d[0]*(d[3] + d[5])
+	  + d[3]*d[5]
+          - d[1]*d[1]
+          - d[2]*d[2]
+	  - d[4]*d[4];
       }
     }
+
+    std::copy(plane.begin(), plane.end(), div_psi2 + ix*nplane);
   }
 
   fft_div_psi2->mode= fft_mode_x;
@@ -540,30 +896,35 @@ void lpt_compute_psi2_k(void)
   msg_printf(msg_verbose, "Fourier transforming second order source...\n");
   
   fft_div_psi2->execute_forward();
-  complex_t* div_psi2_k= fft_div_psi2->fk;
-  complex_t* psi2_k[]= {fft_psi2[0]->fk, fft_psi2[1]->fk, fft_psi2[2]->fk};
+  complex_t const * const div_psi2_k= fft_div_psi2->fk;
+  complex_t* const psi2_k= fft_psi2->fk;
 
   if(local_ix0 == 0) {
     for(int i=0; i<3; i++)
-      psi2_k[i][0][0]= psi2_k[i][0][1] = 0.0;
+      psi2_k[i][0]= psi2_k[i][1] = 0.0;
     // avoid zero division kmag2 = 0
   }
 
   // Set 2nd-order Psi(2)
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared)
+#endif
   for(size_t ix=0; ix<local_nx; ix++) {
+    double kvec[3];
+    if((ix + local_ix0) < nc/2)
+      kvec[0]=  dk*(ix + local_ix0);
+    else
+      kvec[0]= -dk*(nc - (ix + local_ix0));
+
     for(size_t iy=0; iy<nc; iy++) {
+      if(iy < nc/2)
+	kvec[1]= dk*iy;
+      else
+	kvec[1]= -dk*(nc - iy);
+
       int iz0= (ix + local_ix0 == 0) && (iy == 0); // skip kvec=(0,0,0)
       for(size_t iz=iz0; iz<nckz; iz++) {
 	size_t index= (ix*nc + iy)*nckz + iz;
-	if((ix + local_ix0) < nc/2)
-	  kvec[0]=  dk*(ix + local_ix0);
-	else
-	  kvec[0]= -dk*(nc - (ix + local_ix0));
-	
-	if(iy < nc/2)
-	  kvec[1]= dk*iy;
-	else
-	  kvec[1]= -dk*(nc - iy);
 	
 	if(iz < nc/2)
 	  kvec[2] = dk*iz;
@@ -578,16 +939,267 @@ void lpt_compute_psi2_k(void)
 	    
 	// Psi(2)_k = div.Psi(2)_k * k / (sqrt(-1) k^2)
 	for(int i=0; i<3; i++) {
-	  psi2_k[i][index][0]=  div_psi2_k[index][1]*kvec[i]/kmag2;
-	  psi2_k[i][index][1]= -div_psi2_k[index][0]*kvec[i]/kmag2;
+	  psi2_k[3*index + i][0]=  div_psi2_k[index][1]*kvec[i]/kmag2;
+	  psi2_k[3*index + i][1]= -div_psi2_k[index][0]*kvec[i]/kmag2;
+	}
+      }
+    }
+  }
+
+  fft_psi2->mode= fft_mode_k;
+}
+
+void lpt_compute_psi3_k(const double a, Particles* const particles)
+{
+  // Compute 3rd order Psi(3) at scale factor a (Catelan 1995;
+  // Bouchet et al. 1995)
+  //
+  //   Psi(3) = D3a Psi(3a) + D3b Psi(3b) + D3c Psi(3c)
+  //   div  Psi(3a) = det Psi_i,j
+  //   div  Psi(3b) = 1/2 sum_{i != j} [Psi_i,i Psi(2)_j,j - Psi_i,j Psi(2)_j,i]
+  //   curl Psi(3c) = sum_i grad Psi_i x grad Psi(2)_i
+  //
+  //   Precondition Psi_k in fft_psi->fk, Psi2_k in fft_psi2->fk
+  //   Result       Psi3_k in fft_psi3->fk (growth factors included)
+  //                Psi(2) in particles->dx2, because its memory is reused
+  
+  msg_printf(msg_verbose, "Computing 3LPT displacement fields...\n");
+
+  const size_t nckz= nc/2 + 1;
+  const size_t nczr= 2*(nc/2 + 1);
+  const double dk= 2.0*M_PI/boxsize;
+  const Float nmesh3_inv= 1.0/pow((double)nc, 3.0);
+
+  const double D1= cosmology_D_growth(a);
+  const Float D3a= cosmology_D3a_growth(a, D1);
+  const Float D3b= cosmology_D3b_growth(a, D1);
+  const Float D3c= cosmology_D3c_growth(a, D1);
+
+  msg_printf(msg_verbose, "3LPT growth factors: D3a= %e, D3b= %e, D3c= %e\n",
+	     D3a, D3b, D3c);
+
+  // Psi(2)_i,j in Fourier space before Psi(2) is transformed to real space
+  compute_psi_ij_k(fft_psi2, fft_psi2_ij);
+
+  fft_psi2->execute_inverse();
+  
+  Float const * const psi2= fft_psi2->fx;
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared)
+#endif
+  for(size_t ix=0; ix<local_nx; ix++) {
+    Particle* p= particles->p + ix*nc*nc;
+    for(size_t iy=0; iy<nc; iy++) {
+      for(size_t iz=0; iz<nc; iz++) {
+	size_t index= (ix*nc + iy)*nczr + iz;
+	for(int k=0; k<3; k++)
+	  p->dx2[k]= nmesh3_inv*psi2[3*index + k];
+	p++;
+      }
+    }
+  }
+
+  // Psi_i,j overwrites Psi(2), which is now in particles
+  compute_psi_ij_k(fft_psi, fft_psi_ij);
+
+  msg_printf(msg_verbose, "Fourier transforming displacement gradients...\n");
+  fft_psi_ij->execute_inverse();
+  fft_psi2_ij->execute_inverse();
+
+  // Sources in real space; the 4 fields are
+  // D3a div Psi(3a) + D3b div Psi(3b), and D3c curl Psi(3c)
+  //
+  // Source shares memory with the beginning of psi_ij; it is computed plane
+  // by plane to a buffer, which overwrites psi_ij in planes <= ix only.
+  Float const * const psi_ij= fft_psi_ij->fx;
+  Float const * const psi2_ij= fft_psi2_ij->fx;
+  Float* const src= fft_src3->fx;
+
+  const size_t nplane= nc*nczr;
+  vector<Float> plane(4*nplane, 0);
+
+  for(size_t ix=0; ix<local_nx; ix++) {
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared)
+#endif
+    for(size_t iy=0; iy<nc; iy++) {
+      for(size_t iz=0; iz<nc; iz++) {
+	size_t index= (ix*nc + iy)*nczr + iz;
+
+	// Full 3x3 gradient matrices from symmetric 6 components
+	// 0:11, 1:12, 2:13, 3:22, 4:23, 5:33
+	Float const * const d= psi_ij + 6*index;
+	Float const * const e= psi2_ij + 6*index;
+	const Float g[3][3]= {{d[0], d[1], d[2]},
+			      {d[1], d[3], d[4]},
+			      {d[2], d[4], d[5]}};
+	Float h[3][3];
+	h[0][0]= nmesh3_inv*e[0];
+	h[0][1]= h[1][0]= nmesh3_inv*e[1];
+	h[0][2]= h[2][0]= nmesh3_inv*e[2];
+	h[1][1]= nmesh3_inv*e[3];
+	h[1][2]= h[2][1]= nmesh3_inv*e[4];
+	h[2][2]= nmesh3_inv*e[5];
+	// psi2_ij had two inverse Fourier transforms
+
+	const Float det=
+	    g[0][0]*(g[1][1]*g[2][2] - g[1][2]*g[2][1])
+	  - g[0][1]*(g[1][0]*g[2][2] - g[1][2]*g[2][0])
+	  + g[0][2]*(g[1][0]*g[2][1] - g[1][1]*g[2][0]);
+
+	Float tr_gh= 0;
+	for(int i=0; i<3; i++)
+	  for(int j=0; j<3; j++)
+	    tr_gh += g[i][j]*h[j][i];
+
+	const Float mu2= 0.5*((g[0][0] + g[1][1] + g[2][2])*
+			      (h[0][0] + h[1][1] + h[2][2]) - tr_gh);
+
+	Float* const s= &plane[4*(iy*nczr + iz)];
+	s[0]= D3a*det + D3b*mu2;
+
+	// (grad Psi_i x grad Psi(2)_i)_k = Psi_i,k+1 Psi(2)_i,k+2 - ...
+	for(int k=0; k<3; k++) {
+	  const int k1= (k + 1) % 3;
+	  const int k2= (k + 2) % 3;
+	  Float curl= 0;
+	  for(int i=0; i<3; i++)
+	    curl += g[i][k1]*h[i][k2] - g[i][k2]*h[i][k1];
+	  s[1 + k]= D3c*curl;
+	}
+      }
+    }
+
+    std::copy(plane.begin(), plane.end(), src + 4*ix*nplane);
+  }
+
+  fft_src3->mode= fft_mode_x;
+
+  msg_printf(msg_verbose, "Fourier transforming third order source...\n");
+  fft_src3->execute_forward();
+
+  complex_t const * const src_k= fft_src3->fk;
+  complex_t* const psi3_k= fft_psi3->fk;
+
+  if(local_ix0 == 0) {
+    for(int i=0; i<3; i++)
+      psi3_k[i][0]= psi3_k[i][1] = 0.0;
+  }
+
+  // Psi(3)_k = -sqrt(-1) k S_k/k^2 + sqrt(-1) k x C_k/k^2
+  // for div Psi(3) = S and curl Psi(3) = C
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared)
+#endif
+  for(size_t ix=0; ix<local_nx; ix++) {
+    double kvec[3];
+    if((ix + local_ix0) < nc/2)
+      kvec[0]=  dk*(ix + local_ix0);
+    else
+      kvec[0]= -dk*(nc - (ix + local_ix0));
+
+    for(size_t iy=0; iy<nc; iy++) {
+      if(iy < nc/2)
+	kvec[1]= dk*iy;
+      else
+	kvec[1]= -dk*(nc - iy);
+
+      int iz0= (ix + local_ix0 == 0) && (iy == 0); // skip kvec=(0,0,0)
+      for(size_t iz=iz0; iz<nckz; iz++) {
+	size_t index= (ix*nc + iy)*nckz + iz;
+	
+	if(iz < nc/2)
+	  kvec[2] = dk*iz;
+	else
+	  kvec[2] = -dk*(nc - iz);
+	
+	double kmag2= kvec[0]*kvec[0] + kvec[1]*kvec[1] + kvec[2]*kvec[2];
+
+	complex_t const * const s= src_k + 4*index;
+	complex_t const * const c= s + 1;
+	
+	for(int i=0; i<3; i++) {
+	  const int i1= (i + 1) % 3;
+	  const int i2= (i + 2) % 3;
+	  // (k x C)_i
+	  const double kc_re= kvec[i1]*c[i2][0] - kvec[i2]*c[i1][0];
+	  const double kc_im= kvec[i1]*c[i2][1] - kvec[i2]*c[i1][1];
+	  
+	  psi3_k[3*index + i][0]= ( s[0][1]*kvec[i] - kc_im)/kmag2;
+	  psi3_k[3*index + i][1]= (-s[0][0]*kvec[i] + kc_re)/kmag2;
+	}
+      }
+    }
+  }
+
+  fft_psi3->mode= fft_mode_k;
+}
+
+void max_displacements(Float* const dx1_max, Float* const dx2_max)
+{
+  // Maximum |Psi_i| and |Psi(2)_i| in all nodes; fields must be in real space
+  Float const * const psi= fft_psi->fx;
+  Float const * const psi2= fft_psi2->fx;
+  const size_t nczr= 2*(nc/2 + 1);
+  const Float nmesh3_inv= 1.0/pow((double)nc, 3.0);
+
+  Float m1= 0, m2= 0;
+  for(size_t ix=0; ix<local_nx; ix++) {
+    for(size_t iy=0; iy<nc; iy++) {
+      for(size_t iz=0; iz<nc; iz++) {
+	size_t index= (ix*nc + iy)*nczr + iz;
+	for(int k=0; k<3; k++) {
+	  m1= max(m1, fabs(psi[3*index + k]));
+	  m2= max(m2, fabs(nmesh3_inv*psi2[3*index + k]));
 	}
       }
     }
   }
 
-  for(int i=0; i<3; i++) {
-    fft_psi2[i]->mode= fft_mode_k;
+  *dx1_max= comm_max<Float>(m1);
+  *dx2_max= comm_max<Float>(m2);
+}
+
+bool is_lpt_kind(const string& kind)
+{
+  return kind == "zeldovich" || kind == "2lpt" || kind == "cola" ||
+         kind == "3lpt" || kind == "cola3lpt";
+}
+
+void growth_factors(const double a, const string& kind,
+		    Float* D1, Float* D2, Float* Dv, Float* D2v, Float* D3v)
+{
+  // Growth factors for x= q + D1 Psi + D2 Psi(2) + Psi(3)
+  //                    v= Dv Psi + D2v Psi(2) + D3v Psi(3)
+  *D1= cosmology_D_growth(a);
+  *D2= kind == "zeldovich" ? 0.0 : cosmology_D2_growth(a, *D1);
+
+  msg_printf(msg_verbose, "LPT growth factor for a=%e: D1= %e, D2= %e\n",
+	     a, *D1, *D2);
+
+  *D3v= 0.0;
+  if(kind == "cola") {
+    *Dv= *D2v= 0.0;
+  }
+  else if(kind == "zeldovich") {
+    *Dv= cosmology_Dv_growth(a, *D1);
+    *D2v= 0.0;
+  }
+  else if(kind == "2lpt") {
+    *Dv= cosmology_Dv_growth(a, *D1);
+    *D2v= cosmology_D2v_growth(a, *D2);
   }
+  else if(kind == "3lpt") {
+    *Dv= cosmology_Dv_growth(a, *D1);
+    *D2v= cosmology_D2v_growth(a, *D2);
+    *D3v= cosmology_D3v_growth(a, 1.0); // psi3 is Psi(3) at a
+  }
+  else if(kind == "cola3lpt") {
+    *Dv= *D2v= 0.0;
+    *D3v= cosmology_D3v_growth(a, 1.0);
+  }
+  else
+    assert(false);
 }
 
 } // Unnamed namespace
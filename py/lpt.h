@@ -6,12 +6,59 @@
 #include "power.h"
 #include "fft.h"
 
-void lpt_init(const int nc, const double boxsize, Mem* mem);
+//
+// Receives LPT particles plane by plane, for lpt_write_displacements
+//
+class LPTPlaneWriter {
+ public:
+  virtual ~LPTPlaneWriter() {}
+  // np_local particles on this node, np_total in all nodes
+  virtual void begin(const size_t np_local, const uint64_t np_total,
+		     const double a, const double boxsize)= 0;
+  // np particles in the next x plane; called the same number of times on all nodes,
+  // with np = 0 on nodes with fewer planes, so that I/O can be collective
+  virtual void write_plane(Particle const * const p, const size_t np)= 0;
+  virtual void end()= 0;
+};
+
+void lpt_init(const int nc, const double boxsize, Mem* mem,
+	      const bool third_order=false);
 void lpt_free();
+size_t lpt_mem_size(const int nc, const bool third_order=false);
 
 void lpt_set_displacements(const unsigned long seed, PowerSpectrum* const ps,
 			   const double a, const char kind[],
-			   Particles* particles);
+			   Particles* particles,
+			   const bool fix_amplitude=false,
+			   const bool invert_phase=false);
+
+// Called for each realization in lpt_set_displacements_batch;
+// return false to stop
+typedef bool (*LPTBatchFunc)(const int i, const unsigned long seed,
+			     Particles* const particles, void* data);
+
+void lpt_set_displacements_batch(const int n, unsigned long const seeds[],
+				 PowerSpectrum* const ps,
+				 const double a, const char kind[],
+				 Particles* particles,
+				 LPTBatchFunc f, void* data,
+				 const bool fix_amplitude=false,
+				 const bool invert_phase=false);
+
+void lpt_write_displacements(const unsigned long seed, PowerSpectrum* const ps,
+			     const double a, const char kind[],
+			     LPTPlaneWriter* const writer,
+			     const bool fix_amplitude=false,
+			     const bool invert_phase=false);
+// 2LPT kinds only, via lpt_write_displacements; LPT displacements and
+// positions are stored in fixed point if particles are constructed with
+// compress_lpt and fixed_position
+void lpt_set_displacements(const unsigned long seed, PowerSpectrum* const ps,
+			   const double a, const char kind[],
+			   ParticlesSoA* particles,
+			   const bool fix_amplitude=false,
+			   const bool invert_phase=false);
+
 FFT* lpt_generate_phi(const unsigned long seed, PowerSpectrum* const);
 void lpt_set_offset(Float offset_);
 
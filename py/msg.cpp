@@ -8,6 +8,7 @@
 namespace {
   enum LogLevel log_level;
   char prefix[8]= "";
+  char last_error[256]= "";
 }
 
 
@@ -28,6 +29,18 @@ void msg_set_prefix(const char prefix_[])
 
 void msg_printf(const enum LogLevel msg_level, char const * const fmt, ...)
 {
+  if(msg_level >= msg_error) {
+    va_list argp;
+
+    va_start(argp, fmt);
+    vsnprintf(last_error, sizeof(last_error), fmt, argp);
+    va_end(argp);
+
+    size_t n= strlen(last_error);
+    while(n > 0 && last_error[n - 1] == '\n')
+      last_error[--n]= '\0';
+  }
+
   if(msg_level >= msg_error ||
      (msg_level >= log_level && comm_this_node() == 0)) {
     va_list argp;
@@ -43,6 +56,18 @@ void msg_printf(const enum LogLevel msg_level, char const * const fmt, ...)
 }
 
 
+char const * msg_last_error()
+{
+  return last_error;
+}
+
+
+void msg_clear_error()
+{
+  last_error[0]= '\0';
+}
+
+
 void msg_abort(char const * const fmt, ...)
 {
   va_list argp;
@@ -22,5 +22,10 @@ void msg_set_prefix(const char prefix[]);
 void msg_printf(const LogLevel level, char const * const fmt, ...);
 void msg_abort(char const * const fmt, ...);
 
+// Last msg_error or msg_fatal message without the trailing newline, which
+// explains the exception thrown after it; "" if there is none
+char const * msg_last_error();
+void msg_clear_error();
+
 
 #endif
@@ -1,8 +1,11 @@
 #include <cstdlib>
+#include <cmath>
 #include <cassert>
+#include <algorithm>
 #include <mpi.h>
 
 #include "msg.h"
+#include "error.h"
 #include "comm.h"
 #include "util.h"
 #include "fft.h"
@@ -39,3 +42,163 @@ void Particles::update_np_total()
 
   msg_printf(msg_debug, "Update np_total(%d) = %lu\n", comm_this_node(), np_total);
 }
+
+namespace {
+template<class T>
+T* alloc_aligned(const size_t n)
+{
+  void* p;
+  if(posix_memalign(&p, ALGN, sizeof(T)*n) != 0) {
+    msg_printf(msg_fatal,
+	       "Error: unable to allocate %lu Mbytes for particles\n",
+	       mbytes(sizeof(T)*n));
+    throw MemoryError();
+  }
+
+  return (T*) p;
+}
+}
+
+ParticlesSoA::ParticlesSoA(const size_t np_alloc, const double boxsize_,
+			   const bool compress_lpt, const bool fixed_position) :
+  x(0), xi(0),
+  dx1(0), dx2(0), dx1_16(0), dx2_16(0), dx1_scale(1), dx2_scale(1),
+  a_x(0.0), a_v(0.0), a_f(0.0),
+  np_local(0), np_allocated(np_alloc), np_total(0), boxsize(boxsize_)
+{
+  if(fixed_position)
+    xi=  alloc_aligned<PosFixed>(np_alloc);
+  else
+    x=   alloc_aligned<Pos>(np_alloc);
+  v=     alloc_aligned<Float3>(np_alloc);
+  id=    alloc_aligned<uint64_t>(np_alloc);
+  force= alloc_aligned<Float3>(np_alloc);
+
+  size_t size_lpt;
+  if(compress_lpt) {
+    dx1_16= alloc_aligned<Short3>(np_alloc);
+    dx2_16= alloc_aligned<Short3>(np_alloc);
+    size_lpt= 2*sizeof(Short3);
+  }
+  else {
+    dx1= alloc_aligned<Float3>(np_alloc);
+    dx2= alloc_aligned<Float3>(np_alloc);
+    size_lpt= 2*sizeof(Float3);
+  }
+
+  const size_t size= (fixed_position ? sizeof(PosFixed) : sizeof(Pos)) +
+                     2*sizeof(Float3) + sizeof(uint64_t) + size_lpt;
+  msg_printf(msg_verbose, "%lu Mbytes allocated for %lu particles (SoA)\n",
+	     mbytes(np_alloc*size), np_alloc);
+}
+
+ParticlesSoA::~ParticlesSoA()
+{
+  free(x);
+  free(xi);
+  free(v);
+  free(dx1);
+  free(dx2);
+  free(dx1_16);
+  free(dx2_16);
+  free(id);
+  free(force);
+}
+
+void ParticlesSoA::update_np_total()
+{
+  np_total= comm_sum<long long>(np_local);
+}
+
+void particles_copy(Particles const * const src, ParticlesSoA* const dest)
+{
+  const size_t np= src->np_local;
+  assert(np <= dest->np_allocated);
+
+  Particle const * const p= src->p;
+  const bool fixed= dest->position_fixed();
+  const double to_fixed= fixed32_to_fixed(src->boxsize);
+  for(size_t i=0; i<np; ++i) {
+    for(int k=0; k<3; ++k) {
+      if(fixed)
+	dest->xi[i].x[k]= fixed32_encode(p[i].x[k], to_fixed);
+      else
+	dest->x[i].x[k]= p[i].x[k];
+      dest->v[i][k]=   p[i].v[k];
+      dest->force[i][k]= src->force[i][k];
+    }
+    dest->id[i]= p[i].id;
+  }
+
+  if(dest->lpt_compressed()) {
+    Float dx_max[2]= {0, 0};
+    for(size_t i=0; i<np; ++i) {
+      for(int k=0; k<3; ++k) {
+	dx_max[0]= max(dx_max[0], fabs(p[i].dx1[k]));
+	dx_max[1]= max(dx_max[1], fabs(p[i].dx2[k]));
+      }
+    }
+
+    dest->dx1_scale= fixed16_scale(comm_max<Float>(dx_max[0]));
+    dest->dx2_scale= fixed16_scale(comm_max<Float>(dx_max[1]));
+
+    for(size_t i=0; i<np; ++i) {
+      for(int k=0; k<3; ++k) {
+	dest->dx1_16[i][k]= fixed16_encode(p[i].dx1[k], dest->dx1_scale);
+	dest->dx2_16[i][k]= fixed16_encode(p[i].dx2[k], dest->dx2_scale);
+      }
+    }
+  }
+  else {
+    for(size_t i=0; i<np; ++i) {
+      for(int k=0; k<3; ++k) {
+	dest->dx1[i][k]= p[i].dx1[k];
+	dest->dx2[i][k]= p[i].dx2[k];
+      }
+    }
+  }
+
+  dest->np_local= np;
+  dest->np_total= src->np_total;
+  dest->boxsize= src->boxsize;
+  dest->a_x= src->a_x;
+  dest->a_v= src->a_v;
+  dest->a_f= src->a_f;
+}
+
+void particles_copy(ParticlesSoA const * const src, Particles* const dest)
+{
+  const size_t np= src->np_local;
+  assert(np <= dest->np_allocated);
+
+  Particle* const p= dest->p;
+  const bool compressed= src->lpt_compressed();
+  const bool fixed= src->position_fixed();
+  for(size_t i=0; i<np; ++i) {
+    if(fixed)
+      position_float(src->xi[i], src->boxsize, p[i].x);
+
+    for(int k=0; k<3; ++k) {
+      if(!fixed)
+	p[i].x[k]= src->x[i].x[k];
+      p[i].v[k]=   src->v[i][k];
+      if(compressed) {
+	p[i].dx1[k]= src->dx1_scale*src->dx1_16[i][k];
+	p[i].dx2[k]= src->dx2_scale*src->dx2_16[i][k];
+      }
+      else {
+	p[i].dx1[k]= src->dx1[i][k];
+	p[i].dx2[k]= src->dx2[i][k];
+      }
+      dest->force[i][k]= src->force[i][k];
+    }
+    p[i].id= src->id[i];
+  }
+
+  dest->np_local= np;
+  dest->np_total= src->np_total;
+  dest->boxsize= src->boxsize;
+  dest->a_x= src->a_x;
+  dest->a_v= src->a_v;
+  dest->a_f= src->a_f;
+}
@@ -22,6 +22,14 @@ struct Pos {
   Float x[3];
 };
 
+// Position as a uint32 fraction of the boxsize, x = boxsize*xi/2^32;
+// periodic wrapping is the unsigned integer overflow
+struct PosFixed {
+  uint32_t x[3];
+};
+
+typedef int16_t Short3[3];
+
 class Particles {
  public:
   Particles(const size_t np_alloc, const double boxsize);
@@ -38,6 +46,206 @@ class Particles {
   double boxsize;
 };
 
+//
+// Structure-of-arrays layout; each member is a separate aligned array
+// so that kernels reading only some of the fields stream contiguously
+//
+// With compress_lpt, the LPT displacements, which do not change after the
+// initial condition, are stored in 16-bit fixed point dx = dx_scale*dx_16
+// (12 instead of 24 bytes per particle); dx1 and dx2 are then 0.
+//
+// With fixed_position, positions are stored in xi as PosFixed, which has
+// uniform resolution boxsize/2^32 in single precision; x is then 0.
+//
+class ParticlesSoA {
+ public:
+  ParticlesSoA(const size_t np_alloc, const double boxsize,
+	       const bool compress_lpt=false, const bool fixed_position=false);
+  ~ParticlesSoA();
+  void update_np_total();
+  bool lpt_compressed() const { return dx1_16 != 0; }
+  bool position_fixed() const { return xi != 0; }
+
+  Pos* x;
+  PosFixed* xi;
+  Float3* v;
+  Float3* dx1;
+  Float3* dx2;
+  Short3* dx1_16;
+  Short3* dx2_16;
+  Float dx1_scale, dx2_scale;
+  uint64_t* id;
+  Float3* force;
+  double a_x, a_v, a_f;
+
+  size_t np_local, np_allocated;
+  uint64_t np_total;
+  double boxsize;
+};
+
+//
+// Fixed-point conversions
+//
+static inline Float fixed16_scale(const Float max_abs)
+{
+  // Scale for 16-bit fixed point values with |x| <= max_abs
+  return max_abs > 0 ? max_abs/32767 : 1;
+}
+
+static inline int16_t fixed16_encode(const Float x, const Float scale)
+{
+  return static_cast<int16_t>(std::lround(x/scale));
+}
+
+static inline uint32_t fixed32_encode(const double x, const double to_fixed)
+{
+  // to_fixed = 2^32/boxsize; x outside [0, boxsize) is wrapped periodically
+  return static_cast<uint32_t>(std::llround(x*to_fixed));
+}
+
+static inline double fixed32_to_fixed(const double boxsize)
+{
+  return 4294967296.0/boxsize;
+}
+
+//
+// Accessors for kernels templated over the particle layout
+//   v(i), dx1(i), dx2(i): velocity and LPT displacements; dx(i)[k] readable
+//   move(i, dx): x += dx
+//   wrap(i, boxsize): periodic wrapup of position
+//   positions(): Particle*, Pos*, or PosFixed* for position-only kernels
+//
+struct ParticleAccessAoS {
+  typedef Particles Container;
+  typedef Particle  Position;
+
+  // number of Float (uint64_t) between consecutive v, dx1, dx2 (id)
+  static const size_t stride= sizeof(Particle)/sizeof(Float);
+  static const size_t id_stride= sizeof(Particle)/sizeof(uint64_t);
+
+  explicit ParticleAccessAoS(Particles* const particles) :
+    p(particles->p) {}
+  Float* v(const size_t i) const { return p[i].v; }
+  Float* dx1(const size_t i) const { return p[i].dx1; }
+  Float* dx2(const size_t i) const { return p[i].dx2; }
+  uint64_t& id(const size_t i) const { return p[i].id; }
+  Position* positions() const { return p; }
+  void move(const size_t i, Float const dx[]) const {
+    p[i].x[0] += dx[0];
+    p[i].x[1] += dx[1];
+    p[i].x[2] += dx[2];
+  }
+  void wrap(const size_t i, const Float boxsize) const {
+    for(int k=0; k<3; k++) {
+      if(p[i].x[k] < 0) p[i].x[k] += boxsize;
+      if(p[i].x[k] >= boxsize) p[i].x[k] -= boxsize;
+    }
+  }
+
+  Particle* const p;
+};
+
+// Position part of the ParticlesSoA accessors, P = Pos or PosFixed
+template<class P> struct SoAPositions;
+
+template<> struct SoAPositions<Pos> {
+  explicit SoAPositions(ParticlesSoA* const particles) : px(particles->x) {}
+  Pos* positions() const { return px; }
+  void move(const size_t i, Float const dx[]) const {
+    px[i].x[0] += dx[0];
+    px[i].x[1] += dx[1];
+    px[i].x[2] += dx[2];
+  }
+  void wrap(const size_t i, const Float boxsize) const {
+    for(int k=0; k<3; k++) {
+      if(px[i].x[k] < 0) px[i].x[k] += boxsize;
+      if(px[i].x[k] >= boxsize) px[i].x[k] -= boxsize;
+    }
+  }
+
+  Pos* const px;
+};
+
+template<> struct SoAPositions<PosFixed> {
+  explicit SoAPositions(ParticlesSoA* const particles) :
+    px(particles->xi), to_fixed(fixed32_to_fixed(particles->boxsize)) {}
+  PosFixed* positions() const { return px; }
+  void move(const size_t i, Float const dx[]) const {
+    // unsigned addition of a signed displacement wraps periodically
+    px[i].x[0] += static_cast<uint32_t>(std::llround(dx[0]*to_fixed));
+    px[i].x[1] += static_cast<uint32_t>(std::llround(dx[1]*to_fixed));
+    px[i].x[2] += static_cast<uint32_t>(std::llround(dx[2]*to_fixed));
+  }
+  void wrap(const size_t, const Float) const {}
+
+  PosFixed* const px;
+  const double to_fixed;
+};
+
+template<class P>
+struct ParticleAccessSoAT : SoAPositions<P> {
+  typedef ParticlesSoA Container;
+  typedef P            Position;
+
+  static const size_t stride= 3;
+  static const size_t id_stride= 1;
+
+  explicit ParticleAccessSoAT(ParticlesSoA* const particles) :
+    SoAPositions<P>(particles), pv(particles->v),
+    pdx1(particles->dx1), pdx2(particles->dx2), pid(particles->id) {}
+  Float* v(const size_t i) const { return pv[i]; }
+  Float* dx1(const size_t i) const { return pdx1[i]; }
+  Float* dx2(const size_t i) const { return pdx2[i]; }
+  uint64_t& id(const size_t i) const { return pid[i]; }
+
+  Float3* const pv;
+  Float3* const pdx1;
+  Float3* const pdx2;
+  uint64_t* const pid;
+};
+
+// Accessor for ParticlesSoA with compress_lpt; dx1(i)[k] decodes
+struct Disp16 {
+  Short3 const * q;
+  Float scale;
+  Float operator[](const int k) const { return scale*(*q)[k]; }
+};
+
+template<class P>
+struct ParticleAccessSoA16T : SoAPositions<P> {
+  typedef ParticlesSoA Container;
+  typedef P            Position;
+  typedef Disp16       Disp;
+
+  static const size_t stride= 3;
+  static const size_t id_stride= 1;
+
+  explicit ParticleAccessSoA16T(ParticlesSoA* const particles) :
+    SoAPositions<P>(particles), pv(particles->v),
+    pdx1(particles->dx1_16), pdx2(particles->dx2_16), pid(particles->id),
+    dx1_scale(particles->dx1_scale), dx2_scale(particles->dx2_scale) {}
+  Float* v(const size_t i) const { return pv[i]; }
+  Disp dx1(const size_t i) const { Disp d= {pdx1 + i, dx1_scale}; return d; }
+  Disp dx2(const size_t i) const { Disp d= {pdx2 + i, dx2_scale}; return d; }
+  uint64_t& id(const size_t i) const { return pid[i]; }
+
+  Float3* const pv;
+  Short3 const * const pdx1;
+  Short3 const * const pdx2;
+  uint64_t* const pid;
+  const Float dx1_scale, dx2_scale;
+};
+
+typedef ParticleAccessSoAT<Pos>        ParticleAccessSoA;
+typedef ParticleAccessSoA16T<Pos>      ParticleAccessSoA16;
+typedef ParticleAccessSoAT<PosFixed>   ParticleAccessSoAFixed;
+typedef ParticleAccessSoA16T<PosFixed> ParticleAccessSoA16Fixed;
+
 void particles_update_np_total(Particles* const particles);
 
+// Copy particle data between the two layouts; dest must have
+// np_allocated >= src->np_local
+void particles_copy(Particles const * const src, ParticlesSoA* const dest);
+void particles_copy(ParticlesSoA const * const src, Particles* const dest);
+
 #endif
@@ -1,6 +1,7 @@
 #include <cstdio>
 #include <cmath>
 #include <cassert>
+#include <limits>
 #include <gsl/gsl_rng.h>
 
 #include "msg.h"
@@ -18,6 +19,9 @@
 //
 // Module variables
 // Initialisation is checked by nc = 0
+//
+// The mesh is FFTT<float> or FFTT<double>, chosen by pm_init independently
+// of the particle Float; only the mesh of that precision is allocated
 
 namespace {
   PmStatus status;
@@ -25,11 +29,17 @@ namespace {
   size_t nc=0, ncz;
   Float boxsize;
   
-  FFT* fft_pm= 0;
-  complex_t* delta_k;
+  FFTT<float>* fft_pm_f= 0;
+  FFTT<double>* fft_pm_d= 0;
+  void* delta_k; // FFTT<R>::Complex for the mesh precision R
+
+  template<class R> FFTT<R>*& mesh();
+  template<> FFTT<float>*& mesh<float>() { return fft_pm_f; }
+  template<> FFTT<double>*& mesh<double>() { return fft_pm_d; }
 }
 
-static inline void grid_assign(Float * const d, 
+template<class R>
+static inline void grid_assign(R * const d, 
 	    const size_t ix, const size_t iy, const size_t iz, const Float f)
 {
 #ifdef _OPENMP
@@ -38,7 +48,8 @@ static inline void grid_assign(Float * const d,
   d[(ix*nc + iy)*ncz + iz] += f;
 }
 
-static inline Float grid_val(Float const * const d,
+template<class R>
+static inline R grid_val(R const * const d,
 			const size_t ix, const size_t iy, const size_t iz)
 {
   return d[(ix*nc + iy)*ncz + iz];
@@ -46,18 +57,32 @@ static inline Float grid_val(Float const * const d,
 
 
 namespace {
-  void compute_delta_k();
-  void compute_force_mesh(const int axis);
-  void clear_density();
+  template<class R> void compute_delta_k();
+  template<class R> void compute_force_mesh(const int axis);
+  template<class R> void clear_density();
 }
 
 //
 // Template functions
 //
+
+// Position in units of the mesh spacing; T is Particle or Pos
 template<class T>
+static inline Float mesh_coord(T const& p, const int k, const Float dx_inv)
+{
+  return p.x[k]*dx_inv;
+}
+
+static inline Float mesh_coord(PosFixed const& p, const int k, const Float)
+{
+  // Exact integer fraction of the box in double, then to Float
+  return static_cast<Float>(p.x[k]*(nc/4294967296.0));
+}
+
+template<class R, class T>
 void pm_assign_cic_density(T const * const p, size_t np) 
 {
-  // Assign CIC density to fft_pm using np particles P* p.x
+  // Assign CIC density to the mesh of precision R using np particles P* p.x
 
   // Input:  particle positions in p[i].x for 0 <= i < np
   // Result: density field delta(x) in fft_pm->fx
@@ -68,7 +93,8 @@ void pm_assign_cic_density(T const * const p, size_t np)
   msg_printf(msg_verbose, "Computing PM density with %lu particles\n", np);
 	     
   
-  Float* const density= fft_pm->fx;
+  FFTT<R>* const fft_pm= mesh<R>();
+  R* const density= fft_pm->fx;
   const size_t local_nx= fft_pm->local_nx;
   const size_t local_ix0= fft_pm->local_ix0;
  
@@ -82,9 +108,9 @@ void pm_assign_cic_density(T const * const p, size_t np)
   #pragma omp parallel for default(shared)
 #endif
   for(size_t i=0; i<np; i++) {
-    Float x=p[i].x[0]*dx_inv;
-    Float y=p[i].x[1]*dx_inv;
-    Float z=p[i].x[2]*dx_inv;
+    Float x=mesh_coord(p[i], 0, dx_inv);
+    Float y=mesh_coord(p[i], 1, dx_inv);
+    Float z=mesh_coord(p[i], 2, dx_inv);
 
 #ifdef CHECK
     assert(0 <= x && x <= boxsize &&
@@ -139,23 +165,24 @@ void pm_assign_cic_density(T const * const p, size_t np)
 }
 
 
-template <class T>
+template <class R, class T>
 void force_at_particle_locations(T const * const p, const size_t np, 
 				 const int axis, Float3* const f)
 {
+  FFTT<R> const * const fft_pm= mesh<R>();
   const Float dx_inv= nc/boxsize;
   const size_t local_nx= fft_pm->local_nx;
   const size_t local_ix0= fft_pm->local_ix0;
-  const Float* fx= fft_pm->fx;
+  const R* fx= fft_pm->fx;
   const int nci= static_cast<int>(nc);
 
 #ifdef _OPENMP
   #pragma omp parallel for default(shared)     
 #endif
   for(size_t i=0; i<np; i++) {
-    Float x= p[i].x[0]*dx_inv;
-    Float y= p[i].x[1]*dx_inv;
-    Float z= p[i].x[2]*dx_inv;
+    Float x= mesh_coord(p[i], 0, dx_inv);
+    Float y= mesh_coord(p[i], 1, dx_inv);
+    Float z= mesh_coord(p[i], 2, dx_inv);
 
 #ifdef CHECK
     assert(0 <= x && x <= nc &&
@@ -219,19 +246,127 @@ void force_at_particle_locations(T const * const p, const size_t np,
   }
 }
 
+namespace {
+template<class R, class T, class Container>
+void mesh_force(Container* const particles, T const * const p)
+{
+  // Force with the mesh of precision R
+  compute_delta_k<R>();
+
+  for(int axis=0; axis<3; axis++) {
+    // delta(k) -> f(x_i)
+    compute_force_mesh<R>(axis);
+
+    force_at_particle_locations<R, T>(
+      p, particles->np_local, axis, particles->force);
+
+    force_at_particle_locations<R, Pos>(
+      pm_domain_buffer_positions(), pm_domain_buffer_np(), axis,
+      pm_domain_buffer_forces());
+  }
+}
+
+template<class R, class T>
+void mesh_density(T const * const p, const size_t np)
+{
+  // Density on the mesh of precision R
+  clear_density<R>();
+  pm_assign_cic_density<R, T>(p, np);
+  pm_assign_cic_density<R, Pos>(pm_domain_buffer_positions(),
+				pm_domain_buffer_np());
+}
+
+template<class R>
+void check_total_density()
+{
+  // Checks <delta> = 0
+  FFTT<R> const * const fft_pm= mesh<R>();
+  R const * const density= fft_pm->fx;
+  assert(fft_pm->mode == fft_mode_x);
+  
+  double sum= 0.0;
+  const size_t local_nx= fft_pm->local_nx;
+  
+  for(size_t ix=0; ix<local_nx; ix++)
+    for(size_t iy=0; iy<nc; iy++)
+      for(size_t iz=0; iz<nc; iz++)
+	sum += density[(ix*nc + iy)*ncz + iz];
+
+  double sum_global;
+  MPI_Reduce(&sum, &sum_global, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
+  if(comm_this_node() == 0) {
+    double tol= 10*std::numeric_limits<R>::epsilon()*nc*nc*nc;
+
+    if(fabs(sum_global) > tol) {
+      msg_printf(msg_error,
+		 "Error: total CIC density error is  too large: %le > %le\n", 
+		 sum_global, tol);
+      throw AssertionError();
+    }
+
+    msg_printf(msg_debug, 
+	      "Total CIC density OK within machine precision: %lf (< %.2lf).\n",
+	       sum_global, tol);
+  }
+}
+
+template<class T, class Container>
+void compute_force(Container* const particles, T const * const p)
+{
+  if(particles->a_f == particles-> a_x)
+    return;
+
+  if(status != PmStatus::density_done) {
+    msg_printf(msg_error, "Error: PM density not ready.");
+    throw RuntimeError();
+  }
+  
+  msg_printf(msg_verbose, "PM force computation...\n");
+  if(fft_pm_d)
+    mesh_force<double>(particles, p);
+  else
+    mesh_force<float>(particles, p);
+
+  // Force is computed at time a_x
+  particles->a_f = particles->a_x;
+
+  status= PmStatus::force_done;
+}
+
+template<class T>
+FFT* compute_density(T const * const p, const size_t np)
+{
+  msg_printf(msg_verbose, "PM density computation...\n");
+
+  //pm_domain_send_positions(particles);
+
+  if(fft_pm_d)
+    mesh_density<double>(p, np);
+  else
+    mesh_density<float>(p, np);
+
+  status= PmStatus::density_done;
+
+  return pm_get_fft();
+}
+} // unnamed namespace
+
 //
 // Public functions
 //
+template<class T>
 void pm_init(const size_t nc_pm, const double pm_factor_,
 	     Mem* const mem_pm, Mem* const mem_density,
 	     const Float boxsize_)
 {
   // pm_init may be called multiple times with same parameters
-  //
+  // T is the precision of the mesh, float or double
 
 
   if(nc > 0) {
-    if(nc_pm != nc || pm_factor != pm_factor_ || boxsize !=  boxsize_)
+    if(nc_pm != nc || pm_factor != pm_factor_ || boxsize !=  boxsize_ ||
+       mesh<T>() == 0)
       pm_free();
     else
       return;
@@ -257,20 +392,29 @@ void pm_init(const size_t nc_pm, const double pm_factor_,
   const size_t nckz= nc/2 + 1;
   
   mem_pm->use_from_zero(0);
-  fft_pm= new FFT("PM", nc, mem_pm, 1);
+  FFTT<T>* const fft_pm= new FFTT<T>("PM", nc, mem_pm, 1);
+  mesh<T>()= fft_pm;
 
-  size_t size_density_k= nc*(fft_pm->local_nky)*nckz*sizeof(complex_t);
-  delta_k= (complex_t*) mem_density->use_from_zero(size_density_k);
+  size_t size_density_k= nc*(fft_pm->local_nky)*nckz*
+                         sizeof(typename FFTT<T>::Complex);
+  delta_k= mem_density->use_from_zero(size_density_k);
 
-  msg_printf(msg_verbose, "PM module inititialised\n");
+  msg_printf(msg_verbose, "PM module inititialised in %s precision\n",
+	     PrecisionTraits<T>::name());
 
   status = PmStatus::done;
 }
 
+template void pm_init<float>(const size_t, const double, Mem* const,
+			     Mem* const, const Float);
+template void pm_init<double>(const size_t, const double, Mem* const,
+			      Mem* const, const Float);
+
 void pm_free()
 {
   nc = 0;
-  delete fft_pm; fft_pm= 0;
+  delete fft_pm_f; fft_pm_f= 0;
+  delete fft_pm_d; fft_pm_d= 0;
 }
 
 /*
@@ -307,94 +451,52 @@ void pm_compute_force(Particles* const particles)
 {
   // Compute density mesh, force mesh, forces on particles
   // Raises: AssertionError
-
-  if(particles->a_f == particles-> a_x)
-    return;
-
-  if(status != PmStatus::density_done) {
-    msg_printf(msg_error, "Error: PM density not ready.");
-    throw RuntimeError();
-  }
-  
-  msg_printf(msg_verbose, "PM force computation...\n");
-  compute_delta_k();
-
-  for(int axis=0; axis<3; axis++) {
-    // delta(k) -> f(x_i)
-    compute_force_mesh(axis);
-
-    force_at_particle_locations<Particle>(
-      particles->p, particles->np_local, axis, particles->force);
-
-    force_at_particle_locations<Pos>(
-      pm_domain_buffer_positions(), pm_domain_buffer_np(), axis,
-      pm_domain_buffer_forces());
-  }
-
-  // Force is computed at time a_x
-  particles->a_f = particles->a_x;
-
-  status= PmStatus::force_done;
+  compute_force<Particle>(particles, particles->p);
 }
 
+void pm_compute_force(ParticlesSoA* const particles)
+{
+  if(particles->position_fixed())
+    compute_force<PosFixed>(particles, particles->xi);
+  else
+    compute_force<Pos>(particles, particles->x);
+}
 
 FFT* pm_compute_density(Particles* const particles)
 {
-  msg_printf(msg_verbose, "PM density computation...\n");
-
-  //pm_domain_send_positions(particles);
-
-  clear_density();
-  pm_assign_cic_density<Particle>(particles->p, particles->np_local);
-  pm_assign_cic_density<Pos>(pm_domain_buffer_positions(),
-			     pm_domain_buffer_np());
+  return compute_density<Particle>(particles->p, particles->np_local);
+}
 
-  status= PmStatus::density_done;
+FFT* pm_compute_density(ParticlesSoA* const particles)
+{
+  // Only the contiguous position array is read for the CIC assignment
+  if(particles->position_fixed())
+    return compute_density<PosFixed>(particles->xi, particles->np_local);
 
-  return fft_pm;
+  return compute_density<Pos>(particles->x, particles->np_local);
 }
 
 void pm_check_total_density()
 {
 #ifdef CHECK
-  // Checks <delta> = 0
-  Float const * const density= fft_pm->fx;
-  assert(fft_pm->mode == fft_mode_x);
-  
-  double sum= 0.0;
-  const size_t local_nx= fft_pm->local_nx;
-  
-  for(size_t ix=0; ix<local_nx; ix++)
-    for(size_t iy=0; iy<nc; iy++)
-      for(size_t iz=0; iz<nc; iz++)
-	sum += density[(ix*nc + iy)*ncz + iz];
-
-  double sum_global;
-  MPI_Reduce(&sum, &sum_global, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-
-  if(comm_this_node() == 0) {
-    double tol= 10*FLOAT_EPS*nc*nc*nc;
-
-    if(fabs(sum_global) > tol) {
-      msg_printf(msg_error,
-		 "Error: total CIC density error is  too large: %le > %le\n", 
-		 sum_global, tol);
-      throw AssertionError();
-    }
-
-    msg_printf(msg_debug, 
-	      "Total CIC density OK within machine precision: %lf (< %.2lf).\n",
-	       sum_global, tol);
-  }
+  if(fft_pm_d)
+    check_total_density<double>();
+  else
+    check_total_density<float>();
 #endif
 }
 
 
-FFT* pm_get_fft()
+template<class T>
+FFTT<T>* pm_get_fft()
 {
-  return fft_pm;
+  // The PM mesh if it is of precision T, 0 otherwise
+  return mesh<T>();
 }
 
+template FFTT<float>* pm_get_fft<float>();
+template FFTT<double>* pm_get_fft<double>();
+
 PmStatus pm_get_status()
 {
   return status;
@@ -411,10 +513,11 @@ void pm_set_status(PmStatus pm_status)
 //
 namespace {
 
+template<class R>
 void clear_density()
 {
-  Float* const density= fft_pm->fx;
-  const size_t local_nx= fft_pm->local_nx;
+  R* const density= mesh<R>()->fx;
+  const size_t local_nx= mesh<R>()->local_nx;
     
 #ifdef _OPENMP
   #pragma omp parallel for default(shared)
@@ -428,11 +531,15 @@ void clear_density()
 
 
 
+template<class R>
 void compute_delta_k()
 {
   // Fourier transform delta(x) -> delta(k) and copy it to delta_k
   //  Input:  delta(x) in fft_pm->fx
   //  Output: delta(k) in delta_k
+  typedef typename FFTT<R>::Complex Complex;
+  FFTT<R>* const fft_pm= mesh<R>();
+  Complex* const dk= (Complex*) delta_k;
 
   msg_printf(msg_verbose, "delta(x) -> delta(k)\n");
   fft_pm->execute_forward();
@@ -441,7 +548,7 @@ void compute_delta_k()
   const size_t nckz= nc/2 + 1;
   const size_t local_nky= fft_pm->local_nky;
 
-  complex_t* pm_k= fft_pm->fk;
+  Complex* pm_k= fft_pm->fk;
   
 #ifdef _OPENMP
   #pragma omp parallel for default(shared)
@@ -450,20 +557,24 @@ void compute_delta_k()
     for(size_t ix=0; ix<nc; ix++) {
       for(size_t iz=0; iz<nckz; iz++){
 	size_t index= (nc*iy + ix)*nckz + iz;
-	delta_k[index][0]= pm_k[index][0];
-	delta_k[index][1]= pm_k[index][1];	
+	dk[index][0]= pm_k[index][0];
+	dk[index][1]= pm_k[index][1];	
       }
     }
   }
 }
 
+template<class R>
 void compute_force_mesh(const int axis)
 {
   // Calculate one component of force mesh from precalculated density(k)
   //   Input:   delta(k)   mesh delta_k
   //   Output:  force_i(k) mesh fft_pm->fx
+  typedef typename FFTT<R>::Complex Complex;
+  FFTT<R>* const fft_pm= mesh<R>();
+  Complex const * const dk= (Complex const*) delta_k;
 
-  complex_t* const fk= fft_pm->fk;
+  Complex* const fk= fft_pm->fk;
   
   //k=0 zero mode force is zero
   fk[0][0]= 0;
@@ -497,8 +608,8 @@ void compute_force_mesh(const int axis)
 	Float f2= f1/(k[0]*k[0] + k[1]*k[1] + k[2]*k[2])*k[axis];
 
 	size_t index= (nc*iy_local + ix)*nckz + iz;
-	fk[index][0]= -f2*delta_k[index][1];
-	fk[index][1]=  f2*delta_k[index][0];
+	fk[index][0]= -f2*dk[index][1];
+	fk[index][1]=  f2*dk[index][0];
       }
     }
   }
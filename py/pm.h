@@ -7,6 +7,9 @@
 
 enum class PmStatus {density_done, force_done, done};
 
+// T is the precision of the mesh and FFT, float or double, independent of
+// the particle Float; mem_pm and mem_density need fft_mem_size<T>
+template<class T=Float>
 void pm_init(const size_t nc_pm, const double pm_factor_,
 	     Mem* const mem_pm, Mem* const mem_density,
 	     const Float boxsize_);
@@ -15,10 +18,15 @@ void pm_init(const size_t nc_pm, const double pm_factor_,
 void pm_free();
 
 void pm_compute_force(Particles* const particles);
+void pm_compute_force(ParticlesSoA* const particles);
+// Returns the density mesh if it is FFT (Float), 0 otherwise
 FFT* pm_compute_density(Particles* const particles);
+FFT* pm_compute_density(ParticlesSoA* const particles);
 void pm_check_total_density();
 
-FFT* pm_get_fft();
+// The PM mesh if it is of precision T, 0 otherwise
+template<class T=Float>
+FFTT<T>* pm_get_fft();
 
 PmStatus pm_get_status();
 void pm_set_status(PmStatus pm_status);
@@ -21,7 +21,7 @@
 using namespace std;
 
 namespace {
-  FFT const * fft = 0;
+  void const * fft = 0; // FFTT<float> or FFTT<double> of the PM mesh
   int nc;
   int nbuf, nbuf_alloc;
   int nbuf_index, nbuf_index_alloc;
@@ -40,6 +40,12 @@ namespace {
 				   const int local_nx);
   void packets_clear();
   void packets_flush();
+
+  template<class Container>
+  void domain_init(Container const * const particles);
+  template<class Container, class T>
+  void send_positions(Container* const particles, T* const p);
+  void get_forces(Float3* const f, const size_t np_local);
 }
 
 static inline void send(const int i, const Float x[], const Float boxsize);
@@ -50,32 +56,12 @@ void pm_domain_init(Particles const * const particles)
 {
   // Initialise pm_domain module
   // May be called several times
-  
-  if(pm_get_fft() == 0) {
-    msg_printf(msg_error,
-	       "Error: pm_init must be called before pm_domain_init/pm_domain_send_positions\n");
-    throw RuntimeError();
-  }
-
-  if(fft == pm_get_fft())
-    return;  // already initialised and pm_fft stays the same
-
-  pm_domain_free();  
-  fft = pm_get_fft();
-
-  // Initialise static variables  
-  nc= fft->nc;
-
-  const Float boxsize= particles->boxsize;
-  x_left= boxsize/nc*(fft->local_ix0 + 1);
-  x_right= boxsize/nc*(fft->local_ix0 + fft->local_nx - 1);
-
-  allocate_pm_buffer(particles->np_allocated, particles->np_total,
-		     fft->local_nx);
-
-  allocate_decomposition(boxsize, fft->local_ix0, fft->local_nx);
+  domain_init(particles);
+}
 
-  msg_printf(msg_verbose, "pm_domain initilised\n");
+void pm_domain_init(ParticlesSoA const * const particles)
+{
+  domain_init(particles);
 }
 
 void pm_domain_free()
@@ -95,69 +81,26 @@ void pm_domain_send_positions(Particles* const particles)
 {
   // Send particle positions to other nodes for PM density computation
   // Raises RuntimeError if pm module not initialised
-  pm_domain_init(particles);
-  assert(buf_pos);
-
-  msg_printf(msg_verbose, "sending positions\n");
-
-  nbuf= 0;
-  nbuf_index= 0;
-  packets_sent.clear();
-  packets_clear();
-  
-  const int np= particles->np_local;
-  const Float boxsize= particles->boxsize;
-
-  MPI_Win_fence(0, win_pos);
-
-  Particle* const p= particles->p;
-  for(int i=0; i<np; ++i) {
-    periodic_wrapup_p(p[i], boxsize);
-
-    if(p[i].x[0] < x_left)
-      send(i, p[i].x, boxsize);
-    if(p[i].x[0] > x_right)
-      send(i, p[i].x, boxsize);
-  }
-
-  packets_flush();
-
-  MPI_Win_fence(0, win_pos);
+  send_positions(particles, particles->p);
 }
 
+void pm_domain_send_positions(ParticlesSoA* const particles)
+{
+  if(particles->position_fixed())
+    send_positions(particles, particles->xi);
+  else
+    send_positions(particles, particles->x);
+}
 
 void pm_domain_get_forces(Particles* const particles)
 {
   // Get force from other nodes
-  Float3* const f= particles->force;
-  
-  MPI_Win_fence(0, win_force);
-
-  for(auto& packet : packets_sent) {
-    const Index nsent= packet.n;
-
-    MPI_Get(packet_force, 3*nsent, FLOAT_TYPE, packet.dest_rank,
-	    packet.offset*3, 3*nsent, FLOAT_TYPE, win_force);
+  get_forces(particles->force, particles->np_local);
+}
 
-    Index index0= packet.offset_index;
-    for(Index i=0; i<nsent; ++i) {
-      Index ii= index0 + i;
-#ifdef CHECK
-      assert(0 <= ii && ii < nbuf_index);
-#endif
-      Index index= buf_index[ii];
-      
-      
-#ifdef CHECK
-      assert(0 <= index && index < particles->np_local);
-#endif
-      
-      f[index][0] += packet_force[i][0];
-      f[index][1] += packet_force[i][1];
-      f[index][2] += packet_force[i][2];
-    }
-  }
-  MPI_Win_fence(0, win_force);
+void pm_domain_get_forces(ParticlesSoA* const particles)
+{
+  get_forces(particles->force, particles->np_local);
 }
 
 
@@ -308,6 +251,110 @@ void packets_flush()
     dom.send_packet();
 }
 
+template<class Container>
+void domain_init(Container const * const particles)
+{
+  // The mesh decomposition is the same for both precisions of the mesh
+  FFTT<float> const * const fft_f= pm_get_fft<float>();
+  FFTT<double> const * const fft_d= pm_get_fft<double>();
+  void const * const pm_fft= fft_f ? (void const *) fft_f : fft_d;
+
+  if(pm_fft == 0) {
+    msg_printf(msg_error,
+	       "Error: pm_init must be called before pm_domain_init/pm_domain_send_positions\n");
+    throw RuntimeError();
+  }
+
+  if(fft == pm_fft)
+    return;  // already initialised and pm_fft stays the same
+
+  pm_domain_free();  
+  fft = pm_fft;
+
+  // Initialise static variables  
+  nc= fft_f ? fft_f->nc : fft_d->nc;
+  const int local_ix0= fft_f ? fft_f->local_ix0 : fft_d->local_ix0;
+  const int local_nx= fft_f ? fft_f->local_nx : fft_d->local_nx;
+
+  const Float boxsize= particles->boxsize;
+  x_left= boxsize/nc*(local_ix0 + 1);
+  x_right= boxsize/nc*(local_ix0 + local_nx - 1);
+
+  allocate_pm_buffer(particles->np_allocated, particles->np_total,
+		     local_nx);
+
+  allocate_decomposition(boxsize, local_ix0, local_nx);
+
+  msg_printf(msg_verbose, "pm_domain initilised\n");
+}
+
+template<class Container, class T>
+void send_positions(Container* const particles, T* const p)
+{
+  // T is Particle, Pos, or PosFixed
+  domain_init(particles);
+  assert(buf_pos);
+
+  msg_printf(msg_verbose, "sending positions\n");
+
+  nbuf= 0;
+  nbuf_index= 0;
+  packets_sent.clear();
+  packets_clear();
+  
+  const int np= particles->np_local;
+  const Float boxsize= particles->boxsize;
+
+  MPI_Win_fence(0, win_pos);
+
+  for(int i=0; i<np; ++i) {
+    periodic_wrapup_p(p[i], boxsize);
+
+    Float x[3];
+    position_float(p[i], boxsize, x);
+    if(x[0] < x_left)
+      send(i, x, boxsize);
+    if(x[0] > x_right)
+      send(i, x, boxsize);
+  }
+
+  packets_flush();
+
+  MPI_Win_fence(0, win_pos);
+}
+
+
+void get_forces(Float3* const f, const size_t np_local)
+{
+  MPI_Win_fence(0, win_force);
+
+  for(auto& packet : packets_sent) {
+    const Index nsent= packet.n;
+
+    MPI_Get(packet_force, 3*nsent, FLOAT_TYPE, packet.dest_rank,
+	    packet.offset*3, 3*nsent, FLOAT_TYPE, win_force);
+
+    Index index0= packet.offset_index;
+    for(Index i=0; i<nsent; ++i) {
+      Index ii= index0 + i;
+#ifdef CHECK
+      assert(0 <= ii && ii < nbuf_index);
+#endif
+      Index index= buf_index[ii];
+      
+      
+#ifdef CHECK
+      assert(0 <= index && (size_t) index < np_local);
+#endif
+      
+      f[index][0] += packet_force[i][0];
+      f[index][1] += packet_force[i][1];
+      f[index][2] += packet_force[i][2];
+    }
+  }
+  MPI_Win_fence(0, win_force);
+}
+
   
 }
 
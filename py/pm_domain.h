@@ -37,13 +37,16 @@ struct Packet {
 };
 
 void pm_domain_init(Particles const * const particles);
+void pm_domain_init(ParticlesSoA const * const particles);
 void pm_domain_free();
 
 void pm_domain_send_positions(Particles* const particles);
+void pm_domain_send_positions(ParticlesSoA* const particles);
 Pos const * pm_domain_buffer_positions();
 Float3* pm_domain_buffer_forces();
 int pm_domain_buffer_np();
 void pm_domain_get_forces(Particles* const particles);
+void pm_domain_get_forces(ParticlesSoA* const particles);
 void pm_domain_write_packet_info(const char filename[]);
 int pm_domain_nbuf();
 void pm_domain_set_packet_size(const int packet_size);
@@ -1,6 +1,7 @@
 #ifndef PY_ASSERT_H
 #define PY_ASSERT_H 1
 
+#include <cstring>
 #include "Python.h"
 #include "msg.h"
 
@@ -11,6 +12,17 @@
 #define py_assert_ptr(e)\
   if(!(e)){PyErr_SetString(PyExc_TypeError, "py_assersion error"); return NULL; }
 
+// Set a Python exception with the last msg_error message, which explains
+// the C++ exception thrown after it, without the "Error: " prefix
+static inline void py_set_error(PyObject* const type,
+				char const * const default_msg)
+{
+  char const * msg= msg_last_error();
+  if(strncmp(msg, "Error: ", 7) == 0)
+    msg += 7;
+
+  PyErr_SetString(type, *msg ? msg : default_msg);
+}
 
 /*
 #define py_assert(e)\
@@ -1,14 +1,16 @@
 #include "cola.h"
 #include "py_assert.h"
+#include "py_step_schedule.h"
+#include "py_lightcone.h"
 
 PyObject* py_cola_kick(PyObject* self, PyObject* args)
 {
-  // _cola_kick(_particles, a_vel)
+  // _cola_kick(_particles, a_vel, _schedule=None)
 
-  PyObject *py_particles;
+  PyObject *py_particles, *py_schedule= Py_None;
   double a_vel;
   
-  if(!PyArg_ParseTuple(args, "Od", &py_particles, &a_vel)) {
+  if(!PyArg_ParseTuple(args, "Od|O", &py_particles, &a_vel, &py_schedule)) {
     return NULL;
   }
 
@@ -16,19 +18,24 @@ PyObject* py_cola_kick(PyObject* self, PyObject* args)
     (Particles *) PyCapsule_GetPointer(py_particles, "_Particles");
   py_assert_ptr(particles);
 
-  cola_kick(particles, a_vel);
+  StepSchedule const * const schedule= py_step_schedule_get(py_schedule);
+  if(py_schedule != Py_None)
+    py_assert_ptr(schedule);
+
+  cola_kick(particles, a_vel, schedule);
 
   Py_RETURN_NONE;
 }
 
 PyObject* py_cola_drift(PyObject* self, PyObject* args)
 {
-  // _cola_drift(_particles, a_pos)
+  // _cola_drift(_particles, a_pos, _schedule=None, _lightcone=None)
 
-  PyObject *py_particles;
+  PyObject *py_particles, *py_schedule= Py_None, *py_lightcone= Py_None;
   double a_pos;
   
-  if(!PyArg_ParseTuple(args, "Od", &py_particles, &a_pos)) {
+  if(!PyArg_ParseTuple(args, "Od|OO", &py_particles, &a_pos, &py_schedule,
+		       &py_lightcone)) {
     return NULL;
   }
 
@@ -36,7 +43,44 @@ PyObject* py_cola_drift(PyObject* self, PyObject* args)
     (Particles *) PyCapsule_GetPointer(py_particles, "_Particles");
   py_assert_ptr(particles);
 
-  cola_drift(particles, a_pos);
+  StepSchedule const * const schedule= py_step_schedule_get(py_schedule);
+  if(py_schedule != Py_None)
+    py_assert_ptr(schedule);
+
+  Lightcone* const lightcone= py_lightcone_get(py_lightcone);
+  if(py_lightcone != Py_None)
+    py_assert_ptr(lightcone);
+
+  cola_drift(particles, a_pos, schedule, lightcone);
+
+  Py_RETURN_NONE;
+}
+
+PyObject* py_cola_step(PyObject* self, PyObject* args)
+{
+  // _cola_step(_particles, a_vel, a_pos, _schedule=None, _lightcone=None)
+
+  PyObject *py_particles, *py_schedule= Py_None, *py_lightcone= Py_None;
+  double a_vel, a_pos;
+  
+  if(!PyArg_ParseTuple(args, "Odd|OO", &py_particles, &a_vel, &a_pos,
+		       &py_schedule, &py_lightcone)) {
+    return NULL;
+  }
+
+  Particles* const particles=
+    (Particles *) PyCapsule_GetPointer(py_particles, "_Particles");
+  py_assert_ptr(particles);
+
+  StepSchedule const * const schedule= py_step_schedule_get(py_schedule);
+  if(py_schedule != Py_None)
+    py_assert_ptr(schedule);
+
+  Lightcone* const lightcone= py_lightcone_get(py_lightcone);
+  if(py_lightcone != Py_None)
+    py_assert_ptr(lightcone);
+
+  cola_step(particles, a_vel, a_pos, schedule, lightcone);
 
   Py_RETURN_NONE;
 }
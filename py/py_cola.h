@@ -5,6 +5,7 @@
 
 PyObject* py_cola_kick(PyObject* self, PyObject* args);
 PyObject* py_cola_drift(PyObject* self, PyObject* args);
+PyObject* py_cola_step(PyObject* self, PyObject* args);
 
 
 #endif
@@ -37,3 +37,23 @@ PyObject* py_cosmology_D2_growth(PyObject* self, PyObject* args)
   return Py_BuildValue("d", D2);
 }
 
+PyObject* py_cosmology_f_growth_rate(PyObject* self, PyObject* args)
+{
+  double a;
+  if(!PyArg_ParseTuple(args, "d", &a)) {
+    return NULL;
+  }
+
+  return Py_BuildValue("d", cosmology_f_growth_rate(a));
+}
+
+PyObject* py_cosmology_time_integral(PyObject* self, PyObject* args)
+{
+  // _cosmology_time_integral(ai, af, n)
+  double ai, af, n;
+  if(!PyArg_ParseTuple(args, "ddd", &ai, &af, &n)) {
+    return NULL;
+  }
+
+  return Py_BuildValue("d", cosmology_time_integral(ai, af, n));
+}
@@ -6,5 +6,7 @@
 PyObject* py_cosmology_init(PyObject* self, PyObject* args);
 PyObject* py_cosmology_D_growth(PyObject* self, PyObject* args);
 PyObject* py_cosmology_D2_growth(PyObject* self, PyObject* args);
+PyObject* py_cosmology_f_growth_rate(PyObject* self, PyObject* args);
+PyObject* py_cosmology_time_integral(PyObject* self, PyObject* args);
 
 #endif
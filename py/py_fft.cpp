@@ -11,12 +11,28 @@ using namespace std;
 #define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
 #include "numpy/arrayobject.h"
 
-#ifdef DOUBLEPRECISION
-#define NPY_FLOAT_TYPE NPY_DOUBLE
-#else
-#define NPY_FLOAT_TYPE NPY_FLOAT
-#endif
+//
+// FFT grids of the precision other than Float are "_FFTf" or "_FFTd"
+// capsules; "_FFT" is always FFT (Float), e.g., PM density
+//
+namespace {
+  template<class T> int npy_type();
+  template<> int npy_type<float>() { return NPY_FLOAT; }
+  template<> int npy_type<double>() { return NPY_DOUBLE; }
+
+  template<class T> void fft_free(PyObject *obj);
+  template<class T> void set_test_data(FFTT<T>* const fft);
+  template<class T> PyObject* fx_global_as_array(FFTT<T> const * const fft);
+}
+
 
+template<> char const * py_fft_capsule_name<float>() {
+  return sizeof(Float) == sizeof(float) ? "_FFT" : "_FFTf";
+}
+
+template<> char const * py_fft_capsule_name<double>() {
+  return sizeof(Float) == sizeof(double) ? "_FFT" : "_FFTd";
+}
 
 PyMODINIT_FUNC
 py_fft_module_init()
@@ -27,49 +43,94 @@ py_fft_module_init()
 
 PyObject* py_fft_alloc(PyObject* self, PyObject* args)
 {
-  // _fft_alloc(nc)
-  int nc;
-  if(!PyArg_ParseTuple(args, "i", &nc)) {
+  // _fft_alloc(nc, double_precision)
+  int nc, double_precision;
+  if(!PyArg_ParseTuple(args, "ip", &nc, &double_precision)) {
     return NULL;
   }
 
-  FFT* fft= 0;
   try {
-    fft= new FFT("py_fft", nc, 0, true);
+    if(double_precision) {
+      FFTT<double>* const fft= new FFTT<double>("py_fft", nc, 0, true);
+      return PyCapsule_New(fft, py_fft_capsule_name<double>(), fft_free<double>);
+    }
+
+    FFTT<float>* const fft= new FFTT<float>("py_fft", nc, 0, true);
+    return PyCapsule_New(fft, py_fft_capsule_name<float>(), fft_free<float>);
   }
   catch(MemoryError) {
     PyErr_SetNone(PyExc_MemoryError);
-    return NULL;
   }
 
-  return PyCapsule_New(fft, "_FFT", py_fft_free);
+  return NULL;
 }
 
-void py_fft_free(PyObject *obj)
+PyObject* py_fft_set_test_data(PyObject* self, PyObject* args)
 {
-  FFT* const fft=
-    (FFT*) PyCapsule_GetPointer(obj, "_FFT");
-  py_assert_void(fft);
+  // _fft_set_test_data(_fft); set 1,2,3, ...
+  PyObject* py_fft;
+  if(!PyArg_ParseTuple(args, "O", &py_fft))
+    return NULL;
 
-  delete fft;
+  if(PyCapsule_IsValid(py_fft, py_fft_capsule_name<float>())) {
+    FFTT<float>* const fft= (FFTT<float>*)
+      PyCapsule_GetPointer(py_fft, py_fft_capsule_name<float>());
+    py_assert_ptr(fft);
+    set_test_data(fft);
+  }
+  else {
+    FFTT<double>* const fft= (FFTT<double>*)
+      PyCapsule_GetPointer(py_fft, py_fft_capsule_name<double>());
+    py_assert_ptr(fft);
+    set_test_data(fft);
+  }
+
+  Py_RETURN_NONE;
 }
 
-PyObject* py_fft_set_test_data(PyObject* self, PyObject* args)
+PyObject* py_fft_fx_global_as_array(PyObject* self, PyObject* args)
 {
-  // _fft_set_test_data(_fft); set 1,2,3, ...
+  // _fft_fx_global_as_array(_fft)
+  //   return whole nc^3 fft->fx grid as an np.array at node 0
+  //   return None for node != 0
+
   PyObject* py_fft;
   if(!PyArg_ParseTuple(args, "O", &py_fft))
     return NULL;
 
-  FFT* const fft=
-      (FFT *) PyCapsule_GetPointer(py_fft, "_FFT");
+  if(PyCapsule_IsValid(py_fft, py_fft_capsule_name<float>())) {
+    FFTT<float> const * const fft= (FFTT<float>*)
+      PyCapsule_GetPointer(py_fft, py_fft_capsule_name<float>());
+    py_assert_ptr(fft);
+    return fx_global_as_array(fft);
+  }
+
+  FFTT<double> const * const fft= (FFTT<double>*)
+    PyCapsule_GetPointer(py_fft, py_fft_capsule_name<double>());
   py_assert_ptr(fft);
 
+  return fx_global_as_array(fft);
+}
+
+namespace {
+template<class T>
+void fft_free(PyObject *obj)
+{
+  FFTT<T>* const fft=
+    (FFTT<T>*) PyCapsule_GetPointer(obj, py_fft_capsule_name<T>());
+  py_assert_void(fft);
+
+  delete fft;
+}
+
+template<class T>
+void set_test_data(FFTT<T>* const fft)
+{
   const size_t nc= fft->nc;
   const size_t ncz= 2*(nc/2 + 1);
   const size_t nx= fft->local_nx;
   const size_t ix0= fft->local_ix0;
-  Float* const fx= fft->fx;
+  T* const fx= fft->fx;
   
   for(size_t ix=0; ix<nx; ++ix) {
     for(size_t iy=0; iy<nc; ++iy) {
@@ -80,24 +141,11 @@ PyObject* py_fft_set_test_data(PyObject* self, PyObject* args)
       }
     }
   }
-
-  Py_RETURN_NONE;
 }
 
-PyObject* py_fft_fx_global_as_array(PyObject* self, PyObject* args)
+template<class T>
+PyObject* fx_global_as_array(FFTT<T> const * const fft)
 {
-  // _fft_fx_global_as_array(_fft)
-  //   return whole nc^3 fft->fx grid as an np.array at node 0
-  //   return None for node != 0
-
-  PyObject* py_fft;
-  if(!PyArg_ParseTuple(args, "O", &py_fft))
-    return NULL;
-
-  FFT* const fft=
-      (FFT *) PyCapsule_GetPointer(py_fft, "_FFT");
-  py_assert_ptr(fft);
-
   const size_t nc= fft->nc;
   const size_t ncz= 2*(nc/2 + 1);
   const size_t nx= fft->local_nx;
@@ -106,16 +154,16 @@ PyObject* py_fft_fx_global_as_array(PyObject* self, PyObject* args)
   // Allocate a new np.array
   //
   PyObject* arr= 0;
-  Float* recvbuf= 0;
+  T* recvbuf= 0;
     
   if(comm_this_node() == 0) {
     const int nd= 3;
     npy_intp dims[]= {(npy_intp)nc, (npy_intp)nc, (npy_intp)nc};
 
-    arr= PyArray_ZEROS(nd, dims, NPY_FLOAT_TYPE, 0);
+    arr= PyArray_ZEROS(nd, dims, npy_type<T>(), 0);
     py_assert_ptr(arr);
   
-    recvbuf= (Float*) PyArray_DATA((PyArrayObject*) arr);
+    recvbuf= (T*) PyArray_DATA((PyArrayObject*) arr);
     py_assert_ptr(recvbuf);
   }
 
@@ -136,7 +184,7 @@ PyObject* py_fft_fx_global_as_array(PyObject* self, PyObject* args)
   const int nsend= fft->local_nx*nc*nc;
 
   const int n= comm_n_nodes();
-  Float* const sendbuf= (Float*) malloc(sizeof(Float)*nsend);
+  T* const sendbuf= (T*) malloc(sizeof(T)*nsend);
   if(sendbuf == 0) {
     PyErr_SetString(PyExc_MemoryError,
 		    "Unable to allocate memory for nrecv");
@@ -174,8 +222,9 @@ PyObject* py_fft_fx_global_as_array(PyObject* self, PyObject* args)
     }
   }
     
-  MPI_Gatherv(sendbuf, nsend, FLOAT_TYPE, 
-	      recvbuf, nrecv, displ, FLOAT_TYPE, 0, MPI_COMM_WORLD);
+  const MPI_Datatype mpi_type= PrecisionTraits<T>::mpi_type();
+  MPI_Gatherv(sendbuf, nsend, mpi_type,
+	      recvbuf, nrecv, displ, mpi_type, 0, MPI_COMM_WORLD);
 
   free(nrecv);
   free(sendbuf);
@@ -186,6 +235,7 @@ PyObject* py_fft_fx_global_as_array(PyObject* self, PyObject* args)
 
   Py_RETURN_NONE;
 }
+}
 
 /*
 PyObject* py_fft_fx_as_array(FFT* const fft)
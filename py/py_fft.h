@@ -7,8 +7,12 @@
 PyMODINIT_FUNC
 py_fft_module_init();
 
+// Capsule name of FFTT<T>: "_FFT" for Float, "_FFTf" or "_FFTd" otherwise
+template<class T> char const * py_fft_capsule_name();
+template<> char const * py_fft_capsule_name<float>();
+template<> char const * py_fft_capsule_name<double>();
+
 PyObject* py_fft_alloc(PyObject* self, PyObject* args);
-void py_fft_free(PyObject *obj);
 PyObject* py_fft_set_test_data(PyObject* self, PyObject* args);
 
 //PyObject* py_fft_fx_as_array(FFT* const fft);
@@ -1,29 +1,74 @@
 #include <cmath>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <mpi.h>
 #include "config.h"
 #include "particle.h"
 #include "comm.h"
 #include "kdtree.h"
 #include "fof.h"
+#include "halo.h"
+#include "hdf5_io.h"
+#include "error.h"
 #include "py_fof.h"
 #include "py_array.h"
 #include "py_assert.h"
 
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include "numpy/arrayobject.h"
+
 using namespace std;
 
+namespace {
+  // NPY type of Index for the particle index arrays
+  template<class T> int npy_type();
+  template<> int npy_type<int>() { return NPY_INT; }
+  template<> int npy_type<long>() { return NPY_LONG; }
+  template<> int npy_type<long long>() { return NPY_LONGLONG; }
+}
+
+PyMODINIT_FUNC
+py_fof_module_init()
+{
+  import_array();
+  return NULL;
+}
 
 PyObject* py_fof_find_groups(PyObject* self, PyObject* args)
 {
-  // _fof_find_groups(_particles, linking_length, quota)
+  // _fof_find_groups(_particles, linking_length, boxsize3, quota,
+  //                  return_nfof, permute, method, update_tree)
+  //   method: "kdtree" or "grid"
 
   PyObject *py_particles, *py_boxsize3;
   double linking_length;
   int quota;
   int return_nfof;
-  if(!PyArg_ParseTuple(args, "OdOii", &py_particles, &linking_length,
-		       &py_boxsize3, &quota, &return_nfof))
+  int permute;
+  char const* method_name;
+  int update_tree;
+  if(!PyArg_ParseTuple(args, "OdOiipsp", &py_particles, &linking_length,
+		       &py_boxsize3, &quota, &return_nfof, &permute,
+		       &method_name, &update_tree))
     return NULL;
 
-  py_assert_ptr(comm_n_nodes() == 1);
+  const string smethod(method_name);
+  FofMethod method;
+  if(smethod == "kdtree")
+    method= FofMethod::kdtree;
+  else if(smethod == "grid")
+    method= FofMethod::grid;
+  else {
+    PyErr_SetString(PyExc_ValueError, "method must be 'kdtree' or 'grid'");
+    return NULL;
+  }
+
+  if(comm_n_nodes() > 1) {
+    PyErr_SetString(PyExc_ValueError,
+		    "find_groups runs on one MPI node; use find_groups_mpi");
+    return NULL;
+  }
   
   Particles* const particles=
     (Particles*) PyCapsule_GetPointer(py_particles, "_Particles");
@@ -31,7 +76,8 @@ PyObject* py_fof_find_groups(PyObject* self, PyObject* args)
 
 
   if(py_boxsize3 == Py_None)
-    fof_find_groups(particles, linking_length, 0, quota);
+    fof_find_groups(particles, linking_length, 0, quota, permute, method,
+		    update_tree);
   else {
     Float boxsize3[3];
     py_assert_ptr(PySequence_Check(py_boxsize3)); // ToDo raise error
@@ -43,7 +89,8 @@ PyObject* py_fof_find_groups(PyObject* self, PyObject* args)
       boxsize3[k]= PyFloat_AsDouble(py_elem);
       Py_DECREF(py_elem);
     }
-    fof_find_groups(particles, linking_length, boxsize3, quota);
+    fof_find_groups(particles, linking_length, boxsize3, quota, permute,
+		    method, update_tree);
   }
 
   if(return_nfof) {
@@ -62,3 +109,150 @@ PyObject* py_fof_grp(PyObject* self, PyObject* args)
 
   Py_RETURN_NONE;  
 }
+
+static PyObject* gather_uint64(vector<uint64_t> const& v)
+{
+  // Return the concatenation of v on all nodes as np.array on node 0,
+  // None on other nodes
+  const int n= comm_n_nodes();
+  const int nsend= v.size();
+  vector<int> nrecv(n), displ(n);
+
+  MPI_Gather(&nsend, 1, MPI_INT, nrecv.data(), 1, MPI_INT, 0,
+	     MPI_COMM_WORLD);
+
+  int nrecv_total= 0;
+  for(int i=0; i<n; ++i) {
+    displ[i]= nrecv_total;
+    nrecv_total += nrecv[i];
+  }
+
+  vector<uint64_t> recvbuf(comm_this_node() == 0 ? nrecv_total : 0);
+  MPI_Gatherv(v.data(), nsend, MPI_UINT64_T,
+	      recvbuf.data(), nrecv.data(), displ.data(), MPI_UINT64_T,
+	      0, MPI_COMM_WORLD);
+
+  if(comm_this_node() != 0)
+    Py_RETURN_NONE;
+
+  npy_intp dim= nrecv_total;
+  PyObject* const arr= PyArray_SimpleNew(1, &dim, NPY_UINT64);
+  py_assert_ptr(arr);
+  if(nrecv_total > 0)
+    memcpy(PyArray_DATA((PyArrayObject*) arr), recvbuf.data(),
+	   sizeof(uint64_t)*nrecv_total);
+
+  return arr;
+}
+
+PyObject* py_fof_find_groups_mpi(PyObject* self, PyObject* args)
+{
+  // _fof_find_groups_mpi(_particles, linking_length, quota)
+  // Returns (group_id, halo_id, halo_nfof) gathered on node 0
+  PyObject *py_particles;
+  double linking_length;
+  int quota;
+  if(!PyArg_ParseTuple(args, "Odi", &py_particles, &linking_length, &quota))
+    return NULL;
+
+  Particles* const particles=
+    (Particles*) PyCapsule_GetPointer(py_particles, "_Particles");
+  py_assert_ptr(particles);
+
+  try {
+    fof_find_groups_mpi(particles, linking_length, quota);
+  }
+  catch(ValError) {
+    PyErr_SetString(PyExc_ValueError,
+		    "linking length larger than the slab width");
+    return NULL;
+  }
+  catch(MemoryError) {
+    PyErr_SetString(PyExc_MemoryError, "unable to allocate memory for FoF");
+    return NULL;
+  }
+  catch(RuntimeError) {
+    PyErr_SetString(PyExc_RuntimeError, "original of FoF ghost not found");
+    return NULL;
+  }
+
+  PyObject* const py_group_id= gather_uint64(fof_group_id());
+  PyObject* const py_halo_id= gather_uint64(fof_halo_id());
+  PyObject* const py_halo_nfof= gather_uint64(fof_halo_nfof());
+
+  return Py_BuildValue("(NNN)", py_group_id, py_halo_id, py_halo_nfof);
+}
+
+static PyObject* index_array(vector<Index> const& v)
+{
+  // Copy of v as np.array
+  npy_intp dim= v.size();
+  PyObject* const arr= PyArray_SimpleNew(1, &dim, npy_type<Index>());
+  py_assert_ptr(arr);
+  if(!v.empty())
+    memcpy(PyArray_DATA((PyArrayObject*) arr), v.data(),
+	   sizeof(Index)*v.size());
+
+  return arr;
+}
+
+PyObject* py_fof_members(PyObject* self, PyObject* args)
+{
+  // _fof_members(nfof_min)
+  // Returns (offsets, members, roots) of the groups of the last
+  // _fof_find_groups with nfof_min members or more
+  int nfof_min;
+  if(!PyArg_ParseTuple(args, "i", &nfof_min))
+    return NULL;
+
+  fof_compute_members(nfof_min);
+
+  return Py_BuildValue("(NNN)", index_array(fof_member_offsets()),
+		       index_array(fof_members()),
+		       index_array(fof_group_roots()));
+}
+
+PyObject* py_fof_write_halos(PyObject* self, PyObject* args)
+{
+  // _fof_write_halos(_particles, filename, nfof_min, cola)
+  // Write the halo catalogue of the last _fof_find_groups; collective
+  // Returns the number of halos in this node
+  PyObject *py_particles, *bytes;
+  int nfof_min;
+  int cola;
+  if(!PyArg_ParseTuple(args, "OO&ip", &py_particles,
+		       PyUnicode_FSConverter, &bytes, &nfof_min, &cola))
+    return NULL;
+
+  char* filename;
+  Py_ssize_t len;
+  PyBytes_AsStringAndSize(bytes, &filename, &len);
+
+  Particles* const particles=
+    (Particles*) PyCapsule_GetPointer(py_particles, "_Particles");
+  py_assert_ptr(particles);
+
+  size_t nhalo= 0;
+  msg_clear_error();
+  try {
+    vector<Halo> const& halos=
+      halo_compute_catalogue(particles, nfof_min, cola);
+    nhalo= halos.size();
+    hdf5_write_halos(filename, halos, particles->boxsize, particles->a_x);
+  }
+  catch(ValError) {
+    Py_DECREF(bytes);
+    py_set_error(PyExc_ValueError,
+		 "FoF groups are not computed for the particles");
+    return NULL;
+  }
+  catch(IOError) {
+    Py_DECREF(bytes);
+    PyErr_SetNone(PyExc_IOError);
+    return NULL;
+  }
+
+  Py_DECREF(bytes);
+
+  return Py_BuildValue("K", (unsigned long long) nhalo);
+}
@@ -3,7 +3,13 @@
 
 #include "Python.h"
 
+PyMODINIT_FUNC
+py_fof_module_init();
+
 PyObject* py_fof_find_groups(PyObject* self, PyObject* args);
 PyObject* py_fof_grp(PyObject* self, PyObject* args);
+PyObject* py_fof_find_groups_mpi(PyObject* self, PyObject* args);
+PyObject* py_fof_members(PyObject* self, PyObject* args);
+PyObject* py_fof_write_halos(PyObject* self, PyObject* args);
 
 #endif
@@ -1,11 +1,48 @@
 #include <cmath>
+#include <cstring>
+#include <vector>
 #include "kdtree.h"
 #include "py_assert.h"
 #include "py_kdtree.h"
 
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include "numpy/arrayobject.h"
+
+using namespace std;
+
+namespace {
+  // NPY type of Index for the particle index arrays
+  template<class T> int npy_type();
+  template<> int npy_type<int>() { return NPY_INT; }
+  template<> int npy_type<long>() { return NPY_LONG; }
+  template<> int npy_type<long long>() { return NPY_LONGLONG; }
+}
+
+PyMODINIT_FUNC
+py_kdtree_module_init()
+{
+  import_array();
+  return NULL;
+}
+
+static bool check_tree()
+{
+  // Set the Python error and return false if no kdtree is built, e.g.,
+  // after fof.find_groups_mpi, which frees its tree
+  if(kdtree_get_root() == 0) {
+    PyErr_SetString(PyExc_RuntimeError,
+		    "kdtree not built; call fs.kdtree.build(particles)");
+    return false;
+  }
+
+  return true;
+}
+
 PyObject* py_kdtree_create_copy(PyObject* self, PyObject* args)
 {
   // Copy the kdtree to Python data structure
+  if(!check_tree())
+    return NULL;
 
   // size_t inode= 0;
   KdTree const * const kdtree= kdtree_get_root();
@@ -19,11 +56,14 @@ PyObject* py_kdtree_create_copy(PyObject* self, PyObject* args)
     
   for(size_t i=0; i<n_node; ++i) {
     KdTree const * node= kdtree + i;
-    PyObject* item= Py_BuildValue("(KiddKK)",
+    PyObject* item= Py_BuildValue("(K(ddd)(ddd)KK)",
 				  (unsigned long long) i,
-				  node->k,
-				  (double) node->left,
-				  (double) node->right,
+				  (double) node->lo[0],
+				  (double) node->lo[1],
+				  (double) node->lo[2],
+				  (double) node->hi[0],
+				  (double) node->hi[1],
+				  (double) node->hi[2],
 				  (unsigned long long) node->ibegin,
 				  (unsigned long long) node->iend);
     int ret= PyList_Append(list, item);
@@ -37,3 +77,144 @@ PyObject* py_kdtree_get_height(PyObject* self, PyObject* args)
 {
   return Py_BuildValue("K", (unsigned long long) kdtree_get_height());
 }
+
+PyObject* py_kdtree_init(PyObject* self, PyObject* args)
+{
+  // _kdtree_init(_particles, quota)
+  // Build the kdtree without reordering particles
+  PyObject* py_particles;
+  int quota;
+  if(!PyArg_ParseTuple(args, "Oi", &py_particles, &quota))
+    return NULL;
+
+  Particles* const particles=
+    (Particles*) PyCapsule_GetPointer(py_particles, "_Particles");
+  py_assert_ptr(particles);
+
+  kdtree_init(particles, 0, quota, false);
+
+  Py_RETURN_NONE;
+}
+
+static bool get_query_points(PyObject* py_x, vector<Float>& x)
+{
+  // Copy the (n, 3) array of doubles to x; set the Python error and
+  // return false if py_x is not such an array
+  Py_buffer view;
+  if(PyObject_GetBuffer(py_x, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) == -1)
+    return false;
+
+  if(view.ndim != 2 || view.shape[1] != 3) {
+    PyErr_SetString(PyExc_TypeError, "Expected an array of shape (n, 3)");
+    PyBuffer_Release(&view);
+    return false;
+  }
+  if(strcmp(view.format, "d") != 0) {
+    PyErr_SetString(PyExc_TypeError, "Expected an array of doubles");
+    PyBuffer_Release(&view);
+    return false;
+  }
+
+  const size_t n= 3*view.shape[0];
+  double const * const buf= (double const *) view.buf;
+  x.resize(n);
+  for(size_t i=0; i<n; ++i)
+    x[i]= buf[i];
+
+  PyBuffer_Release(&view);
+
+  return true;
+}
+
+PyObject* py_kdtree_knn(PyObject* self, PyObject* args)
+{
+  // _kdtree_knn(x, k, boxsize)
+  // Returns (idx, r), arrays of shape (n, k): particle indices of the
+  // k nearest neighbours of x and their distances in increasing order
+  PyObject* py_x;
+  int k;
+  double boxsize;
+  if(!PyArg_ParseTuple(args, "Oid", &py_x, &k, &boxsize))
+    return NULL;
+
+  if(!check_tree())
+    return NULL;
+
+  vector<Float> x;
+  if(!get_query_points(py_x, x))
+    return NULL;
+
+  const size_t n= x.size()/3;
+  npy_intp dims[]= {(npy_intp) n, k};
+  PyObject* const py_idx= PyArray_SimpleNew(2, dims, npy_type<Index>());
+  PyObject* const py_r= PyArray_SimpleNew(2, dims, NPY_DOUBLE);
+  py_assert_ptr(py_idx && py_r);
+
+  Index* const idx= (Index*) PyArray_DATA((PyArrayObject*) py_idx);
+  double* const r= (double*) PyArray_DATA((PyArrayObject*) py_r);
+
+  Py_BEGIN_ALLOW_THREADS
+  vector<Float> d2(n*k);
+  kdtree_knn(x.data(), n, k, boxsize, idx, d2.data());
+
+  for(size_t i=0; i<n*k; ++i)
+    r[i]= idx[i] >= 0 ? sqrt(d2[i]) : HUGE_VAL;
+  Py_END_ALLOW_THREADS
+
+  return Py_BuildValue("(NN)", py_idx, py_r);
+}
+
+PyObject* py_kdtree_radius_search(PyObject* self, PyObject* args)
+{
+  // _kdtree_radius_search(x, r, boxsize)
+  // Returns (offsets, idx): particle indices within distance r of x[i]
+  // are idx[offsets[i]:offsets[i + 1]], in the kdtree order
+  PyObject* py_x;
+  double r;
+  double boxsize;
+  if(!PyArg_ParseTuple(args, "Odd", &py_x, &r, &boxsize))
+    return NULL;
+
+  if(!check_tree())
+    return NULL;
+
+  vector<Float> x;
+  if(!get_query_points(py_x, x))
+    return NULL;
+
+  const size_t n= x.size()/3;
+  vector<vector<Index> > found(n);
+
+  Py_BEGIN_ALLOW_THREADS
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) schedule(dynamic, 64)
+#endif
+  for(size_t i=0; i<n; ++i) {
+    vector<Index>& v= found[i];
+    kdtree_radius_search(&x[3*i], r, boxsize,
+			 [&v](KdPoint const& q, const Float d2) {
+			   v.push_back(q.i); });
+  }
+  Py_END_ALLOW_THREADS
+
+  npy_intp nrow= n + 1;
+  PyObject* const py_offsets= PyArray_SimpleNew(1, &nrow, NPY_INT64);
+  py_assert_ptr(py_offsets);
+  int64_t* const offsets= (int64_t*) PyArray_DATA((PyArrayObject*) py_offsets);
+
+  offsets[0]= 0;
+  for(size_t i=0; i<n; ++i)
+    offsets[i + 1]= offsets[i] + found[i].size();
+
+  npy_intp nidx= offsets[n];
+  PyObject* const py_idx= PyArray_SimpleNew(1, &nidx, npy_type<Index>());
+  py_assert_ptr(py_idx);
+  Index* const idx= (Index*) PyArray_DATA((PyArrayObject*) py_idx);
+
+  for(size_t i=0; i<n; ++i) {
+    if(!found[i].empty())
+      memcpy(idx + offsets[i], found[i].data(), sizeof(Index)*found[i].size());
+  }
+
+  return Py_BuildValue("(NN)", py_offsets, py_idx);
+}
@@ -3,8 +3,14 @@
 
 #include "Python.h"
 
+PyMODINIT_FUNC
+py_kdtree_module_init();
+
 PyObject* py_kdtree_create_copy(PyObject* self, PyObject* args);
 PyObject* py_kdtree_get_height(PyObject* self, PyObject* args);
+PyObject* py_kdtree_init(PyObject* self, PyObject* args);
+PyObject* py_kdtree_knn(PyObject* self, PyObject* args);
+PyObject* py_kdtree_radius_search(PyObject* self, PyObject* args);
 
 #endif
 
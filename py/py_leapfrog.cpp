@@ -1,5 +1,7 @@
 #include "leapfrog.h"
 #include "py_assert.h"
+#include "py_step_schedule.h"
+#include "py_lightcone.h"
 #include "py_leapfrog.h"
 
 PyObject* py_leapfrog_initial_velocity(PyObject* self, PyObject* args)
@@ -22,12 +24,12 @@ PyObject* py_leapfrog_initial_velocity(PyObject* self, PyObject* args)
 
 PyObject* py_leapfrog_kick(PyObject* self, PyObject* args)
 {
-  // _leapfrog_kick(_particles, a_vel)
+  // _leapfrog_kick(_particles, a_vel, _schedule=None)
 
-  PyObject *py_particles;
+  PyObject *py_particles, *py_schedule= Py_None;
   double a_vel;
   
-  if(!PyArg_ParseTuple(args, "Od", &py_particles, &a_vel)) {
+  if(!PyArg_ParseTuple(args, "Od|O", &py_particles, &a_vel, &py_schedule)) {
     return NULL;
   }
 
@@ -35,19 +37,24 @@ PyObject* py_leapfrog_kick(PyObject* self, PyObject* args)
     (Particles *) PyCapsule_GetPointer(py_particles, "_Particles");
   py_assert_ptr(particles);
 
-  leapfrog_kick(particles, a_vel);
+  StepSchedule const * const schedule= py_step_schedule_get(py_schedule);
+  if(py_schedule != Py_None)
+    py_assert_ptr(schedule);
+
+  leapfrog_kick(particles, a_vel, schedule);
 
   Py_RETURN_NONE;
 }
 
 PyObject* py_leapfrog_drift(PyObject* self, PyObject* args)
 {
-  // _leapfrog_drift(_particles, a_pos)
+  // _leapfrog_drift(_particles, a_pos, _schedule=None, _lightcone=None)
 
-  PyObject *py_particles;
+  PyObject *py_particles, *py_schedule= Py_None, *py_lightcone= Py_None;
   double a_pos;
   
-  if(!PyArg_ParseTuple(args, "Od", &py_particles, &a_pos)) {
+  if(!PyArg_ParseTuple(args, "Od|OO", &py_particles, &a_pos, &py_schedule,
+		       &py_lightcone)) {
     return NULL;
   }
 
@@ -55,7 +62,15 @@ PyObject* py_leapfrog_drift(PyObject* self, PyObject* args)
     (Particles *) PyCapsule_GetPointer(py_particles, "_Particles");
   py_assert_ptr(particles);
 
-  leapfrog_drift(particles, a_pos);
+  StepSchedule const * const schedule= py_step_schedule_get(py_schedule);
+  if(py_schedule != Py_None)
+    py_assert_ptr(schedule);
+
+  Lightcone* const lightcone= py_lightcone_get(py_lightcone);
+  if(py_lightcone != Py_None)
+    py_assert_ptr(lightcone);
+
+  leapfrog_drift(particles, a_pos, schedule, lightcone);
 
   Py_RETURN_NONE;
 }
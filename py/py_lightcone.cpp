@@ -0,0 +1,83 @@
+//
+// wrapping lightcone.cpp
+//
+#include "error.h"
+#include "hdf5_io.h"
+#include "py_lightcone.h"
+#include "py_assert.h"
+
+static void py_lightcone_free(PyObject *obj);
+
+PyObject* py_lightcone_alloc(PyObject* self, PyObject* args)
+{
+  // _lightcone_alloc(filename, boxsize, observer, a_min)
+  //   observer: (x, y, z)
+  char const* filename;
+  double boxsize, a_min;
+  double observer[3];
+
+  if(!PyArg_ParseTuple(args, "sd(ddd)d", &filename, &boxsize,
+		       observer, observer + 1, observer + 2, &a_min)) {
+    return NULL;
+  }
+
+  Lightcone* lightcone;
+
+  try {
+    LightconeWriter* const writer=
+      hdf5_lightcone_writer(filename, boxsize, observer);
+    lightcone= new Lightcone(writer, boxsize, observer, a_min);
+  }
+  catch(IOError) {
+    PyErr_SetString(PyExc_IOError, "unable to create lightcone file");
+    return NULL;
+  }
+
+  return PyCapsule_New(lightcone, "_Lightcone", py_lightcone_free);
+}
+
+void py_lightcone_free(PyObject *obj)
+{
+  Lightcone* const lightcone=
+    (Lightcone*) PyCapsule_GetPointer(obj, "_Lightcone");
+  py_assert_void(lightcone);
+
+  delete lightcone;
+}
+
+PyObject* py_lightcone_close(PyObject* self, PyObject* args)
+{
+  // _lightcone_close(_lightcone); close the file, collective
+  PyObject* py_lightcone;
+  if(!PyArg_ParseTuple(args, "O", &py_lightcone))
+    return NULL;
+
+  Lightcone* const lightcone= py_lightcone_get(py_lightcone);
+  py_assert_ptr(lightcone);
+
+  lightcone->close();
+
+  Py_RETURN_NONE;
+}
+
+PyObject* py_lightcone_np_total(PyObject* self, PyObject* args)
+{
+  // _lightcone_np_total(_lightcone); number of particles written
+  PyObject* py_lightcone;
+  if(!PyArg_ParseTuple(args, "O", &py_lightcone))
+    return NULL;
+
+  Lightcone* const lightcone= py_lightcone_get(py_lightcone);
+  py_assert_ptr(lightcone);
+
+  return Py_BuildValue("K", (unsigned long long) lightcone->np_total());
+}
+
+Lightcone* py_lightcone_get(PyObject* py_lightcone)
+{
+  // Returns 0 for None
+  if(py_lightcone == Py_None)
+    return 0;
+
+  return (Lightcone*) PyCapsule_GetPointer(py_lightcone, "_Lightcone");
+}
@@ -0,0 +1,13 @@
+#ifndef PY_LIGHTCONE_H
+#define PY_LIGHTCONE_H 1
+
+#include "Python.h"
+#include "lightcone.h"
+
+PyObject* py_lightcone_alloc(PyObject* self, PyObject* args);
+PyObject* py_lightcone_close(PyObject* self, PyObject* args);
+PyObject* py_lightcone_np_total(PyObject* self, PyObject* args);
+
+Lightcone* py_lightcone_get(PyObject* py_lightcone);
+
+#endif
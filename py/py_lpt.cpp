@@ -1,14 +1,23 @@
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <vector>
 #include "cosmology.h"
 #include "particle.h"
 #include "fft.h"
 #include "lpt.h"
+#include "error.h"
+#include "hdf5_io.h"
+#include "gadget_file.h"
 #include "py_assert.h"
 #include "py_particles.h"
 #include "py_lpt.h"
 
+using namespace std;
+
 PyObject* py_lpt(PyObject* self, PyObject* args)
 {
-  //_lpt(nc, boxsize, a, _ps, seed
+  //_lpt(nc, boxsize, a, _ps, seed, kind, fix_amplitude, invert_phase)
 
   PyObject* py_ps;
   int nc;
@@ -16,7 +25,10 @@ PyObject* py_lpt(PyObject* self, PyObject* args)
   unsigned long seed;
   char const* kind;
 
-  if(!PyArg_ParseTuple(args, "iddkOs", &nc, &boxsize, &a,  &seed, &py_ps, &kind)) {
+  int fix_amplitude= 0, invert_phase= 0;
+
+  if(!PyArg_ParseTuple(args, "iddkOs|pp", &nc, &boxsize, &a,  &seed, &py_ps,
+		       &kind, &fix_amplitude, &invert_phase)) {
     return NULL;
   }
 
@@ -29,16 +41,190 @@ PyObject* py_lpt(PyObject* self, PyObject* args)
 
   Particles* particles= new Particles(np_alloc, boxsize);
     
-  size_t mem_size= 9*fft_mem_size(nc, 0);
-  Mem* const mem= new Mem("LPT", mem_size);
+  const string skind(kind);
+  const bool third_order= skind == "3lpt" || skind == "cola3lpt";
+  
+  // LPT memory and FFT plans are freed after a single realization;
+  // use _lpt_batch to reuse them
+  lpt_init(nc, boxsize, 0, third_order);
+  lpt_set_displacements(seed, ps, a, kind, particles,
+			fix_amplitude, invert_phase);
+  lpt_free();
 
-  lpt_init(nc, boxsize, mem);
-  lpt_set_displacements(seed, ps, a, kind, particles);
+  return PyCapsule_New(particles, "_Particles", py_particles_free);  
+}
 
+namespace {
+  struct BatchCallback {
+    PyObject* f;
+    bool error;
+  };
 
-  delete mem;
-  
-  return PyCapsule_New(particles, "_Particles", py_particles_free);  
+  Particles* copy_particles(Particles const * const src)
+  {
+    // New Particles with the same particles, force, and scale factors
+    Particles* const particles= new Particles(src->np_allocated, src->boxsize);
+    copy(src->p, src->p + src->np_local, particles->p);
+    memcpy(particles->force, src->force, sizeof(Float3)*src->np_local);
+
+    particles->np_local= src->np_local;
+    particles->np_total= src->np_total;
+    particles->a_x= src->a_x;
+    particles->a_v= src->a_v;
+    particles->a_f= src->a_f;
+
+    return particles;
+  }
+
+  bool call_batch_callback(const int i, const unsigned long seed,
+			   Particles* const particles, void* data)
+  {
+    // Call Python f(i, seed, _particles); the capsule does not own particles,
+    // which are overwritten by the next realization and deleted at the end.
+    // If f keeps a reference, the capsule is given its own copy
+    BatchCallback* const cb= (BatchCallback*) data;
+    
+    PyObject* py_particles= PyCapsule_New(particles, "_Particles", NULL);
+    if(py_particles == NULL) {
+      cb->error= true;
+      return false;
+    }
+
+    PyObject* ret= PyObject_CallFunction(cb->f, "ikO", i, seed, py_particles);
+
+    if(Py_REFCNT(py_particles) > 1) {
+      PyCapsule_SetPointer(py_particles, copy_particles(particles));
+      PyCapsule_SetDestructor(py_particles, py_particles_free);
+    }
+    Py_DECREF(py_particles);
+
+    if(ret == NULL) {
+      cb->error= true;
+      return false;
+    }
+    
+    Py_DECREF(ret);
+    return true;
+  }
+}
+
+PyObject* py_lpt_batch(PyObject* self, PyObject* args)
+{
+  // _lpt_batch(nc, boxsize, a, seeds, _ps, kind, f)
+  // Call f(i, seed, _particles) for each seed in the sequence seeds
+  PyObject *py_ps, *py_seeds, *py_f;
+  int nc;
+  double a, boxsize;
+  char const* kind;
+
+  if(!PyArg_ParseTuple(args, "iddOOsO", &nc, &boxsize, &a, &py_seeds, &py_ps,
+		       &kind, &py_f)) {
+    return NULL;
+  }
+
+  PowerSpectrum* const ps=
+    (PowerSpectrum *) PyCapsule_GetPointer(py_ps, "_PowerSpectrum");
+  py_assert_ptr(ps);
+
+  PyObject* seq= PySequence_Fast(py_seeds, "seeds must be a sequence");
+  if(seq == NULL)
+    return NULL;
+
+  const int n= PySequence_Fast_GET_SIZE(seq);
+  vector<unsigned long> seeds(n);
+  for(int i=0; i<n; i++)
+    seeds[i]= PyLong_AsUnsignedLong(PySequence_Fast_GET_ITEM(seq, i));
+  Py_DECREF(seq);
+
+  if(PyErr_Occurred())
+    return NULL;
+
+  const string skind(kind);
+  const bool third_order= skind == "3lpt" || skind == "cola3lpt";
+
+  size_t nx= fft_local_nx(nc);
+  size_t np_alloc= (size_t)((1.25*(nx + 1)*nc*nc));
+  Particles* particles= new Particles(np_alloc, boxsize);
+
+  lpt_init(nc, boxsize, 0, third_order);
+
+  BatchCallback cb= {py_f, false};
+  lpt_set_displacements_batch(n, seeds.empty() ? 0 : &seeds.front(), ps,
+			      a, kind, particles, call_batch_callback, &cb);
+
+  delete particles;
+  lpt_free();
+
+  if(cb.error)
+    return NULL;
+
+  Py_RETURN_NONE;
+}
+
+PyObject* py_lpt_write(PyObject* self, PyObject* args)
+{
+  // _lpt_write(nc, boxsize, a, seed, _ps, kind, filename, format, var,
+  //            use_long_id)
+  // Write LPT particles to file without creating Particles
+  //   format: "hdf5" or "gadget"
+  //   var: subset of "ixv12" for hdf5
+  PyObject *py_ps, *bytes;
+  int nc, use_long_id;
+  double a, boxsize;
+  unsigned long seed;
+  char const *kind, *format, *var;
+
+  if(!PyArg_ParseTuple(args, "iddkOsO&ssi", &nc, &boxsize, &a, &seed, &py_ps,
+		       &kind, PyUnicode_FSConverter, &bytes, &format, &var,
+		       &use_long_id)) {
+    return NULL;
+  }
+
+  PowerSpectrum* const ps=
+    (PowerSpectrum *) PyCapsule_GetPointer(py_ps, "_PowerSpectrum");
+  py_assert_ptr(ps);
+
+  char* filename;
+  Py_ssize_t len;
+  PyBytes_AsStringAndSize(bytes, &filename, &len);
+
+  const string sformat(format);
+  LPTPlaneWriter* writer= 0;
+
+  try {
+    if(sformat == "hdf5")
+      writer= hdf5_lpt_writer(filename, var);
+    else if(sformat == "gadget")
+      writer= gadget_file_lpt_writer(filename, use_long_id);
+    else {
+      Py_DECREF(bytes);
+      PyErr_SetString(PyExc_ValueError, "format must be hdf5 or gadget");
+      return NULL;
+    }
+
+    lpt_init(nc, boxsize, 0);
+    lpt_write_displacements(seed, ps, a, kind, writer);
+  }
+  catch(const IOError e) {
+    delete writer;
+    lpt_free();
+    Py_DECREF(bytes);
+    PyErr_SetNone(PyExc_IOError);
+    return NULL;
+  }
+  catch(const ValError e) {
+    delete writer;
+    lpt_free();
+    Py_DECREF(bytes);
+    PyErr_SetNone(PyExc_ValueError);
+    return NULL;
+  }
+
+  delete writer;
+  lpt_free();
+  Py_DECREF(bytes);
+
+  Py_RETURN_NONE;
 }
 
 PyObject* py_lpt_set_offset(PyObject* self, PyObject* args)
@@ -2,6 +2,8 @@
 #define PY_LPT_H !
 
 PyObject* py_lpt(PyObject* self, PyObject* args);
+PyObject* py_lpt_batch(PyObject* self, PyObject* args);
+PyObject* py_lpt_write(PyObject* self, PyObject* args);
 PyObject* py_lpt_set_offset(PyObject* self, PyObject* args);
 
 PyObject* py_lpt_set_zeldovich_force(PyObject* self, PyObject* args);
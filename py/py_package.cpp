@@ -14,6 +14,9 @@
 #include "py_pm.h"
 #include "py_cola.h"
 #include "py_leapfrog.h"
+#include "py_step_schedule.h"
+#include "py_simulation.h"
+#include "py_lightcone.h"
 #include "py_write.h"
 #include "py_hdf5_io.h"
 #include "py_fft.h"
@@ -51,6 +54,10 @@ static PyMethodDef methods[] = {
    "_cosmology_D_growth(a)"},
   {"_cosmology_D2_growth", py_cosmology_D2_growth, METH_VARARGS,
    "_cosmology_D2_growth(a)"},
+  {"_cosmology_f_growth_rate", py_cosmology_f_growth_rate, METH_VARARGS,
+   "_cosmology_f_growth_rate(a)"},
+  {"_cosmology_time_integral", py_cosmology_time_integral, METH_VARARGS,
+   "_cosmology_time_integral(ai, af, n)"},
 
   {"_power_alloc", py_power_alloc, METH_VARARGS,
    "allocate a new _ps opbject"},
@@ -87,14 +94,22 @@ static PyMethodDef methods[] = {
    "_particles_append(_particles, x)"},
   
   {"_lpt", py_lpt, METH_VARARGS,
-   "_lpt(nc, boxsize, a, _ps, rando_seed); setup 2LPT displacements"},
+   "_lpt(nc, boxsize, a, seed, _ps, kind, fix_amplitude, invert_phase); "
+   "setup 2LPT displacements"},
+  {"_lpt_batch", py_lpt_batch, METH_VARARGS,
+   "_lpt_batch(nc, boxsize, a, seeds, _ps, kind, f); "
+   "call f(i, seed, _particles) for each seed"},
+  {"_lpt_write", py_lpt_write, METH_VARARGS,
+   "_lpt_write(nc, boxsize, a, seed, _ps, kind, filename, format, var, "
+   "use_long_id); write LPT particles to file"},
   {"_lpt_set_offset", py_lpt_set_offset, METH_VARARGS,
    "_lpt_set_offset(offset)"},
   {"_lpt_set_zeldovich_force", py_lpt_set_zeldovich_force, METH_VARARGS,
    "_lpt_set_zeldovich_force(_particles, a)"},
 
   {"_pm_init", py_pm_init, METH_VARARGS,
-   "_pm_init(nc_pm, pm_factor, boxsize); initialise pm module"},
+   "_pm_init(nc_pm, pm_factor, boxsize, double_precision); "
+   "initialise pm module"},
   {"_pm_compute_force", py_pm_compute_force, METH_VARARGS,
    "_pm_compute_force(_particles)"},   
   {"_pm_compute_density", py_pm_compute_density, METH_VARARGS,
@@ -115,16 +130,49 @@ static PyMethodDef methods[] = {
    "_pm_set_packet_size(packet_size)"},
   
   {"_cola_kick", py_cola_kick, METH_VARARGS,
-   "_cola_kick(_particles, a_vel); update particle velocities to a_vel"},
+   "_cola_kick(_particles, a_vel, _schedule); "
+   "update particle velocities to a_vel"},
   {"_cola_drift", py_cola_drift, METH_VARARGS,
-   "_cola_drift(_particles, a_pos); update particle positions to a_pos"},
+   "_cola_drift(_particles, a_pos, _schedule, _lightcone); "
+   "update particle positions to a_pos"},
+  {"_cola_step", py_cola_step, METH_VARARGS,
+   "_cola_step(_particles, a_vel, a_pos, _schedule, _lightcone); "
+   "kick to a_vel, drift to a_pos, and periodic wrapup"},
 
   {"_leapfrog_initial_velocity", py_leapfrog_initial_velocity, METH_VARARGS,
    "_leapfrog_initial_velocity(_particles, a_pos"},
   {"_leapfrog_kick", py_leapfrog_kick, METH_VARARGS,
-   "_leapfrog_kick(_particles, a_vel); update particle velocities to a_vel"},
+   "_leapfrog_kick(_particles, a_vel, _schedule); "
+   "update particle velocities to a_vel"},
   {"_leapfrog_drift", py_leapfrog_drift, METH_VARARGS,
-   "_leapfrog_drift(_particles, a_pos); update particle positions to a_pos"},
+   "_leapfrog_drift(_particles, a_pos, _schedule, _lightcone); "
+   "update particle positions to a_pos"},
+
+  {"_step_schedule_alloc", py_step_schedule_alloc, METH_VARARGS,
+   "_step_schedule_alloc(a_x0, a_v0, a_vel, a_pos); "
+   "precompute kick and drift factors"},
+  {"_step_schedule_n", py_step_schedule_n, METH_VARARGS,
+   "_step_schedule_n(_schedule); number of steps"},
+
+  {"_simulation_alloc", py_simulation_alloc, METH_VARARGS,
+   "_simulation_alloc(a_init, a_final, nstep, spacing, a_mid, integrator)"},
+  {"_simulation_add_output", py_simulation_add_output, METH_VARARGS,
+   "_simulation_add_output(_simulation, a); output at a"},
+  {"_simulation_add_snapshot", py_simulation_add_snapshot, METH_VARARGS,
+   "_simulation_add_snapshot(_simulation, a, filename); "
+   "write particles at a by interpolation"},
+  {"_simulation_a", py_simulation_a, METH_VARARGS,
+   "_simulation_a(_simulation); return (a_x, a_vel)"},
+  {"_simulation_run", py_simulation_run, METH_VARARGS,
+   "_simulation_run(_simulation, _particles, f, _lightcone); "
+   "run all steps, calling f(a, _particles) at outputs"},
+
+  {"_lightcone_alloc", py_lightcone_alloc, METH_VARARGS,
+   "_lightcone_alloc(filename, boxsize, observer, a_min)"},
+  {"_lightcone_close", py_lightcone_close, METH_VARARGS,
+   "_lightcone_close(_lightcone); close the lightcone file"},
+  {"_lightcone_np_total", py_lightcone_np_total, METH_VARARGS,
+   "_lightcone_np_total(_lightcone); number of particles written"},
 
   {"_write_gadget_binary", py_write_gadget_binary, METH_VARARGS,
    "_write_gadget_binary(_particles, filename, use_long_id"},   
@@ -133,7 +181,7 @@ static PyMethodDef methods[] = {
    "_hdf5_write_particles(_particles, filename)"},
 
   {"_fft_alloc", py_fft_alloc, METH_VARARGS,
-   "_fft_alloc(nc)"},
+   "_fft_alloc(nc, double_precision)"},
   {"_fft_set_test_data", py_fft_set_test_data, METH_VARARGS,
    "_fft_set_test_data(_fft)"},
   {"_fft_fx_global_as_array", py_fft_fx_global_as_array, METH_VARARGS,
@@ -143,9 +191,18 @@ static PyMethodDef methods[] = {
    "get 'single' or 'double'"},
 
   {"_fof_find_groups", py_fof_find_groups, METH_VARARGS,
-   "_fof_find_groups(_particles, linking_length, quota"},
+   "_fof_find_groups(_particles, linking_length, boxsize3, quota, "
+   "return_nfof, permute, method, update_tree)"},
   {"_fof_grp", py_fof_grp, METH_VARARGS,
    "_fof_grp()"},
+  {"_fof_find_groups_mpi", py_fof_find_groups_mpi, METH_VARARGS,
+   "_fof_find_groups_mpi(_particles, linking_length, quota); "
+   "return (group_id, halo_id, halo_nfof) on node 0"},
+  {"_fof_members", py_fof_members, METH_VARARGS,
+   "_fof_members(nfof_min); return (offsets, members, roots)"},
+  {"_fof_write_halos", py_fof_write_halos, METH_VARARGS,
+   "_fof_write_halos(_particles, filename, nfof_min, cola); "
+   "return the number of halos in this node"},
 
   {"_kdtree_create_copy", py_kdtree_create_copy, METH_VARARGS,
    "_kdtree_create_copy()"},
@@ -153,6 +210,15 @@ static PyMethodDef methods[] = {
   {"_kdtree_get_height", py_kdtree_get_height, METH_VARARGS,
    "_kdtree_get_height()"},
 
+  {"_kdtree_init", py_kdtree_init, METH_VARARGS,
+   "_kdtree_init(_particles, quota)"},
+
+  {"_kdtree_knn", py_kdtree_knn, METH_VARARGS,
+   "_kdtree_knn(x, k, boxsize); return (idx, r)"},
+
+  {"_kdtree_radius_search", py_kdtree_radius_search, METH_VARARGS,
+   "_kdtree_radius_search(x, r, boxsize); return (offsets, idx)"},
+
   {NULL, NULL, 0, NULL}
 };
 
@@ -170,6 +236,8 @@ PyInit__fs(void) {
   py_particles_module_init();
   py_fft_module_init();
   py_array_module_init();
+  py_fof_module_init();
+  py_kdtree_module_init();
   
   return PyModule_Create(&module);
 }
@@ -9,21 +9,27 @@ static bool pm_initialised= false;
 
 PyObject* py_pm_init(PyObject* self, PyObject* args)
 {
-  // pm_init(nc_pm, pm_factor, boxsize)
+  // pm_init(nc_pm, pm_factor, boxsize, double_precision)
+  //   double_precision: precision of the mesh and FFT
   
 
-  int nc_pm;
+  int nc_pm, double_precision;
   double pm_factor, boxsize;
   
-  if(!PyArg_ParseTuple(args, "idd", &nc_pm, &pm_factor, &boxsize)) {
+  if(!PyArg_ParseTuple(args, "iddp", &nc_pm, &pm_factor, &boxsize,
+		       &double_precision)) {
     return NULL;
   }
 
-  size_t mem_size= fft_mem_size(nc_pm, 1);
+  size_t mem_size= double_precision ? fft_mem_size<double>(nc_pm, 1) :
+                                      fft_mem_size<float>(nc_pm, 1);
   Mem* const mem1= new Mem("ParticleMesh", mem_size);
   Mem* const mem2= new Mem("delta_k", mem_size);
 
-  pm_init(nc_pm, pm_factor, mem1, mem2, boxsize);
+  if(double_precision)
+    pm_init<double>(nc_pm, pm_factor, mem1, mem2, boxsize);
+  else
+    pm_init<float>(nc_pm, pm_factor, mem1, mem2, boxsize);
 
   pm_initialised= true;
 
@@ -50,9 +56,15 @@ PyObject* py_pm_compute_density(PyObject* self, PyObject* args)
     (Particles *) PyCapsule_GetPointer(py_particles, "_Particles");
   py_assert_ptr(particles);
   
-  FFT* const fft= pm_compute_density(particles);
+  pm_compute_density(particles);
 
-  return PyCapsule_New(fft, "_FFT", NULL);
+  // "_FFT" if the mesh is Float, "_FFTf" or "_FFTd" otherwise
+  if(pm_get_fft<double>())
+    return PyCapsule_New(pm_get_fft<double>(),
+			 py_fft_capsule_name<double>(), NULL);
+
+  return PyCapsule_New(pm_get_fft<float>(),
+		       py_fft_capsule_name<float>(), NULL);
 }
 
 
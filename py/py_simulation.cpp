@@ -0,0 +1,247 @@
+//
+// wrapping simulation.cpp
+//
+#include <string>
+#include "msg.h"
+#include "error.h"
+#include "simulation.h"
+#include "hdf5_io.h"
+#include "py_simulation.h"
+#include "py_assert.h"
+#include "py_lightcone.h"
+
+using namespace std;
+
+static void py_simulation_free(PyObject *obj);
+
+namespace {
+  struct OutputCallback {
+    PyObject* f;
+    bool error;
+  };
+
+  bool call_output_callback(const double a, Particles* const particles,
+			    void* data)
+  {
+    // Call Python f(a, _particles) with the GIL, which is released in run
+    OutputCallback* const cb= (OutputCallback*) data;
+    PyGILState_STATE gstate= PyGILState_Ensure();
+
+    PyObject* py_particles= PyCapsule_New(particles, "_Particles", NULL);
+    PyObject* ret= PyObject_CallFunction(cb->f, "dO", a, py_particles);
+    Py_DECREF(py_particles);
+
+    if(ret == NULL)
+      cb->error= true;
+    else
+      Py_DECREF(ret);
+
+    PyGILState_Release(gstate);
+
+    return !cb->error;
+  }
+
+  Simulation* get_simulation(PyObject* py_simulation)
+  {
+    return (Simulation*) PyCapsule_GetPointer(py_simulation, "_Simulation");
+  }
+}
+
+PyObject* py_simulation_alloc(PyObject* self, PyObject* args)
+{
+  // _simulation_alloc(a_init, a_final, nstep, spacing, a_mid, integrator)
+  //   spacing: "linear", "log", or "mixed"
+  //   integrator: "cola" or "leapfrog"
+  double a_init, a_final, a_mid;
+  int nstep;
+  char const *spacing_name, *integrator_name;
+
+  if(!PyArg_ParseTuple(args, "ddisds", &a_init, &a_final, &nstep,
+		       &spacing_name, &a_mid, &integrator_name)) {
+    return NULL;
+  }
+
+  const string sspacing(spacing_name);
+  StepSpacing spacing;
+  if(sspacing == "linear")
+    spacing= StepSpacing::linear;
+  else if(sspacing == "log")
+    spacing= StepSpacing::log;
+  else if(sspacing == "mixed")
+    spacing= StepSpacing::mixed;
+  else {
+    PyErr_SetString(PyExc_ValueError,
+		    "spacing must be 'linear', 'log', or 'mixed'");
+    return NULL;
+  }
+
+  const string sintegrator(integrator_name);
+  Integrator integrator;
+  if(sintegrator == "cola")
+    integrator= Integrator::cola;
+  else if(sintegrator == "leapfrog")
+    integrator= Integrator::leapfrog;
+  else {
+    PyErr_SetString(PyExc_ValueError,
+		    "integrator must be 'cola' or 'leapfrog'");
+    return NULL;
+  }
+
+  Simulation* simulation;
+
+  try {
+    simulation= new Simulation(a_init, a_final, nstep, spacing, a_mid,
+			       integrator);
+  }
+  catch(ValError) {
+    PyErr_SetString(PyExc_ValueError, "invalid time steps");
+    return NULL;
+  }
+
+  return PyCapsule_New(simulation, "_Simulation", py_simulation_free);
+}
+
+void py_simulation_free(PyObject *obj)
+{
+  Simulation* const simulation= get_simulation(obj);
+  py_assert_void(simulation);
+
+  delete simulation;
+}
+
+PyObject* py_simulation_add_output(PyObject* self, PyObject* args)
+{
+  // _simulation_add_output(_simulation, a)
+  PyObject* py_simulation;
+  double a;
+
+  if(!PyArg_ParseTuple(args, "Od", &py_simulation, &a))
+    return NULL;
+
+  Simulation* const simulation= get_simulation(py_simulation);
+  py_assert_ptr(simulation);
+
+  try {
+    simulation->add_output(a);
+  }
+  catch(ValError) {
+    PyErr_SetString(PyExc_ValueError, "output a outside the simulation");
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+PyObject* py_simulation_add_snapshot(PyObject* self, PyObject* args)
+{
+  // _simulation_add_snapshot(_simulation, a, filename)
+  // Write id, x, v at a to an HDF5 file by interpolation within the step
+  PyObject* py_simulation;
+  double a;
+  char const* filename;
+
+  if(!PyArg_ParseTuple(args, "Ods", &py_simulation, &a, &filename))
+    return NULL;
+
+  Simulation* const simulation= get_simulation(py_simulation);
+  py_assert_ptr(simulation);
+
+  try {
+    simulation->add_snapshot(a, hdf5_lpt_writer(filename, "ixv"));
+  }
+  catch(ValError) {
+    PyErr_SetString(PyExc_ValueError, "snapshot a outside the simulation");
+    return NULL;
+  }
+
+  Py_RETURN_NONE;
+}
+
+PyObject* py_simulation_a(PyObject* self, PyObject* args)
+{
+  // _simulation_a(_simulation); return lists (a_x, a_vel)
+  PyObject* py_simulation;
+
+  if(!PyArg_ParseTuple(args, "O", &py_simulation))
+    return NULL;
+
+  Simulation* const simulation= get_simulation(py_simulation);
+  py_assert_ptr(simulation);
+
+  const size_t n= simulation->a_x.size();
+  PyObject* const py_a_x= PyList_New(n);
+  PyObject* const py_a_vel= PyList_New(n - 1);
+  for(size_t i=0; i<n; ++i)
+    PyList_SET_ITEM(py_a_x, i, PyFloat_FromDouble(simulation->a_x[i]));
+  for(size_t i=0; i<n - 1; ++i)
+    PyList_SET_ITEM(py_a_vel, i, PyFloat_FromDouble(simulation->a_vel[i]));
+
+  return Py_BuildValue("NN", py_a_x, py_a_vel);
+}
+
+PyObject* py_simulation_run(PyObject* self, PyObject* args)
+{
+  // _simulation_run(_simulation, _particles, f=None, _lightcone=None)
+  // Call f(a, _particles) at each output; the GIL is released otherwise
+  PyObject *py_simulation, *py_particles, *py_f= Py_None;
+  PyObject *py_lightcone= Py_None;
+
+  if(!PyArg_ParseTuple(args, "OO|OO", &py_simulation, &py_particles, &py_f,
+		       &py_lightcone))
+    return NULL;
+
+  Simulation* const simulation= get_simulation(py_simulation);
+  py_assert_ptr(simulation);
+
+  Particles* const particles=
+    (Particles *) PyCapsule_GetPointer(py_particles, "_Particles");
+  py_assert_ptr(particles);
+
+  Lightcone* const lightcone= py_lightcone_get(py_lightcone);
+  if(py_lightcone != Py_None)
+    py_assert_ptr(lightcone);
+
+  OutputCallback cb= {py_f, false};
+  SimulationOutputFunc f= py_f == Py_None ? 0 : call_output_callback;
+
+  // error.h classes are not related by public inheritance;
+  // each is caught and converted after the GIL is reacquired
+  PyObject* error_type= 0;
+  char const * error_msg= 0;
+  msg_clear_error();
+
+  Py_BEGIN_ALLOW_THREADS
+  try {
+    simulation->run(particles, f, &cb, lightcone);
+  }
+  catch(ValError) {
+    error_type= PyExc_ValueError;
+    error_msg= "invalid simulation parameters";
+  }
+  catch(IOError) {
+    error_type= PyExc_IOError;
+    error_msg= "unable to write snapshot";
+  }
+  catch(MemoryError) {
+    error_type= PyExc_MemoryError;
+    error_msg= "unable to allocate memory";
+  }
+  catch(AssertionError) {
+    error_type= PyExc_AssertionError;
+    error_msg= "simulation check failed";
+  }
+  catch(RuntimeError) {
+    error_type= PyExc_RuntimeError;
+    error_msg= "simulation failed";
+  }
+  Py_END_ALLOW_THREADS
+
+  if(error_type) {
+    py_set_error(error_type, error_msg);
+    return NULL;
+  }
+  else if(cb.error)
+    return NULL;
+
+  Py_RETURN_NONE;
+}
@@ -0,0 +1,12 @@
+#ifndef PY_SIMULATION_H
+#define PY_SIMULATION_H 1
+
+#include "Python.h"
+
+PyObject* py_simulation_alloc(PyObject* self, PyObject* args);
+PyObject* py_simulation_add_output(PyObject* self, PyObject* args);
+PyObject* py_simulation_add_snapshot(PyObject* self, PyObject* args);
+PyObject* py_simulation_a(PyObject* self, PyObject* args);
+PyObject* py_simulation_run(PyObject* self, PyObject* args);
+
+#endif
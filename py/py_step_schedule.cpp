@@ -0,0 +1,86 @@
+//
+// wrapping step_schedule.cpp
+//
+#include <vector>
+#include "error.h"
+#include "py_step_schedule.h"
+#include "py_assert.h"
+
+using namespace std;
+
+static void py_step_schedule_free(PyObject *obj);
+
+static bool sequence_as_vector(PyObject* py_seq, vector<double>& v)
+{
+  PyObject* seq= PySequence_Fast(py_seq, "a sequence of float expected");
+  if(seq == NULL)
+    return false;
+
+  const Py_ssize_t n= PySequence_Fast_GET_SIZE(seq);
+  v.resize(n);
+  for(Py_ssize_t i=0; i<n; i++)
+    v[i]= PyFloat_AsDouble(PySequence_Fast_GET_ITEM(seq, i));
+  Py_DECREF(seq);
+
+  return PyErr_Occurred() == NULL;
+}
+
+PyObject* py_step_schedule_alloc(PyObject* self, PyObject* args)
+{
+  // _step_schedule_alloc(a_x0, a_v0, a_vel, a_pos)
+  double a_x0, a_v0;
+  PyObject *py_a_vel, *py_a_pos;
+
+  if(!PyArg_ParseTuple(args, "ddOO", &a_x0, &a_v0, &py_a_vel, &py_a_pos)) {
+    return NULL;
+  }
+
+  vector<double> a_vel, a_pos;
+  if(!sequence_as_vector(py_a_vel, a_vel) ||
+     !sequence_as_vector(py_a_pos, a_pos))
+    return NULL;
+
+  StepSchedule* schedule;
+
+  try {
+    schedule= new StepSchedule(a_x0, a_v0, a_vel, a_pos);
+  }
+  catch(ValError) {
+    PyErr_SetString(PyExc_ValueError,
+		    "a_vel and a_pos must have the same length");
+    return NULL;
+  }
+
+  return PyCapsule_New(schedule, "_StepSchedule", py_step_schedule_free);
+}
+
+void py_step_schedule_free(PyObject *obj)
+{
+  StepSchedule* const schedule=
+    (StepSchedule*) PyCapsule_GetPointer(obj, "_StepSchedule");
+  py_assert_void(schedule);
+
+  delete schedule;
+}
+
+PyObject* py_step_schedule_n(PyObject* self, PyObject* args)
+{
+  // _step_schedule_n(_schedule); number of steps
+  PyObject* py_schedule;
+  if(!PyArg_ParseTuple(args, "O", &py_schedule))
+    return NULL;
+
+  StepSchedule* const schedule= py_step_schedule_get(py_schedule);
+  py_assert_ptr(schedule);
+
+  return Py_BuildValue("n", (Py_ssize_t) schedule->kicks.size());
+}
+
+StepSchedule* py_step_schedule_get(PyObject* py_schedule)
+{
+  // Returns 0 for None
+  if(py_schedule == Py_None)
+    return 0;
+
+  return (StepSchedule*) PyCapsule_GetPointer(py_schedule, "_StepSchedule");
+}
@@ -0,0 +1,12 @@
+#ifndef PY_STEP_SCHEDULE_H
+#define PY_STEP_SCHEDULE_H 1
+
+#include "Python.h"
+#include "step_schedule.h"
+
+PyObject* py_step_schedule_alloc(PyObject* self, PyObject* args);
+PyObject* py_step_schedule_n(PyObject* self, PyObject* args);
+
+StepSchedule* py_step_schedule_get(PyObject* py_schedule);
+
+#endif
@@ -45,10 +45,11 @@ lib_files = ['comm.cpp', 'msg.cpp', 'config.cpp',
              'fft.cpp', 'mem.cpp', 'particle.cpp',
              'util.cpp', 'power.cpp',
              'cosmology.cpp', 'lpt.cpp', 'pm.cpp',
-             'cola.cpp', 'leapfrog.cpp',
+             'cola.cpp', 'leapfrog.cpp', 'step_schedule.cpp',
+             'simulation.cpp', 'lightcone.cpp',
              'pm_domain.cpp',
              'gadget_file.cpp', 'hdf5_write.cpp',
-             'kdtree.cpp', 'fof.cpp',
+             'kdtree.cpp', 'fof.cpp', 'halo.cpp',
 ]
 
 #
@@ -58,6 +59,8 @@ py_files = ['py_package.cpp', 'py_msg.cpp', 'py_comm.cpp',
             'py_mem.cpp',
             'py_cosmology.cpp', 'py_power.cpp', 'py_particles.cpp',
             'py_lpt.cpp', 'py_pm.cpp', 'py_cola.cpp','py_leapfrog.cpp',
+            'py_step_schedule.cpp', 'py_simulation.cpp',
+            'py_lightcone.cpp',
             'py_write.cpp', 'py_fft.cpp', 'py_hdf5_io.cpp',
             'py_config.cpp',
             'py_fof.cpp', 'py_array.cpp', 'py_kdtree.cpp']
@@ -0,0 +1,296 @@
+//
+// Time-step driver
+//
+// Runs all PM steps in C++ without returning to the caller; output
+// functions are called at requested scale factors, which are inserted into
+// the step sequence. At an output, velocities are kicked to a_x using the
+// force at a_x, which is needed for the next step anyway.
+//
+#include <cmath>
+#include <algorithm>
+#include "msg.h"
+#include "comm.h"
+#include "error.h"
+#include "util.h"
+#include "pm.h"
+#include "pm_domain.h"
+#include "cola.h"
+#include "leapfrog.h"
+#include "simulation.h"
+
+using namespace std;
+
+namespace {
+  bool equal(const double a, const double b)
+  {
+    return fabs(a - b) <= 1.0e-12*fabs(b);
+  }
+
+  // Time variable s(a) in which the steps are uniform, and its inverse
+  double step_variable(const double a, const StepSpacing spacing,
+		       const double a_mid)
+  {
+    switch(spacing) {
+    case StepSpacing::linear:
+      return a;
+    case StepSpacing::log:
+      return log(a);
+    case StepSpacing::mixed:
+      return a < a_mid ? log(a) : log(a_mid) + (a - a_mid)/a_mid;
+    }
+    return a;
+  }
+
+  double step_variable_inv(const double s, const StepSpacing spacing,
+			   const double a_mid)
+  {
+    switch(spacing) {
+    case StepSpacing::linear:
+      return s;
+    case StepSpacing::log:
+      return exp(s);
+    case StepSpacing::mixed:
+      return s < log(a_mid) ? exp(s) : a_mid*(1.0 + s - log(a_mid));
+    }
+    return s;
+  }
+}
+
+vector<double> simulation_step_a(const double a_init, const double a_final,
+				 const int nstep, const StepSpacing spacing,
+				 const double a_mid)
+{
+  // Scale factors of positions a_x[0] = a_init, ..., a_x[nstep] = a_final
+  if(nstep <= 0 || a_init <= 0.0 || a_final <= a_init) {
+    msg_printf(msg_error,
+	       "Error: invalid time steps a= %lg -> %lg with %d steps\n",
+	       a_init, a_final, nstep);
+    throw ValError();
+  }
+
+  if(spacing == StepSpacing::mixed && a_mid <= 0.0) {
+    msg_printf(msg_error, "Error: mixed step spacing requires a_mid > 0\n");
+    throw ValError();
+  }
+
+  const double s_init= step_variable(a_init, spacing, a_mid);
+  const double s_final= step_variable(a_final, spacing, a_mid);
+
+  vector<double> a(nstep + 1);
+  for(int i=0; i<nstep; ++i)
+    a[i]= step_variable_inv(s_init + (s_final - s_init)*i/nstep,
+			    spacing, a_mid);
+  a[0]= a_init;
+  a[nstep]= a_final;
+
+  return a;
+}
+
+Simulation::Simulation(const double a_init, const double a_final,
+		       const int nstep, const StepSpacing spacing_,
+		       const double a_mid_, const Integrator integrator_) :
+  a_x(simulation_step_a(a_init, a_final, nstep, spacing_, a_mid_)),
+  output(nstep + 1, false),
+  spacing(spacing_), a_mid(a_mid_), integrator(integrator_), schedule(0)
+{
+  update_schedule();
+}
+
+Simulation::~Simulation()
+{
+  delete schedule;
+  for(vector<Snapshot>::iterator p= snapshots.begin();
+      p != snapshots.end(); ++p)
+    delete p->writer;
+}
+
+void Simulation::add_output(const double a)
+{
+  // Output at a; a is added to the steps unless it is already a step
+  if(a < a_x.front()*(1.0 - 1.0e-12) || a > a_x.back()*(1.0 + 1.0e-12)) {
+    msg_printf(msg_error,
+	       "Error: output a= %lg outside the simulation %lg -> %lg\n",
+	       a, a_x.front(), a_x.back());
+    throw ValError();
+  }
+
+  vector<double>::iterator p= lower_bound(a_x.begin(), a_x.end(), a);
+  if(p != a_x.end() && equal(*p, a)) {
+    output[p - a_x.begin()]= true;
+    return;
+  }
+  if(p != a_x.begin() && equal(*(p - 1), a)) {
+    output[p - a_x.begin() - 1]= true;
+    return;
+  }
+
+  output.insert(output.begin() + (p - a_x.begin()), true);
+  a_x.insert(p, a);
+
+  update_schedule();
+}
+
+void Simulation::add_snapshot(const double a, LPTPlaneWriter* const writer)
+{
+  // Write particles at a using writer
+  if(a < a_x.front()*(1.0 - 1.0e-12) || a > a_x.back()*(1.0 + 1.0e-12)) {
+    msg_printf(msg_error,
+	       "Error: snapshot a= %lg outside the simulation %lg -> %lg\n",
+	       a, a_x.front(), a_x.back());
+    delete writer;
+    throw ValError();
+  }
+
+  Snapshot snapshot= {a, writer};
+  vector<Snapshot>::iterator p= snapshots.begin();
+  while(p != snapshots.end() && p->a <= a)
+    ++p;
+  snapshots.insert(p, snapshot);
+}
+
+void Simulation::update_schedule()
+{
+  // Velocities are kicked to the midpoint of the step in s(a);
+  // steps starting at an output are kicked from the synchronised velocity
+  const size_t nstep= a_x.size() - 1;
+  a_vel.resize(nstep);
+  for(size_t i=0; i<nstep; ++i)
+    a_vel[i]= step_variable_inv(0.5*(step_variable(a_x[i], spacing, a_mid) +
+				     step_variable(a_x[i + 1], spacing, a_mid)),
+				spacing, a_mid);
+
+  vector<double> a_pos(a_x.begin() + 1, a_x.end());
+
+  delete schedule;
+  schedule= new StepSchedule(a_x.front(), a_x.front(), a_vel, a_pos);
+
+  for(size_t i=1; i<nstep; ++i) {
+    if(output[i]) {
+      KickFactors& k= schedule->kicks[i];
+      k.ai= a_x[i];
+      cola_kick_factors(k.ai, k.a, k.af, &k.cola_kick, &k.q1, &k.q2);
+      k.leapfrog_kick= leapfrog_kick_factor(k.ai, k.af);
+    }
+  }
+}
+
+template<class Container>
+void Simulation::compute_force(Container* const particles)
+{
+  pm_domain_send_positions(particles);
+  pm_compute_density(particles);
+  pm_check_total_density();
+  pm_compute_force(particles);
+  pm_domain_get_forces(particles);
+}
+
+template<class Container>
+void Simulation::write_snapshot(Container const * const particles,
+				const double a_vel,
+				Snapshot const & snapshot) const
+{
+  // Stream particles interpolated to snapshot.a in chunks; the number of
+  // chunks is the same on all nodes for collective I/O
+  const size_t chunk= 65536;
+  const size_t np= particles->np_local;
+  const long long nchunk= comm_max<long long>((np + chunk - 1)/chunk);
+
+  vector<Particle> buf(chunk);
+  LPTPlaneWriter* const writer= snapshot.writer;
+  writer->begin(np, particles->np_total, snapshot.a, particles->boxsize);
+
+  for(long long ichunk=0; ichunk<nchunk; ++ichunk) {
+    const size_t ibegin= min<size_t>(ichunk*chunk, np);
+    const size_t iend= min(ibegin + chunk, np);
+
+    if(integrator == Integrator::cola)
+      cola_interpolate(particles, a_vel, snapshot.a, ibegin, iend,
+		       &buf.front());
+    else
+      leapfrog_interpolate(particles, a_vel, snapshot.a, ibegin, iend,
+			   &buf.front());
+
+    writer->write_plane(&buf.front(), iend - ibegin);
+  }
+
+  writer->end();
+
+  msg_printf(msg_info, "Snapshot at a= %.4f written\n", snapshot.a);
+}
+
+template<class Container>
+bool Simulation::run_steps(Container* const particles,
+			   bool (*f)(const double, Container* const, void*),
+			   void* data, Lightcone* const lightcone)
+{
+  // Evolve particles from a_x.front() to a_x.back(), recording the
+  // lightcone crossings if lightcone is given
+  // Returns false if stopped by the output function
+  if(!equal(particles->a_x, a_x.front())) {
+    msg_printf(msg_error,
+	       "Error: particles at a= %lg, simulation starts at a= %lg\n",
+	       particles->a_x, a_x.front());
+    throw ValError();
+  }
+
+  const size_t nstep= a_vel.size();
+  vector<Snapshot>::const_iterator snapshot= snapshots.begin();
+
+  for(size_t i=0; i<=nstep; ++i) {
+    if(i == nstep && !output[i])
+      break;
+
+    msg_printf(msg_verbose, "Step %d/%d a= %.4f\n",
+	       (int) i, (int) nstep, a_x[i]);
+    compute_force(particles);
+
+    if(output[i]) {
+      // Synchronise velocities to positions
+      if(!equal(particles->a_v, a_x[i])) {
+	if(integrator == Integrator::cola)
+	  cola_kick(particles, a_x[i]);
+	else
+	  leapfrog_kick(particles, a_x[i]);
+      }
+
+      if(f && !f(a_x[i], particles, data))
+	return false;
+    }
+
+    if(i == nstep)
+      break;
+
+    // Snapshots within this step, a_x[i] <= a < a_x[i + 1], or
+    // a <= a_final in the last step
+    while(snapshot != snapshots.end() &&
+	  (snapshot->a < a_x[i + 1] || i == nstep - 1)) {
+      write_snapshot(particles, a_vel[i], *snapshot);
+      ++snapshot;
+    }
+
+    if(integrator == Integrator::cola) {
+      cola_step(particles, a_vel[i], a_x[i + 1], schedule, lightcone);
+    }
+    else {
+      leapfrog_kick(particles, a_vel[i], schedule);
+      leapfrog_drift(particles, a_x[i + 1], schedule, lightcone);
+      util_periodic_wrapup(particles);
+    }
+  }
+
+  return true;
+}
+
+bool Simulation::run(Particles* const particles,
+		     SimulationOutputFunc f, void* data,
+		     Lightcone* const lightcone)
+{
+  return run_steps(particles, f, data, lightcone);
+}
+
+bool Simulation::run(ParticlesSoA* const particles,
+		     SimulationOutputFuncSoA f, void* data,
+		     Lightcone* const lightcone)
+{
+  return run_steps(particles, f, data, lightcone);
+}
@@ -0,0 +1,88 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H 1
+
+#include <vector>
+#include "particle.h"
+#include "step_schedule.h"
+#include "lightcone.h"
+#include "lpt.h"
+
+//
+// Time-step driver: PM force, kick, and drift for all steps in one call
+//
+
+// Spacing of the time steps between a_init and a_final
+//   linear: uniform in a
+//   log:    uniform in log a
+//   mixed:  uniform in log a for a < a_mid and in a for a > a_mid,
+//           with continuous step size at a_mid
+enum class StepSpacing {linear, log, mixed};
+
+enum class Integrator {cola, leapfrog};
+
+// Called at each output scale factor with velocities synchronised to
+// positions; return false to stop the simulation
+typedef bool (*SimulationOutputFunc)(const double a,
+				     Particles* const particles, void* data);
+typedef bool (*SimulationOutputFuncSoA)(const double a,
+					ParticlesSoA* const particles,
+					void* data);
+
+std::vector<double> simulation_step_a(const double a_init,
+				      const double a_final, const int nstep,
+				      const StepSpacing spacing,
+				      const double a_mid=0);
+
+// Outputs:
+//   add_output(a): a is added to the steps and the function given to run
+//     is called at a with velocities synchronised to positions.
+//   add_snapshot(a, writer): particles are written at a by interpolation
+//     within the step, without an extra step or a copy of the particles;
+//     the velocity kick to a uses the force at the beginning of the step.
+//     Simulation takes the ownership of writer.
+//
+// run also accepts ParticlesSoA, e.g., with compress_lpt or fixed_position,
+// set by lpt_set_displacements.
+class Simulation {
+ public:
+  Simulation(const double a_init, const double a_final, const int nstep,
+	     const StepSpacing spacing, const double a_mid=0,
+	     const Integrator integrator= Integrator::cola);
+  ~Simulation();
+
+  void add_output(const double a);
+  void add_snapshot(const double a, LPTPlaneWriter* const writer);
+  bool run(Particles* const particles,
+	   SimulationOutputFunc f=0, void* data=0,
+	   Lightcone* const lightcone=0);
+  bool run(ParticlesSoA* const particles,
+	   SimulationOutputFuncSoA f=0, void* data=0,
+	   Lightcone* const lightcone=0);
+
+  // Step i is kick to a_vel[i] with force at a_x[i],
+  // followed by drift to a_x[i + 1]
+  std::vector<double> a_x, a_vel;
+  std::vector<bool> output;
+ private:
+  struct Snapshot {
+    double a;
+    LPTPlaneWriter* writer;
+  };
+  void update_schedule();
+  template<class Container>
+  bool run_steps(Container* const particles,
+		 bool (*f)(const double, Container* const, void*), void* data,
+		 Lightcone* const lightcone);
+  template<class Container>
+  void compute_force(Container* const particles);
+  template<class Container>
+  void write_snapshot(Container const * const particles,
+		      const double a_vel, Snapshot const & snapshot) const;
+  StepSpacing spacing;
+  double a_mid;
+  Integrator integrator;
+  StepSchedule* schedule;
+  std::vector<Snapshot> snapshots; // sorted in a
+};
+
+#endif
@@ -0,0 +1,88 @@
+//
+// Precomputed kick and drift factors for a given sequence of time steps
+//
+// Step i is kick(a_v -> a_vel[i]) with force at a_x, followed by
+// drift(a_x -> a_pos[i]) with velocity at a_vel[i].
+//
+#include <cmath>
+#include <cassert>
+#include "msg.h"
+#include "error.h"
+#include "cola.h"
+#include "leapfrog.h"
+#include "step_schedule.h"
+
+using namespace std;
+
+namespace {
+  bool equal(const double a, const double b)
+  {
+    return fabs(a - b) <= 1.0e-12*fabs(b);
+  }
+}
+
+StepSchedule::StepSchedule(const double a_x0, const double a_v0,
+			   vector<double> const & a_vel,
+			   vector<double> const & a_pos)
+{
+  if(a_vel.size() != a_pos.size()) {
+    msg_printf(msg_error,
+	       "Error: StepSchedule a_vel and a_pos have different lengths, "
+	       "%d %d\n", (int) a_vel.size(), (int) a_pos.size());
+    throw ValError();
+  }
+  
+  const size_t n= a_vel.size();
+  kicks.resize(n);
+  drifts.resize(n);
+
+  double a_x= a_x0;
+  double a_v= a_v0;
+
+  for(size_t i=0; i<n; i++) {
+    KickFactors& k= kicks[i];
+    k.ai= a_v;
+    k.a= a_x;
+    k.af= a_vel[i];
+    cola_kick_factors(k.ai, k.a, k.af, &k.cola_kick, &k.q1, &k.q2);
+    k.leapfrog_kick= leapfrog_kick_factor(k.ai, k.af);
+    a_v= a_vel[i];
+
+    DriftFactors& d= drifts[i];
+    d.ai= a_x;
+    d.af= a_pos[i];
+    d.av= a_v;
+    cola_drift_factors(d.ai, d.af, d.av, &d.cola_dt, &d.da1, &d.da2);
+    d.leapfrog_dt= leapfrog_drift_factor(d.ai, d.af);
+    a_x= a_pos[i];
+  }
+
+  msg_printf(msg_verbose, "StepSchedule with %d steps computed\n", (int) n);
+}
+
+KickFactors const * StepSchedule::find_kick(const double ai, const double a,
+					    const double af) const
+{
+  // Returns the factors for kick ai -> af at a; 0 if not in the schedule
+  for(vector<KickFactors>::const_iterator k= kicks.begin();
+      k != kicks.end(); ++k) {
+    if(equal(k->ai, ai) && equal(k->a, a) && equal(k->af, af))
+      return &*k;
+  }
+
+  return 0;
+}
+
+DriftFactors const * StepSchedule::find_drift(const double ai, const double af,
+					      const double av) const
+{
+  // Returns the factors for drift ai -> af with velocity at av;
+  // 0 if not in the schedule
+  for(vector<DriftFactors>::const_iterator d= drifts.begin();
+      d != drifts.end(); ++d) {
+    if(equal(d->ai, ai) && equal(d->af, af) && equal(d->av, av))
+      return &*d;
+  }
+
+  return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef STEP_SCHEDULE_H
+#define STEP_SCHEDULE_H 1
+
+#include <vector>
+#include "config.h"
+
+//
+// Time-stepping factors for a sequence of kicks and drifts, computed once
+//
+
+struct KickFactors {
+  double ai, a, af;         // velocity ai -> af with force at a
+  Float cola_kick, q1, q2;  // for cola_kick
+  Float leapfrog_kick;      // for leapfrog_kick
+};
+
+struct DriftFactors {
+  double ai, af, av;        // position ai -> af with velocity at av
+  Float cola_dt, da1, da2;  // for cola_drift
+  Float leapfrog_dt;        // for leapfrog_drift
+};
+
+class StepSchedule {
+ public:
+  StepSchedule(const double a_x0, const double a_v0,
+	       std::vector<double> const & a_vel,
+	       std::vector<double> const & a_pos);
+
+  KickFactors const * find_kick(const double ai, const double a,
+				const double af) const;
+  DriftFactors const * find_drift(const double ai, const double af,
+				  const double av) const;
+  
+  std::vector<KickFactors> kicks;
+  std::vector<DriftFactors> drifts;
+};
+
+#endif
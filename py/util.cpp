@@ -10,3 +10,16 @@ void util_periodic_wrapup(Particles* const particles)
     periodic_wrapup_p(p[i], boxsize);
 }
 
+
+void util_periodic_wrapup(ParticlesSoA* const particles)
+{
+  if(particles->position_fixed())
+    return;
+
+  const size_t n= particles->np_local;
+  Pos* const x= particles->x;
+  const Float boxsize= particles->boxsize;
+  
+  for(size_t i=0; i<n; ++i)
+    periodic_wrapup_p(x[i], boxsize);
+}
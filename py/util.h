@@ -11,7 +11,9 @@ static inline size_t mbytes(size_t bytes)
 }
 
 
-static inline void periodic_wrapup_p(Particle& p, const Float boxsize)
+// T is Particle or Pos
+template<class T>
+static inline void periodic_wrapup_p(T& p, const Float boxsize)
 {
   for(int k=0; k<3; k++) {
     if(p.x[k] < 0) p.x[k] += boxsize;
@@ -23,6 +25,29 @@ static inline void periodic_wrapup_p(Particle& p, const Float boxsize)
   }
 }
 
+static inline void periodic_wrapup_p(PosFixed&, const Float)
+{
+  // Fixed-point positions are always in the box
+}
+
+// Position as Float; T is Particle, Pos, or PosFixed
+template<class T>
+static inline void position_float(T const& p, const Float, Float x[])
+{
+  x[0]= p.x[0];
+  x[1]= p.x[1];
+  x[2]= p.x[2];
+}
+
+static inline void position_float(PosFixed const& p, const Float boxsize,
+				  Float x[])
+{
+  const double fac= boxsize/4294967296.0;
+  x[0]= fac*p.x[0];
+  x[1]= fac*p.x[1];
+  x[2]= fac*p.x[2];
+}
+
 static inline Float periodic_wrapup_x(Float x, const Float boxsize)
 {
   if(x < 0) x += boxsize;
@@ -38,5 +63,6 @@ static inline Float periodic_wrapup_x(Float x, const Float boxsize)
 bool util_stat(const char filename);
 
 void util_periodic_wrapup(Particles* const particles);
+void util_periodic_wrapup(ParticlesSoA* const particles);
 
 #endif
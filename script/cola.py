@@ -34,14 +34,7 @@ particles = fs.lpt.init(nc, boxsize, a_init, ps, seed, 'cola')
 
 fs.pm.init(nc_pm, nc_pm/nc, boxsize)
 
-for i in range(nstep):
-    a_vel = a_init + (a_final - a_init)/nstep*(i + 0.5)
-    fs.pm.force(particles)
-
-    fs.cola.kick(particles, a_vel)
-
-    a_pos = a_init + (a_final - a_init)/nstep*(i + 1.0)
-    fs.cola.drift(particles, a_pos)
+fs.Simulation(a_init, a_final, nstep).run(particles)
 
 filename = 'cola.h5'
 
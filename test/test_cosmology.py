@@ -0,0 +1,75 @@
+#
+# Test tabulated growth factors and time integrals against direct
+# numerical integration
+#
+
+import unittest
+import numpy as np
+import fs
+
+omega_m = 0.308
+
+
+def hubble(a):
+    return np.sqrt(omega_m/a**3 + 1.0 - omega_m)
+
+
+def simpson(f, x0, x1, n=2000):
+    x = np.linspace(x0, x1, 2*n + 1)
+    y = f(x)
+    h = (x1 - x0)/(2*n)
+    return h/3*(y[0] + y[-1] + 4*np.sum(y[1:-1:2]) + 2*np.sum(y[2:-1:2]))
+
+
+def growth_unnormalised(a):
+    # D(a) propto H(a) int_0^a (a H)^-3 da, integrated in log a
+    def f(x):
+        aa = np.exp(x)
+        return aa*(aa*hubble(aa))**-3
+
+    return hubble(a)*simpson(f, np.log(1.0e-12), np.log(a), 4000)
+
+
+def time_integral(ai, af, n):
+    # int_ai^af a^n/(a^3 H) da
+    def f(x):
+        aa = np.exp(x)
+        return aa**(n - 2)/hubble(aa)
+
+    return simpson(f, np.log(ai), np.log(af))
+
+
+class TestCosmology(unittest.TestCase):
+    def setUp(self):
+        fs.msg.set_loglevel(3)
+        fs.cosmology.init(omega_m)
+        self.a = [0.001, 0.01, 0.02, 0.1, 0.33, 0.5, 0.9, 1.0, 1.2]
+
+    def test_D_growth(self):
+        norm = 1.0/growth_unnormalised(1.0)
+        for a in self.a:
+            D = norm*growth_unnormalised(a)
+            self.assertAlmostEqual(fs.cosmology.D_growth(a)/D, 1.0,
+                                   delta=1.0e-7)
+
+    def test_f_growth_rate(self):
+        for a in self.a:
+            d_un = growth_unnormalised(a)
+            h = hubble(a)
+            f = 1.0/(d_un*a*a*h*h) - 1.5*omega_m/(h*h*a**3)
+            self.assertAlmostEqual(fs.cosmology.f_growth_rate(a)/f, 1.0,
+                                   delta=1.0e-7)
+
+    def test_time_integral(self):
+        for n in [0.0, 1.0, -2.5]:
+            for a in self.a:
+                for da in [0.001, 0.1]:
+                    ai = a
+                    af = a*(1.0 + da)
+                    integ = time_integral(ai, af, n)
+                    r = fs.cosmology.time_integral(ai, af, n)/integ
+                    self.assertAlmostEqual(r, 1.0, delta=1.0e-5)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -23,6 +23,19 @@ class TestFFT(unittest.TestCase):
                         index = (ix*nc + iy)*nc + iz
                         self.assertAlmostEqual(a[ix, iy, iz], index + 1)
 
+    def test_fft_double(self):
+        nc = self.nc
+        fft = fs.FFT(nc, precision='double')
+        fft.set_test_data()
+        a = fft.asarray()
+        if fs.comm.this_node() == 0:
+            self.assertEqual(a.dtype.itemsize, 8)
+            for ix in range(nc):
+                for iy in range(nc):
+                    for iz in range(nc):
+                        index = (ix*nc + iy)*nc + iz
+                        self.assertEqual(a[ix, iy, iz], index + 1)
+
 
 if __name__ == '__main__':
     unittest.main()
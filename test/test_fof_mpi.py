@@ -0,0 +1,159 @@
+#
+# Test distributed FoF against a brute-force FoF on node 0
+#
+
+import unittest
+import numpy as np
+import fs
+
+omega_m = 0.308
+nc = 16
+boxsize = 16.0
+a = 1.0
+seed = 1
+ll = 0.2*boxsize/nc
+
+
+def brute_force_fof(x, ids):
+    """Return the group id, the smallest member id, of each particle"""
+    n = len(x)
+    parent = np.arange(n)
+
+    def find(i):
+        while parent[i] != i:
+            parent[i] = parent[parent[i]]
+            i = parent[i]
+        return i
+
+    for i in range(n):
+        dx = x[i + 1:] - x[i]
+        dx -= boxsize*np.round(dx/boxsize)
+        for j in i + 1 + np.nonzero(np.sum(dx**2, axis=1) < ll**2)[0]:
+            ri = find(i)
+            rj = find(j)
+            if ri != rj:
+                parent[max(ri, rj)] = min(ri, rj)
+
+    roots = np.array([find(i) for i in range(n)])
+    min_id = np.full(n, np.iinfo(np.uint64).max, dtype=np.uint64)
+    np.minimum.at(min_id, roots, ids)
+
+    return min_id[roots]
+
+
+class TestFoFMPI(unittest.TestCase):
+    def setUp(self):
+        fs.msg.set_loglevel(3)
+        fs.cosmology.init(omega_m)
+        self.ps = fs.PowerSpectrum('../data/planck_matterpower.dat')
+
+    def test_groups(self):
+        """Distributed FoF groups equal the brute-force groups"""
+        particles = fs.lpt.init(nc, boxsize, a, self.ps, seed, '2lpt')
+        ret = fs.fof.find_groups_mpi(particles, ll, quota=8)
+        x = particles.x
+        ids = particles.id
+
+        if fs.comm.this_node() != 0:
+            return
+
+        group_id, halo_id, nfof = ret
+        self.assertEqual(len(group_id), nc**3)
+        self.assertEqual(np.sum(nfof), nc**3)
+
+        expected = brute_force_fof(x.astype(np.float64), ids)
+        self.assertTrue(np.all(group_id == expected))
+
+        id_expected, n_expected = np.unique(expected, return_counts=True)
+        self.assertTrue(np.all(halo_id == id_expected))
+        self.assertTrue(np.all(nfof == n_expected))
+        self.assertGreater(np.max(nfof), 10)
+
+    def test_tree_freed(self):
+        """kdtree queries after find_groups_mpi raise instead of reading
+        the freed tree"""
+        particles = fs.lpt.init(nc, boxsize, a, self.ps, seed, '2lpt')
+        fs.fof.find_groups_mpi(particles, ll, quota=8)
+
+        x = np.zeros((1, 3))
+        with self.assertRaises(RuntimeError):
+            fs.kdtree.knn(x, 1)
+        with self.assertRaises(RuntimeError):
+            fs.kdtree.radius_search(x, ll)
+
+    def test_grid(self):
+        """Grid FoF groups equal the kdtree FoF groups"""
+        if fs.comm.n_nodes() > 1:
+            return
+
+        particles = fs.lpt.init(nc, boxsize, a, self.ps, seed, '2lpt')
+        nfof_kdtree = fs.fof.find_groups(particles, ll, quota=8,
+                                         compute_nfof=True, permute=False)
+        grp_kdtree = particles.fof_group.copy()
+        nfof_grid = fs.fof.find_groups(particles, ll, compute_nfof=True,
+                                       method='grid')
+        grp_grid = particles.fof_group
+
+        # Group numbers are the smallest particle index for both methods
+        self.assertTrue(np.all(grp_grid == grp_kdtree))
+        self.assertTrue(np.all(grp_grid <= np.arange(nc**3)))
+        self.assertTrue(np.all(grp_grid[grp_grid] == grp_grid))
+
+        self.assertEqual(np.sum(nfof_grid), nc**3)
+        self.assertTrue(np.all(nfof_grid == nfof_kdtree))
+        self.assertGreater(np.max(nfof_grid), 10)
+
+    def test_update_tree(self):
+        """FoF groups on an updated kdtree equal those of fresh builds"""
+        if fs.comm.n_nodes() > 1:
+            return
+
+        particles = fs.lpt.init(nc, boxsize, a, self.ps, seed, '2lpt')
+        particles.periodic_wrapup()
+        x0 = particles.x.astype(np.float64)
+        n = len(x0)
+
+        # Opposite velocities for odd and even particles; particles cross
+        # the periodic boundaries many times in the unwrapped tree
+        sign = np.where(np.arange(n) % 2 == 0, 1.0, -1.0)
+        v = 0.1*sign[:, np.newaxis]*np.array([1.0, 2.0, 3.0])
+
+        p = fs.Particles(n, boxsize)
+        p.append(x0)
+        fs.fof.find_groups(p, ll, permute=False)
+
+        for step in range(1, 61):
+            p = fs.Particles(n, boxsize)
+            p.append((x0 + step*v) % boxsize)
+
+            fs.fof.find_groups(p, ll, update_tree=True)
+            grp_update = p.fof_group.copy()
+            fs.fof.find_groups(p, ll, method='grid')
+            self.assertTrue(np.all(p.fof_group == grp_update))
+
+        fs.fof.find_groups(p, ll, permute=False)
+        self.assertTrue(np.all(p.fof_group == grp_update))
+
+    def test_members(self):
+        """Group members in CSR format equal the groups of fof_group"""
+        if fs.comm.n_nodes() > 1:
+            return
+
+        nfof_min = 5
+        particles = fs.lpt.init(nc, boxsize, a, self.ps, seed, '2lpt')
+        fs.fof.find_groups(particles, ll, permute=False)
+        grp = particles.fof_group
+        offsets, members, roots = fs.fof.members(nfof_min)
+
+        root, nfof = np.unique(grp, return_counts=True)
+        self.assertTrue(np.all(roots == root[nfof >= nfof_min]))
+        self.assertEqual(len(offsets), len(roots) + 1)
+
+        for g in range(len(roots)):
+            expected = np.nonzero(grp == roots[g])[0]
+            self.assertTrue(np.all(members[offsets[g]:offsets[g + 1]] ==
+                                   expected))
+
+
+if __name__ == '__main__':
+    unittest.main()
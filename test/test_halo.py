@@ -0,0 +1,107 @@
+#
+# Test the halo catalogue against the FoF groups computed with numpy
+#
+
+import unittest
+import numpy as np
+import h5py
+import fs
+
+omega_m = 0.308
+nc = 16
+boxsize = 16.0
+a = 1.0
+seed = 1
+ll = 0.2*boxsize/nc
+nfof_min = 10
+
+
+def read(filename):
+    with h5py.File(filename, 'r') as f:
+        return {name: f[name][:] for name in f if name != 'parameters'}
+
+
+class TestHalo(unittest.TestCase):
+    def setUp(self):
+        fs.msg.set_loglevel(3)
+        fs.cosmology.init(omega_m)
+        self.ps = fs.PowerSpectrum('../data/planck_matterpower.dat')
+
+    def test_halos(self):
+        """Halo positions, masses, and moments equal numpy results"""
+        if fs.comm.n_nodes() > 1:
+            return
+
+        particles = fs.lpt.init(nc, boxsize, a, self.ps, seed, '2lpt')
+        fs.fof.find_groups(particles, ll, permute=False)
+        nhalo = fs.fof.write_halos(particles, 'halo_2lpt.h5',
+                                   nfof_min=nfof_min, cola=False)
+        h = read('halo_2lpt.h5')
+
+        self.assertGreater(nhalo, 0)
+        self.assertEqual(len(h['id']), nhalo)
+
+        x = particles.x.astype(np.float64)
+        ids = particles.id
+        grp = particles.fof_group
+        roots, nfof = np.unique(grp, return_counts=True)
+        roots = roots[nfof >= nfof_min]
+        self.assertEqual(len(roots), nhalo)
+
+        m = h['mass']/h['nfof']
+        self.assertTrue(np.allclose(m, m[0], rtol=1.0e-5))
+
+        for i in range(nhalo):
+            root = roots[ids[roots] == h['id'][i]][0]
+            dx = x[grp == root] - x[root]
+            dx -= boxsize*np.round(dx/boxsize)
+            dc = np.mean(dx, axis=0)
+            dx -= dc
+            ia = [0, 1, 2, 0, 1, 2]
+            ib = [0, 1, 2, 1, 2, 0]
+            inertia = np.mean(dx[:, ia]*dx[:, ib], axis=0)
+
+            self.assertEqual(h['nfof'][i], len(dx))
+            self.assertTrue(np.allclose(h['x'][i], (x[root] + dc) % boxsize,
+                                        atol=1.0e-4))
+            self.assertTrue(np.allclose(h['inertia'][i], inertia,
+                                        rtol=1.0e-3, atol=1.0e-6))
+
+    def test_cola_velocity(self):
+        """COLA velocities with the 2LPT velocities added equal 2LPT"""
+        if fs.comm.n_nodes() > 1:
+            return
+
+        particles = fs.lpt.init(nc, boxsize, a, self.ps, seed, '2lpt')
+        fs.fof.find_groups(particles, ll, permute=False)
+        fs.fof.write_halos(particles, 'halo_2lpt.h5', nfof_min=nfof_min,
+                           cola=False)
+
+        particles = fs.lpt.init(nc, boxsize, a, self.ps, seed, 'cola')
+        fs.fof.find_groups(particles, ll, permute=False)
+        fs.fof.write_halos(particles, 'halo_cola.h5', nfof_min=nfof_min)
+
+        h = read('halo_2lpt.h5')
+        h_cola = read('halo_cola.h5')
+
+        self.assertTrue(np.all(h['id'] == h_cola['id']))
+        for name in ['v', 'sigma_v', 'j']:
+            self.assertTrue(np.allclose(h[name], h_cola[name],
+                                        rtol=1.0e-4, atol=1.0e-4))
+        self.assertGreater(np.max(h['sigma_v']), 0.0)
+
+    def test_mpi(self):
+        """Halo catalogue raises ValueError with more than one MPI node"""
+        if fs.comm.n_nodes() == 1:
+            return
+
+        particles = fs.lpt.init(nc, boxsize, a, self.ps, seed, '2lpt')
+        with self.assertRaisesRegex(ValueError, 'find_groups_mpi'):
+            fs.fof.find_groups(particles, ll)
+
+        with self.assertRaisesRegex(ValueError, 'one MPI node'):
+            fs.fof.write_halos(particles, 'halo_mpi.h5')
+
+
+if __name__ == '__main__':
+    unittest.main()
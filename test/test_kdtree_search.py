@@ -0,0 +1,58 @@
+#
+# Test kdtree knn and radius search against brute force
+#
+
+import unittest
+import numpy as np
+import fs
+
+omega_m = 0.308
+nc = 16
+boxsize = 16.0
+a = 1.0
+seed = 1
+k = 8
+r = 1.5
+
+
+class TestKdTreeSearch(unittest.TestCase):
+    def setUp(self):
+        fs.msg.set_loglevel(3)
+        fs.cosmology.init(omega_m)
+        self.ps = fs.PowerSpectrum('../data/planck_matterpower.dat')
+
+    def test_search(self):
+        """knn and radius_search equal brute-force searches"""
+        if fs.comm.n_nodes() > 1:
+            return
+
+        particles = fs.lpt.init(nc, boxsize, a, self.ps, seed, '2lpt')
+        particles.periodic_wrapup()
+        x = particles.x.astype(np.float64)
+        fs.kdtree.build(particles, quota=8)
+
+        rng = np.random.default_rng(1)
+        q = boxsize*rng.random((100, 3))
+
+        for box in (boxsize, 0.0):
+            idx, dist = fs.kdtree.knn(q, k, boxsize=box)
+            offsets, ridx = fs.kdtree.radius_search(q, r, boxsize=box)
+
+            for i in range(len(q)):
+                dx = np.abs(x - q[i])
+                if box > 0:
+                    dx = np.minimum(dx, box - dx)
+                d = np.sqrt(np.sum(dx**2, axis=1))
+
+                expected = np.sort(d)[:k]
+                self.assertTrue(np.allclose(dist[i], expected, rtol=1e-5))
+                self.assertTrue(np.allclose(d[idx[i]], dist[i], rtol=1e-5))
+
+                found = np.sort(ridx[offsets[i]:offsets[i + 1]])
+                inside = np.nonzero(d < r*(1 - 1e-5))[0]
+                self.assertTrue(np.all(np.isin(inside, found)))
+                self.assertTrue(np.all(d[found] <= r*(1 + 1e-5)))
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,80 @@
+#
+# Test lightcone particles recorded during drifts
+#
+
+import unittest
+import numpy as np
+import h5py
+import fs
+
+omega_m = 0.308
+nc = 16
+boxsize = 500
+a_init = 0.1
+a_final = 1.0
+a_min = 0.7
+seed = 1
+nstep = 10
+observer = (0.5*boxsize, 0.5*boxsize, 0.5*boxsize)
+cH0inv = 2997.92458
+
+
+class TestLightcone(unittest.TestCase):
+    def setUp(self):
+        fs.msg.set_loglevel(3)
+        fs.cosmology.init(omega_m)
+        self.ps = fs.PowerSpectrum('../data/planck_matterpower.dat')
+        fs.pm.init(nc, 1, boxsize)
+
+    def check(self, filename, np_total):
+        if fs.comm.this_node() != 0:
+            return
+
+        with h5py.File(filename, 'r') as f:
+            a = f['a'][:]
+            x = f['x'][:]
+            n = len(f['id'])
+
+        self.assertEqual(n, np_total)
+        self.assertGreater(n, nc**3)
+        # a_min is within a drift; no crossing before a_min is recorded
+        self.assertTrue(np.all((a >= a_min*(1 - 1.0e-4)) & (a <= a_final)))
+
+        # Particles are on the lightcone, distance = chi(a)
+        r = np.sqrt(np.sum((x - np.array(observer))**2, axis=1))
+        chi = np.array([cH0inv*fs.cosmology.time_integral(aa, 1.0, 1.0)
+                        for aa in a])
+        self.assertLess(np.max(np.abs(r - chi)), 0.02*boxsize)
+
+    def test_cola(self):
+        """COLA lightcone particles are at distance chi(a)"""
+        filename = 'lightcone_%d.h5' % fs.comm.n_nodes()
+        lightcone = fs.Lightcone(filename, boxsize, observer, a_min)
+        particles = fs.lpt.init(nc, boxsize, a_init, self.ps, seed, 'cola')
+        fs.Simulation(a_init, a_final, nstep).run(particles,
+                                                  lightcone=lightcone)
+        np_total = lightcone.np_total
+        lightcone.close()
+
+        self.check(filename, np_total)
+
+    def test_leapfrog(self):
+        """Leapfrog lightcone particles are at distance chi(a)"""
+        filename = 'lightcone_leapfrog_%d.h5' % fs.comm.n_nodes()
+        lightcone = fs.Lightcone(filename, boxsize, observer, a_min)
+        particles = fs.lpt.init(nc, boxsize, a_init, self.ps, seed, '2lpt')
+        da = (a_final - a_init)/nstep
+        for i in range(nstep):
+            fs.pm.force(particles)
+            fs.leapfrog.kick(particles, a_init + (i + 0.5)*da)
+            fs.leapfrog.drift(particles, a_init + (i + 1)*da,
+                              lightcone=lightcone)
+            particles.periodic_wrapup()
+        np_total = lightcone.np_total
+        lightcone.close()
+
+        self.check(filename, np_total)
+
+
+if __name__ == '__main__':
+    unittest.main()
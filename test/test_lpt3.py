@@ -0,0 +1,56 @@
+#
+# Test 3LPT initial condition
+#
+
+import unittest
+import numpy as np
+import fs
+
+omega_m = 0.308
+nc = 32
+boxsize = 64
+seed = 1
+
+
+def rms_diff(x, y):
+    d = x - y
+    d[d > 0.5*boxsize] -= boxsize
+    d[d < -0.5*boxsize] += boxsize
+    return np.sqrt(np.mean(d**2))
+
+
+class TestLPT3(unittest.TestCase):
+    def setUp(self):
+        fs.msg.set_loglevel(3)
+        fs.cosmology.init(omega_m)
+        self.ps = fs.PowerSpectrum('../data/planck_matterpower.dat')
+
+    def third_order_ratio(self, a):
+        """Return rms(x_3lpt - x_2lpt)/rms(x_2lpt - x_1lpt)"""
+        p1 = fs.lpt.init(nc, boxsize, a, self.ps, seed, 'zeldovich')
+        x1 = p1.x
+        p2 = fs.lpt.init(nc, boxsize, a, self.ps, seed, '2lpt')
+        x2 = p2.x
+        dx2 = p2.dx2
+        p3 = fs.lpt.init(nc, boxsize, a, self.ps, seed, '3lpt')
+        x3 = p3.x
+
+        # Psi(2) is the same for 2LPT and 3LPT
+        self.assertLess(np.max(np.abs(p3.dx2 - dx2)),
+                        1.0e-4*np.max(np.abs(dx2)))
+
+        return rms_diff(x3, x2)/rms_diff(x2, x1)
+
+    def test_growth(self):
+        """3LPT correction relative to 2LPT grows as D"""
+        r1 = self.third_order_ratio(0.1)
+        r2 = self.third_order_ratio(0.2)
+
+        self.assertLess(r1, 1.0)
+
+        growth = fs.cosmology.D_growth(0.2)/fs.cosmology.D_growth(0.1)
+        self.assertAlmostEqual(r2/r1/growth, 1.0, delta=0.2)
+
+
+if __name__ == '__main__':
+    unittest.main()
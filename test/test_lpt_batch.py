@@ -0,0 +1,58 @@
+#
+# Test LPT initial conditions for many seeds with fs.lpt.init_batch
+#
+
+import unittest
+import numpy as np
+import fs
+
+omega_m = 0.308
+nc = 16
+boxsize = 32
+a = 0.1
+seeds = [1, 2, 3]
+
+
+class TestLPTBatch(unittest.TestCase):
+    def setUp(self):
+        fs.msg.set_loglevel(3)
+        fs.cosmology.init(omega_m)
+        self.ps = fs.PowerSpectrum('../data/planck_matterpower.dat')
+
+    def test_batch(self):
+        """Batch realizations are the same as fs.lpt.init"""
+        xs = {}
+
+        def f(i, seed, particles):
+            self.assertEqual(seeds[i], seed)
+            xs[seed] = particles.x
+
+        fs.lpt.init_batch(nc, boxsize, a, self.ps, seeds, '2lpt', f)
+        self.assertEqual(len(xs), len(seeds))
+
+        for seed in seeds:
+            particles = fs.lpt.init(nc, boxsize, a, self.ps, seed, '2lpt')
+            x = particles.x
+            if fs.comm.this_node() == 0:
+                self.assertTrue(np.all(x == xs[seed]))
+
+    def test_batch_keep(self):
+        """Particles kept by the callback are not overwritten or freed"""
+        kept = []
+
+        def f(i, seed, particles):
+            kept.append(particles)
+
+        fs.lpt.init_batch(nc, boxsize, a, self.ps, seeds, '2lpt', f)
+        self.assertEqual(len(kept), len(seeds))
+
+        for seed, particles_kept in zip(seeds, kept):
+            x_kept = particles_kept.x
+            particles = fs.lpt.init(nc, boxsize, a, self.ps, seed, '2lpt')
+            x = particles.x
+            if fs.comm.this_node() == 0:
+                self.assertTrue(np.all(x == x_kept))
+
+
+if __name__ == '__main__':
+    unittest.main()
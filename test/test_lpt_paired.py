@@ -0,0 +1,51 @@
+#
+# Test paired-and-fixed initial conditions
+#
+
+import unittest
+import numpy as np
+import fs
+
+omega_m = 0.308
+nc = 16
+boxsize = 32
+a = 0.1
+seed = 1
+
+
+class TestLPTPaired(unittest.TestCase):
+    def setUp(self):
+        fs.msg.set_loglevel(3)
+        fs.cosmology.init(omega_m)
+        self.ps = fs.PowerSpectrum('../data/planck_matterpower.dat')
+
+    def lpt(self, fix_amplitude, invert_phase):
+        p = fs.lpt.init(nc, boxsize, a, self.ps, seed, '2lpt',
+                        fix_amplitude=fix_amplitude,
+                        invert_phase=invert_phase)
+        return p.dx1, p.dx2
+
+    def test_paired(self):
+        """Inverted phase flips Psi(1) and keeps Psi(2)"""
+        dx1, dx2 = self.lpt(True, False)
+        dx1_inv, dx2_inv = self.lpt(True, True)
+
+        if fs.comm.this_node() == 0:
+            eps = 1.0e-5
+            self.assertLess(np.max(np.abs(dx1 + dx1_inv)),
+                            eps*np.max(np.abs(dx1)))
+            self.assertLess(np.max(np.abs(dx2 - dx2_inv)),
+                            eps*np.max(np.abs(dx2)))
+
+    def test_fixed(self):
+        """Fixed amplitude has the same rms displacement on average"""
+        dx1, dx2 = self.lpt(False, False)
+        dx1_fixed, dx2_fixed = self.lpt(True, False)
+
+        if fs.comm.this_node() == 0:
+            r = np.std(dx1_fixed)/np.std(dx1)
+            self.assertAlmostEqual(r, 1.0, delta=0.2)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,57 @@
+#
+# Test LPT particles written directly to file with fs.lpt.write
+#
+
+import unittest
+import numpy as np
+import h5py
+import fs
+
+omega_m = 0.308
+nc = 16
+boxsize = 32
+a = 0.1
+seed = 1
+
+
+class TestLPTWrite(unittest.TestCase):
+    def setUp(self):
+        fs.msg.set_loglevel(3)
+        fs.cosmology.init(omega_m)
+        self.ps = fs.PowerSpectrum('../data/planck_matterpower.dat')
+
+    def test_hdf5(self):
+        """Streamed file is the same as Particles.save_hdf5"""
+        n = fs.comm.n_nodes()
+        filename_ref = 'lpt_particles_%d.h5' % n
+        filename = 'lpt_write_%d.h5' % n
+
+        particles = fs.lpt.init(nc, boxsize, a, self.ps, seed, '2lpt')
+        particles.save_hdf5(filename_ref, 'ixv12')
+
+        fs.lpt.write(filename, nc, boxsize, a, self.ps, seed, '2lpt',
+                     format='hdf5', var='ixv12')
+
+        if fs.comm.this_node() == 0:
+            with h5py.File(filename_ref, 'r') as ref, \
+                 h5py.File(filename, 'r') as f:
+                self.assertEqual(f['parameters/nc'][()], nc)
+                self.assertTrue(np.all(f['id'][:] == ref['id'][:]))
+                for name in ['x', 'v', 'dx1', 'dx2']:
+                    self.assertEqual(f[name].shape, (nc**3, 3))
+                    self.assertTrue(np.all(f[name][:] == ref[name][:]))
+
+    def test_invalid(self):
+        """Unsupported kind and repeated variables raise ValueError"""
+        filename = 'lpt_write_invalid_%d.h5' % fs.comm.n_nodes()
+
+        with self.assertRaises(ValueError):
+            fs.lpt.write(filename, nc, boxsize, a, self.ps, seed, '3lpt')
+
+        with self.assertRaises(ValueError):
+            fs.lpt.write(filename, nc, boxsize, a, self.ps, seed, '2lpt',
+                         var='ixx')
+
+
+if __name__ == '__main__':
+    unittest.main()
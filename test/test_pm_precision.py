@@ -0,0 +1,52 @@
+#
+# Test PM with single and double precision meshes
+#
+
+import unittest
+import numpy as np
+import fs
+
+omega_m = 0.308
+nc = 32
+boxsize = 64
+a = 1.0
+seed = 1
+
+
+class TestPmPrecision(unittest.TestCase):
+    def setUp(self):
+        fs.msg.set_loglevel(3)
+        fs.cosmology.init(omega_m)
+        self.ps = fs.PowerSpectrum('../data/planck_matterpower.dat')
+
+    def force(self, precision):
+        particles = fs.lpt.init(nc, boxsize, a, self.ps, seed, '2lpt')
+        fs.pm.init(nc, 1, boxsize, precision)
+        fs.pm.send_positions(particles)
+        density = fs.pm.compute_density(particles).asarray()
+        fs.pm.check_total_density()
+        fs.pm.compute_force(particles)
+        fs.pm.get_forces(particles)
+        return density, particles.force
+
+    def test_precision(self):
+        """Forces with a float and a double mesh agree"""
+        density_s, force_s = self.force('single')
+        density_d, force_d = self.force('double')
+
+        if fs.comm.this_node() == 0:
+            self.assertEqual(density_s.dtype, np.float32)
+            self.assertEqual(density_d.dtype, np.float64)
+
+            force_rms = np.std(force_d)
+            diff = force_s - force_d
+            self.assertLess(np.std(diff), 1.0e-4*force_rms)
+            self.assertLess(np.max(np.abs(diff)), 1.0e-2*force_rms)
+
+    def test_invalid(self):
+        with self.assertRaises(ValueError):
+            fs.pm.init(nc, 1, boxsize, 'half')
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,131 @@
+#
+# Test the C++ time-step driver fs.Simulation
+#
+
+import unittest
+import numpy as np
+import h5py
+import fs
+
+omega_m = 0.308
+nc = 16
+boxsize = 32
+a_init = 0.1
+a_final = 1.0
+seed = 1
+nstep = 5
+
+
+class TestSimulation(unittest.TestCase):
+    def setUp(self):
+        fs.msg.set_loglevel(3)
+        fs.cosmology.init(omega_m)
+        self.ps = fs.PowerSpectrum('../data/planck_matterpower.dat')
+        fs.pm.init(nc, 1, boxsize)
+
+    def test_spacing(self):
+        """Step scale factors are uniform in a, log a, or mixed"""
+        sim = fs.Simulation(a_init, a_final, nstep, 'linear')
+        self.assertTrue(np.allclose(sim.a_x,
+                                    np.linspace(a_init, a_final, nstep + 1)))
+
+        sim = fs.Simulation(a_init, a_final, nstep, 'log')
+        self.assertTrue(np.allclose(np.log(sim.a_x),
+                                    np.linspace(np.log(a_init),
+                                                np.log(a_final), nstep + 1)))
+        self.assertTrue(np.allclose(sim.a_vel,
+                                    np.sqrt(np.array(sim.a_x[:-1]) *
+                                            np.array(sim.a_x[1:]))))
+
+        a_x = np.array(fs.Simulation(a_init, a_final, 20, 'mixed',
+                                     a_mid=0.3).a_x)
+        da = np.diff(a_x)
+        early = a_x[1:] < 0.3
+        late = a_x[:-1] > 0.3
+        self.assertTrue(np.allclose(da[early]/a_x[:-1][early],
+                                    da[early][0]/a_x[0], rtol=1.0e-2))
+        self.assertTrue(np.allclose(da[late], da[late][0]))
+
+    def test_run(self):
+        """Simulation.run is same as the Python step loop"""
+        a_x = np.linspace(a_init, a_final, nstep + 1)
+        a_vel = 0.5*(a_x[:-1] + a_x[1:])
+
+        particles = fs.lpt.init(nc, boxsize, a_init, self.ps, seed, 'cola')
+        for i in range(nstep):
+            fs.pm.force(particles)
+            fs.cola.step(particles, a_vel[i], a_x[i + 1])
+        x = particles.x
+
+        particles = fs.lpt.init(nc, boxsize, a_init, self.ps, seed, 'cola')
+        fs.Simulation(a_init, a_final, nstep).run(particles)
+        x_sim = particles.x
+
+        if fs.comm.this_node() == 0:
+            eps = np.finfo(x.dtype).eps
+            self.assertLess(np.max(np.abs(x_sim - x)), 100*eps*boxsize)
+
+    def test_output(self):
+        """Output function is called at each output a"""
+        a_out = [0.35, a_final]
+        sim = fs.Simulation(a_init, a_final, nstep, a_out=a_out)
+        self.assertEqual(len(sim.a_x), nstep + 2)
+
+        outputs = []
+
+        def output(a, particles):
+            outputs.append((a, len(particles)))
+
+        particles = fs.lpt.init(nc, boxsize, a_init, self.ps, seed, 'cola')
+        sim.run(particles, output)
+
+        self.assertEqual([a for a, n in outputs], a_out)
+        self.assertEqual(outputs[-1][1], len(particles))
+
+        with self.assertRaises(ValueError):
+            sim.add_output(2.0)
+
+    def test_run_error(self):
+        """run raises the error message of the C++ exception"""
+        particles = fs.lpt.init(nc, boxsize, 0.2, self.ps, seed, 'cola')
+        with self.assertRaisesRegex(ValueError, 'particles at a= 0.2'):
+            fs.Simulation(a_init, a_final, nstep).run(particles)
+
+    def test_snapshot(self):
+        """Interpolated snapshot at a step is same as the output"""
+        sim = fs.Simulation(a_init, a_final, nstep)
+        a_out = sim.a_x[2]
+        sim.add_output(a_out)
+        filename = 'snapshot_%d.h5' % fs.comm.n_nodes()
+        sim.add_snapshot(a_out, filename)
+        filename_mid = 'snapshot_mid_%d.h5' % fs.comm.n_nodes()
+        sim.add_snapshot(0.5*(sim.a_x[3] + sim.a_x[4]), filename_mid)
+        self.assertEqual(len(sim.a_x), nstep + 1)
+
+        outputs = []
+
+        def output(a, particles):
+            outputs.append((particles.id, particles.x))
+
+        particles = fs.lpt.init(nc, boxsize, a_init, self.ps, seed, 'cola')
+        sim.run(particles, output)
+
+        if fs.comm.this_node() == 0:
+            with h5py.File(filename, 'r') as f:
+                self.assertAlmostEqual(f['parameters/ax'][()], a_out)
+                idx = np.argsort(f['id'][:])
+                x = f['x'][:][idx]
+
+            ids, x_output = outputs[0]
+            x_output = x_output[np.argsort(ids)]
+            eps = np.finfo(x.dtype).eps
+            self.assertLess(np.max(np.abs(x - x_output)), 100*eps*boxsize)
+
+            with h5py.File(filename_mid, 'r') as f:
+                x = f['x'][:]
+                self.assertEqual(len(x), nc**3)
+                self.assertTrue(np.all((0 <= x) & (x < boxsize)))
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,77 @@
+#
+# Test COLA and leapfrog time steps with precomputed StepSchedule
+#
+
+import unittest
+import numpy as np
+import fs
+
+omega_m = 0.308
+nc = 16
+boxsize = 32
+a_init = 0.1
+a_final = 1.0
+seed = 1
+nstep = 5
+
+a_vel = [a_init + (a_final - a_init)/nstep*(i + 0.5) for i in range(nstep)]
+a_pos = [a_init + (a_final - a_init)/nstep*(i + 1.0) for i in range(nstep)]
+
+
+class TestStepSchedule(unittest.TestCase):
+    def setUp(self):
+        fs.msg.set_loglevel(3)
+        fs.cosmology.init(omega_m)
+        self.ps = fs.PowerSpectrum('../data/planck_matterpower.dat')
+        fs.pm.init(nc, 1, boxsize)
+
+    def run_steps(self, integrator, kind, schedule):
+        particles = fs.lpt.init(nc, boxsize, a_init, self.ps, seed, kind)
+        for i in range(nstep):
+            fs.pm.force(particles)
+            integrator.kick(particles, a_vel[i], schedule)
+            integrator.drift(particles, a_pos[i], schedule)
+
+        return particles.x
+
+    def compare(self, integrator, kind):
+        schedule = fs.StepSchedule(a_init, a_init, a_vel, a_pos)
+        self.assertEqual(len(schedule), nstep)
+
+        x = self.run_steps(integrator, kind, None)
+        x_schedule = self.run_steps(integrator, kind, schedule)
+
+        if fs.comm.this_node() == 0:
+            eps = np.finfo(x.dtype).eps
+            self.assertLess(np.max(np.abs(x_schedule - x)), 100*eps*boxsize)
+
+    def test_cola(self):
+        """COLA steps with schedule are same as without"""
+        self.compare(fs.cola, 'cola')
+
+    def test_cola_step(self):
+        """Fused cola.step is same as kick, drift, and wrapup"""
+        schedule = fs.StepSchedule(a_init, a_init, a_vel, a_pos)
+        x = self.run_steps(fs.cola, 'cola', schedule)
+
+        particles = fs.lpt.init(nc, boxsize, a_init, self.ps, seed, 'cola')
+        for i in range(nstep):
+            fs.pm.force(particles)
+            fs.cola.step(particles, a_vel[i], a_pos[i], schedule)
+        x_step = particles.x
+
+        if fs.comm.this_node() == 0:
+            d = x_step - x
+            d[d > 0.5*boxsize] -= boxsize
+            d[d < -0.5*boxsize] += boxsize
+            eps = np.finfo(x.dtype).eps
+            self.assertLess(np.max(np.abs(d)), 100*eps*boxsize)
+            self.assertTrue(np.all((0 <= x_step) & (x_step < boxsize)))
+
+    def test_leapfrog(self):
+        """Leapfrog steps with schedule are same as without"""
+        self.compare(fs.leapfrog, '2lpt')
+
+
+if __name__ == '__main__':
+    unittest.main()